@@ -0,0 +1,72 @@
+#include "utils/hashing.hpp"
+#include "utils/cpu_features.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace {
+
+    /**
+     * Hash the buffer repeatedly and return the throughput in GB/s
+     */
+    double measure(utils::HashAlgorithm algorithm, bool allowHardware,
+                   const std::vector<uint8_t> &buffer, int iterations) {
+        // Warm up caches and the dispatch path
+        auto warmup = utils::Hashing::create(algorithm, allowHardware);
+        warmup->update(buffer.data(), buffer.size());
+        warmup->finish();
+
+        auto start = steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            auto hasher = utils::Hashing::create(algorithm, allowHardware);
+            hasher->update(buffer.data(), buffer.size());
+            hasher->finish();
+        }
+        auto seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+
+        return static_cast<double>(buffer.size()) * iterations / seconds / 1e9;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // Buffer size in MB and iteration count can be overridden on the command line
+    std::size_t sizeMb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    std::vector<uint8_t> buffer(sizeMb * 1024 * 1024);
+    std::mt19937_64 rng(42);
+    for (auto &byte: buffer) {
+        byte = static_cast<uint8_t>(rng());
+    }
+
+    std::printf("CPU features: %s\n", utils::CpuFeatures::describe().c_str());
+    std::printf("Buffer: %zu MB x %d iterations\n\n", sizeMb, iterations);
+    std::printf("%-10s %-10s %10s\n", "algorithm", "impl", "GB/s");
+
+    const utils::HashAlgorithm algorithms[] = {
+            utils::HashAlgorithm::Sha256,
+            utils::HashAlgorithm::Xxh3,
+            utils::HashAlgorithm::Crc32c
+    };
+
+    for (auto algorithm: algorithms) {
+        auto name = utils::Hashing::toString(algorithm);
+        auto impl = utils::Hashing::implementationName(algorithm);
+
+        std::printf("%-10s %-10s %10.2f\n", name.c_str(), impl.c_str(),
+                    measure(algorithm, true, buffer, iterations));
+
+        // Also report the portable fallback where a hardware path exists
+        if (impl != "generic" && algorithm != utils::HashAlgorithm::Xxh3) {
+            std::printf("%-10s %-10s %10.2f\n", name.c_str(), "generic",
+                        measure(algorithm, false, buffer, iterations));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,638 @@
+#include "async_file_io.hpp"
+
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <new>
+
+#ifndef PLATFORM_WINDOWS
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <atomic>
+#endif
+
+namespace core {
+
+#ifdef HAS_IO_URING
+
+    /**
+     * Minimal io_uring submission/completion ring driven through the raw syscalls
+     */
+    class IoRing {
+    public:
+        explicit IoRing(unsigned entries) {
+            io_uring_params params{};
+            m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+            if (m_fd < 0) {
+                throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+            }
+
+            // IORING_OP_READ/WRITE arrived together with this feature flag (Linux 5.6)
+            if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+                ::close(m_fd);
+                throw std::runtime_error("Kernel io_uring is too old");
+            }
+
+            m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (singleMmap) {
+                m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+            }
+
+            m_sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              m_fd, IORING_OFF_SQ_RING);
+            m_cqRing = singleMmap ? m_sqRing
+                                  : ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+            m_sqeSize = params.sq_entries * sizeof(io_uring_sqe);
+            m_sqes = static_cast<io_uring_sqe *>(::mmap(nullptr, m_sqeSize, PROT_READ | PROT_WRITE,
+                                                        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+
+            if (m_sqRing == MAP_FAILED || m_cqRing == MAP_FAILED || m_sqes == MAP_FAILED) {
+                release();
+                throw std::runtime_error("Failed to map io_uring rings");
+            }
+
+            auto *sq = static_cast<uint8_t *>(m_sqRing);
+            m_sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            m_sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+            m_sqEntries = params.sq_entries;
+            m_localTail = *m_sqTail;
+
+            auto *cq = static_cast<uint8_t *>(m_cqRing);
+            m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            m_cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        }
+
+        ~IoRing() {
+            release();
+        }
+
+        /**
+         * Register staging buffers so the kernel can skip pinning them on every request
+         * Failure (e.g. RLIMIT_MEMLOCK) is not fatal; unregistered requests are used instead
+         */
+        void registerBuffers(AlignedBufferPool &buffers) {
+            std::vector<iovec> iovecs;
+            iovecs.reserve(buffers.count());
+            for (std::size_t i = 0; i < buffers.count(); ++i) {
+                iovecs.push_back({buffers.buffer(i), buffers.bufferSize()});
+            }
+
+            m_buffersRegistered = ::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS,
+                                            iovecs.data(), static_cast<unsigned>(iovecs.size())) == 0;
+            if (!m_buffersRegistered) {
+                SPDLOG_DEBUG("io_uring buffer registration failed ({}), using unregistered buffers",
+                             std::strerror(errno));
+            }
+        }
+
+        void queue(bool write, int fd, void *buffer, unsigned length, uint64_t offset,
+                   unsigned bufferIndex, uint64_t userData) {
+            unsigned head = std::atomic_ref<unsigned>(*m_sqHead).load(std::memory_order_acquire);
+            if (m_localTail - head >= m_sqEntries) {
+                submit();
+                head = std::atomic_ref<unsigned>(*m_sqHead).load(std::memory_order_acquire);
+                if (m_localTail - head >= m_sqEntries) {
+                    throw std::runtime_error("io_uring submission queue full");
+                }
+            }
+
+            unsigned index = m_localTail & m_sqMask;
+            io_uring_sqe *sqe = &m_sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+
+            if (m_buffersRegistered) {
+                sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+                sqe->buf_index = static_cast<uint16_t>(bufferIndex);
+            } else {
+                sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+            }
+            sqe->fd = fd;
+            sqe->off = offset;
+            sqe->addr = reinterpret_cast<uint64_t>(buffer);
+            sqe->len = length;
+            sqe->user_data = userData;
+
+            m_sqArray[index] = index;
+            m_localTail++;
+        }
+
+        void submit() {
+            unsigned toSubmit = m_localTail - *m_sqTail;
+            std::atomic_ref<unsigned>(*m_sqTail).store(m_localTail, std::memory_order_release);
+
+            while (toSubmit > 0) {
+                long submitted = ::syscall(__NR_io_uring_enter, m_fd, toSubmit, 0, 0, nullptr, 0);
+                if (submitted < 0) {
+                    if (errno == EINTR || errno == EAGAIN) {
+                        continue;
+                    }
+                    throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+                }
+                toSubmit -= static_cast<unsigned>(submitted);
+            }
+        }
+
+        void waitCompletion(uint64_t &userData, int &result) {
+            while (true) {
+                unsigned head = *m_cqHead;
+                unsigned tail = std::atomic_ref<unsigned>(*m_cqTail).load(std::memory_order_acquire);
+
+                if (head != tail) {
+                    const io_uring_cqe &cqe = m_cqes[head & m_cqMask];
+                    userData = cqe.user_data;
+                    result = cqe.res;
+                    std::atomic_ref<unsigned>(*m_cqHead).store(head + 1, std::memory_order_release);
+                    return;
+                }
+
+                if (::syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+                    errno != EINTR) {
+                    throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+                }
+            }
+        }
+
+    private:
+        void release() {
+            if (m_sqes && m_sqes != MAP_FAILED) {
+                ::munmap(m_sqes, m_sqeSize);
+            }
+            if (m_cqRing && m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+                ::munmap(m_cqRing, m_cqRingSize);
+            }
+            if (m_sqRing && m_sqRing != MAP_FAILED) {
+                ::munmap(m_sqRing, m_sqRingSize);
+            }
+            if (m_fd >= 0) {
+                ::close(m_fd);
+            }
+        }
+
+        int m_fd = -1;
+        bool m_buffersRegistered = false;
+
+        void *m_sqRing = nullptr;
+        void *m_cqRing = nullptr;
+        io_uring_sqe *m_sqes = nullptr;
+        std::size_t m_sqRingSize = 0;
+        std::size_t m_cqRingSize = 0;
+        std::size_t m_sqeSize = 0;
+
+        unsigned *m_sqHead = nullptr;
+        unsigned *m_sqTail = nullptr;
+        unsigned *m_sqArray = nullptr;
+        unsigned m_sqMask = 0;
+        unsigned m_sqEntries = 0;
+        unsigned m_localTail = 0;
+
+        unsigned *m_cqHead = nullptr;
+        unsigned *m_cqTail = nullptr;
+        io_uring_cqe *m_cqes = nullptr;
+        unsigned m_cqMask = 0;
+    };
+
+#else
+
+    // Placeholder so the owning pointers compile where io_uring is not available
+    class IoRing {
+    };
+
+#endif
+
+    namespace {
+        std::unique_ptr<IoRing> createRing(unsigned entries) {
+#ifdef HAS_IO_URING
+            try {
+                return std::make_unique<IoRing>(entries);
+            } catch (const std::exception &e) {
+                SPDLOG_DEBUG("io_uring unavailable, falling back to pread/pwrite: {}", e.what());
+            }
+#endif
+            return nullptr;
+        }
+    }
+
+    AlignedBufferPool::AlignedBufferPool(std::size_t bufferSize, std::size_t count)
+            : m_memory(static_cast<uint8_t *>(::operator new[](alignUp(bufferSize) * count,
+                                                                 std::align_val_t{DIRECT_IO_ALIGNMENT}))),
+              m_bufferSize(alignUp(bufferSize)), m_count(count) {
+    }
+
+    void AlignedBufferPool::AlignedDelete::operator()(uint8_t *memory) const {
+        ::operator delete[](memory, std::align_val_t{DIRECT_IO_ALIGNMENT});
+    }
+
+    uint8_t *AlignedBufferPool::buffer(std::size_t index) {
+        return m_memory.get() + index * m_bufferSize;
+    }
+
+    std::size_t AlignedBufferPool::bufferSize() const {
+        return m_bufferSize;
+    }
+
+    std::size_t AlignedBufferPool::count() const {
+        return m_count;
+    }
+
+    std::size_t AlignedBufferPool::alignUp(std::size_t length) {
+        return (length + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    }
+
+    ReadAheadReader::ReadAheadReader(const std::string &filePath, std::size_t chunkSize, unsigned queueDepth,
+                                     CacheMode cacheMode)
+            : m_reader(std::make_unique<FileReader>(filePath)), m_chunkSize(chunkSize) {
+        m_chunkCount = static_cast<std::size_t>((m_reader->size() + chunkSize - 1) / chunkSize);
+
+        m_reader->setCacheMode(cacheMode);
+#ifndef PLATFORM_WINDOWS
+        // Every chunk starts on an aligned offset, and buffers are rounded up so the last one can be read whole
+        m_direct = m_reader->directDescriptor() >= 0 && chunkSize % DIRECT_IO_ALIGNMENT == 0;
+#endif
+
+        // No point queueing more reads than there are chunks
+        queueDepth = static_cast<unsigned>(std::clamp<std::size_t>(m_chunkCount, 1, queueDepth));
+        m_ring = createRing(queueDepth);
+        if (!m_ring) {
+            if (m_direct) {
+                m_buffers = AlignedBufferPool(chunkSize, 1);
+            }
+            return;
+        }
+
+        m_buffers = AlignedBufferPool(chunkSize, queueDepth);
+        m_results.assign(queueDepth, 0);
+        m_done.assign(queueDepth, false);
+#ifdef HAS_IO_URING
+        m_ring->registerBuffers(m_buffers);
+#endif
+
+        for (std::size_t i = 0; i < std::min<std::size_t>(queueDepth, m_chunkCount); ++i) {
+            queueRead(i);
+        }
+#ifdef HAS_IO_URING
+        m_ring->submit();
+#endif
+    }
+
+    ReadAheadReader::~ReadAheadReader() {
+#ifdef HAS_IO_URING
+        // The kernel may still write into our buffers; wait for it before they are freed
+        try {
+            while (m_inFlight > 0) {
+                uint64_t userData;
+                int result;
+                m_ring->waitCompletion(userData, result);
+                m_inFlight--;
+            }
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error draining read-ahead queue: {}", e.what());
+        }
+#endif
+    }
+
+    void ReadAheadReader::queueRead(std::size_t chunkIndex) {
+#ifdef HAS_IO_URING
+        std::size_t slot = chunkIndex % m_buffers.count();
+        std::uintmax_t offset = static_cast<std::uintmax_t>(chunkIndex) * m_chunkSize;
+        auto length = static_cast<std::size_t>(std::min<std::uintmax_t>(m_chunkSize, m_reader->size() - offset));
+
+        m_done[slot] = false;
+        m_ring->queue(false, m_direct ? m_reader->directDescriptor() : m_reader->descriptor(), m_buffers.buffer(slot),
+                      static_cast<unsigned>(m_direct ? AlignedBufferPool::alignUp(length) : length), offset,
+                      static_cast<unsigned>(slot), chunkIndex);
+        m_inFlight++;
+#endif
+    }
+
+    void ReadAheadReader::copyOut(std::size_t slot, std::size_t bytesRead, std::uintmax_t offset,
+                                  std::vector<uint8_t> &chunk) {
+        // Direct reads of the last chunk are rounded up and may return more than the chunk holds
+        bytesRead = std::min(bytesRead, chunk.size());
+        std::memcpy(chunk.data(), m_buffers.buffer(slot), bytesRead);
+
+        // Short reads are rare; finish them synchronously
+        if (bytesRead < chunk.size()) {
+            std::span<uint8_t> rest(chunk.data() + bytesRead, chunk.size() - bytesRead);
+            if (m_reader->readChunk(offset + bytesRead, rest) != rest.size()) {
+                throw std::runtime_error("Unexpected end of file: " + m_reader->path());
+            }
+        }
+    }
+
+    bool ReadAheadReader::readNext(std::vector<uint8_t> &chunk) {
+        if (m_nextChunk >= m_chunkCount) {
+            return false;
+        }
+
+        std::uintmax_t offset = static_cast<std::uintmax_t>(m_nextChunk) * m_chunkSize;
+        auto length = static_cast<std::size_t>(std::min<std::uintmax_t>(m_chunkSize, m_reader->size() - offset));
+        chunk.resize(length);
+
+        if (!m_ring) {
+#ifndef PLATFORM_WINDOWS
+            if (m_direct) {
+                ssize_t result;
+                do {
+                    result = ::pread(m_reader->directDescriptor(), m_buffers.buffer(0),
+                                     AlignedBufferPool::alignUp(length), static_cast<off_t>(offset));
+                } while (result < 0 && errno == EINTR);
+                if (result < 0) {
+                    throw std::runtime_error("Error reading file: " + m_reader->path() + ": " + std::strerror(errno));
+                }
+                copyOut(0, static_cast<std::size_t>(result), offset, chunk);
+                m_nextChunk++;
+                return true;
+            }
+#endif
+            if (m_reader->readChunk(offset, chunk) != length) {
+                throw std::runtime_error("Unexpected end of file: " + m_reader->path());
+            }
+            m_nextChunk++;
+            return true;
+        }
+
+#ifdef HAS_IO_URING
+        std::size_t slot = m_nextChunk % m_buffers.count();
+
+        // Completions arrive in any order; park them until their chunk is asked for
+        while (!m_done[slot]) {
+            uint64_t chunkIndex;
+            int result;
+            m_ring->waitCompletion(chunkIndex, result);
+            m_inFlight--;
+
+            std::size_t completedSlot = chunkIndex % m_buffers.count();
+            m_results[completedSlot] = result;
+            m_done[completedSlot] = true;
+        }
+
+        int result = m_results[slot];
+        if (result < 0) {
+            throw std::runtime_error("Error reading file: " + m_reader->path() + ": " + std::strerror(-result));
+        }
+
+        copyOut(slot, static_cast<std::size_t>(result), offset, chunk);
+
+        // Reuse the slot for the chunk one queue depth ahead
+        std::size_t ahead = m_nextChunk + m_buffers.count();
+        if (ahead < m_chunkCount) {
+            queueRead(ahead);
+            m_ring->submit();
+        }
+
+        // Reads issued through the ring bypass readChunk(), so report progress through the file here
+        m_reader->releaseCache(offset + length);
+#endif
+
+        m_nextChunk++;
+        return true;
+    }
+
+    std::uintmax_t ReadAheadReader::size() const {
+        return m_reader->size();
+    }
+
+    bool ReadAheadReader::usingIoUring() const {
+        return m_ring != nullptr;
+    }
+
+    bool ReadAheadReader::isIoUringAvailable() {
+        // Probe once; containers and hardened kernels often block the syscalls
+        static const bool available = createRing(2) != nullptr;
+        return available;
+    }
+
+    WriteBehindWriter::WriteBehindWriter(std::shared_ptr<FileWriter> writer, std::size_t bufferSize,
+                                         unsigned queueDepth)
+            : m_writer(std::move(writer)), m_bufferSize(bufferSize) {
+#ifndef PLATFORM_WINDOWS
+        m_direct = m_writer->directDescriptor() >= 0;
+#endif
+
+        m_ring = createRing(queueDepth);
+        if (!m_ring) {
+            if (m_direct) {
+                m_buffers = AlignedBufferPool(bufferSize, 1);
+            }
+            return;
+        }
+
+        m_buffers = AlignedBufferPool(bufferSize, queueDepth);
+        m_pending.assign(queueDepth, PendingWrite{});
+#ifdef HAS_IO_URING
+        m_ring->registerBuffers(m_buffers);
+#endif
+    }
+
+    WriteBehindWriter::~WriteBehindWriter() {
+        try {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while (m_inFlight > 0) {
+                reapOne();
+            }
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error draining write-behind queue: {}", e.what());
+        }
+    }
+
+    void WriteBehindWriter::writeAt(std::uintmax_t offset, std::span<const uint8_t> data) {
+        // O_DIRECT needs aligned offsets and lengths; anything else, like the tail of a file, uses the page cache
+        bool aligned = offset % DIRECT_IO_ALIGNMENT == 0 &&
+                       std::min(data.size(), m_bufferSize) % DIRECT_IO_ALIGNMENT == 0;
+        if (!m_ring && m_direct && aligned) {
+            writeDirect(offset, data);
+            return;
+        }
+        if (!m_ring || (m_direct && !aligned)) {
+            m_writer->writeAt(offset, data);
+            return;
+        }
+
+#ifdef HAS_IO_URING
+        std::lock_guard<std::mutex> lock(m_mutex);
+        throwIfFailed();
+
+        while (!data.empty()) {
+            // Wait for a staging buffer only when all of them are in flight
+            auto slot = std::find_if(m_pending.begin(), m_pending.end(),
+                                     [](const PendingWrite &pending) { return !pending.busy; });
+            while (slot == m_pending.end()) {
+                reapOne();
+                throwIfFailed();
+                slot = std::find_if(m_pending.begin(), m_pending.end(),
+                                    [](const PendingWrite &pending) { return !pending.busy; });
+            }
+
+            auto index = static_cast<std::size_t>(slot - m_pending.begin());
+            std::size_t length = std::min(data.size(), m_bufferSize);
+            std::memcpy(m_buffers.buffer(index), data.data(), length);
+
+            // Only the final piece of a write can be short, and it is written through the page cache if unaligned
+            bool direct = m_direct && length % DIRECT_IO_ALIGNMENT == 0;
+            if (m_direct && !direct) {
+                m_writer->writeAt(offset, data.subspan(0, length));
+                break;
+            }
+
+            *slot = PendingWrite{offset, length, true};
+            m_ring->queue(true, direct ? m_writer->directDescriptor() : m_writer->descriptor(),
+                          m_buffers.buffer(index), static_cast<unsigned>(length), offset,
+                          static_cast<unsigned>(index), index);
+            m_ring->submit();
+            m_inFlight++;
+
+            offset += length;
+            data = data.subspan(length);
+        }
+#endif
+    }
+
+    void WriteBehindWriter::reapOne() {
+#ifdef HAS_IO_URING
+        uint64_t index;
+        int result;
+        m_ring->waitCompletion(index, result);
+        m_inFlight--;
+
+        PendingWrite &pending = m_pending[index];
+        pending.busy = false;
+
+        if (result < 0) {
+            if (m_error.empty()) {
+                m_error = "Error writing to file: " + m_writer->tempPath() + ": " + std::strerror(-result);
+            }
+            return;
+        }
+
+        // Short writes are rare; finish them synchronously
+        auto written = static_cast<std::size_t>(result);
+        if (written < pending.length) {
+            try {
+                m_writer->writeAt(pending.offset + written,
+                                  std::span<const uint8_t>(m_buffers.buffer(index) + written,
+                                                           pending.length - written));
+            } catch (const std::exception &e) {
+                if (m_error.empty()) {
+                    m_error = e.what();
+                }
+            }
+        }
+
+        m_writer->recordWrite(pending.offset, written);
+#endif
+    }
+
+    void WriteBehindWriter::writeDirect(std::uintmax_t offset, std::span<const uint8_t> data) {
+#ifndef PLATFORM_WINDOWS
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        while (!data.empty()) {
+            std::size_t length = std::min(data.size(), m_bufferSize);
+            if (length % DIRECT_IO_ALIGNMENT != 0) {
+                m_writer->writeAt(offset, data);
+                return;
+            }
+
+            // The caller's buffer has no particular alignment, so stage the data first
+            std::memcpy(m_buffers.buffer(0), data.data(), length);
+
+            std::size_t total = 0;
+            while (total < length) {
+                ssize_t written = ::pwrite(m_writer->directDescriptor(), m_buffers.buffer(0) + total, length - total,
+                                           static_cast<off_t>(offset + total));
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written < 0) {
+                    throw std::runtime_error("Error writing to file: " + m_writer->tempPath() + ": " +
+                                             std::strerror(errno));
+                }
+                total += static_cast<std::size_t>(written);
+            }
+
+            m_writer->recordWrite(offset, length);
+            offset += length;
+            data = data.subspan(length);
+        }
+#endif
+    }
+
+    void WriteBehindWriter::throwIfFailed() {
+        if (!m_error.empty()) {
+            throw std::runtime_error(m_error);
+        }
+    }
+
+    void WriteBehindWriter::writeHole(std::uintmax_t offset, std::uintmax_t length) {
+        // Holes never overlap queued writes, so there is nothing to wait for
+        m_writer->writeHole(offset, length);
+    }
+
+    void WriteBehindWriter::flush() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (m_inFlight > 0) {
+            reapOne();
+        }
+        throwIfFailed();
+    }
+
+    void WriteBehindWriter::sync() {
+        flush();
+        m_writer->sync();
+    }
+
+    void WriteBehindWriter::checkpoint(const std::string &state) {
+        flush();
+        m_writer->checkpoint(state);
+    }
+
+    void WriteBehindWriter::discard() {
+        m_writer->discard();
+    }
+
+    void WriteBehindWriter::finalize() {
+        flush();
+        m_writer->finalize();
+    }
+
+    const std::string &WriteBehindWriter::tempPath() const {
+        return m_writer->tempPath();
+    }
+
+    std::uintmax_t WriteBehindWriter::bytesWritten() const {
+        return m_writer->bytesWritten();
+    }
+
+    bool WriteBehindWriter::usingIoUring() const {
+        return m_ring != nullptr;
+    }
+
+    unsigned WriteBehindWriter::queueDepth() const {
+        return static_cast<unsigned>(m_pending.size());
+    }
+
+#ifndef PLATFORM_WINDOWS
+    int WriteBehindWriter::descriptor() const {
+        return m_writer->descriptor();
+    }
+
+    void WriteBehindWriter::recordExternalWrite(std::uintmax_t offset, std::size_t length) {
+        m_writer->recordWrite(offset, length);
+    }
+#endif
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "file_handler.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <cstdint>
+
+namespace core {
+
+    class IoRing;
+
+    /**
+     * Equally sized staging buffers carved from one page-aligned allocation, as O_DIRECT requires
+     */
+    class AlignedBufferPool {
+    public:
+        AlignedBufferPool() = default;
+
+        /**
+         * Allocate the buffers
+         * @param bufferSize Size of each buffer, rounded up to DIRECT_IO_ALIGNMENT
+         * @param count Number of buffers
+         */
+        AlignedBufferPool(std::size_t bufferSize, std::size_t count);
+
+        /**
+         * Get a buffer
+         * @param index Index of the buffer
+         * @return Start of the buffer, aligned to DIRECT_IO_ALIGNMENT
+         */
+        uint8_t *buffer(std::size_t index);
+
+        /**
+         * Get the size of each buffer
+         * @return Size in bytes
+         */
+        std::size_t bufferSize() const;
+
+        /**
+         * Get the number of buffers
+         * @return Buffer count
+         */
+        std::size_t count() const;
+
+        /**
+         * Round a length up to DIRECT_IO_ALIGNMENT
+         * @param length Length in bytes
+         * @return Aligned length
+         */
+        static std::size_t alignUp(std::size_t length);
+
+    private:
+        struct AlignedDelete {
+            void operator()(uint8_t *memory) const;
+        };
+
+        std::unique_ptr<uint8_t[], AlignedDelete> m_memory;
+        std::size_t m_bufferSize = 0;
+        std::size_t m_count = 0;
+    };
+
+    /**
+     * Sequential chunk reader that keeps several reads queued ahead of the consumer
+     * Uses io_uring with registered buffers when available, plain pread otherwise
+     */
+    class ReadAheadReader {
+    public:
+        /**
+         * Open a file and queue the first reads
+         * @param filePath Path to the file
+         * @param chunkSize Size of each chunk
+         * @param queueDepth Number of chunks kept in flight
+         * @param cacheMode How reads treat the page cache; Direct needs a chunk size aligned to DIRECT_IO_ALIGNMENT
+         * @throws std::runtime_error if the file cannot be opened
+         */
+        ReadAheadReader(const std::string &filePath, std::size_t chunkSize, unsigned queueDepth = 8,
+                        CacheMode cacheMode = CacheMode::Normal);
+
+        /**
+         * Destructor, waits for queued reads to finish
+         */
+        ~ReadAheadReader();
+
+        ReadAheadReader(const ReadAheadReader &) = delete;
+        ReadAheadReader &operator=(const ReadAheadReader &) = delete;
+
+        /**
+         * Get the next chunk in file order
+         * @param chunk Output buffer, resized to the chunk length
+         * @return False once the whole file has been returned
+         * @throws std::runtime_error on read errors
+         */
+        bool readNext(std::vector<uint8_t> &chunk);
+
+        /**
+         * Get the size of the file
+         * @return Size in bytes
+         */
+        std::uintmax_t size() const;
+
+        /**
+         * Check whether reads go through io_uring
+         * @return True if io_uring is in use
+         */
+        bool usingIoUring() const;
+
+        /**
+         * Check whether the running kernel allows io_uring
+         * @return True if io_uring can be used
+         */
+        static bool isIoUringAvailable();
+
+    private:
+        void queueRead(std::size_t chunkIndex);
+
+        /**
+         * Copy a completed read out of its staging buffer, finishing it synchronously if it came up short
+         */
+        void copyOut(std::size_t slot, std::size_t bytesRead, std::uintmax_t offset, std::vector<uint8_t> &chunk);
+
+        std::unique_ptr<FileReader> m_reader;
+        std::unique_ptr<IoRing> m_ring;
+        std::size_t m_chunkSize;
+        std::size_t m_chunkCount;
+        std::size_t m_nextChunk = 0;
+        bool m_direct = false;                       // Reads go through the O_DIRECT descriptor
+        AlignedBufferPool m_buffers;                 // One per queue slot
+        std::vector<int> m_results;                  // Completion result per slot
+        std::vector<bool> m_done;
+        unsigned m_inFlight = 0;
+    };
+
+    /**
+     * Writer that queues writes behind the caller so it never waits on the disk unless all buffers are busy
+     * Uses io_uring with registered buffers when available, plain pwrite otherwise
+     */
+    class WriteBehindWriter {
+    public:
+        /**
+         * Constructor
+         * Aligned writes bypass the page cache when the file writer is in CacheMode::Direct
+         * @param writer The file writer to write through
+         * @param bufferSize Size of each staging buffer
+         * @param queueDepth Number of writes kept in flight
+         */
+        explicit WriteBehindWriter(std::shared_ptr<FileWriter> writer,
+                                   std::size_t bufferSize = 1024 * 1024, unsigned queueDepth = 8);
+
+        /**
+         * Destructor, waits for queued writes to finish
+         */
+        ~WriteBehindWriter();
+
+        WriteBehindWriter(const WriteBehindWriter &) = delete;
+        WriteBehindWriter &operator=(const WriteBehindWriter &) = delete;
+
+        /**
+         * Queue data to be written at an offset; the data is copied
+         * @param offset Offset of the first byte
+         * @param data Data to write
+         * @throws std::runtime_error if an earlier queued write failed
+         */
+        void writeAt(std::uintmax_t offset, std::span<const uint8_t> data);
+
+        /**
+         * Leave a range of the file as a hole
+         * @param offset Offset of the first byte
+         * @param length Number of bytes
+         * @throws std::runtime_error if the hole cannot be made
+         */
+        void writeHole(std::uintmax_t offset, std::uintmax_t length);
+
+        /**
+         * Wait for all queued writes
+         * @throws std::runtime_error if a queued write failed
+         */
+        void flush();
+
+        /**
+         * Flush queued writes and sync the underlying file without moving it into place
+         * @throws std::runtime_error if a write failed or the file cannot be synced
+         */
+        void sync();
+
+        /**
+         * Flush queued writes and record a resume point in the underlying file
+         * @param state Description of the data that has reached the file
+         * @throws std::runtime_error if a write failed or the resume point cannot be saved
+         */
+        void checkpoint(const std::string &state);
+
+        /**
+         * Give up on the underlying file so it is removed instead of kept for resuming
+         */
+        void discard();
+
+        /**
+         * Flush queued writes and finalize the underlying file
+         * @throws std::runtime_error if a write failed or the file cannot be finalized
+         */
+        void finalize();
+
+        /**
+         * Get the path of the temporary file being written
+         * @return Temporary file path
+         */
+        const std::string &tempPath() const;
+
+        /**
+         * Get the number of bytes that have reached the file
+         * @return Bytes written
+         */
+        std::uintmax_t bytesWritten() const;
+
+        /**
+         * Check whether writes go through io_uring
+         * @return True if io_uring is in use
+         */
+        bool usingIoUring() const;
+
+        /**
+         * Get the number of writes kept in flight, each with a staging buffer of its own
+         * @return Queue depth, 0 if writes do not go through io_uring
+         */
+        unsigned queueDepth() const;
+
+#ifndef PLATFORM_WINDOWS
+        /**
+         * Get the descriptor of the file, for data spliced into it directly
+         * @return File descriptor
+         */
+        int descriptor() const;
+
+        /**
+         * Account for data written to the descriptor without going through writeAt
+         * @param offset Offset of the first byte
+         * @param length Number of bytes written
+         */
+        void recordExternalWrite(std::uintmax_t offset, std::size_t length);
+#endif
+
+    private:
+        struct PendingWrite {
+            std::uintmax_t offset = 0;
+            std::size_t length = 0;
+            bool busy = false;
+        };
+
+        void reapOne();
+        void throwIfFailed();
+
+        void writeDirect(std::uintmax_t offset, std::span<const uint8_t> data);
+
+        std::shared_ptr<FileWriter> m_writer;
+        std::unique_ptr<IoRing> m_ring;
+        std::size_t m_bufferSize;
+        bool m_direct = false; // Aligned writes go through the O_DIRECT descriptor
+        AlignedBufferPool m_buffers;
+        std::vector<PendingWrite> m_pending;
+        unsigned m_inFlight = 0;
+        std::string m_error;
+        std::mutex m_mutex;
+    };
+}
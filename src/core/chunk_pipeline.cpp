@@ -0,0 +1,121 @@
+#include "chunk_pipeline.hpp"
+
+#include <spdlog/spdlog.h>
+#include <algorithm>
+
+namespace core {
+
+    ChunkPipeline::ChunkPipeline(ChunkTransform transform, std::size_t workerCount)
+            : m_transform(std::move(transform)) {
+        if (workerCount == 0) {
+            workerCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        m_workers.reserve(workerCount);
+        for (std::size_t i = 0; i < workerCount; ++i) {
+            m_workers.emplace_back(&ChunkPipeline::workerLoop, this);
+        }
+
+        SPDLOG_DEBUG("Chunk pipeline started with {} workers", workerCount);
+    }
+
+    ChunkPipeline::~ChunkPipeline() {
+        cancel();
+
+        for (auto &worker: m_workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    void ChunkPipeline::submit(uint32_t chunkIndex, ChunkBuffer chunk) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_canceled) {
+                return;
+            }
+
+            m_input.emplace_back(chunkIndex, std::move(chunk));
+            m_submitted++;
+        }
+        m_inputReady.notify_one();
+    }
+
+    std::optional<network::FileDataMessage> ChunkPipeline::next() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        m_outputReady.wait(lock, [this]() {
+            return m_canceled || m_error || m_nextIndex == m_submitted ||
+                   m_output.find(m_nextIndex) != m_output.end();
+        });
+
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+
+        auto it = m_output.find(m_nextIndex);
+        if (m_canceled || it == m_output.end()) {
+            return std::nullopt;
+        }
+
+        network::FileDataMessage frame = std::move(it->second);
+        m_output.erase(it);
+        m_nextIndex++;
+        return frame;
+    }
+
+    std::size_t ChunkPipeline::inFlight() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_submitted - m_nextIndex;
+    }
+
+    std::size_t ChunkPipeline::workerCount() const {
+        return m_workers.size();
+    }
+
+    void ChunkPipeline::cancel() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_canceled = true;
+            m_input.clear();
+            m_output.clear();
+        }
+        m_inputReady.notify_all();
+        m_outputReady.notify_all();
+    }
+
+    void ChunkPipeline::workerLoop() {
+        while (true) {
+            std::pair<uint32_t, ChunkBuffer> work;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_inputReady.wait(lock, [this]() { return m_canceled || !m_input.empty(); });
+
+                if (m_canceled) {
+                    return;
+                }
+
+                work = std::move(m_input.front());
+                m_input.pop_front();
+            }
+
+            try {
+                network::FileDataMessage frame = m_transform(work.first, std::move(work.second));
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_canceled) {
+                    m_output.emplace(work.first, std::move(frame));
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error) {
+                    m_error = std::current_exception();
+                }
+            }
+
+            m_outputReady.notify_all();
+        }
+    }
+}
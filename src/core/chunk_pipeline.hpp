@@ -0,0 +1,125 @@
+#pragma once
+
+#include "../network/protocol.hpp"
+
+#include <vector>
+#include <span>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <optional>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+
+namespace core {
+
+    /**
+     * Plain bytes of a chunk, either owned or a view of memory that outlives the pipeline, such as a mapped file
+     * A view is only copied if the chunk goes out unchanged
+     */
+    struct ChunkBuffer {
+        std::vector<uint8_t> owned;
+        std::span<const uint8_t> view;
+
+        ChunkBuffer() = default;
+        ChunkBuffer(std::vector<uint8_t> &&data) : owned(std::move(data)) {}
+        ChunkBuffer(std::span<const uint8_t> data) : view(data) {}
+
+        /**
+         * Get the bytes of the chunk
+         * @return The view if set, otherwise the owned bytes
+         */
+        std::span<const uint8_t> bytes() const {
+            return view.data() ? view : std::span<const uint8_t>(owned);
+        }
+
+        /**
+         * Take the bytes of the chunk, copying them out of a view
+         * @return The bytes
+         */
+        std::vector<uint8_t> take() {
+            return view.data() ? std::vector<uint8_t>(view.begin(), view.end()) : std::move(owned);
+        }
+    };
+
+    /**
+     * Transform applied to each chunk by the pipeline workers
+     * @param chunkIndex Index of the chunk
+     * @param chunk Plain chunk data
+     * @return The file data message for the chunk
+     */
+    using ChunkTransform = std::function<network::FileDataMessage(uint32_t chunkIndex, ChunkBuffer &&chunk)>;
+
+    /**
+     * Worker pool that compresses/encrypts chunks concurrently and hands the
+     * resulting frames back in chunk index order
+     */
+    class ChunkPipeline {
+    public:
+        /**
+         * Constructor, starts the workers
+         * @param transform Transform applied to every chunk
+         * @param workerCount Number of worker threads, 0 to use the number of cores
+         */
+        explicit ChunkPipeline(ChunkTransform transform, std::size_t workerCount = 0);
+
+        /**
+         * Destructor, stops and joins the workers
+         */
+        ~ChunkPipeline();
+
+        ChunkPipeline(const ChunkPipeline &) = delete;
+        ChunkPipeline &operator=(const ChunkPipeline &) = delete;
+
+        /**
+         * Queue a chunk for transformation; chunks must be submitted in index order starting at 0
+         * @param chunkIndex Index of the chunk
+         * @param chunk Plain chunk data; a view must stay valid until the frame is returned by next()
+         */
+        void submit(uint32_t chunkIndex, ChunkBuffer chunk);
+
+        /**
+         * Wait for the next frame in index order
+         * @return The frame, or std::nullopt if no submitted chunk is left or the pipeline was canceled
+         * @throws Rethrows the first exception raised by the transform
+         */
+        std::optional<network::FileDataMessage> next();
+
+        /**
+         * Get the number of chunks submitted but not yet returned by next()
+         * @return Number of chunks in flight
+         */
+        std::size_t inFlight() const;
+
+        /**
+         * Get the number of worker threads
+         * @return Worker count
+         */
+        std::size_t workerCount() const;
+
+        /**
+         * Stop the workers and discard all pending chunks
+         */
+        void cancel();
+
+    private:
+        void workerLoop();
+
+        ChunkTransform m_transform;
+        std::vector<std::thread> m_workers;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_inputReady;
+        std::condition_variable m_outputReady;
+
+        std::deque<std::pair<uint32_t, ChunkBuffer>> m_input;
+        std::map<uint32_t, network::FileDataMessage> m_output; // Reordering buffer
+        uint32_t m_submitted = 0;
+        uint32_t m_nextIndex = 0;
+        bool m_canceled = false;
+        std::exception_ptr m_error;
+    };
+}
@@ -0,0 +1,541 @@
+#include "delta_sync.hpp"
+#include "../utils/logging.hpp"
+#include "../utils/hashing.hpp"
+
+#include <spdlog/spdlog.h>
+#include <unordered_map>
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace core {
+
+    namespace {
+        // Modulus of the rolling checksum halves
+        constexpr uint32_t CHECKSUM_MOD = 1 << 16;
+
+        // Bounds for the automatically chosen block size
+        constexpr uint32_t MIN_BLOCK_SIZE = 2 * 1024;
+        constexpr uint32_t MAX_BLOCK_SIZE = 128 * 1024;
+
+        // Wire size of a single block signature (weak + strong)
+        constexpr std::size_t PACKED_BLOCK_SIZE = 4 + 16;
+
+        void appendU32(std::vector<uint8_t> &out, uint32_t value) {
+            for (int i = 0; i < 4; ++i) {
+                out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        uint32_t readU32(const std::vector<uint8_t> &in, std::size_t &pos) {
+            if (pos + 4 > in.size()) {
+                throw std::runtime_error("Truncated delta data");
+            }
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) {
+                value |= static_cast<uint32_t>(in[pos + i]) << (8 * i);
+            }
+            pos += 4;
+            return value;
+        }
+
+        /**
+         * Flush a closed file to disk
+         * @param path Path to the file
+         */
+        void syncFile(const std::string &path) {
+#ifdef PLATFORM_WINDOWS
+            HANDLE handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            bool synced = handle != INVALID_HANDLE_VALUE && FlushFileBuffers(handle);
+            if (handle != INVALID_HANDLE_VALUE) {
+                CloseHandle(handle);
+            }
+            if (!synced) {
+                throw std::runtime_error("Failed to flush file: " + path);
+            }
+#else
+            int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+            if (fd < 0 || ::fsync(fd) != 0) {
+                int error = errno;
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                throw std::runtime_error("Failed to flush file: " + path + ": " + std::strerror(error));
+            }
+            ::close(fd);
+#endif
+        }
+
+        /**
+         * Rolling checksum state over a fixed-size window
+         */
+        struct RollingChecksum {
+            uint32_t a = 0;
+            uint32_t b = 0;
+            std::size_t length = 0;
+
+            void reset(const uint8_t *data, std::size_t len) {
+                a = 0;
+                b = 0;
+                length = len;
+                for (std::size_t i = 0; i < len; ++i) {
+                    a += data[i];
+                    b += static_cast<uint32_t>(len - i) * data[i];
+                }
+                a %= CHECKSUM_MOD;
+                b %= CHECKSUM_MOD;
+            }
+
+            void roll(uint8_t out, uint8_t in) {
+                a = (a - out + in) % CHECKSUM_MOD;
+                b = (b - static_cast<uint32_t>(length) * out + a) % CHECKSUM_MOD;
+            }
+
+            uint32_t value() const {
+                return a | (b << 16);
+            }
+        };
+    }
+
+    // FileSignature wire encoding
+    std::vector<uint8_t> FileSignature::pack() const {
+        std::vector<uint8_t> out;
+        out.reserve(blocks.size() * PACKED_BLOCK_SIZE);
+
+        for (const auto &block: blocks) {
+            appendU32(out, block.weak);
+            out.insert(out.end(), block.strong.begin(), block.strong.end());
+        }
+
+        return out;
+    }
+
+    FileSignature FileSignature::unpack(uint32_t blockSize, std::uintmax_t fileSize,
+                                        const std::vector<uint8_t> &data) {
+        if (blockSize < MIN_BLOCK_SIZE || blockSize > MAX_BLOCK_SIZE) {
+            throw std::runtime_error("Invalid signature block size: " + std::to_string(blockSize));
+        }
+
+        // One signature per block of the basis, the last possibly short
+        if (data.size() % PACKED_BLOCK_SIZE != 0 ||
+            data.size() / PACKED_BLOCK_SIZE != (fileSize + blockSize - 1) / blockSize) {
+            throw std::runtime_error("Malformed file signature");
+        }
+
+        FileSignature signature;
+        signature.blockSize = blockSize;
+        signature.fileSize = fileSize;
+        signature.blocks.resize(data.size() / PACKED_BLOCK_SIZE);
+
+        std::size_t pos = 0;
+        for (auto &block: signature.blocks) {
+            block.weak = readU32(data, pos);
+            std::copy_n(data.begin() + static_cast<std::ptrdiff_t>(pos), block.strong.size(), block.strong.begin());
+            pos += block.strong.size();
+        }
+
+        return signature;
+    }
+
+    uint32_t DeltaSync::chooseBlockSize(std::uintmax_t fileSize) {
+        auto blockSize = static_cast<uint32_t>(std::sqrt(static_cast<double>(fileSize)));
+
+        // Round up to a multiple of 1 KB
+        blockSize = (blockSize + 1023) & ~1023u;
+        return std::clamp(blockSize, MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+    }
+
+    uint32_t DeltaSync::weakChecksum(const uint8_t *data, std::size_t length) {
+        RollingChecksum checksum;
+        checksum.reset(data, length);
+        return checksum.value();
+    }
+
+    std::array<uint8_t, 16> DeltaSync::strongHash(const uint8_t *data, std::size_t length) {
+        // Truncated SHA-256
+        auto digest = utils::Hashing::sha256(data, length);
+        std::array<uint8_t, 16> result{};
+        std::copy_n(digest.begin(), result.size(), result.begin());
+        return result;
+    }
+
+    FileSignature DeltaSync::computeSignature(const std::string &filePath, uint32_t blockSize) {
+        FileSignature signature;
+        signature.fileSize = fs::file_size(filePath);
+        signature.blockSize = blockSize != 0 ? blockSize : chooseBlockSize(signature.fileSize);
+
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Failed to open file for signature: " + filePath);
+        }
+
+        signature.blocks.reserve((signature.fileSize + signature.blockSize - 1) / signature.blockSize);
+        std::vector<uint8_t> block(signature.blockSize);
+
+        while (file) {
+            file.read(reinterpret_cast<char *>(block.data()), static_cast<std::streamsize>(block.size()));
+            auto bytesRead = static_cast<std::size_t>(file.gcount());
+            if (bytesRead == 0) {
+                break;
+            }
+
+            signature.blocks.push_back({weakChecksum(block.data(), bytesRead),
+                                        strongHash(block.data(), bytesRead)});
+        }
+
+        SPDLOG_DEBUG("Signature computed for {}: {} blocks of {} bytes",
+                     filePath, signature.blocks.size(), signature.blockSize);
+        return signature;
+    }
+
+    bool DeltaSync::computeDelta(const FileSignature &signature, const std::string &filePath,
+                                 const DeltaBatchCallback &onBatch, const ProgressCallback &progressCallback,
+                                 std::size_t batchBytes, utils::Hasher *fileHasher) {
+        const std::size_t blockSize = signature.blockSize;
+        if (blockSize == 0 || signature.blocks.size() != (signature.fileSize + blockSize - 1) / blockSize) {
+            throw std::runtime_error("Invalid file signature");
+        }
+
+        // Index full-size blocks by their weak checksum; a short final block is matched separately
+        std::unordered_map<uint32_t, std::vector<uint32_t>> blockIndex;
+        std::size_t tailLength = signature.fileSize % blockSize;
+        std::size_t fullBlocks = tailLength == 0 ? signature.blocks.size() : signature.blocks.size() - 1;
+        blockIndex.reserve(fullBlocks);
+        for (uint32_t i = 0; i < fullBlocks; ++i) {
+            blockIndex[signature.blocks[i].weak].push_back(i);
+        }
+
+        std::uintmax_t fileSize = fs::file_size(filePath);
+        std::string fileName = fs::path(filePath).filename().string();
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Failed to open file for delta: " + filePath);
+        }
+
+        std::vector<DeltaInstruction> batch;
+        std::size_t batchSize = 0;
+        std::uintmax_t literalBytes = 0;
+        std::uintmax_t matchedBytes = 0;
+
+        // Window buffer: [litStart, pos) is pending literal data, [pos, pos + blockSize) the current window
+        std::vector<uint8_t> buffer(std::max<std::size_t>(4 * blockSize, batchBytes));
+        std::size_t bufLen = 0;
+        std::size_t pos = 0;
+        std::size_t litStart = 0;
+        std::uintmax_t bufferOffset = 0;
+        bool eof = false;
+
+        RollingChecksum rolling;
+        bool rollingValid = false;
+
+        auto flushBatch = [&]() {
+            if (batch.empty()) {
+                return true;
+            }
+            // Start the next batch empty, so nothing already handed over is sent or coalesced into again
+            std::vector<DeltaInstruction> ready;
+            ready.swap(batch);
+            batchSize = 0;
+            return onBatch(std::move(ready));
+        };
+
+        auto emitLiteral = [&]() {
+            if (pos == litStart) {
+                return true;
+            }
+            DeltaInstruction instruction{DeltaInstruction::Type::Literal};
+            instruction.data.assign(buffer.begin() + static_cast<std::ptrdiff_t>(litStart),
+                                    buffer.begin() + static_cast<std::ptrdiff_t>(pos));
+            literalBytes += instruction.data.size();
+            batchSize += instruction.data.size();
+            batch.push_back(std::move(instruction));
+            litStart = pos;
+            return batchSize < batchBytes || flushBatch();
+        };
+
+        auto emitBlock = [&](uint32_t index) {
+            matchedBytes += std::min<std::uintmax_t>(blockSize, signature.fileSize - std::uintmax_t(index) * blockSize);
+
+            // Coalesce runs of consecutive blocks into one reference
+            if (!batch.empty() && batch.back().type == DeltaInstruction::Type::BlockRef &&
+                batch.back().blockIndex + batch.back().blockCount == index) {
+                batch.back().blockCount++;
+                return;
+            }
+
+            DeltaInstruction instruction{DeltaInstruction::Type::BlockRef};
+            instruction.blockIndex = index;
+            instruction.blockCount = 1;
+            batchSize += 9;
+            batch.push_back(std::move(instruction));
+        };
+
+        if (progressCallback) {
+            progressCallback(0, fileSize, fileName);
+        }
+
+        while (true) {
+            // Refill when the window runs past the buffered data
+            if (bufLen - pos < blockSize && !eof) {
+                if (!emitLiteral()) {
+                    return false;
+                }
+
+                std::memmove(buffer.data(), buffer.data() + pos, bufLen - pos);
+                bufferOffset += pos;
+                bufLen -= pos;
+                pos = 0;
+                litStart = 0;
+
+                file.read(reinterpret_cast<char *>(buffer.data() + bufLen),
+                          static_cast<std::streamsize>(buffer.size() - bufLen));
+                auto bytesRead = static_cast<std::size_t>(file.gcount());
+                if (fileHasher) {
+                    fileHasher->update(buffer.data() + bufLen, bytesRead);
+                }
+                bufLen += bytesRead;
+                eof = !file;
+                rollingValid = false;
+
+                if (progressCallback) {
+                    progressCallback(bufferOffset, fileSize, fileName);
+                }
+            }
+
+            std::size_t available = bufLen - pos;
+            if (available == 0) {
+                break;
+            }
+
+            if (available < blockSize) {
+                // Only the short final block of the basis can match here
+                if (tailLength != 0 && available == tailLength) {
+                    const auto &tail = signature.blocks.back();
+                    if (weakChecksum(buffer.data() + pos, available) == tail.weak &&
+                        strongHash(buffer.data() + pos, available) == tail.strong) {
+                        if (!emitLiteral()) {
+                            return false;
+                        }
+                        emitBlock(static_cast<uint32_t>(signature.blocks.size() - 1));
+                        pos = bufLen;
+                        litStart = pos;
+                        break;
+                    }
+                }
+                pos = bufLen;
+                break;
+            }
+
+            if (!rollingValid) {
+                rolling.reset(buffer.data() + pos, blockSize);
+                rollingValid = true;
+            }
+
+            bool matched = false;
+            if (auto it = blockIndex.find(rolling.value()); it != blockIndex.end()) {
+                auto strong = strongHash(buffer.data() + pos, blockSize);
+                for (uint32_t index: it->second) {
+                    if (signature.blocks[index].strong == strong) {
+                        if (!emitLiteral()) {
+                            return false;
+                        }
+                        emitBlock(index);
+                        pos += blockSize;
+                        litStart = pos;
+                        rollingValid = false;
+                        matched = true;
+                        break;
+                    }
+                }
+            }
+
+            if (!matched) {
+                if (pos + blockSize < bufLen) {
+                    rolling.roll(buffer[pos], buffer[pos + blockSize]);
+                } else {
+                    rollingValid = false;
+                }
+                pos++;
+
+                if (pos - litStart >= batchBytes && !emitLiteral()) {
+                    return false;
+                }
+            }
+        }
+
+        if (!emitLiteral() || !flushBatch()) {
+            return false;
+        }
+
+        if (progressCallback) {
+            progressCallback(fileSize, fileSize, fileName);
+        }
+
+        SPDLOG_INFO("Delta computed for {}: {} bytes matched, {} bytes literal",
+                    fileName, matchedBytes, literalBytes);
+        return true;
+    }
+
+    std::vector<uint8_t> DeltaSync::packInstructions(const std::vector<DeltaInstruction> &instructions) {
+        std::vector<uint8_t> out;
+
+        for (const auto &instruction: instructions) {
+            out.push_back(static_cast<uint8_t>(instruction.type));
+            if (instruction.type == DeltaInstruction::Type::BlockRef) {
+                appendU32(out, instruction.blockIndex);
+                appendU32(out, instruction.blockCount);
+            } else {
+                appendU32(out, static_cast<uint32_t>(instruction.data.size()));
+                out.insert(out.end(), instruction.data.begin(), instruction.data.end());
+            }
+        }
+
+        return out;
+    }
+
+    std::vector<DeltaInstruction> DeltaSync::unpackInstructions(const std::vector<uint8_t> &data) {
+        std::vector<DeltaInstruction> instructions;
+        std::size_t pos = 0;
+
+        while (pos < data.size()) {
+            DeltaInstruction instruction{static_cast<DeltaInstruction::Type>(data[pos++])};
+
+            switch (instruction.type) {
+                case DeltaInstruction::Type::BlockRef:
+                    instruction.blockIndex = readU32(data, pos);
+                    instruction.blockCount = readU32(data, pos);
+                    break;
+
+                case DeltaInstruction::Type::Literal: {
+                    uint32_t length = readU32(data, pos);
+                    if (pos + length > data.size()) {
+                        throw std::runtime_error("Truncated delta literal");
+                    }
+                    instruction.data.assign(data.begin() + static_cast<std::ptrdiff_t>(pos),
+                                            data.begin() + static_cast<std::ptrdiff_t>(pos + length));
+                    pos += length;
+                    break;
+                }
+
+                default:
+                    throw std::runtime_error("Unknown delta instruction type");
+            }
+
+            instructions.push_back(std::move(instruction));
+        }
+
+        return instructions;
+    }
+
+    DeltaApplier::DeltaApplier(std::string basisPath, uint32_t blockSize, std::string outputPath,
+                               utils::HashAlgorithm hashAlgorithm)
+            : m_basisPath(std::move(basisPath)), m_outputPath(std::move(outputPath)),
+              m_tempPath(m_outputPath + ".delta"), m_blockSize(blockSize),
+              m_basis(m_basisPath, std::ios::binary), m_output(m_tempPath, std::ios::binary | std::ios::trunc),
+              m_copyBuffer(blockSize), m_hasher(utils::Hashing::create(hashAlgorithm)) {
+        if (!m_basis) {
+            throw std::runtime_error("Failed to open delta basis: " + m_basisPath);
+        }
+        if (!m_output) {
+            throw std::runtime_error("Failed to open delta output: " + m_tempPath);
+        }
+    }
+
+    DeltaApplier::~DeltaApplier() {
+        if (!m_installed) {
+            m_output.close();
+            std::error_code ec;
+            fs::remove(m_tempPath, ec);
+        }
+    }
+
+    std::uintmax_t DeltaApplier::apply(const std::vector<DeltaInstruction> &instructions) {
+        std::uintmax_t written = 0;
+
+        for (const auto &instruction: instructions) {
+            if (instruction.type == DeltaInstruction::Type::Literal) {
+                m_output.write(reinterpret_cast<const char *>(instruction.data.data()),
+                               static_cast<std::streamsize>(instruction.data.size()));
+                m_hasher->update(instruction.data.data(), instruction.data.size());
+                written += instruction.data.size();
+                continue;
+            }
+
+            m_basis.clear();
+            m_basis.seekg(static_cast<std::streamoff>(instruction.blockIndex) * m_blockSize);
+
+            for (uint32_t i = 0; i < instruction.blockCount; ++i) {
+                m_basis.read(reinterpret_cast<char *>(m_copyBuffer.data()),
+                             static_cast<std::streamsize>(m_copyBuffer.size()));
+                auto bytesRead = m_basis.gcount();
+                if (bytesRead <= 0) {
+                    throw std::runtime_error("Delta references block past the end of " + m_basisPath);
+                }
+                m_output.write(reinterpret_cast<const char *>(m_copyBuffer.data()), bytesRead);
+                m_hasher->update(m_copyBuffer.data(), static_cast<std::size_t>(bytesRead));
+                written += static_cast<std::uintmax_t>(bytesRead);
+            }
+        }
+
+        if (m_output.fail()) {
+            throw std::runtime_error("Error writing delta output: " + m_tempPath);
+        }
+
+        m_bytesWritten += written;
+        return written;
+    }
+
+    bool DeltaApplier::finish() {
+        try {
+            m_output.close();
+            m_basis.close();
+            if (m_output.fail()) {
+                throw std::runtime_error("Error closing delta output: " + m_tempPath);
+            }
+
+            // The new file must be on disk before it may replace the old one
+            syncFile(m_tempPath);
+            m_fileHash = utils::Hashing::toHex(m_hasher->finish());
+            m_finished = true;
+
+            SPDLOG_DEBUG("Delta output complete: {} ({} bytes)", m_tempPath, m_bytesWritten);
+            return true;
+
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error finishing delta for {}: {}", m_outputPath, e.what());
+            return false;
+        }
+    }
+
+    bool DeltaApplier::install() {
+        if (!m_finished) {
+            SPDLOG_ERROR("Delta output for {} installed before it was finished", m_outputPath);
+            return false;
+        }
+
+        try {
+            fs::rename(m_tempPath, m_outputPath);
+            m_installed = true;
+
+            SPDLOG_DEBUG("Delta applied: {} ({} bytes)", m_outputPath, m_bytesWritten);
+            return true;
+
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error installing delta for {}: {}", m_outputPath, e.what());
+            return false;
+        }
+    }
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "file_handler.hpp"
+#include "../utils/hashing.hpp"
+
+#include <string>
+#include <vector>
+#include <array>
+#include <fstream>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace core {
+
+    /**
+     * Signature of a single block of the receiver's existing file
+     */
+    struct BlockSignature {
+        uint32_t weak;                      // Rolling (Adler-style) checksum
+        std::array<uint8_t, 16> strong;     // Truncated strong hash
+    };
+
+    /**
+     * Block signatures of a whole file, sent by the receiver so that the
+     * sender can express the new version in terms of blocks it already has
+     */
+    struct FileSignature {
+        uint32_t blockSize = 0;
+        std::uintmax_t fileSize = 0;
+        std::vector<BlockSignature> blocks;
+
+        // Compact binary encoding for the wire
+        std::vector<uint8_t> pack() const;
+
+        static FileSignature unpack(uint32_t blockSize, std::uintmax_t fileSize,
+                                    const std::vector<uint8_t> &data);
+    };
+
+    /**
+     * A single step in the reconstruction of the new file
+     */
+    struct DeltaInstruction {
+        enum class Type : uint8_t {
+            Literal,   // Raw bytes not present in the receiver's copy
+            BlockRef   // Run of blocks copied from the receiver's copy
+        };
+
+        Type type;
+        uint32_t blockIndex = 0;
+        uint32_t blockCount = 0;
+        std::vector<uint8_t> data{};
+    };
+
+    /**
+     * Callback receiving batches of delta instructions as they are produced
+     * @param instructions The batch of instructions
+     * @return True to continue, false to abort the delta computation
+     */
+    using DeltaBatchCallback = std::function<bool(std::vector<DeltaInstruction> &&instructions)>;
+
+    /**
+     * rsync-style delta encoding between an existing file on the receiver
+     * and a newer version on the sender
+     */
+    class DeltaSync {
+    public:
+        /**
+         * Minimum size of the receiver's existing copy for a delta to be worthwhile
+         */
+        static constexpr std::uintmax_t MIN_BASIS_SIZE = 64 * 1024;
+
+        /**
+         * Choose a block size for a basis file (roughly sqrt of the size, like rsync)
+         * @param fileSize Size of the basis file
+         * @return Block size in bytes
+         */
+        static uint32_t chooseBlockSize(std::uintmax_t fileSize);
+
+        /**
+         * Calculate the signature of an existing file
+         * @param filePath Path to the basis file
+         * @param blockSize Block size to use, 0 to pick one automatically
+         * @return Signature of every block in the file
+         */
+        static FileSignature computeSignature(const std::string &filePath, uint32_t blockSize = 0);
+
+        /**
+         * Compute the delta of a file against a remote signature
+         * @param signature Signature of the receiver's copy
+         * @param filePath Path to the new version of the file
+         * @param onBatch Callback receiving instruction batches of roughly batchBytes each
+         * @param progressCallback Optional callback for progress updates
+         * @param batchBytes Approximate wire size of each batch
+         * @param fileHasher Optional hasher fed every byte of the file as it is read, so the
+         *                   file hash needs no second pass over the file
+         * @return True if the whole file was processed, false if aborted
+         */
+        static bool computeDelta(const FileSignature &signature,
+                                 const std::string &filePath,
+                                 const DeltaBatchCallback &onBatch,
+                                 const ProgressCallback &progressCallback = nullptr,
+                                 std::size_t batchBytes = 1024 * 1024,
+                                 utils::Hasher *fileHasher = nullptr);
+
+        /**
+         * Encode a batch of instructions for the wire
+         * @param instructions The instructions to encode
+         * @return Encoded instructions
+         */
+        static std::vector<uint8_t> packInstructions(const std::vector<DeltaInstruction> &instructions);
+
+        /**
+         * Decode a batch of instructions received from the wire
+         * @param data Encoded instructions
+         * @return Decoded instructions
+         */
+        static std::vector<DeltaInstruction> unpackInstructions(const std::vector<uint8_t> &data);
+
+        /**
+         * Calculate the rolling checksum of a block
+         * @param data Pointer to the block
+         * @param length Length of the block
+         * @return Weak checksum
+         */
+        static uint32_t weakChecksum(const uint8_t *data, std::size_t length);
+
+        /**
+         * Calculate the strong hash of a block
+         * @param data Pointer to the block
+         * @param length Length of the block
+         * @return Truncated strong hash
+         */
+        static std::array<uint8_t, 16> strongHash(const uint8_t *data, std::size_t length);
+    };
+
+    /**
+     * Rebuilds a file on the receiver from its existing copy and a stream of
+     * delta instructions. Output goes to a temporary file, hashed as it is
+     * written, that only replaces the target when install() is called; the
+     * caller checks fileHash() against the sender's hash first.
+     */
+    class DeltaApplier {
+    public:
+        /**
+         * Constructor
+         * @param basisPath Path to the receiver's existing copy
+         * @param blockSize Block size used for the signature
+         * @param outputPath Path of the reconstructed file
+         * @param hashAlgorithm Algorithm of the hash calculated over the new file
+         */
+        DeltaApplier(std::string basisPath, uint32_t blockSize, std::string outputPath,
+                     utils::HashAlgorithm hashAlgorithm = utils::HashAlgorithm::Sha256);
+
+        /**
+         * Destructor, removes the temporary file unless it was installed
+         */
+        ~DeltaApplier();
+
+        /**
+         * Apply a batch of instructions in order
+         * @param instructions The instructions to apply
+         * @return Number of bytes written to the new file
+         */
+        std::uintmax_t apply(const std::vector<DeltaInstruction> &instructions);
+
+        /**
+         * Close and sync the temporary file, leaving the target untouched
+         * @return True if the new file is complete on disk, false otherwise
+         */
+        bool finish();
+
+        /**
+         * Move the finished file over the target
+         * @return True if the new file was installed, false otherwise
+         */
+        bool install();
+
+        /**
+         * Check whether finish() has completed
+         * @return True if the new file is complete
+         */
+        bool finished() const { return m_finished; }
+
+        /**
+         * Get the hash of the new file, available once finish() has completed
+         * @return Hexadecimal digest
+         */
+        const std::string &fileHash() const { return m_fileHash; }
+
+        /**
+         * Get the number of bytes written so far
+         * @return Bytes written
+         */
+        std::uintmax_t bytesWritten() const { return m_bytesWritten; }
+
+    private:
+        std::string m_basisPath;
+        std::string m_outputPath;
+        std::string m_tempPath;
+        uint32_t m_blockSize;
+        std::ifstream m_basis;
+        std::ofstream m_output;
+        std::vector<uint8_t> m_copyBuffer;
+        std::unique_ptr<utils::Hasher> m_hasher;
+        std::string m_fileHash;
+        std::uintmax_t m_bytesWritten = 0;
+        bool m_finished = false;
+        bool m_installed = false;
+    };
+}
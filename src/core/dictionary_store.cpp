@@ -0,0 +1,88 @@
+#include "dictionary_store.hpp"
+
+#include <spdlog/spdlog.h>
+#include <algorithm>
+
+namespace core {
+
+    std::shared_ptr<const utils::CompressionDictionary>
+    DictionaryStore::dictionaryForPeer(const std::string &peerId) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_sessions.find(peerId);
+        return it != m_sessions.end() ? it->second.dictionary : nullptr;
+    }
+
+    std::shared_ptr<const utils::CompressionDictionary>
+    DictionaryStore::addSample(const std::string &peerId, std::span<const uint8_t> fileData) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &session = m_sessions[peerId];
+        if (session.dictionary || session.gaveUp) {
+            return session.dictionary;
+        }
+
+        std::size_t sampleSize = std::min(fileData.size(), SAMPLE_BYTES);
+        session.samples.emplace_back(fileData.begin(), fileData.begin() + sampleSize);
+
+        // Retry training every MIN_SAMPLES files until it succeeds or we run out of patience
+        if (session.samples.size() % MIN_SAMPLES != 0) {
+            return nullptr;
+        }
+
+        auto trained = utils::Compression::trainDictionary(session.samples);
+        if (!trained.empty()) {
+            try {
+                session.dictionary = std::make_shared<utils::CompressionDictionary>(std::move(trained));
+                SPDLOG_INFO("Trained compression dictionary {} for peer {} from {} files",
+                            session.dictionary->id(), peerId, session.samples.size());
+            } catch (const std::exception &e) {
+                SPDLOG_ERROR("Error loading trained dictionary: {}", e.what());
+            }
+        }
+
+        if (session.dictionary || session.samples.size() >= MAX_SAMPLES) {
+            session.gaveUp = !session.dictionary;
+            session.samples.clear();
+            session.samples.shrink_to_fit();
+        }
+
+        return session.dictionary;
+    }
+
+    uint32_t DictionaryStore::store(std::vector<uint8_t> data) {
+        std::shared_ptr<const utils::CompressionDictionary> dictionary;
+        try {
+            dictionary = std::make_shared<utils::CompressionDictionary>(std::move(data));
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Rejected compression dictionary: {}", e.what());
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        uint32_t id = dictionary->id();
+        if (m_cache.emplace(id, dictionary).second) {
+            m_cacheOrder.push_back(id);
+        }
+
+        while (m_cacheOrder.size() > MAX_CACHED) {
+            m_cache.erase(m_cacheOrder.front());
+            m_cacheOrder.pop_front();
+        }
+
+        return id;
+    }
+
+    std::shared_ptr<const utils::CompressionDictionary> DictionaryStore::find(uint32_t id) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_cache.find(id);
+        return it != m_cache.end() ? it->second : nullptr;
+    }
+
+    std::vector<uint32_t> DictionaryStore::cachedIds() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return {m_cacheOrder.begin(), m_cacheOrder.end()};
+    }
+}
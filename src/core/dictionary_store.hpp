@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../utils/compression.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <cstdint>
+
+namespace core {
+
+    /**
+     * Shared compression dictionaries for small files
+     * The sending side trains one dictionary per peer session from the small files
+     * it sends; the receiving side caches the dictionaries it was shipped by ID
+     */
+    class DictionaryStore {
+    public:
+        // Bytes taken from the start of each file as a training sample
+        static constexpr std::size_t SAMPLE_BYTES = 16 * 1024;
+
+        // Samples needed before the first training attempt, and the point at which we give up
+        static constexpr std::size_t MIN_SAMPLES = 32;
+        static constexpr std::size_t MAX_SAMPLES = 512;
+
+        // Received dictionaries kept in the cache
+        static constexpr std::size_t MAX_CACHED = 64;
+
+        /**
+         * Get the dictionary trained for a peer
+         * @param peerId ID of the peer
+         * @return The dictionary or nullptr if none has been trained yet
+         */
+        std::shared_ptr<const utils::CompressionDictionary> dictionaryForPeer(const std::string &peerId) const;
+
+        /**
+         * Add a small file to a peer's training samples, training a dictionary once there are enough
+         * @param peerId ID of the peer
+         * @param fileData Content of the file
+         * @return The dictionary if one is available after this sample, nullptr otherwise
+         */
+        std::shared_ptr<const utils::CompressionDictionary> addSample(const std::string &peerId,
+                                                                      std::span<const uint8_t> fileData);
+
+        /**
+         * Cache a dictionary received from a peer
+         * @param data Raw dictionary
+         * @return The dictionary ID, 0 if the data is not a valid dictionary
+         */
+        uint32_t store(std::vector<uint8_t> data);
+
+        /**
+         * Find a cached dictionary
+         * @param id Dictionary ID
+         * @return The dictionary or nullptr if not cached
+         */
+        std::shared_ptr<const utils::CompressionDictionary> find(uint32_t id) const;
+
+        /**
+         * Get the IDs of all cached dictionaries, advertised to senders in the handshake
+         * @return Dictionary IDs
+         */
+        std::vector<uint32_t> cachedIds() const;
+
+    private:
+        struct PeerSession {
+            std::vector<std::vector<uint8_t>> samples;
+            std::shared_ptr<const utils::CompressionDictionary> dictionary;
+            bool gaveUp = false;
+        };
+
+        mutable std::mutex m_mutex;
+        std::map<std::string, PeerSession> m_sessions;
+        std::map<uint32_t, std::shared_ptr<const utils::CompressionDictionary>> m_cache;
+        std::deque<uint32_t> m_cacheOrder; // Oldest first, for eviction
+    };
+}
@@ -0,0 +1,209 @@
+#include "directory_walker.hpp"
+
+#include <spdlog/spdlog.h>
+#include <filesystem>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <chrono>
+
+namespace fs = std::filesystem;
+
+namespace core {
+
+    namespace {
+
+        std::size_t resolveWorkers(std::size_t workerCount) {
+            if (workerCount == 0) {
+                workerCount = std::max(1u, std::thread::hardware_concurrency());
+            }
+            return workerCount;
+        }
+
+        int64_t toUnixNanos(fs::file_time_type time) {
+            auto systemTime = std::chrono::file_clock::to_sys(time);
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(systemTime.time_since_epoch()).count();
+        }
+
+        fs::file_time_type fromUnixNanos(int64_t nanos) {
+            std::chrono::sys_time<std::chrono::nanoseconds> systemTime{std::chrono::nanoseconds(nanos)};
+            return std::chrono::time_point_cast<fs::file_time_type::duration>(
+                    std::chrono::file_clock::from_sys(systemTime));
+        }
+
+        network::ManifestEntry makeEntry(const fs::path &relative, const fs::directory_entry &item,
+                                         const fs::file_status &status, bool directory) {
+            network::ManifestEntry entry;
+            entry.path = relative.generic_string();
+            entry.size = directory ? 0 : item.file_size();
+            entry.mode = static_cast<uint32_t>(status.permissions() & fs::perms::all);
+            entry.mtime = toUnixNanos(item.last_write_time());
+            entry.directory = directory;
+            return entry;
+        }
+    }
+
+    std::vector<network::ManifestEntry> DirectoryWalker::walk(const std::string &root, std::size_t workerCount) {
+        fs::path rootPath(root);
+        if (!fs::is_directory(rootPath)) {
+            throw std::runtime_error("Not a directory: " + root);
+        }
+
+        // Directories waiting to be listed, relative to the root; workers stop once none are queued or being listed
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<fs::path> pending{fs::path()};
+        std::size_t listing = 0;
+        std::exception_ptr error;
+        std::vector<network::ManifestEntry> entries;
+
+        auto worker = [&]() {
+            while (true) {
+                fs::path relative;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&]() { return !pending.empty() || listing == 0 || error; });
+                    if (pending.empty() || error) {
+                        return;
+                    }
+                    relative = std::move(pending.front());
+                    pending.pop_front();
+                    listing++;
+                }
+
+                std::vector<network::ManifestEntry> found;
+                std::vector<fs::path> subdirectories;
+                try {
+                    for (const auto &item: fs::directory_iterator(rootPath / relative)) {
+                        fs::file_status status = item.symlink_status();
+                        fs::path itemPath = relative / item.path().filename();
+
+                        if (fs::is_directory(status)) {
+                            found.push_back(makeEntry(itemPath, item, status, true));
+                            subdirectories.push_back(std::move(itemPath));
+                        } else if (fs::is_regular_file(status)) {
+                            found.push_back(makeEntry(itemPath, item, status, false));
+                        } else {
+                            SPDLOG_DEBUG("Skipping {}: not a regular file or directory", item.path().string());
+                        }
+                    }
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (auto &subdirectory: subdirectories) {
+                        pending.push_back(std::move(subdirectory));
+                    }
+                    std::move(found.begin(), found.end(), std::back_inserter(entries));
+                    listing--;
+                }
+                changed.notify_all();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (std::size_t i = 1; i < resolveWorkers(workerCount); ++i) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto &thread: workers) {
+            thread.join();
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        // A directory's path is a prefix of its contents' paths, so it sorts before them
+        std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) { return a.path < b.path; });
+
+        SPDLOG_DEBUG("Listed {} entries under {}", entries.size(), root);
+        return entries;
+    }
+
+    void DirectoryWalker::hashFiles(const std::string &root, std::vector<network::ManifestEntry> &entries,
+                                    utils::HashAlgorithm algorithm, std::size_t workerCount) {
+        fs::path rootPath(root);
+        std::atomic<std::size_t> next{0};
+        std::mutex errorMutex;
+        std::exception_ptr error;
+
+        // Each worker claims the next unhashed entry, so large and small files even out across workers
+        auto worker = [&]() {
+            for (std::size_t i = next++; i < entries.size(); i = next++) {
+                if (entries[i].directory) {
+                    continue;
+                }
+
+                try {
+                    entries[i].hash = utils::Hashing::hashFile((rootPath / entries[i].path).string(), algorithm);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    return;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (std::size_t i = 1; i < resolveWorkers(workerCount); ++i) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto &thread: workers) {
+            thread.join();
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    bool DirectoryWalker::isSafePath(const std::string &path) {
+        fs::path relative(path);
+        if (path.empty() || relative.has_root_name() || relative.has_root_directory()) {
+            return false;
+        }
+
+        return std::none_of(relative.begin(), relative.end(), [](const fs::path &component) {
+            return component.empty() || component == "." || component == "..";
+        });
+    }
+
+    network::ManifestEntry DirectoryWalker::describe(const std::string &path, const std::string &manifestPath) {
+        fs::directory_entry item(path);
+        fs::file_status status = item.status();
+        if (!fs::is_regular_file(status)) {
+            throw std::runtime_error("Not a regular file: " + path);
+        }
+
+        return makeEntry(fs::path(manifestPath), item, status, false);
+    }
+
+    void DirectoryWalker::applyMetadata(const std::string &path, const network::ManifestEntry &entry) {
+        std::error_code ec;
+        // Only the read, write and execute bits; a peer must not be able to make a received file setuid
+        if (entry.mode != 0) {
+            fs::permissions(path, static_cast<fs::perms>(entry.mode) & fs::perms::all, ec);
+            if (ec) {
+                SPDLOG_WARN("Could not set permissions of {}: {}", path, ec.message());
+            }
+        }
+
+        fs::last_write_time(path, fromUnixNanos(entry.mtime), ec);
+        if (ec) {
+            SPDLOG_WARN("Could not set modification time of {}: {}", path, ec.message());
+        }
+    }
+}
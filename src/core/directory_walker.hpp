@@ -0,0 +1,61 @@
+#pragma once
+
+#include "../network/protocol.hpp"
+#include "../utils/hashing.hpp"
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace core {
+
+    /**
+     * Builds and applies the manifests of directory transfers
+     */
+    class DirectoryWalker {
+    public:
+        /**
+         * List a directory tree, with several threads listing directories at once
+         * Regular files and directories are listed; symbolic links and special files are skipped
+         * @param root Root of the tree
+         * @param workerCount Number of threads, 0 for one per core
+         * @return Entries with paths relative to root, sorted so every directory comes before its contents
+         * @throws std::runtime_error or std::filesystem::filesystem_error if the tree cannot be listed
+         */
+        static std::vector<network::ManifestEntry> walk(const std::string &root, std::size_t workerCount = 0);
+
+        /**
+         * Fill in the hashes of the files of a manifest, hashing several files at once
+         * @param root Root of the tree the entries are relative to
+         * @param entries Manifest entries
+         * @param algorithm Hash algorithm
+         * @param workerCount Number of threads, 0 for one per core
+         * @throws std::runtime_error if a file cannot be read
+         */
+        static void hashFiles(const std::string &root, std::vector<network::ManifestEntry> &entries,
+                              utils::HashAlgorithm algorithm, std::size_t workerCount = 0);
+
+        /**
+         * Check that a manifest path stays inside the directory it is relative to
+         * @param path Manifest path
+         * @return True for non-empty relative paths without "." or ".." components
+         */
+        static bool isSafePath(const std::string &path);
+
+        /**
+         * Describe a single file for a manifest
+         * @param path Local path of the file
+         * @param manifestPath Path the receiver is to give the file, relative to the directory it receives
+         * @return The manifest entry, without a hash
+         * @throws std::runtime_error or std::filesystem::filesystem_error if the path is not a readable regular file
+         */
+        static network::ManifestEntry describe(const std::string &path, const std::string &manifestPath);
+
+        /**
+         * Give a received file or directory the permissions and modification time recorded in its entry
+         * @param path Local path of the file or directory
+         * @param entry Manifest entry
+         */
+        static void applyMetadata(const std::string &path, const network::ManifestEntry &entry);
+    };
+}
@@ -168,6 +168,16 @@ namespace core {
         return result;
     }
 
+    std::map<std::string, std::string> DiscoveryService::getInterfaceAddresses() const {
+        std::map<std::string, std::string> addresses;
+        for (const auto &name: m_platform->getNetworkInterfaces()) {
+            if (auto address = m_platform->getInterfaceAddress(name); !address.empty()) {
+                addresses[name] = address;
+            }
+        }
+        return addresses;
+    }
+
     void DiscoveryService::registerPeerDiscoveryCallback(PeerDiscoveredCallback callback) {
         m_peerDiscoveredCallback = std::move(callback);
     }
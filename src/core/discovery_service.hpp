@@ -5,6 +5,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <memory>
 #include <functional>
 #include <mutex>
@@ -153,6 +154,12 @@ namespace core {
          */
         std::vector<PeerInfo> getKnownPeers() const;
 
+        /**
+         * Get the IPv4 address of each local network interface, loopback excluded
+         * @return Address by interface name
+         */
+        std::map<std::string, std::string> getInterfaceAddresses() const;
+
         /**
          * Register a callback for peer discovery events
          * @param callback The callback function
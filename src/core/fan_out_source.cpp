@@ -0,0 +1,148 @@
+#include "fan_out_source.hpp"
+
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace core {
+
+    FanOutSource::FanOutSource(const std::string &filePath, std::size_t consumers, std::size_t chunkSize,
+                               std::size_t ringChunks, CacheMode cacheMode, std::chrono::milliseconds detachAfter)
+            : m_filePath(filePath), m_chunkSize(chunkSize), m_cacheMode(cacheMode), m_detachAfter(detachAfter),
+              m_reader(std::make_unique<ReadAheadReader>(filePath, chunkSize, 8, cacheMode)),
+              m_size(m_reader->size()), m_ring(std::max<std::size_t>(ringChunks, 1)), m_consumers(consumers) {
+    }
+
+    std::shared_ptr<const std::vector<uint8_t>> FanOutSource::chunk(std::size_t consumer, std::size_t index) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        Consumer &self = m_consumers.at(consumer);
+
+        // Moving the cursor may free a slot the reader is waiting for
+        if (self.attached && index > self.cursor) {
+            self.cursor = index;
+            self.movedAt = std::chrono::steady_clock::now();
+            m_changed.notify_all();
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + m_detachAfter;
+        while (self.attached) {
+            if (m_error) {
+                std::rethrow_exception(m_error);
+            }
+
+            if (index < m_nextRead) {
+                return m_ring[index % m_ring.size()];
+            }
+
+            // Read the next chunk ourselves if no one else is and the slowest consumer has left room for it
+            if (!m_reading && m_nextRead - slowestCursor() < m_ring.size()) {
+                std::size_t readIndex = m_nextRead;
+                m_reading = true;
+                lock.unlock();
+
+                auto data = std::make_shared<std::vector<uint8_t>>();
+                std::exception_ptr error;
+                try {
+                    m_reader->readNext(*data);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+
+                lock.lock();
+                m_reading = false;
+                if (error) {
+                    m_error = error;
+                } else {
+                    m_ring[readIndex % m_ring.size()] = std::move(data);
+                    m_nextRead++;
+                }
+                m_changed.notify_all();
+                continue;
+            }
+
+            if (m_reading || m_detachAfter.count() == 0) {
+                m_changed.wait(lock);
+                continue;
+            }
+
+            // The ring is full because of the slowest consumer; give it a while to catch up, then cut it loose
+            if (m_changed.wait_until(lock, deadline) == std::cv_status::timeout) {
+                // Another waiting consumer may have detached the laggard already
+                std::size_t slowest = slowestCursor();
+                if (m_reading || m_nextRead - slowest < m_ring.size()) {
+                    continue;
+                }
+
+                // Only a consumer stuck there all along is cut loose, not one that just caught up with it
+                auto now = std::chrono::steady_clock::now();
+                for (std::size_t i = 0; i < m_consumers.size(); ++i) {
+                    if (m_consumers[i].attached && m_consumers[i].cursor == slowest &&
+                        now - m_consumers[i].movedAt >= m_detachAfter) {
+                        m_consumers[i].attached = false;
+                        SPDLOG_WARN("Consumer {} of {} fell {} chunks behind, reading by itself", i, m_filePath,
+                                    m_nextRead - slowest);
+                    }
+                }
+                deadline = now + m_detachAfter;
+                m_changed.notify_all();
+            }
+        }
+
+        lock.unlock();
+        return readDetached(self, index);
+    }
+
+    std::shared_ptr<const std::vector<uint8_t>> FanOutSource::readDetached(Consumer &consumer, std::size_t index) {
+        if (!consumer.reader) {
+            consumer.reader = std::make_unique<FileReader>(m_filePath);
+            consumer.reader->setCacheMode(m_cacheMode == CacheMode::Normal ? CacheMode::Normal
+                                                                           : CacheMode::DropBehind);
+        }
+
+        std::uintmax_t offset = static_cast<std::uintmax_t>(index) * m_chunkSize;
+        if (offset >= m_size) {
+            throw std::runtime_error("Chunk past the end of " + m_filePath);
+        }
+
+        auto data = std::make_shared<std::vector<uint8_t>>(
+                static_cast<std::size_t>(std::min<std::uintmax_t>(m_chunkSize, m_size - offset)));
+        if (consumer.reader->readChunk(offset, *data) != data->size()) {
+            throw std::runtime_error("File changed during transfer: " + m_filePath);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_detachedReads++;
+        return data;
+    }
+
+    void FanOutSource::release(std::size_t consumer) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (consumer >= m_consumers.size() || !m_consumers[consumer].attached) {
+                return;
+            }
+            m_consumers[consumer].attached = false;
+        }
+
+        m_changed.notify_all();
+    }
+
+    std::uintmax_t FanOutSource::size() const {
+        return m_size;
+    }
+
+    std::size_t FanOutSource::chunksRead() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_nextRead + m_detachedReads;
+    }
+
+    std::size_t FanOutSource::slowestCursor() const {
+        std::size_t slowest = m_nextRead;
+        for (const auto &consumer: m_consumers) {
+            if (consumer.attached) {
+                slowest = std::min(slowest, consumer.cursor);
+            }
+        }
+        return slowest;
+    }
+}
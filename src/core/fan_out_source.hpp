@@ -0,0 +1,106 @@
+#pragma once
+
+#include "file_handler.hpp"
+#include "async_file_io.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace core {
+
+    /**
+     * Reads a file once for several consumers that each stream it in chunk order, such as the senders of a file
+     * going to many peers
+     * Chunks are kept in a ring of reference-counted buffers until the slowest consumer has moved past them; a
+     * consumer that holds the ring up for too long is detached and reads the rest of the file by itself
+     */
+    class FanOutSource {
+    public:
+        /**
+         * Open the file
+         * @param filePath Path to the file
+         * @param consumers Number of consumers, numbered from 0
+         * @param chunkSize Size of each chunk
+         * @param ringChunks Number of chunks buffered ahead of the slowest consumer
+         * @param cacheMode How reads treat the page cache
+         * @param detachAfter How long the others wait for the slowest consumer before detaching it, 0 to wait
+         *                    forever
+         * @throws std::runtime_error if the file cannot be opened
+         */
+        FanOutSource(const std::string &filePath, std::size_t consumers, std::size_t chunkSize,
+                     std::size_t ringChunks = 16, CacheMode cacheMode = CacheMode::Normal,
+                     std::chrono::milliseconds detachAfter = std::chrono::milliseconds(2000));
+
+        FanOutSource(const FanOutSource &) = delete;
+        FanOutSource &operator=(const FanOutSource &) = delete;
+
+        /**
+         * Get a chunk for a consumer, reading it if no consumer has yet
+         * Asking for a chunk tells the source the consumer is done with every earlier one
+         * @param consumer The consumer
+         * @param index Index of the chunk; each consumer must ask for the chunks in order
+         * @return The chunk, shared with the other consumers
+         * @throws std::runtime_error on read errors
+         */
+        std::shared_ptr<const std::vector<uint8_t>> chunk(std::size_t consumer, std::size_t index);
+
+        /**
+         * Stop buffering for a consumer, e.g. because its transfer ended; releasing twice is allowed
+         * @param consumer The consumer
+         */
+        void release(std::size_t consumer);
+
+        /**
+         * Get the size of the file when it was opened
+         * @return Size in bytes
+         */
+        std::uintmax_t size() const;
+
+        /**
+         * Get the number of chunks read from the file, by the shared reader and by detached consumers
+         * @return Chunks read
+         */
+        std::size_t chunksRead() const;
+
+    private:
+        struct Consumer {
+            std::size_t cursor = 0;              // First chunk the consumer may still ask for
+            std::chrono::steady_clock::time_point movedAt = std::chrono::steady_clock::now(); // Cursor last moved
+            bool attached = true;                // Served from the ring rather than its own reader
+            std::unique_ptr<FileReader> reader;  // Own reader once detached
+        };
+
+        /**
+         * Read a chunk for a detached consumer; only that consumer's thread touches its reader
+         */
+        std::shared_ptr<const std::vector<uint8_t>> readDetached(Consumer &consumer, std::size_t index);
+
+        /**
+         * Get the lowest cursor of the attached consumers; the caller holds m_mutex
+         */
+        std::size_t slowestCursor() const;
+
+        std::string m_filePath;
+        std::size_t m_chunkSize;
+        CacheMode m_cacheMode;
+        std::chrono::milliseconds m_detachAfter;
+        std::unique_ptr<ReadAheadReader> m_reader;
+        std::uintmax_t m_size;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::vector<std::shared_ptr<const std::vector<uint8_t>>> m_ring;
+        std::vector<Consumer> m_consumers;
+        std::size_t m_nextRead = 0;   // Next chunk the shared reader reads
+        bool m_reading = false;       // A consumer is reading m_nextRead without holding m_mutex
+        std::size_t m_detachedReads = 0;
+        std::exception_ptr m_error;   // Read error of the shared reader, rethrown to every attached consumer
+    };
+}
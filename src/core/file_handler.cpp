@@ -1,4 +1,5 @@
 #include "file_handler.hpp"
+#include "mime_types.hpp"
 #include "../utils/logging.hpp"
 
 #include <fstream>
@@ -8,9 +9,28 @@
 #include <iomanip>
 #include <filesystem>
 #include <algorithm>
+#include <tuple>
+#include <climits>
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
 using json = nlohmann::json;
 namespace fs = std::filesystem;
 
@@ -37,6 +57,732 @@ namespace core {
         return info;
     }
 
+    MappedFile::MappedFile(const std::string &filePath, AccessPattern pattern) : m_path(filePath) {
+#ifdef PLATFORM_WINDOWS
+        HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  pattern == AccessPattern::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN
+                                                                       : FILE_FLAG_RANDOM_ACCESS,
+                                  nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to open file for mapping: " + filePath);
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to get file size: " + filePath);
+        }
+        m_fileHandle = file;
+        m_size = static_cast<std::uintmax_t>(fileSize.QuadPart);
+
+        // Empty files cannot be mapped; they simply have no data
+        if (m_size == 0) {
+            return;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to map file: " + filePath);
+        }
+        m_mappingHandle = mapping;
+
+        m_data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!m_data) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            throw std::runtime_error("Failed to map file: " + filePath);
+        }
+#else
+        int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open file for mapping: " + filePath + ": " + std::strerror(errno));
+        }
+
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to stat file: " + filePath);
+        }
+        m_size = static_cast<std::uintmax_t>(st.st_size);
+
+        // Empty files cannot be mapped; they simply have no data
+        if (m_size == 0) {
+            ::close(fd);
+            return;
+        }
+
+        void *address = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Failed to map file: " + filePath + ": " + std::strerror(errno));
+        }
+        m_data = static_cast<const uint8_t *>(address);
+        m_fd = fd;
+
+        ::madvise(address, m_size, pattern == AccessPattern::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
+
+        SPDLOG_DEBUG("Mapped {} ({} bytes)", filePath, m_size);
+    }
+
+    MappedFile::~MappedFile() {
+#ifdef PLATFORM_WINDOWS
+        if (m_data) {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mappingHandle) {
+            CloseHandle(m_mappingHandle);
+        }
+        if (m_fileHandle) {
+            CloseHandle(m_fileHandle);
+        }
+#else
+        if (m_data) {
+            ::munmap(const_cast<uint8_t *>(m_data), m_size);
+        }
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+#endif
+    }
+
+    std::uintmax_t MappedFile::size() const {
+        return m_size;
+    }
+
+    std::span<const uint8_t> MappedFile::data() const {
+        return {m_data, static_cast<std::size_t>(m_size)};
+    }
+
+    std::span<const uint8_t> MappedFile::chunk(std::uintmax_t offset, std::size_t length) const {
+        if (offset >= m_size) {
+            return {};
+        }
+
+        auto available = static_cast<std::size_t>(m_size - offset);
+        return {m_data + offset, std::min(length, available)};
+    }
+
+    std::size_t MappedFile::chunkCount(std::size_t chunkSize) const {
+        return static_cast<std::size_t>((m_size + chunkSize - 1) / chunkSize);
+    }
+
+    void MappedFile::willNeed(std::uintmax_t offset, std::size_t length) const {
+        auto range = chunk(offset, length);
+        if (range.empty()) {
+            return;
+        }
+
+#ifdef PLATFORM_WINDOWS
+        WIN32_MEMORY_RANGE_ENTRY entry{const_cast<uint8_t *>(range.data()), range.size()};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &entry, 0);
+#else
+        // madvise needs a page-aligned start address
+        static const auto pageSize = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+        auto start = reinterpret_cast<std::uintptr_t>(range.data()) & ~(pageSize - 1);
+        auto end = reinterpret_cast<std::uintptr_t>(range.data() + range.size());
+        ::madvise(reinterpret_cast<void *>(start), end - start, MADV_WILLNEED);
+#endif
+    }
+
+    bool MappedFile::covers(std::uintmax_t offset, std::size_t length) const {
+#ifdef PLATFORM_WINDOWS
+        // Windows refuses to shrink a file while a view of it is mapped
+        return offset + length <= m_size;
+#else
+        if (length == 0) {
+            return true;
+        }
+
+        struct stat st{};
+        return m_fd >= 0 && ::fstat(m_fd, &st) == 0 && offset + length <= static_cast<std::uintmax_t>(st.st_size);
+#endif
+    }
+
+    FileReader::FileReader(const std::string &filePath, ProgressCallback progressCallback)
+            : m_path(filePath), m_progressCallback(std::move(progressCallback)) {
+#ifdef PLATFORM_WINDOWS
+        HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to open file for reading: " + filePath);
+        }
+        m_handle = file;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to get file size: " + filePath);
+        }
+        m_size = static_cast<std::uintmax_t>(fileSize.QuadPart);
+#else
+        m_fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) {
+            throw std::runtime_error("Failed to open file for reading: " + filePath + ": " + std::strerror(errno));
+        }
+
+        struct stat st{};
+        if (::fstat(m_fd, &st) != 0) {
+            ::close(m_fd);
+            throw std::runtime_error("Failed to stat file: " + filePath);
+        }
+        m_size = static_cast<std::uintmax_t>(st.st_size);
+#endif
+    }
+
+    FileReader::~FileReader() {
+#ifdef PLATFORM_WINDOWS
+        CloseHandle(m_handle);
+#else
+        ::close(m_fd);
+        if (m_directFd >= 0) {
+            ::close(m_directFd);
+        }
+#endif
+    }
+
+    std::size_t FileReader::readChunk(std::uintmax_t offset, std::span<uint8_t> buffer) {
+        std::size_t total = 0;
+
+        while (total < buffer.size()) {
+#ifdef PLATFORM_WINDOWS
+            OVERLAPPED overlapped{};
+            std::uintmax_t position = offset + total;
+            overlapped.Offset = static_cast<DWORD>(position);
+            overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+
+            DWORD bytesRead = 0;
+            DWORD toRead = static_cast<DWORD>(std::min<std::size_t>(buffer.size() - total, 1u << 30));
+            if (!ReadFile(m_handle, buffer.data() + total, toRead, &bytesRead, &overlapped)) {
+                if (GetLastError() == ERROR_HANDLE_EOF) {
+                    break;
+                }
+                throw std::runtime_error("Error reading file: " + m_path);
+            }
+#else
+            ssize_t bytesRead = ::pread(m_fd, buffer.data() + total, buffer.size() - total,
+                                        static_cast<off_t>(offset + total));
+            if (bytesRead < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Error reading file: " + m_path + ": " + std::strerror(errno));
+            }
+#endif
+            if (bytesRead == 0) {
+                break; // End of file
+            }
+            total += static_cast<std::size_t>(bytesRead);
+        }
+
+        auto bytesRead = m_bytesRead += total;
+        if (m_progressCallback) {
+            m_progressCallback(bytesRead, m_size, fs::path(m_path).filename().string());
+        }
+
+        releaseCache(offset + total);
+        return total;
+    }
+
+    std::uintmax_t FileReader::size() const {
+        return m_size;
+    }
+
+    std::vector<std::pair<std::uintmax_t, std::uintmax_t>> FileReader::dataRanges() const {
+        std::vector<std::pair<std::uintmax_t, std::uintmax_t>> ranges;
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+        off_t position = 0;
+        auto size = static_cast<off_t>(m_size);
+        while (position < size) {
+            off_t dataStart = ::lseek(m_fd, position, SEEK_DATA);
+            if (dataStart < 0) {
+                if (errno == ENXIO) {
+                    break; // Only a hole is left
+                }
+                // Holes cannot be detected on this file system
+                ranges.assign(1, {0, m_size});
+                return ranges;
+            }
+
+            off_t dataEnd = ::lseek(m_fd, dataStart, SEEK_HOLE);
+            if (dataEnd < 0 || dataEnd > size) {
+                dataEnd = size;
+            }
+
+            ranges.emplace_back(dataStart, dataEnd - dataStart);
+            position = dataEnd;
+        }
+#else
+        if (m_size > 0) {
+            ranges.emplace_back(0, m_size);
+        }
+#endif
+
+        return ranges;
+    }
+
+    void FileReader::setCacheMode(CacheMode mode) {
+        m_cacheMode = mode;
+
+#ifdef __linux__
+        // Deep read-ahead keeps the disk streaming while the pages behind us are dropped
+        ::posix_fadvise(m_fd, 0, 0, mode == CacheMode::Normal ? POSIX_FADV_NORMAL : POSIX_FADV_SEQUENTIAL);
+
+        if (mode != CacheMode::Direct && m_directFd >= 0) {
+            ::close(m_directFd);
+            m_directFd = -1;
+        } else if (mode == CacheMode::Direct && m_directFd < 0) {
+            m_directFd = ::open(m_path.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+            if (m_directFd < 0) {
+                SPDLOG_DEBUG("O_DIRECT not supported for {} ({}), dropping pages behind reads instead",
+                             m_path, std::strerror(errno));
+                m_cacheMode = CacheMode::DropBehind;
+            }
+        }
+#else
+        if (mode == CacheMode::Direct) {
+            m_cacheMode = CacheMode::DropBehind;
+        }
+#endif
+    }
+
+    CacheMode FileReader::cacheMode() const {
+        return m_cacheMode;
+    }
+
+    void FileReader::releaseCache(std::uintmax_t offset) {
+#ifdef __linux__
+        // Drop in window-sized steps, keeping the latest window for reads that are still being consumed
+        if (m_cacheMode == CacheMode::Normal || offset < m_releasedUntil + 2 * CACHE_DROP_WINDOW) {
+            return;
+        }
+
+        // Readers on other threads skip the drop rather than wait for it
+        std::unique_lock<std::mutex> lock(m_cacheMutex, std::try_to_lock);
+        std::uintmax_t start = m_releasedUntil;
+        std::uintmax_t end = offset - CACHE_DROP_WINDOW;
+        if (!lock.owns_lock() || end <= start) {
+            return;
+        }
+
+        ::posix_fadvise(m_fd, static_cast<off_t>(start), static_cast<off_t>(end - start), POSIX_FADV_DONTNEED);
+        m_releasedUntil = end;
+#else
+        (void) offset;
+#endif
+    }
+
+    const std::string &FileReader::path() const {
+        return m_path;
+    }
+
+#ifndef PLATFORM_WINDOWS
+    int FileReader::descriptor() const {
+        return m_fd;
+    }
+
+    int FileReader::directDescriptor() const {
+        return m_directFd;
+    }
+#endif
+
+    namespace {
+        const char *const RESUME_SUFFIX = ".resume";
+
+        /**
+         * Replace a small file atomically by writing a sibling and renaming it over the original
+         * @param path Path of the file
+         * @param content New content
+         * @param flush Whether to sync the content before the rename
+         * @throws std::runtime_error if the file cannot be written or renamed
+         */
+        void replaceFile(const std::string &path, const std::string &content, bool flush) {
+            std::string scratchPath = path + ".tmp";
+#ifdef PLATFORM_WINDOWS
+            {
+                std::ofstream out(scratchPath, std::ios::binary | std::ios::trunc);
+                out.write(content.data(), static_cast<std::streamsize>(content.size()));
+                if (!out) {
+                    throw std::runtime_error("Failed to write " + scratchPath);
+                }
+            }
+
+            DWORD flags = MOVEFILE_REPLACE_EXISTING | (flush ? MOVEFILE_WRITE_THROUGH : 0);
+            if (!MoveFileExA(scratchPath.c_str(), path.c_str(), flags)) {
+                throw std::runtime_error("Failed to move file into place: " + path);
+            }
+#else
+            int fd = ::open(scratchPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                throw std::runtime_error("Failed to open " + scratchPath + ": " + std::strerror(errno));
+            }
+
+            std::size_t total = 0;
+            while (total < content.size()) {
+                ssize_t written = ::write(fd, content.data() + total, content.size() - total);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written < 0) {
+                    int error = errno;
+                    ::close(fd);
+                    throw std::runtime_error("Failed to write " + scratchPath + ": " + std::strerror(error));
+                }
+                total += static_cast<std::size_t>(written);
+            }
+
+            if (flush && ::fsync(fd) != 0) {
+                int error = errno;
+                ::close(fd);
+                throw std::runtime_error("Failed to flush " + scratchPath + ": " + std::strerror(error));
+            }
+            ::close(fd);
+
+            if (::rename(scratchPath.c_str(), path.c_str()) != 0) {
+                throw std::runtime_error("Failed to move file into place: " + path + ": " + std::strerror(errno));
+            }
+#endif
+        }
+
+#ifndef PLATFORM_WINDOWS
+        /**
+         * Flush a directory so entries renamed into it survive a power loss
+         * @param filePath Path of a file in the directory
+         */
+        void syncParentDirectory(const std::string &filePath) {
+            fs::path parent = fs::path(filePath).parent_path();
+            int fd = ::open(parent.empty() ? "." : parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0 || ::fsync(fd) != 0) {
+                SPDLOG_WARN("Failed to flush directory of {}: {}", filePath, std::strerror(errno));
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+#endif
+    }
+
+    FileWriter::FileWriter(const std::string &filePath, std::uintmax_t expectedSize,
+                           ProgressCallback progressCallback, OpenMode mode)
+            : m_path(filePath), m_tempPath(filePath + ".part"), m_expectedSize(expectedSize),
+              m_progressCallback(std::move(progressCallback)), m_keepTemp(mode == OpenMode::Resume) {
+        // Creating exclusively means two transfers can never end up writing into the same temporary file
+#ifdef PLATFORM_WINDOWS
+        HANDLE file = CreateFileA(m_tempPath.c_str(), GENERIC_WRITE, 0, nullptr,
+                                  mode == OpenMode::Create ? CREATE_NEW : OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            if (GetLastError() == ERROR_FILE_EXISTS) {
+                throw std::system_error(EEXIST, std::generic_category(), "Partial file already exists: " + m_tempPath);
+            }
+            throw std::runtime_error("Failed to open file for writing: " + m_tempPath);
+        }
+        m_handle = file;
+#else
+        int flags = O_WRONLY | O_CLOEXEC | (mode == OpenMode::Create ? O_CREAT | O_EXCL : 0);
+        m_fd = ::open(m_tempPath.c_str(), flags, 0644);
+        if (m_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Failed to open file for writing: " + m_tempPath);
+        }
+#endif
+
+        // Reserving the whole file up front avoids fragmentation and turns a full disk into an early error
+        if (expectedSize > 0 && !preallocate(expectedSize)) {
+#ifndef PLATFORM_WINDOWS
+            if (errno == ENOSPC) {
+                close();
+                if (!m_keepTemp) {
+                    std::error_code ec;
+                    fs::remove(m_tempPath, ec);
+                }
+                throw std::system_error(ENOSPC, std::generic_category(),
+                                        "Not enough disk space for " + std::to_string(expectedSize) + " bytes");
+            }
+#endif
+            SPDLOG_WARN("Could not preallocate {} bytes for {}", expectedSize, m_tempPath);
+        }
+    }
+
+    FileWriter::~FileWriter() {
+        close();
+
+        if (!m_finalized && !m_keepTemp) {
+            std::error_code ec;
+            fs::remove(m_tempPath, ec);
+            fs::remove(m_tempPath + RESUME_SUFFIX, ec);
+        }
+    }
+
+    void FileWriter::close() {
+#ifdef PLATFORM_WINDOWS
+        if (m_handle) {
+            CloseHandle(m_handle);
+            m_handle = nullptr;
+        }
+#else
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+        if (m_directFd >= 0) {
+            ::close(m_directFd);
+            m_directFd = -1;
+        }
+#endif
+    }
+
+    bool FileWriter::preallocate(std::uintmax_t size) {
+#ifdef PLATFORM_WINDOWS
+        FILE_ALLOCATION_INFO allocation{};
+        allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+        return SetFileInformationByHandle(m_handle, FileAllocationInfo, &allocation, sizeof(allocation));
+#elif defined(__linux__)
+        int result = ::posix_fallocate(m_fd, 0, static_cast<off_t>(size));
+        errno = result;
+        return result == 0;
+#else
+        return ::ftruncate(m_fd, static_cast<off_t>(size)) == 0;
+#endif
+    }
+
+    void FileWriter::writeAt(std::uintmax_t offset, std::span<const uint8_t> data) {
+        std::size_t total = 0;
+
+        while (total < data.size()) {
+#ifdef PLATFORM_WINDOWS
+            OVERLAPPED overlapped{};
+            std::uintmax_t position = offset + total;
+            overlapped.Offset = static_cast<DWORD>(position);
+            overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+
+            DWORD bytesWritten = 0;
+            DWORD toWrite = static_cast<DWORD>(std::min<std::size_t>(data.size() - total, 1u << 30));
+            if (!WriteFile(m_handle, data.data() + total, toWrite, &bytesWritten, &overlapped)) {
+                throw std::runtime_error("Error writing to file: " + m_tempPath);
+            }
+#else
+            ssize_t bytesWritten = ::pwrite(m_fd, data.data() + total, data.size() - total,
+                                            static_cast<off_t>(offset + total));
+            if (bytesWritten < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Error writing to file: " + m_tempPath + ": " + std::strerror(errno));
+            }
+#endif
+            total += static_cast<std::size_t>(bytesWritten);
+        }
+
+        recordWrite(offset, data.size());
+    }
+
+    void FileWriter::writeHole(std::uintmax_t offset, std::uintmax_t length) {
+#ifdef __linux__
+        // Give back the blocks preallocated for the range; without preallocation it is already a hole
+        if (m_expectedSize > 0 &&
+            ::fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset),
+                        static_cast<off_t>(length)) != 0 && errno != EOPNOTSUPP) {
+            throw std::runtime_error("Failed to punch hole in " + m_tempPath + ": " + std::strerror(errno));
+        }
+#endif
+        // Elsewhere the range is never written and reads back as zeros once finalize() sets the size
+        recordWrite(offset, static_cast<std::size_t>(length));
+    }
+
+    void FileWriter::recordWrite(std::uintmax_t offset, std::size_t length) {
+        // Remember the furthest byte written so finalize() can trim any preallocated tail
+        std::uintmax_t end = offset + length;
+        std::uintmax_t current = m_endOffset.load();
+        while (end > current && !m_endOffset.compare_exchange_weak(current, end)) {
+        }
+
+        auto bytesWritten = m_bytesWritten += length;
+        if (m_progressCallback) {
+            m_progressCallback(bytesWritten, m_expectedSize, fs::path(m_path).filename().string());
+        }
+
+        releaseCache();
+    }
+
+    void FileWriter::setCacheMode(CacheMode mode) {
+        m_cacheMode = mode;
+
+#ifdef __linux__
+        if (mode == CacheMode::Direct && m_directFd < 0) {
+            m_directFd = ::open(m_tempPath.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+            if (m_directFd < 0) {
+                SPDLOG_DEBUG("O_DIRECT not supported for {} ({}), dropping pages behind writes instead",
+                             m_tempPath, std::strerror(errno));
+                m_cacheMode = CacheMode::DropBehind;
+            }
+        }
+#else
+        if (mode == CacheMode::Direct) {
+            m_cacheMode = CacheMode::DropBehind;
+        }
+#endif
+    }
+
+    CacheMode FileWriter::cacheMode() const {
+        return m_cacheMode;
+    }
+
+    void FileWriter::releaseCache() {
+#ifdef __linux__
+        std::uintmax_t written = m_endOffset.load();
+        if (m_cacheMode == CacheMode::Normal || written < m_releasedUntil + 2 * CACHE_DROP_WINDOW) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(m_cacheMutex, std::try_to_lock);
+        std::uintmax_t start = m_releasedUntil;
+        std::uintmax_t end = written - CACHE_DROP_WINDOW;
+        if (!lock.owns_lock() || end <= start) {
+            return;
+        }
+
+        // Dirty pages cannot be dropped: start writeback of the newest window now, then wait for the older
+        // range, whose writeback was started on the previous call, before dropping it
+        ::sync_file_range(m_fd, static_cast<off_t>(end), static_cast<off_t>(written - end), SYNC_FILE_RANGE_WRITE);
+        ::sync_file_range(m_fd, static_cast<off_t>(start), static_cast<off_t>(end - start),
+                          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        ::posix_fadvise(m_fd, static_cast<off_t>(start), static_cast<off_t>(end - start), POSIX_FADV_DONTNEED);
+        m_releasedUntil = end;
+#endif
+    }
+
+    void FileWriter::setDurability(DurabilityPolicy policy) {
+        m_durability = policy;
+    }
+
+    void FileWriter::flushData() {
+        if (m_durability == DurabilityPolicy::None) {
+            return;
+        }
+
+#ifdef PLATFORM_WINDOWS
+        if (!FlushFileBuffers(m_handle)) {
+            throw std::runtime_error("Failed to flush file: " + m_tempPath);
+        }
+#else
+#ifdef __linux__
+        // The size is the only metadata needed to read the data back, and fdatasync covers it
+        int result = m_durability == DurabilityPolicy::Full ? ::fsync(m_fd) : ::fdatasync(m_fd);
+#else
+        int result = ::fsync(m_fd);
+#endif
+        if (result != 0) {
+            throw std::runtime_error("Failed to flush file: " + m_tempPath + ": " + std::strerror(errno));
+        }
+#endif
+    }
+
+    void FileWriter::sync() {
+        if (m_synced || m_finalized) {
+            return;
+        }
+
+        // The expected size wins so a trailing hole is kept; otherwise trim to the furthest byte written
+        std::uintmax_t finalSize = std::max(m_endOffset.load(), m_expectedSize);
+#ifdef PLATFORM_WINDOWS
+        FILE_END_OF_FILE_INFO endOfFile{};
+        endOfFile.EndOfFile.QuadPart = static_cast<LONGLONG>(finalSize);
+        if (!SetFileInformationByHandle(m_handle, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile))) {
+            throw std::runtime_error("Failed to set size of file: " + m_tempPath);
+        }
+#else
+        if (::ftruncate(m_fd, static_cast<off_t>(finalSize)) != 0) {
+            throw std::runtime_error("Failed to set size of file: " + m_tempPath + ": " + std::strerror(errno));
+        }
+#endif
+        flushData();
+        m_synced = true;
+    }
+
+    void FileWriter::checkpoint(const std::string &state) {
+        // The data must be on disk before the state that claims it is
+        flushData();
+        replaceFile(m_tempPath + RESUME_SUFFIX, state, m_durability != DurabilityPolicy::None);
+        m_keepTemp = true;
+    }
+
+    std::string FileWriter::loadCheckpoint(const std::string &filePath) {
+        std::string tempPath = filePath + ".part";
+        std::error_code ec;
+        if (!fs::exists(tempPath, ec)) {
+            return {};
+        }
+
+        std::ifstream in(tempPath + RESUME_SUFFIX, std::ios::binary);
+        if (!in) {
+            return {};
+        }
+
+        std::stringstream state;
+        state << in.rdbuf();
+        return state.str();
+    }
+
+    void FileWriter::discard() {
+        m_keepTemp = false;
+    }
+
+    void FileWriter::finalize() {
+        if (m_finalized) {
+            return;
+        }
+
+        sync();
+        close();
+
+#ifdef PLATFORM_WINDOWS
+        DWORD flags = MOVEFILE_REPLACE_EXISTING |
+                      (m_durability != DurabilityPolicy::None ? MOVEFILE_WRITE_THROUGH : 0);
+        if (!MoveFileExA(m_tempPath.c_str(), m_path.c_str(), flags)) {
+            throw std::runtime_error("Failed to move file into place: " + m_path);
+        }
+#else
+        if (::rename(m_tempPath.c_str(), m_path.c_str()) != 0) {
+            throw std::runtime_error("Failed to move file into place: " + m_path + ": " + std::strerror(errno));
+        }
+
+        if (m_durability == DurabilityPolicy::Full) {
+            syncParentDirectory(m_path);
+        }
+#endif
+
+        m_finalized = true;
+
+        std::error_code ec;
+        fs::remove(m_tempPath + RESUME_SUFFIX, ec);
+
+        SPDLOG_DEBUG("File finalized: {} ({} bytes)", m_path, m_endOffset.load());
+    }
+
+    std::uintmax_t FileWriter::bytesWritten() const {
+        return m_bytesWritten;
+    }
+
+    const std::string &FileWriter::path() const {
+        return m_path;
+    }
+
+    const std::string &FileWriter::tempPath() const {
+        return m_tempPath;
+    }
+
+#ifndef PLATFORM_WINDOWS
+    int FileWriter::descriptor() const {
+        return m_fd;
+    }
+
+    int FileWriter::directDescriptor() const {
+        return m_directFd;
+    }
+#endif
+
     FileHandler::FileHandler(std::shared_ptr<platform::Platform> platform) : m_platform(std::move(platform)) {
         SPDLOG_DEBUG("FileHandler initialized");
     }
@@ -125,6 +871,59 @@ namespace core {
         }
     }
 
+    std::unique_ptr<MappedFile> FileHandler::mapFile(const std::string &filePath,
+                                                     MappedFile::AccessPattern pattern) const {
+        try {
+            return std::make_unique<MappedFile>(filePath, pattern);
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error mapping file {}: {}", filePath, e.what());
+            return nullptr;
+        }
+    }
+
+    std::unique_ptr<FileReader> FileHandler::openReader(const std::string &filePath,
+                                                        const ProgressCallback &progressCallback) const {
+        try {
+            return std::make_unique<FileReader>(filePath, progressCallback);
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error opening file {}: {}", filePath, e.what());
+            return nullptr;
+        }
+    }
+
+    std::unique_ptr<FileWriter> FileHandler::openWriter(const std::string &filePath, std::uintmax_t expectedSize,
+                                                        const ProgressCallback &progressCallback,
+                                                        std::error_code *error) const {
+        try {
+            // Create directories if they don't exist
+            fs::path path(filePath);
+            if (!path.parent_path().empty()) {
+                fs::create_directories(path.parent_path());
+            }
+
+            return std::make_unique<FileWriter>(filePath, expectedSize, progressCallback);
+        } catch (const std::system_error &e) {
+            SPDLOG_ERROR("Error creating file {}: {}", filePath, e.what());
+            if (error) {
+                *error = e.code();
+            }
+            return nullptr;
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error creating file {}: {}", filePath, e.what());
+            return nullptr;
+        }
+    }
+
+    std::unique_ptr<FileWriter> FileHandler::resumeWriter(const std::string &filePath,
+                                                          std::uintmax_t expectedSize) const {
+        try {
+            return std::make_unique<FileWriter>(filePath, expectedSize, nullptr, FileWriter::OpenMode::Resume);
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error reopening partial file {}: {}", filePath, e.what());
+            return nullptr;
+        }
+    }
+
     bool FileHandler::writeFile(const std::string &filePath, const std::vector<uint8_t> &data,
                                 const core::ProgressCallback &progressCallback) const {
         try {
@@ -134,11 +933,7 @@ namespace core {
                 fs::create_directories(path.parent_path());
             }
 
-            // Open file for writing in binary mode
-            std::ofstream file(filePath, std::ios::binary);
-            if (!file) {
-                throw std::runtime_error("Failed to open file for writing: " + filePath);
-            }
+            FileWriter writer(filePath, data.size());
 
             std::size_t totalSize = data.size();
 
@@ -152,12 +947,7 @@ namespace core {
 
             while (bytesWritten < totalSize) {
                 std::size_t bytesToWrite = std::min(chunkSize, totalSize - bytesWritten);
-                file.write(reinterpret_cast<const char *>(data.data() + bytesWritten),
-                           static_cast<std::streamsize>(bytesToWrite));
-
-                if (file.fail()) {
-                    throw std::runtime_error("Error writing to file: " + filePath);
-                }
+                writer.writeAt(bytesWritten, std::span<const uint8_t>(data.data() + bytesWritten, bytesToWrite));
 
                 bytesWritten += bytesToWrite;
 
@@ -166,7 +956,7 @@ namespace core {
                 }
             }
 
-            file.close();
+            writer.finalize();
             SPDLOG_DEBUG("File write complete: {} ({} bytes)", filePath, totalSize);
             return true;
 
@@ -190,63 +980,268 @@ namespace core {
 
     std::string FileHandler::getUniqueFilename(const std::string &directory, const std::string &filename) const {
         fs::path dir(directory);
-        fs::path origFilename(filename);
 
-        // If the file doesn't exist, we can use the original filename
-        if (!fs::exists(dir / origFilename)) {
+        unsigned number = findFreeNameNumber(dir, filename);
+
+        // The name is not claimed, so another name may still be taken by the time it is used
+        while (isFilenameTaken(dir, numberedFilename(filename, number))) {
+            ++number;
+        }
+
+        return numberedFilename(filename, number);
+    }
+
+    std::unique_ptr<FileWriter> FileHandler::createUniqueWriter(const std::string &directory,
+                                                                const std::string &filename,
+                                                                std::uintmax_t expectedSize,
+                                                                const ProgressCallback &progressCallback,
+                                                                std::error_code *error) const {
+        fs::path dir(directory);
+        std::string key = (dir / filename).string();
+
+        try {
+            fs::create_directories(dir);
+
+            unsigned number = 0;
+            for (int attempt = 0; attempt < MAX_NAME_ATTEMPTS; ++attempt) {
+                // Probed afresh each time, so names freed since, such as deleted downloads, are handed out again;
+                // a concurrent transfer that probed the same number loses the exclusive create below and moves on
+                unsigned probed = findFreeNameNumber(dir, filename);
+                number = attempt == 0 ? probed : std::max(probed, number + 1);
+
+                std::string path = (dir / numberedFilename(filename, number)).string();
+                if (fs::exists(path)) {
+                    continue;
+                }
+
+                try {
+                    return std::make_unique<FileWriter>(path, expectedSize, progressCallback);
+                } catch (const std::system_error &e) {
+                    // Only a partial download created by someone else since the number was taken; try the next one
+                    if (e.code() != std::errc::file_exists) {
+                        throw;
+                    }
+                    SPDLOG_DEBUG("Name {} was claimed concurrently, trying the next one", path);
+                }
+            }
+
+            SPDLOG_ERROR("No free name for {} after {} attempts", key, MAX_NAME_ATTEMPTS);
+            if (error) {
+                *error = std::make_error_code(std::errc::file_exists);
+            }
+            return nullptr;
+        } catch (const std::system_error &e) {
+            SPDLOG_ERROR("Error creating file for {}: {}", key, e.what());
+            if (error) {
+                *error = e.code();
+            }
+            return nullptr;
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error creating file for {}: {}", key, e.what());
+            return nullptr;
+        }
+    }
+
+    std::string FileHandler::createUniqueDirectory(const std::string &directory, const std::string &name) const {
+        fs::path dir(directory);
+        std::string key = (dir / name).string();
+
+        try {
+            fs::create_directories(dir);
+
+            unsigned number = 0;
+            for (int attempt = 0; attempt < MAX_NAME_ATTEMPTS; ++attempt) {
+                unsigned probed = findFreeNameNumber(dir, name);
+                number = attempt == 0 ? probed : std::max(probed, number + 1);
+
+                // Creating a directory fails if the name exists, so it claims the name like O_EXCL does for files
+                fs::path path = dir / numberedFilename(name, number);
+                if (!isFilenameTaken(dir, path.filename().string()) && fs::create_directory(path)) {
+                    return path.string();
+                }
+            }
+
+            SPDLOG_ERROR("No free name for directory {} after {} attempts", key, MAX_NAME_ATTEMPTS);
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error creating directory {}: {}", key, e.what());
+        }
+
+        return "";
+    }
+
+    void FileHandler::writeFiles(std::span<const SmallFile> files, DurabilityPolicy durability) const {
+        std::vector<std::unique_ptr<FileWriter>> writers;
+        writers.reserve(files.size());
+
+#ifdef __linux__
+        // One syncfs() covers every file of the batch, so the writers themselves skip flushing
+        DurabilityPolicy writerDurability = DurabilityPolicy::None;
+#else
+        DurabilityPolicy writerDurability = durability;
+#endif
+
+        for (const auto &file: files) {
+            auto writer = std::make_unique<FileWriter>(file.path);
+            writer->setDurability(writerDurability);
+            if (!file.data.empty()) {
+                writer->writeAt(0, file.data);
+            }
+            writer->sync();
+            writers.push_back(std::move(writer));
+        }
+
+#ifdef __linux__
+        auto syncFilesystem = [](const std::string &path) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0 || ::syncfs(fd) != 0) {
+                int error = errno;
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                throw std::runtime_error("Failed to flush files under " + path + ": " + std::strerror(error));
+            }
+            ::close(fd);
+        };
+
+        // The data must be on disk before the names that point at it
+        if (!writers.empty() && durability != DurabilityPolicy::None) {
+            syncFilesystem(writers.front()->tempPath());
+        }
+#endif
+
+        for (auto &writer: writers) {
+            writer->finalize();
+        }
+
+#ifdef __linux__
+        if (!writers.empty() && durability == DurabilityPolicy::Full) {
+            syncFilesystem(writers.front()->path());
+        }
+#endif
+
+        SPDLOG_DEBUG("Wrote a batch of {} files", files.size());
+    }
+
+    std::string FileHandler::numberedFilename(const std::string &filename, unsigned number) {
+        if (number == 0) {
             return filename;
         }
 
-        std::string baseName = origFilename.stem().string();
-        std::string extension = origFilename.extension().string();
+        fs::path original(filename);
+        return original.stem().string() + "_" + std::to_string(number) + original.extension().string();
+    }
 
-        // Try adding numbers to the filename until we find one that doesn't exist
-        int counter = 1;
-        std::string newFilename;
+    bool FileHandler::isFilenameTaken(const fs::path &directory, const std::string &filename) {
+        std::error_code ec;
+        return fs::exists(directory / filename, ec) || fs::exists(directory / (filename + ".part"), ec);
+    }
 
-        do {
-            std::stringstream ss;
-            ss << baseName << "_" << counter++ << extension;
-            newFilename = ss.str();
-        } while (fs::exists(dir / newFilename));
+    unsigned FileHandler::findFreeNameNumber(const fs::path &directory, const std::string &filename) {
+        if (!isFilenameTaken(directory, filename)) {
+            return 0;
+        }
+
+        // Double until a free number turns up, then bisect between the last taken and the free one
+        unsigned taken = 0;
+        unsigned free = 1;
+        while (isFilenameTaken(directory, numberedFilename(filename, free))) {
+            taken = free;
+            if (free > UINT_MAX / 2) {
+                return free + 1;
+            }
+            free *= 2;
+        }
+
+        while (free - taken > 1) {
+            unsigned middle = taken + (free - taken) / 2;
+            if (isFilenameTaken(directory, numberedFilename(filename, middle))) {
+                taken = middle;
+            } else {
+                free = middle;
+            }
+        }
+
+        return free;
+    }
+
+    std::vector<std::size_t> FileHandler::diskOrder(const std::vector<std::string> &filePaths) const {
+        std::vector<std::size_t> order(filePaths.size());
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+
+#ifndef PLATFORM_WINDOWS
+        // Files are grouped by device; within a device those with a known extent come first, by block address,
+        // then the rest by inode number, which most file systems allocate close to the data. Files that cannot
+        // be examined go last
+        struct Position {
+            dev_t device = 0;
+            bool known = false;
+            bool mapped = false;
+            uint64_t key = 0;
+        };
+
+        std::vector<Position> positions(filePaths.size());
+        for (std::size_t i = 0; i < filePaths.size(); ++i) {
+            struct stat st{};
+            if (::stat(filePaths[i].c_str(), &st) != 0) {
+                continue;
+            }
+
+            Position &position = positions[i];
+            position.device = st.st_dev;
+            position.known = true;
+            position.key = static_cast<uint64_t>(st.st_ino);
+
+#ifdef __linux__
+            int fd = ::open(filePaths[i].c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+
+            // Only the first extent is asked for; it is where reading the file starts
+            alignas(struct fiemap) uint8_t request[sizeof(struct fiemap) + sizeof(struct fiemap_extent)]{};
+            auto *map = reinterpret_cast<struct fiemap *>(request);
+            map->fm_start = 0;
+            map->fm_length = FIEMAP_MAX_OFFSET;
+            map->fm_extent_count = 1;
+
+            if (::ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0 &&
+                !(map->fm_extents[0].fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_NOT_ALIGNED))) {
+                position.mapped = true;
+                position.key = map->fm_extents[0].fe_physical;
+            }
+            ::close(fd);
+#endif
+        }
+
+        std::stable_sort(order.begin(), order.end(), [&positions](std::size_t a, std::size_t b) {
+            const Position &left = positions[a];
+            const Position &right = positions[b];
+            return std::make_tuple(!left.known, left.device, !left.mapped, left.key) <
+                   std::make_tuple(!right.known, right.device, !right.mapped, right.key);
+        });
+#endif
+
+        return order;
+    }
+
+    std::string FileHandler::identifyMimeType(const std::string &filePath, std::span<const uint8_t> head) const {
+        return std::string(MimeTypes::detect(fs::path(filePath).extension().string(), head));
+    }
+
+    std::string FileHandler::identifyMimeType(const std::string &filePath) const {
+        std::vector<uint8_t> head(MimeTypes::SNIFF_BYTES);
+        std::ifstream file(filePath, std::ios::binary);
+        file.read(reinterpret_cast<char *>(head.data()), static_cast<std::streamsize>(head.size()));
+        head.resize(static_cast<std::size_t>(file.gcount()));
 
-        return newFilename;
+        return identifyMimeType(filePath, head);
     }
 
     std::string FileHandler::detectMimeType(const std::string &filePath) const {
-        // Simple MIME type detection based on file extension
-        std::string extension = fs::path(filePath).extension().string();
-        std::transform(extension.begin(), extension.end(), extension.begin(),
-                       [](unsigned char c) { return std::tolower(c); });
-
-        // Common MIME types
-        if (extension == ".txt") return "text/plain";
-        if (extension == ".html" || extension == ".htm") return "text/html";
-        if (extension == ".css") return "text/css";
-        if (extension == ".js") return "text/javascript";
-        if (extension == ".json") return "application/json";
-        if (extension == ".xml") return "application/xml";
-        if (extension == ".pdf") return "application/pdf";
-        if (extension == ".zip") return "application/zip";
-        if (extension == ".doc") return "application/msword";
-        if (extension == ".docx") return "application/vnd.openxmlformats-officedocument.wordprocessingml.document";
-        if (extension == ".xls") return "application/vnd.ms-excel";
-        if (extension == ".xlsx") return "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet";
-        if (extension == ".ppt") return "application/vnd.ms-powerpoint";
-        if (extension == ".pptx") return "application/vnd.openxmlformats-officedocument.presentationml.presentation";
-        if (extension == ".jpg" || extension == ".jpeg") return "image/jpeg";
-        if (extension == ".png") return "image/png";
-        if (extension == ".gif") return "image/gif";
-        if (extension == ".svg") return "image/svg+xml";
-        if (extension == ".mp3") return "audio/mpeg";
-        if (extension == ".mp4") return "video/mp4";
-        if (extension == ".avi") return "video/x-msvideo";
-        if (extension == ".wav") return "audio/wav";
-        if (extension == ".ogg") return "audio/ogg";
-        if (extension == ".webm") return "video/webm";
-
-        // Default MIME type for unknown extensions
-        return "application/octet-stream";
+        // Extension only, so listing files never touches their content
+        return identifyMimeType(filePath, {});
     }
 
 }
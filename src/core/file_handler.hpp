@@ -5,7 +5,11 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <atomic>
+#include <mutex>
 #include <filesystem>
+#include <span>
+#include <system_error>
 #include <nlohmann/json.hpp>
 
 namespace core {
@@ -39,6 +43,398 @@ namespace core {
                  const std::string &fileName
             )>;
 
+    /**
+     * How streamed file I/O treats the page cache
+     */
+    enum class CacheMode {
+        Normal,     // Leave caching to the OS
+        DropBehind, // Hint sequential access and drop pages once the cursor has moved past them
+        Direct      // Bypass the page cache with O_DIRECT where buffers allow it, dropping behind elsewhere
+    };
+
+    // Bytes kept cached behind the cursor in CacheMode::DropBehind, for I/O still in flight
+    constexpr std::uintmax_t CACHE_DROP_WINDOW = 16 * 1024 * 1024;
+
+    // Alignment of offsets, lengths and buffers for O_DIRECT I/O
+    constexpr std::size_t DIRECT_IO_ALIGNMENT = 4096;
+
+    /**
+     * Read-only memory mapping of a file
+     * Chunks are views into the page cache, so the file is never copied into a user-space buffer
+     */
+    class MappedFile {
+    public:
+        /**
+         * Expected access pattern, passed to the kernel as a read-ahead hint
+         */
+        enum class AccessPattern {
+            Sequential,
+            Random
+        };
+
+        /**
+         * Map a file
+         * @param filePath Path to the file
+         * @param pattern Expected access pattern
+         * @throws std::runtime_error if the file cannot be opened or mapped
+         */
+        explicit MappedFile(const std::string &filePath, AccessPattern pattern = AccessPattern::Sequential);
+
+        /**
+         * Destructor, unmaps the file
+         */
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        /**
+         * Get the size of the mapped file
+         * @return Size in bytes
+         */
+        std::uintmax_t size() const;
+
+        /**
+         * Get the whole file
+         * @return View of the mapped bytes
+         */
+        std::span<const uint8_t> data() const;
+
+        /**
+         * Get a range of the file
+         * @param offset Offset of the first byte
+         * @param length Number of bytes, clamped to the end of the file
+         * @return View of the mapped bytes
+         */
+        std::span<const uint8_t> chunk(std::uintmax_t offset, std::size_t length) const;
+
+        /**
+         * Get the number of chunks of a given size covering the file
+         * @param chunkSize Chunk size in bytes
+         * @return Number of chunks
+         */
+        std::size_t chunkCount(std::size_t chunkSize) const;
+
+        /**
+         * Ask the kernel to start reading a range ahead of use
+         * @param offset Offset of the first byte
+         * @param length Number of bytes
+         */
+        void willNeed(std::uintmax_t offset, std::size_t length) const;
+
+        /**
+         * Check that the file on disk still holds a range of the mapping; reading mapped bytes past the end of a
+         * file truncated since it was mapped raises SIGBUS
+         * @param offset Offset of the first byte
+         * @param length Number of bytes
+         * @return True if the range may be read
+         */
+        bool covers(std::uintmax_t offset, std::size_t length) const;
+
+    private:
+        std::string m_path;
+        const uint8_t *m_data = nullptr;
+        std::uintmax_t m_size = 0;
+#ifdef PLATFORM_WINDOWS
+        void *m_fileHandle = nullptr;
+        void *m_mappingHandle = nullptr;
+#else
+        int m_fd = -1; // Kept open to check the file's size
+#endif
+    };
+
+    /**
+     * Positional reader for streaming a file in chunks with bounded memory
+     * Safe to use from several threads at once
+     */
+    class FileReader {
+    public:
+        /**
+         * Open a file for reading
+         * @param filePath Path to the file
+         * @param progressCallback Optional callback receiving the total bytes read so far
+         * @throws std::runtime_error if the file cannot be opened
+         */
+        explicit FileReader(const std::string &filePath, ProgressCallback progressCallback = nullptr);
+
+        /**
+         * Destructor, closes the file
+         */
+        ~FileReader();
+
+        FileReader(const FileReader &) = delete;
+        FileReader &operator=(const FileReader &) = delete;
+
+        /**
+         * Read a chunk of the file
+         * @param offset Offset of the first byte
+         * @param buffer Buffer to fill
+         * @return Number of bytes read, less than the buffer size only at the end of the file
+         * @throws std::runtime_error on read errors
+         */
+        std::size_t readChunk(std::uintmax_t offset, std::span<uint8_t> buffer);
+
+        /**
+         * Get the size of the file when it was opened
+         * @return Size in bytes
+         */
+        std::uintmax_t size() const;
+
+        /**
+         * Find the parts of the file that hold data, so holes in sparse files can be skipped
+         * @return Offset and length of each data range; the whole file where holes cannot be detected
+         */
+        std::vector<std::pair<std::uintmax_t, std::uintmax_t>> dataRanges() const;
+
+        /**
+         * Choose how reads treat the page cache; falls back to DropBehind where O_DIRECT is not supported
+         * @param mode Cache mode
+         */
+        void setCacheMode(CacheMode mode);
+
+        /**
+         * Get the cache mode in effect
+         * @return Cache mode
+         */
+        CacheMode cacheMode() const;
+
+        /**
+         * Report that everything before an offset has been consumed, so the pages can be dropped
+         * Called by readChunk() itself; backends that read the descriptor directly call it as they go
+         * @param offset End of the consumed range
+         */
+        void releaseCache(std::uintmax_t offset);
+
+        /**
+         * Get the path of the file
+         * @return File path
+         */
+        const std::string &path() const;
+
+#ifndef PLATFORM_WINDOWS
+        /**
+         * Get the underlying file descriptor, for backends that issue their own I/O
+         * @return File descriptor
+         */
+        int descriptor() const;
+
+        /**
+         * Get a descriptor opened with O_DIRECT, for aligned reads that bypass the page cache
+         * @return File descriptor, -1 unless the cache mode is Direct
+         */
+        int directDescriptor() const;
+#endif
+
+    private:
+        std::string m_path;
+        std::uintmax_t m_size = 0;
+        std::atomic<std::uintmax_t> m_bytesRead{0};
+        ProgressCallback m_progressCallback;
+        CacheMode m_cacheMode = CacheMode::Normal;
+        std::atomic<std::uintmax_t> m_releasedUntil{0};
+        std::mutex m_cacheMutex;
+#ifdef PLATFORM_WINDOWS
+        void *m_handle = nullptr;
+#else
+        int m_fd = -1;
+        int m_directFd = -1;
+#endif
+    };
+
+    /**
+     * How hard received files are pushed to stable storage before they are moved into place
+     */
+    enum class DurabilityPolicy {
+        None, // Leave flushing to the OS; a power loss may leave a renamed file with missing data
+        Data, // Flush the file contents before the rename
+        Full  // Also flush the directory after the rename, so the new name itself survives a power loss
+    };
+
+    /**
+     * Positional writer that streams chunks into a temporary file and moves it into place on finalize()
+     * Safe to use from several threads at once, as long as the written ranges do not overlap
+     */
+    class FileWriter {
+    public:
+        /**
+         * How the temporary file is opened
+         */
+        enum class OpenMode {
+            Create, // Create a new temporary file, failing if one already exists
+            Resume  // Continue writing an existing temporary file left by an earlier attempt
+        };
+
+        /**
+         * Open the temporary file next to the destination
+         * @param filePath Final path of the file
+         * @param expectedSize Size to preallocate, 0 to skip preallocation
+         * @param progressCallback Optional callback receiving the total bytes written so far
+         * @param mode Whether to create the temporary file or resume an existing one
+         * @throws std::system_error if the file cannot be opened, already exists when creating,
+         *         or there is not enough space for expectedSize
+         */
+        explicit FileWriter(const std::string &filePath, std::uintmax_t expectedSize = 0,
+                            ProgressCallback progressCallback = nullptr, OpenMode mode = OpenMode::Create);
+
+        /**
+         * Destructor, removes the temporary file unless finalize() succeeded or a checkpoint was saved
+         */
+        ~FileWriter();
+
+        FileWriter(const FileWriter &) = delete;
+        FileWriter &operator=(const FileWriter &) = delete;
+
+        /**
+         * Reserve disk space for the whole file
+         * @param size Size in bytes
+         * @return True if the space was reserved, false otherwise
+         */
+        bool preallocate(std::uintmax_t size);
+
+        /**
+         * Write a chunk at a given offset
+         * @param offset Offset of the first byte
+         * @param data Data to write
+         * @throws std::runtime_error on write errors
+         */
+        void writeAt(std::uintmax_t offset, std::span<const uint8_t> data);
+
+        /**
+         * Leave a range of the file as a hole; it reads back as zeros without taking disk space
+         * @param offset Offset of the first byte
+         * @param length Number of bytes
+         */
+        void writeHole(std::uintmax_t offset, std::uintmax_t length);
+
+        /**
+         * Set how hard the file is flushed by sync(), checkpoint() and finalize()
+         * @param policy Durability policy, DurabilityPolicy::Data by default
+         */
+        void setDurability(DurabilityPolicy policy);
+
+        /**
+         * Set the final size and flush the data according to the durability policy, keeping the temporary name
+         * The temporary file then holds the complete content and can be verified before finalize()
+         * @throws std::runtime_error if the file cannot be synced
+         */
+        void sync();
+
+        /**
+         * Record a resume point: flush the data written so far, then atomically save state describing it
+         * next to the temporary file; the temporary file is kept if the writer is destroyed afterwards
+         * @param state Caller-defined description of the data that has reached the file
+         * @throws std::runtime_error if the data cannot be synced or the state cannot be saved
+         */
+        void checkpoint(const std::string &state);
+
+        /**
+         * Load the state saved by the last checkpoint() of an unfinished file
+         * @param filePath Final path of the file
+         * @return The state or an empty string if there is no resume point
+         */
+        static std::string loadCheckpoint(const std::string &filePath);
+
+        /**
+         * Give up on the file; the temporary file and any resume point are removed when the writer is destroyed
+         */
+        void discard();
+
+        /**
+         * Choose how writes treat the page cache; falls back to DropBehind where O_DIRECT is not supported
+         * @param mode Cache mode
+         */
+        void setCacheMode(CacheMode mode);
+
+        /**
+         * Get the cache mode in effect
+         * @return Cache mode
+         */
+        CacheMode cacheMode() const;
+
+        /**
+         * Sync the data, rename the file into place and drop any resume point
+         * @throws std::runtime_error if the file cannot be synced or renamed
+         */
+        void finalize();
+
+        /**
+         * Get the number of bytes written so far
+         * @return Bytes written
+         */
+        std::uintmax_t bytesWritten() const;
+
+        /**
+         * Get the final path of the file
+         * @return File path
+         */
+        const std::string &path() const;
+
+        /**
+         * Get the path of the temporary file being written
+         * @return Temporary file path
+         */
+        const std::string &tempPath() const;
+
+#ifndef PLATFORM_WINDOWS
+        /**
+         * Get the underlying file descriptor, for backends that issue their own I/O
+         * @return File descriptor
+         */
+        int descriptor() const;
+
+        /**
+         * Get a descriptor opened with O_DIRECT, for aligned writes that bypass the page cache
+         * @return File descriptor, -1 unless the cache mode is Direct
+         */
+        int directDescriptor() const;
+#endif
+
+    private:
+        friend class WriteBehindWriter;
+
+        void close();
+        void flushData();
+
+        /**
+         * Write back and drop the pages behind the furthest byte written, in CacheMode::DropBehind
+         */
+        void releaseCache();
+
+        /**
+         * Account for data written at an offset, by writeAt() or by an asynchronous backend
+         * @param offset Offset of the first byte
+         * @param length Number of bytes
+         */
+        void recordWrite(std::uintmax_t offset, std::size_t length);
+
+        std::string m_path;
+        std::string m_tempPath;
+        std::uintmax_t m_expectedSize = 0;
+        std::atomic<std::uintmax_t> m_bytesWritten{0};
+        std::atomic<std::uintmax_t> m_endOffset{0};
+        ProgressCallback m_progressCallback;
+        DurabilityPolicy m_durability = DurabilityPolicy::Data;
+        CacheMode m_cacheMode = CacheMode::Normal;
+        std::atomic<std::uintmax_t> m_releasedUntil{0};
+        std::mutex m_cacheMutex;
+        bool m_finalized = false;
+        bool m_synced = false;
+        std::atomic<bool> m_keepTemp{false}; // Set by checkpoint(), cleared by discard()
+#ifdef PLATFORM_WINDOWS
+        void *m_handle = nullptr;
+#else
+        int m_fd = -1;
+        int m_directFd = -1;
+#endif
+    };
+
+    /**
+     * A small file written in one piece, together with others, by FileHandler::writeFiles()
+     */
+    struct SmallFile {
+        std::string path;
+        std::span<const uint8_t> data;
+    };
 
     class FileHandler {
     public:
@@ -64,8 +460,49 @@ namespace core {
         std::vector<uint8_t> readFile(const std::string &filePath,
                                       const ProgressCallback &progressCallback = nullptr) const;
 
+        /**
+         * Map a file into memory for zero-copy reading
+         * @param filePath Path to the file
+         * @param pattern Expected access pattern
+         * @return The mapping or nullptr if the file cannot be mapped
+         */
+        std::unique_ptr<MappedFile> mapFile(const std::string &filePath,
+                                            MappedFile::AccessPattern pattern =
+                                                    MappedFile::AccessPattern::Sequential) const;
+
+        /**
+         * Open a file for streaming reads
+         * @param filePath Path to the file
+         * @param progressCallback Optional callback for progress updates
+         * @return The reader or nullptr if the file cannot be opened
+         */
+        std::unique_ptr<FileReader> openReader(const std::string &filePath,
+                                               const ProgressCallback &progressCallback = nullptr) const;
+
+        /**
+         * Create a file for streaming writes, creating parent directories as needed
+         * @param filePath Final path of the file
+         * @param expectedSize Size to preallocate, 0 to skip preallocation
+         * @param progressCallback Optional callback for progress updates
+         * @param error Optional output for the reason the file could not be created
+         * @return The writer or nullptr if the file cannot be created
+         */
+        std::unique_ptr<FileWriter> openWriter(const std::string &filePath, std::uintmax_t expectedSize = 0,
+                                               const ProgressCallback &progressCallback = nullptr,
+                                               std::error_code *error = nullptr) const;
+
+        /**
+         * Reopen the temporary file of an interrupted write, as found through FileWriter::loadCheckpoint()
+         * @param filePath Final path of the file
+         * @param expectedSize Expected size of the complete file
+         * @return The writer or nullptr if the temporary file cannot be reopened
+         */
+        std::unique_ptr<FileWriter> resumeWriter(const std::string &filePath, std::uintmax_t expectedSize) const;
+
         /**
          * Write data to a file
+         * The data goes to a temporary file that is synced and renamed into place, so a crash never
+         * leaves a truncated file under the final name
          * @param filePath Path where the file should be written
          * @param data Data to write to the file
          * @param progressCallback Optional callback for progress updates
@@ -96,7 +533,7 @@ namespace core {
         bool openFile(const std::string &filePath) const;
 
         /**
-         * Get a unique filename by appending a number if the file already exists
+         * Get a unique filename by appending a number if the file, or a partial download of it, already exists
          * @param directory Directory where the file will be saved
          * @param filename Original filename
          * @return Unique filename
@@ -104,11 +541,98 @@ namespace core {
         std::string getUniqueFilename(const std::string &directory,
                                       const std::string &filename) const;
 
+        /**
+         * Create a file for streaming writes under a name that no file or partial download uses yet,
+         * appending a number to the name if needed
+         * The name is claimed by creating its temporary file exclusively, so concurrent transfers of
+         * same-named files always end up with different names
+         * @param directory Directory where the file will be saved, created if needed
+         * @param filename Original filename
+         * @param expectedSize Size to preallocate, 0 to skip preallocation
+         * @param progressCallback Optional callback for progress updates
+         * @param error Optional output for the reason the file could not be created
+         * @return The writer, whose path() is the name it got, or nullptr if the file cannot be created
+         */
+        std::unique_ptr<FileWriter> createUniqueWriter(const std::string &directory, const std::string &filename,
+                                                       std::uintmax_t expectedSize = 0,
+                                                       const ProgressCallback &progressCallback = nullptr,
+                                                       std::error_code *error = nullptr) const;
+
+        /**
+         * Create a directory under a name that no file, directory or partial download uses yet,
+         * appending a number to the name if needed
+         * @param directory Directory to create it in, created if needed
+         * @param name Original name
+         * @return Path of the new directory, or an empty string if it cannot be created
+         */
+        std::string createUniqueDirectory(const std::string &directory, const std::string &name) const;
+
+        /**
+         * Write a batch of small files, each through a temporary file moved into place
+         * The batch is flushed as a whole rather than file by file, so the durability policy costs a few
+         * flushes per batch instead of one or two per file
+         * @param files Files to write; their parent directories must exist
+         * @param durability How hard the batch is flushed before and after the files are moved into place
+         * @throws std::system_error if a file cannot be created, std::runtime_error if it cannot be written
+         */
+        void writeFiles(std::span<const SmallFile> files, DurabilityPolicy durability) const;
+
+        /**
+         * Get the name getUniqueFilename() and createUniqueWriter() use for a given number
+         * @param filename Original filename
+         * @param number Number to append, 0 for the original name
+         * @return Filename such as "report_3.csv"
+         */
+        static std::string numberedFilename(const std::string &filename, unsigned number);
+
+        /**
+         * Order files by where their data lies on disk, so that reading them in turn does not seek back and forth
+         * Uses the first physical extent where the file system reports it (FIEMAP) and the inode number otherwise
+         * @param filePaths Paths to the files
+         * @return Indices into filePaths in on-disk order; files that cannot be examined go last, in their given order
+         */
+        std::vector<std::size_t> diskOrder(const std::vector<std::string> &filePaths) const;
+
+        /**
+         * Identify the type of a file from its extension and leading content
+         * @param filePath Path to the file
+         * @param head Leading bytes of the file, such as the first chunk read for sending
+         * @return MIME type as string
+         */
+        std::string identifyMimeType(const std::string &filePath, std::span<const uint8_t> head) const;
+
+        /**
+         * Identify the type of a file from its extension and the first MimeTypes::SNIFF_BYTES of its content
+         * @param filePath Path to the file
+         * @return MIME type as string
+         */
+        std::string identifyMimeType(const std::string &filePath) const;
+
     private:
         std::shared_ptr<platform::Platform> m_platform;
 
+        // Give up on a name after this many collisions with files created behind our back
+        static constexpr int MAX_NAME_ATTEMPTS = 1000;
+
+        /**
+         * Check whether a name is used by a file or by a partial download that will become it
+         * @param directory Directory of the file
+         * @param filename Filename to check
+         * @return True if the name is taken
+         */
+        static bool isFilenameTaken(const std::filesystem::path &directory, const std::string &filename);
+
+        /**
+         * Find the first free number for a filename, assuming numbers are handed out in order
+         * Probes exponentially growing numbers and then bisects, so it costs a logarithmic number of checks
+         * @param directory Directory of the file
+         * @param filename Original filename
+         * @return Number of the first free name
+         */
+        static unsigned findFreeNameNumber(const std::filesystem::path &directory, const std::string &filename);
+
         /**
-         * Detect the MIME type of a file
+         * Detect the MIME type of a file from its extension
          * @param filePath Path to the file
          * @return MIME type as string
          */
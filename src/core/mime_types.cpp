@@ -0,0 +1,247 @@
+#include "mime_types.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace core {
+
+    namespace {
+
+        struct ExtensionEntry {
+            std::string_view extension;
+            std::string_view mimeType;
+        };
+
+        constexpr ExtensionEntry EXTENSIONS[] = {
+                {"txt",  "text/plain"},
+                {"log",  "text/plain"},
+                {"ini",  "text/plain"},
+                {"conf", "text/plain"},
+                {"cfg",  "text/plain"},
+                {"html", "text/html"},
+                {"htm",  "text/html"},
+                {"css",  "text/css"},
+                {"js",   "text/javascript"},
+                {"csv",  "text/csv"},
+                {"md",   "text/markdown"},
+                {"json", "application/json"},
+                {"xml",  "application/xml"},
+                {"yaml", "application/yaml"},
+                {"yml",  "application/yaml"},
+                {"toml", "application/toml"},
+                {"pdf",  "application/pdf"},
+                {"zip",  "application/zip"},
+                {"gz",   "application/gzip"},
+                {"tgz",  "application/gzip"},
+                {"zst",  "application/zstd"},
+                {"xz",   "application/x-xz"},
+                {"bz2",  "application/x-bzip2"},
+                {"7z",   "application/x-7z-compressed"},
+                {"rar",  "application/vnd.rar"},
+                {"tar",  "application/x-tar"},
+                {"doc",  "application/msword"},
+                {"docx", "application/vnd.openxmlformats-officedocument.wordprocessingml.document"},
+                {"xls",  "application/vnd.ms-excel"},
+                {"xlsx", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"},
+                {"ppt",  "application/vnd.ms-powerpoint"},
+                {"pptx", "application/vnd.openxmlformats-officedocument.presentationml.presentation"},
+                {"jpg",  "image/jpeg"},
+                {"jpeg", "image/jpeg"},
+                {"png",  "image/png"},
+                {"gif",  "image/gif"},
+                {"webp", "image/webp"},
+                {"svg",  "image/svg+xml"},
+                {"mp3",  "audio/mpeg"},
+                {"wav",  "audio/wav"},
+                {"ogg",  "audio/ogg"},
+                {"flac", "audio/flac"},
+                {"mp4",  "video/mp4"},
+                {"mov",  "video/quicktime"},
+                {"avi",  "video/x-msvideo"},
+                {"webm", "video/webm"},
+                {"mkv",  "video/x-matroska"},
+        };
+
+        constexpr std::size_t EXTENSION_COUNT = std::size(EXTENSIONS);
+        constexpr std::size_t MAX_EXTENSION_LENGTH = 4;
+
+        // Slots of the perfect hash table; a power of two at least four times the entry count keeps the seed
+        // search short
+        constexpr std::size_t TABLE_SIZE = 256;
+        constexpr uint8_t EMPTY_SLOT = 0xFF;
+        static_assert(EXTENSION_COUNT < EMPTY_SLOT && EXTENSION_COUNT * 4 <= TABLE_SIZE);
+
+        constexpr char toLower(char c) {
+            return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+        }
+
+        // FNV-1a over the lowercased extension, so lookups need neither a copy nor a transform
+        constexpr uint32_t hashExtension(std::string_view extension, uint32_t seed) {
+            uint32_t hash = 2166136261u ^ seed;
+            for (char c: extension) {
+                hash ^= static_cast<uint8_t>(toLower(c));
+                hash *= 16777619u;
+            }
+            return hash;
+        }
+
+        constexpr std::size_t slotOf(std::string_view extension, uint32_t seed) {
+            return hashExtension(extension, seed) & (TABLE_SIZE - 1);
+        }
+
+        // Try seeds until every extension lands in its own slot
+        constexpr uint32_t findSeed() {
+            for (uint32_t seed = 0; seed < 100000; ++seed) {
+                std::array<bool, TABLE_SIZE> used{};
+                bool collision = false;
+                for (const auto &entry: EXTENSIONS) {
+                    std::size_t slot = slotOf(entry.extension, seed);
+                    if (used[slot]) {
+                        collision = true;
+                        break;
+                    }
+                    used[slot] = true;
+                }
+                if (!collision) {
+                    return seed;
+                }
+            }
+            return UINT32_MAX;
+        }
+
+        constexpr uint32_t SEED = findSeed();
+        static_assert(SEED != UINT32_MAX, "No collision-free seed for the extension table");
+
+        constexpr std::array<uint8_t, TABLE_SIZE> buildTable() {
+            std::array<uint8_t, TABLE_SIZE> table{};
+            for (auto &slot: table) {
+                slot = EMPTY_SLOT;
+            }
+            for (std::size_t i = 0; i < EXTENSION_COUNT; ++i) {
+                table[slotOf(EXTENSIONS[i].extension, SEED)] = static_cast<uint8_t>(i);
+            }
+            return table;
+        }
+
+        constexpr std::array<uint8_t, TABLE_SIZE> TABLE = buildTable();
+
+        struct Signature {
+            std::string_view prefix;  // Bytes at offset 0, may be empty
+            std::size_t offset;       // Offset of magic
+            std::string_view magic;
+            std::string_view mimeType;
+            bool container;
+        };
+
+        using namespace std::string_view_literals;
+
+        constexpr Signature SIGNATURES[] = {
+                {"",     0,   "%PDF-"sv,                            "application/pdf",             false},
+                {"",     0,   "\x89PNG\r\n\x1a\n"sv,                "image/png",                   false},
+                {"",     0,   "\xFF\xD8\xFF"sv,                     "image/jpeg",                  false},
+                {"",     0,   "GIF87a"sv,                           "image/gif",                   false},
+                {"",     0,   "GIF89a"sv,                           "image/gif",                   false},
+                {"RIFF", 8,   "WEBP"sv,                             "image/webp",                  false},
+                {"RIFF", 8,   "WAVE"sv,                             "audio/wav",                   false},
+                {"RIFF", 8,   "AVI "sv,                             "video/x-msvideo",             false},
+                {"",     0,   "RIFF"sv,                             "application/octet-stream",    true},
+                {"",     0,   "PK\x03\x04"sv,                       "application/zip",             true},
+                {"",     0,   "PK\x05\x06"sv,                       "application/zip",             true},
+                {"",     0,   "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1"sv, "application/x-ole-storage",   true},
+                {"",     0,   "\x1F\x8B"sv,                         "application/gzip",            false},
+                {"",     0,   "\x28\xB5\x2F\xFD"sv,                 "application/zstd",            false},
+                {"",     0,   "\xFD" "7zXZ\x00"sv,                  "application/x-xz",            false},
+                {"",     0,   "BZh"sv,                              "application/x-bzip2",         false},
+                {"",     0,   "7z\xBC\xAF\x27\x1C"sv,               "application/x-7z-compressed", false},
+                {"",     0,   "Rar!\x1A\x07"sv,                     "application/vnd.rar",         false},
+                {"",     0,   "\x04\x22\x4D\x18"sv,                 "application/x-lz4",           false},
+                {"",     257, "ustar"sv,                            "application/x-tar",           false},
+                {"",     0,   "OggS"sv,                             "audio/ogg",                   false},
+                {"",     0,   "fLaC"sv,                             "audio/flac",                  false},
+                {"",     0,   "ID3"sv,                              "audio/mpeg",                  false},
+                {"",     4,   "ftyp"sv,                             "video/mp4",                   true},
+                {"",     0,   "\x1A\x45\xDF\xA3"sv,                 "video/webm",                  true},
+                {"",     0,   "\x7F" "ELF"sv,                       "application/x-executable",    false},
+        };
+
+        bool matchesAt(std::span<const uint8_t> head, std::size_t offset, std::string_view bytes) {
+            return bytes.empty() || (head.size() >= offset + bytes.size() &&
+                                     std::memcmp(head.data() + offset, bytes.data(), bytes.size()) == 0);
+        }
+    }
+
+    std::string_view MimeTypes::fromExtension(std::string_view extension) {
+        if (!extension.empty() && extension.front() == '.') {
+            extension.remove_prefix(1);
+        }
+        if (extension.empty() || extension.size() > MAX_EXTENSION_LENGTH) {
+            return {};
+        }
+
+        uint8_t index = TABLE[slotOf(extension, SEED)];
+        if (index == EMPTY_SLOT) {
+            return {};
+        }
+
+        // The slot holds the only candidate; confirm it is not a different extension hashing there
+        const auto &entry = EXTENSIONS[index];
+        if (entry.extension.size() != extension.size()) {
+            return {};
+        }
+        for (std::size_t i = 0; i < extension.size(); ++i) {
+            if (toLower(extension[i]) != entry.extension[i]) {
+                return {};
+            }
+        }
+
+        return entry.mimeType;
+    }
+
+    std::string_view MimeTypes::fromContent(std::span<const uint8_t> head, bool *container) {
+        for (const auto &signature: SIGNATURES) {
+            if (matchesAt(head, 0, signature.prefix) && matchesAt(head, signature.offset, signature.magic)) {
+                if (container) {
+                    *container = signature.container;
+                }
+                return signature.mimeType;
+            }
+        }
+
+        return {};
+    }
+
+    bool MimeTypes::looksLikeText(std::span<const uint8_t> head) {
+        if (head.empty()) {
+            return false;
+        }
+
+        // Bytes from 0x80 up are allowed as they make up UTF-8 sequences
+        std::size_t controls = 0;
+        for (uint8_t byte: head) {
+            if (byte == 0) {
+                return false;
+            }
+            if (byte < 0x20 && byte != '\t' && byte != '\n' && byte != '\r' && byte != '\f' && byte != 0x1B) {
+                controls++;
+            }
+        }
+
+        return controls * 100 <= head.size();
+    }
+
+    std::string_view MimeTypes::detect(std::string_view extension, std::span<const uint8_t> head) {
+        std::string_view byExtension = fromExtension(extension);
+
+        bool container = false;
+        std::string_view byContent = fromContent(head, &container);
+        if (!byContent.empty() && !(container && !byExtension.empty())) {
+            return byContent;
+        }
+
+        if (!byExtension.empty()) {
+            return byExtension;
+        }
+
+        return looksLikeText(head) ? "text/plain" : "application/octet-stream";
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string_view>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+namespace core {
+
+    /**
+     * MIME type detection from file extensions and leading content
+     */
+    class MimeTypes {
+    public:
+        // Leading bytes of a file that content detection looks at
+        static constexpr std::size_t SNIFF_BYTES = 512;
+
+        /**
+         * Look up the MIME type registered for a file extension, ignoring case
+         * @param extension Extension with or without the leading dot
+         * @return MIME type, or an empty view if the extension is unknown
+         */
+        static std::string_view fromExtension(std::string_view extension);
+
+        /**
+         * Identify a file format from its magic number
+         * @param head Leading bytes of the file, ideally SNIFF_BYTES of them
+         * @param container Optional output, set to true if the format is a container that other formats
+         *                  are built on (zip, OLE, RIFF, ISO media, Matroska), so the extension is more specific
+         * @return MIME type, or an empty view if no magic number matches
+         */
+        static std::string_view fromContent(std::span<const uint8_t> head, bool *container = nullptr);
+
+        /**
+         * Check whether leading bytes look like text rather than binary data
+         * @param head Leading bytes of the file
+         * @return True if there are no NUL bytes and hardly any control characters
+         */
+        static bool looksLikeText(std::span<const uint8_t> head);
+
+        /**
+         * Combine the extension and the content into one MIME type
+         * A magic number wins over the extension unless it only names a container; content without a magic
+         * number falls back to the extension, then to text/plain for text and application/octet-stream
+         * @param extension Extension with or without the leading dot
+         * @param head Leading bytes of the file, empty to go by the extension alone
+         * @return MIME type
+         */
+        static std::string_view detect(std::string_view extension, std::span<const uint8_t> head);
+    };
+}
@@ -0,0 +1,30 @@
+#include "read_scheduler.hpp"
+
+namespace core {
+
+    ReadScheduler::ReadScheduler(std::size_t turns) : m_finished(turns, false) {
+    }
+
+    void ReadScheduler::waitTurn(std::size_t turn) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_turnChanged.wait(lock, [this, turn]() {
+            return m_current >= turn || turn >= m_finished.size() || m_finished[turn];
+        });
+    }
+
+    void ReadScheduler::finish(std::size_t turn) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (turn >= m_finished.size() || m_finished[turn]) {
+                return;
+            }
+
+            m_finished[turn] = true;
+            while (m_current < m_finished.size() && m_finished[m_current]) {
+                ++m_current;
+            }
+        }
+
+        m_turnChanged.notify_all();
+    }
+}
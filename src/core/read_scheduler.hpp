@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+namespace core {
+
+    /**
+     * Hands out turns to read the files of a multi-file send one after another, in on-disk order,
+     * so a spinning disk streams instead of seeking between files that are read concurrently
+     */
+    class ReadScheduler {
+    public:
+        /**
+         * Constructor
+         * @param turns Number of files in the batch; turn 0 reads first
+         */
+        explicit ReadScheduler(std::size_t turns);
+
+        ReadScheduler(const ReadScheduler &) = delete;
+        ReadScheduler &operator=(const ReadScheduler &) = delete;
+
+        /**
+         * Block until every earlier turn has finished, or this turn was finished early
+         * @param turn The caller's turn
+         */
+        void waitTurn(std::size_t turn);
+
+        /**
+         * Mark a turn as done, letting the next one read; finishing a turn twice or before it came up is allowed
+         * @param turn The turn to finish
+         */
+        void finish(std::size_t turn);
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_turnChanged;
+        std::vector<bool> m_finished;
+        std::size_t m_current = 0; // First turn that has not finished
+    };
+}
@@ -0,0 +1,232 @@
+#include "stream_striper.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+
+namespace core {
+
+    StreamStriper::StreamStriper(network::SocketHandler &socketHandler, std::vector<Path> paths, bool autoTune)
+            : m_socketHandler(socketHandler),
+              m_streams(paths.size()),
+              m_windowStart(std::chrono::steady_clock::now()) {
+        for (std::size_t i = 0; i < paths.size(); ++i) {
+            m_streams[i].path = std::move(paths[i]);
+        }
+        m_active = autoTune ? std::min<std::size_t>(1, m_streams.size()) : m_streams.size();
+        m_settled = !autoTune || m_streams.size() <= 1;
+
+        for (std::size_t i = 0; i < m_streams.size(); ++i) {
+            m_streams[i].worker = std::thread(&StreamStriper::run, this, i);
+        }
+    }
+
+    StreamStriper::~StreamStriper() {
+        {
+            // Writes under way still read from the caller's file, so they must end before we return
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_closing = true;
+            m_queue.clear();
+            m_changed.notify_all();
+            while (std::any_of(m_streams.begin(), m_streams.end(), [](const Stream &stream) { return stream.busy; })) {
+                m_changed.wait_for(lock, STALL_CHECK_INTERVAL);
+                checkStalls();
+            }
+        }
+
+        for (std::size_t i = 0; i < m_streams.size(); ++i) {
+            auto &stream = m_streams[i];
+            if (stream.worker.joinable()) {
+                stream.worker.join();
+            }
+
+            if (stream.bytesSent > 0 || stream.failed) {
+                double megabytes = static_cast<double>(stream.bytesSent) / (1024 * 1024);
+                SPDLOG_INFO("Connection {}{} carried {:.1f} MB at {:.1f} MB/s{}", stream.path.endpoint,
+                            stream.path.localAddress.empty() ? "" : " from " + stream.path.localAddress, megabytes,
+                            stream.secondsBusy > 0 ? megabytes / stream.secondsBusy : 0.0,
+                            stream.failed ? " before it was given up on" : "");
+            }
+            if (i > 0 && !stream.failed) {
+                m_socketHandler.closeTcp(stream.path.endpoint);
+            }
+        }
+    }
+
+    bool StreamStriper::send(uint32_t chunkIndex, std::vector<uint8_t> message) {
+        Job job;
+        job.chunkIndex = chunkIndex;
+        job.message = std::move(message);
+        return enqueue(std::move(job));
+    }
+
+    bool StreamStriper::sendRaw(uint32_t chunkIndex, std::vector<uint8_t> message, int fd, std::uint64_t offset,
+                                std::size_t length) {
+        Job job;
+        job.chunkIndex = chunkIndex;
+        job.message = std::move(message);
+        job.fd = fd;
+        job.offset = offset;
+        job.length = length;
+        return enqueue(std::move(job));
+    }
+
+    bool StreamStriper::flush() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_failed && (!m_queue.empty() || std::any_of(m_streams.begin(), m_streams.end(),
+                                                             [](const Stream &stream) { return stream.busy; }))) {
+            m_changed.wait_for(lock, STALL_CHECK_INTERVAL);
+            checkStalls();
+        }
+        return !m_failed;
+    }
+
+    std::size_t StreamStriper::activeStreams() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_active;
+    }
+
+    void StreamStriper::run(std::size_t index) {
+        auto &stream = m_streams[index];
+
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [this, &stream, index]() {
+                    return m_closing || stream.failed || (!m_queue.empty() && eligible(index));
+                });
+                if (m_closing || stream.failed) {
+                    return;
+                }
+
+                job = std::move(m_queue.front());
+                m_queue.pop_front();
+                stream.busy = true;
+                stream.writeStarted = std::chrono::steady_clock::now();
+            }
+
+            bool written = write(stream.path.endpoint, job);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            stream.busy = false;
+            if (written) {
+                stream.bytesSent += job.bytes();
+                stream.secondsBusy += std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                                    stream.writeStarted).count();
+            } else if (!m_closing) {
+                if (!stream.failed) {
+                    failStream(index, "failed to write chunk " + std::to_string(job.chunkIndex));
+                }
+
+                // The receiver keeps whichever copy of a chunk arrives first
+                if (!m_failed) {
+                    m_queue.push_front(std::move(job));
+                }
+            }
+            m_changed.notify_all();
+        }
+    }
+
+    bool StreamStriper::write(const std::string &endpoint, const Job &job) {
+        if (job.fd < 0) {
+            return m_socketHandler.sendTcp(endpoint, job.message).get() >= 0;
+        }
+
+        // The raw frame must directly follow its message on the connection
+        return m_socketHandler.sendFile(endpoint, job.fd, job.offset, job.length, job.message).get() >= 0;
+    }
+
+    bool StreamStriper::enqueue(Job job) {
+        std::size_t bytes = job.bytes();
+
+        // One chunk queued per connection keeps each busy without holding much of the file in memory
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_failed && m_queue.size() >= m_streams.size()) {
+            m_changed.wait_for(lock, STALL_CHECK_INTERVAL);
+            checkStalls();
+        }
+        if (m_failed) {
+            return false;
+        }
+
+        m_queue.push_back(std::move(job));
+        record(bytes);
+        m_changed.notify_all();
+        return true;
+    }
+
+    bool StreamStriper::eligible(std::size_t index) const {
+        if (m_streams[index].failed) {
+            return false;
+        }
+
+        // Connections given up on make room for the next ones
+        std::size_t rank = 0;
+        for (std::size_t i = 0; i < index; ++i) {
+            if (!m_streams[i].failed) {
+                ++rank;
+            }
+        }
+        return rank < m_active;
+    }
+
+    void StreamStriper::failStream(std::size_t index, const std::string &reason) {
+        auto &stream = m_streams[index];
+        stream.failed = true;
+
+        // Without the transfer's own connection the receiver cannot be told the transfer is complete; it is shared
+        // with the peer's other transfers, so it is left for the socket handler to close
+        if (index == 0) {
+            SPDLOG_ERROR("Connection {} {}", stream.path.endpoint, reason);
+            m_failed = true;
+        } else {
+            SPDLOG_WARN("Connection {}{} {}, its chunks go to the others", stream.path.endpoint,
+                        stream.path.localAddress.empty() ? "" : " from " + stream.path.localAddress, reason);
+            m_socketHandler.closeTcp(stream.path.endpoint, true);
+        }
+        m_changed.notify_all();
+    }
+
+    void StreamStriper::checkStalls() {
+        // The transfer's own connection also carries other transfers' frames, so a write there may just be waiting
+        // its turn; only the extra connections are timed
+        auto now = std::chrono::steady_clock::now();
+        for (std::size_t i = 1; i < m_streams.size(); ++i) {
+            if (m_streams[i].busy && !m_streams[i].failed && now - m_streams[i].writeStarted > STALL_TIMEOUT) {
+                failStream(i, "stalled");
+            }
+        }
+    }
+
+    void StreamStriper::record(std::size_t bytes) {
+        if (m_settled) {
+            return;
+        }
+
+        m_windowBytes += bytes;
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration<double>(now - m_windowStart);
+        if (elapsed < TUNE_WINDOW) {
+            return;
+        }
+
+        double rate = static_cast<double>(m_windowBytes) / elapsed.count();
+        if (m_bestRate == 0 || rate > m_bestRate * (1.0 + TUNE_GAIN)) {
+            m_bestRate = rate;
+            if (m_active < m_streams.size()) {
+                ++m_active;
+                SPDLOG_DEBUG("Striping over {} connections after {:.1f} MB/s", m_active, rate / (1024 * 1024));
+            } else {
+                m_settled = true;
+                SPDLOG_INFO("Striping over all {} connections ({:.1f} MB/s)", m_active, rate / (1024 * 1024));
+            }
+        } else {
+            // The connection added last did not pay off
+            --m_active;
+            m_settled = true;
+            SPDLOG_INFO("Striping over {} connections ({:.1f} MB/s)", m_active, m_bestRate / (1024 * 1024));
+        }
+
+        m_windowBytes = 0;
+        m_windowStart = now;
+    }
+}
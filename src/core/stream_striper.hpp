@@ -0,0 +1,182 @@
+#pragma once
+
+#include "../network/socket_handler.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace core {
+
+    /**
+     * Sends the chunks of one transfer over several TCP connections to the same peer, possibly leaving through
+     * different local interfaces; each connection has a thread that takes the next chunk once its last write is out,
+     * so a faster path carries more of the file and frames never interleave on a connection
+     * An extra connection whose write stalls is closed and its chunk handed to the others; the transfer's own
+     * connection is shared with the peer's other transfers, so it is never timed out or closed here
+     * When tuning, starts on one connection and adds another every measuring window for as long as throughput rises
+     */
+    class StreamStriper {
+    public:
+        // Most connections one transfer is striped across
+        static constexpr std::size_t MAX_STREAMS = 8;
+
+        // How long a write on an extra connection may take before that connection is given up on
+        static constexpr std::chrono::seconds STALL_TIMEOUT{10};
+
+        /**
+         * A connection chunks can go out on
+         */
+        struct Path {
+            std::string endpoint;
+            std::string localAddress; // Address the connection was made from, empty if the routing table chose
+        };
+
+        /**
+         * Constructor
+         * @param socketHandler Socket handler the connections belong to
+         * @param paths Connections to the peer, the transfer's own first; the others are closed on destruction
+         * @param autoTune True to pick the number of connections from measured throughput, false to use them all
+         */
+        StreamStriper(network::SocketHandler &socketHandler, std::vector<Path> paths, bool autoTune);
+
+        /**
+         * Destructor, waits for the writes under way and closes the extra connections once they are out
+         */
+        ~StreamStriper();
+
+        StreamStriper(const StreamStriper &) = delete;
+        StreamStriper &operator=(const StreamStriper &) = delete;
+
+        /**
+         * Queue a chunk's message for the next free connection, waiting while every connection has one queued
+         * @param chunkIndex Index of the chunk
+         * @param message Serialized message
+         * @return False if the transfer's own connection has failed
+         */
+        bool send(uint32_t chunkIndex, std::vector<uint8_t> message);
+
+        /**
+         * Queue a chunk's message followed by its bytes as a raw frame, sent together on one connection
+         * @param chunkIndex Index of the chunk
+         * @param message Serialized message announcing the raw frame
+         * @param fd File descriptor to read from, open until flush() or destruction
+         * @param offset Position of the first byte in the file
+         * @param length Number of bytes to send
+         * @return False if the transfer's own connection has failed
+         */
+        bool sendRaw(uint32_t chunkIndex, std::vector<uint8_t> message, int fd, std::uint64_t offset,
+                     std::size_t length);
+
+        /**
+         * Wait for every queued chunk to be written
+         * @return True if all of them were
+         */
+        bool flush();
+
+        /**
+         * Get the number of connections chunks currently go out on
+         * @return Connections in use
+         */
+        std::size_t activeStreams() const;
+
+    private:
+        // Throughput is compared over windows this long; a connection is kept if it adds at least this share
+        static constexpr std::chrono::milliseconds TUNE_WINDOW{250};
+        static constexpr double TUNE_GAIN = 0.1;
+
+        // How often waiting callers look for stalled writes
+        static constexpr std::chrono::milliseconds STALL_CHECK_INTERVAL{500};
+
+        struct Job {
+            uint32_t chunkIndex = 0;
+            std::vector<uint8_t> message;
+            int fd = -1; // Set if a raw frame follows the message
+            std::uint64_t offset = 0;
+            std::size_t length = 0;
+
+            std::size_t bytes() const {
+                return fd >= 0 ? length : message.size();
+            }
+        };
+
+        struct Stream {
+            Path path;
+            std::thread worker;
+            bool busy = false;   // A write is under way, started at writeStarted
+            bool failed = false; // The connection was given up on
+            std::chrono::steady_clock::time_point writeStarted;
+            std::uint64_t bytesSent = 0;
+            double secondsBusy = 0;
+        };
+
+        /**
+         * Take chunks off the queue and write them to one connection until it fails or the striper closes
+         * @param index The connection
+         */
+        void run(std::size_t index);
+
+        /**
+         * Write one chunk
+         * @param endpoint The connection
+         * @param job The chunk
+         * @return True if it was written
+         */
+        bool write(const std::string &endpoint, const Job &job);
+
+        /**
+         * Queue a chunk once there is room
+         * @param job The chunk
+         * @return False if the striper has failed
+         */
+        bool enqueue(Job job);
+
+        /**
+         * Check whether a connection is among those in use; m_mutex must be held
+         * @param index The connection
+         * @return True if it may take chunks
+         */
+        bool eligible(std::size_t index) const;
+
+        /**
+         * Give up on a connection, closing it so its pending write fails unless it is the transfer's own;
+         * m_mutex must be held
+         * @param index The connection
+         * @param reason Why, for the log
+         */
+        void failStream(std::size_t index, const std::string &reason);
+
+        /**
+         * Give up on extra connections whose write has taken longer than STALL_TIMEOUT; m_mutex must be held
+         */
+        void checkStalls();
+
+        /**
+         * Count bytes queued, and add or settle on connections at the end of each window while tuning;
+         * m_mutex must be held
+         * @param bytes Bytes just queued
+         */
+        void record(std::size_t bytes);
+
+        network::SocketHandler &m_socketHandler;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::vector<Stream> m_streams;
+        std::deque<Job> m_queue;
+        bool m_closing = false;
+        bool m_failed = false; // The transfer's own connection was given up on, which ends the transfer
+
+        std::size_t m_active;
+        bool m_settled;
+        double m_bestRate = 0; // Bytes per second of the best window so far
+        std::chrono::steady_clock::time_point m_windowStart;
+        std::size_t m_windowBytes = 0;
+    };
+}
@@ -10,6 +10,10 @@
 #include <filesystem>
 #include <nlohmann/json.hpp>
 #include <fstream>
+#include <algorithm>
+#include <bit>
+#include <unordered_set>
+#include <limits>
 
 
 using json = nlohmann::json;
@@ -18,6 +22,21 @@ namespace fs = std::filesystem;
 
 namespace core {
 
+    static_assert(network::DEFAULT_CHUNK_SIZE <= utils::Compression::MAX_CHUNK_SIZE,
+                  "Compression must accept whole chunks");
+
+    namespace {
+        /**
+         * Check whether a chunk is marked in a chunk bitmap
+         * @param chunkMap Bitmap with bit i % 8 of byte i / 8 set for chunk i
+         * @param chunkIndex Index of the chunk
+         * @return True if the chunk is marked
+         */
+        bool hasChunk(const std::vector<uint8_t> &chunkMap, std::size_t chunkIndex) {
+            return chunkIndex / 8 < chunkMap.size() && ((chunkMap[chunkIndex / 8] >> (chunkIndex % 8)) & 1) != 0;
+        }
+    }
+
     // TransferInfo serialization/deserialization
     json TransferInfo::toJson() const {
         return {
@@ -34,7 +53,11 @@ namespace core {
                 {"progress",         progress},
                 {"startTime",        startTime},
                 {"endTime",          endTime},
-                {"errorMessage",     errorMessage}
+                {"errorMessage",     errorMessage},
+                {"hashAlgorithm",    hashAlgorithm},
+                {"fileHash",         fileHash},
+                {"compression",      compression},
+                {"cacheMode",        static_cast<int>(cacheMode)}
         };
     }
 
@@ -54,6 +77,10 @@ namespace core {
         info.startTime = j["startTime"].get<int64_t>();
         info.endTime = j["endTime"].get<int64_t>();
         info.errorMessage = j["errorMessage"].get<std::string>();
+        info.hashAlgorithm = j.value("hashAlgorithm", std::string());
+        info.fileHash = j.value("fileHash", std::string());
+        info.compression = j.value("compression", std::string());
+        info.cacheMode = static_cast<CacheMode>(j.value("cacheMode", 0));
         return info;
     }
 
@@ -135,855 +162,4431 @@ namespace core {
     }
 
     std::string TransferManager::sendFile(const std::string &peerId, const std::string &filePath) {
-        if (!m_initialized) {
-            SPDLOG_ERROR("TransferManager not initialized");
-            return "";
-        }
-
-        // Check if file exists
-        if (!m_fileHandler->fileExists(filePath)) {
-            SPDLOG_ERROR("File doesn't exist: {}", filePath);
-            return "";
-        }
+        return startOutgoingTransfer(peerId, filePath, nullptr);
+    }
 
-        // Get peer information
-        auto peer = getPeerInfo(peerId);
-        if (!peer) {
-            SPDLOG_ERROR("Peer not found: {}", peerId);
-            return "";
+    std::vector<std::string> TransferManager::sendFiles(const std::string &peerId,
+                                                        const std::vector<std::string> &filePaths, bool diskOrder) {
+        std::vector<std::string> transferIds(filePaths.size());
+        if (!diskOrder || filePaths.size() < 2) {
+            for (std::size_t i = 0; i < filePaths.size(); ++i) {
+                transferIds[i] = sendFile(peerId, filePaths[i]);
+            }
+            return transferIds;
         }
 
-        // Connect to peer if not already connected
-        if (!connectToPeer(*peer)) {
-            SPDLOG_ERROR("Failed to connect to peer: {}  ({})", peer->name, peer->id);
-            return "";
+        // The receiver sees the files in the given order; only the reads follow the disk layout
+        std::vector<std::size_t> readOrder = m_fileHandler->diskOrder(filePaths);
+        std::vector<std::size_t> turns(filePaths.size());
+        for (std::size_t turn = 0; turn < readOrder.size(); ++turn) {
+            turns[readOrder[turn]] = turn;
         }
 
-        try {
-            // Get file information
-            FileInfo fileInfo = m_fileHandler->getFileInfo(filePath);
-
-            // Create a new transfer record
-            auto transferId = generateTransferId();
-            auto transfer = std::make_shared<TransferInfo>();
-
-            transfer->id = transferId;
-            transfer->peerId = peerId;
-            transfer->peerName = peer->name;
-            transfer->peerAddress = peer->ipAddress + ":" + std::to_string(peer->port);
-            transfer->direction = TransferDirection::Outgoing;
-            transfer->status = TransferStatus::Initializing;
-            transfer->filePath = filePath;
-            transfer->fileName = fileInfo.name;
-            transfer->fileSize = fileInfo.size;
-            transfer->bytesTransferred = 0;
-            transfer->progress = 0.0f;
-            transfer->startTime = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
-            transfer->endTime = 0;
-
-            // Store the transfer
-            {
-                std::lock_guard<std::mutex> lock(m_transfersMutex);
-                m_transfers[transferId] = transfer;
-            }
+        auto scheduler = std::make_shared<ReadScheduler>(filePaths.size());
+        for (std::size_t i = 0; i < filePaths.size(); ++i) {
+            ReadTurn readTurn{scheduler, turns[i]};
+            transferIds[i] = startOutgoingTransfer(peerId, filePaths[i], &readTurn);
 
-            // Notify the status callback
-            if (m_statusCallback) {
-                m_statusCallback(*transfer);
+            // A file that never got a transfer must not hold up the ones behind it
+            if (transferIds[i].empty()) {
+                scheduler->finish(turns[i]);
             }
+        }
 
-            // Create and send transfer request message
-            network::TransferRequestMessage request;
-            request.transferId = transferId;
-            request.senderId = m_discoveryService->getPeerId();
-            request.senderName = m_discoveryService->getDisplayName();
-            request.fileName = fileInfo.name;
-            request.fileSize = fileInfo.size;
-            request.fileHash = ""; //TODO: implement file hashing
-
-            // Serialize and send the message
-            auto data = network::Protocol::serialize(request);
-            auto endpoint = peer->ipAddress + ":" + std::to_string(peer->port);
+        SPDLOG_INFO("Sending {} files to {} in on-disk read order", filePaths.size(), peerId);
+        return transferIds;
+    }
 
-            auto sendFuture = m_socketHandler->sendTcp(endpoint, data);
-            int result = sendFuture.get();
+    std::string TransferManager::sendDirectory(const std::string &peerId, const std::string &directoryPath,
+                                               bool hashFiles) {
+        auto directory = std::make_shared<OutgoingDirectory>();
+        directory->hashFiles = hashFiles;
 
-            if (result < 0) {
-                SPDLOG_ERROR("Failed to send transfer request to {}", endpoint);
+        try {
+            auto start = steady_clock::now();
+            directory->entries = DirectoryWalker::walk(directoryPath);
 
-                // Update transfer status
-                updateTransferStatus(transferId, TransferStatus::Failed, "Failed to send transfer request");
+            SPDLOG_INFO("Listed {} entries under {} in {} ms", directory->entries.size(), directoryPath,
+                        duration_cast<milliseconds>(steady_clock::now() - start).count());
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error listing directory {}: {}", directoryPath, e.what());
+            return "";
+        }
 
-                return "";
-            }
+        if (directory->entries.size() > UINT32_MAX) {
+            SPDLOG_ERROR("Too many entries under {}", directoryPath);
+            return "";
+        }
 
-            // Update transfer status
-            updateTransferStatus(transferId, TransferStatus::Waiting);
+        return startOutgoingTransfer(peerId, directoryPath, nullptr, std::move(directory));
+    }
 
-            SPDLOG_INFO("Transfer request sent to {}: {}", peer->name, fileInfo.name);
+    std::vector<std::string> TransferManager::sendBatch(std::span<const std::string> peers,
+                                                        std::span<const std::string> files) {
+        std::vector<std::string> transferIds(peers.size());
+        if (peers.empty() || files.empty()) {
+            return transferIds;
+        }
 
-            return transferId;
+        // Describe the files once; every peer gets the same manifest
+        OutgoingDirectory batch;
+        fs::path commonParent;
+        try {
+            std::unordered_set<std::string> usedNames;
+            for (const auto &file: files) {
+                fs::path path = fs::absolute(file).lexically_normal();
+                std::string name = path.filename().string();
+                std::string manifestName = name;
+                for (unsigned number = 1; !usedNames.insert(manifestName).second; ++number) {
+                    manifestName = FileHandler::numberedFilename(name, number);
+                }
 
+                batch.entries.push_back(DirectoryWalker::describe(path.string(), manifestName));
+                batch.sources.push_back(path.string());
+
+                // The batch is named after the deepest directory holding all of the files
+                fs::path parent = path.parent_path();
+                if (commonParent.empty()) {
+                    commonParent = parent;
+                } else {
+                    fs::path common;
+                    for (auto a = commonParent.begin(), b = parent.begin();
+                         a != commonParent.end() && b != parent.end() && *a == *b; ++a, ++b) {
+                        common /= *a;
+                    }
+                    commonParent = common;
+                }
+            }
         } catch (const std::exception &e) {
-            SPDLOG_ERROR("Error sending file: {}", e.what());
-            return "";
+            SPDLOG_ERROR("Error preparing batch: {}", e.what());
+            return transferIds;
         }
-    }
-
 
-    bool TransferManager::cancelTransfer(const std::string &transferId) {
-        if (!m_initialized) {
-            SPDLOG_ERROR("TransferManager not initialized");
-            return false;
+        if (batch.entries.size() > UINT32_MAX) {
+            SPDLOG_ERROR("Too many files in batch");
+            return transferIds;
         }
 
-        auto transfer = findTransfer(transferId);
-        if (!transfer) {
-            SPDLOG_ERROR("Transfer not found: {}", transferId);
-            return false;
+        // Connecting and waiting for each request to go out is what takes time, so peers are handled in parallel
+        std::vector<std::thread> requests;
+        requests.reserve(peers.size());
+        for (std::size_t i = 0; i < peers.size(); ++i) {
+            requests.emplace_back([this, &peers, &transferIds, &batch, &commonParent, i]() {
+                transferIds[i] = startOutgoingTransfer(peers[i], commonParent.string(), nullptr,
+                                                       std::make_shared<OutgoingDirectory>(batch));
+            });
+        }
+        for (auto &request: requests) {
+            request.join();
         }
 
-        // Only cancel if the transfer is active
-        if (transfer->status != TransferStatus::InProgress &&
-            transfer->status != TransferStatus::Initializing &&
-            transfer->status != TransferStatus::Waiting) {
-            SPDLOG_WARN("Transfer already completed or canceled: {}", transferId);
-            return false;
+        std::size_t started = std::count_if(transferIds.begin(), transferIds.end(),
+                                            [](const std::string &id) { return !id.empty(); });
+        SPDLOG_INFO("Batch of {} files offered to {} of {} peers", files.size(), started, peers.size());
+        return transferIds;
+    }
+
+    std::vector<std::string> TransferManager::sendFanOut(std::span<const std::string> peers,
+                                                         const std::string &filePath, bool detachSlowPeers) {
+        std::vector<std::string> transferIds(peers.size());
+        if (peers.empty()) {
+            return transferIds;
         }
 
+        std::shared_ptr<FanOutSource> source;
         try {
-            // Create and send cancel message
-            network::TransferCancelMessage cancel;
-            cancel.transferId = transferId;
-            cancel.reason = "Canceled by user";
+            std::uintmax_t fileSize = m_fileHandler->getFileInfo(filePath).size;
+            source = std::make_shared<FanOutSource>(filePath, peers.size(), network::DEFAULT_CHUNK_SIZE,
+                                                    FAN_OUT_RING_CHUNKS, cacheModeForSize(fileSize),
+                                                    detachSlowPeers ? FAN_OUT_DETACH_AFTER
+                                                                    : std::chrono::milliseconds(0));
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error opening {} for fan-out: {}", filePath, e.what());
+            return transferIds;
+        }
 
-            // Serialize and send the message
-            auto data = network::Protocol::serialize(cancel);
-            auto endpoint = transfer->peerAddress;
+        // Peers are asked concurrently, like a batch; each transfer reads through its own consumer of the source
+        std::vector<std::thread> requests;
+        requests.reserve(peers.size());
+        for (std::size_t i = 0; i < peers.size(); ++i) {
+            requests.emplace_back([this, &peers, &filePath, &transferIds, &source, i]() {
+                FanOutSlot slot{source, i};
+                transferIds[i] = startOutgoingTransfer(peers[i], filePath, nullptr, nullptr, &slot);
+
+                // A peer that never got a transfer must not hold up the others
+                if (transferIds[i].empty()) {
+                    source->release(i);
+                }
+            });
+        }
+        for (auto &request: requests) {
+            request.join();
+        }
 
-            auto sendFuture = m_socketHandler->sendTcp(endpoint, data);
-            sendFuture.get(); // Wait for send to complete, but ignore result
+        std::size_t started = std::count_if(transferIds.begin(), transferIds.end(),
+                                            [](const std::string &id) { return !id.empty(); });
+        SPDLOG_INFO("Fan-out of {} offered to {} of {} peers", filePath, started, peers.size());
+        return transferIds;
+    }
 
-            // Update transfer status
-            updateTransferStatus(transferId, TransferStatus::Canceled, "Canceled by user");
+    std::vector<std::string> TransferManager::sendSwarm(std::span<const std::string> peers,
+                                                        const std::string &filePath) {
+        std::vector<std::string> transferIds(peers.size());
+        if (peers.empty()) {
+            return transferIds;
+        }
 
-            SPDLOG_INFO("Transfer canceled: {}", transferId);
+        auto swarm = std::make_shared<OutgoingSwarm>();
+        swarm->id = generateTransferId();
+        swarm->filePath = filePath;
+        return offerSwarm(swarm, peers);
+    }
 
-            return true;
+    std::vector<std::string> TransferManager::sendMulticast(std::span<const std::string> peers,
+                                                            const std::string &filePath, bool forwardErrorCorrection) {
+        std::vector<std::string> transferIds(peers.size());
+        if (peers.empty()) {
+            return transferIds;
+        }
 
-        } catch (const std::exception &e) {
-            SPDLOG_ERROR("Error canceling transfer: {}", e.what());
+        if (isEncryptionEnabled()) {
+            SPDLOG_ERROR("Multicast transfers are not encrypted, refusing to multicast {}", filePath);
+            return transferIds;
+        }
 
-            // Update transfer status even if we couldn't send the cancel message
-            updateTransferStatus(transferId, TransferStatus::Canceled,
-                                 "Canceled by user (error: " + std::string(e.what()) + ")");
+        auto swarm = std::make_shared<OutgoingSwarm>();
+        swarm->id = generateTransferId();
+        swarm->filePath = filePath;
 
-            return true;
+        network::MulticastSession session;
+        session.group = m_multicastGroup;
+        session.port = m_multicastPort;
+        session.sessionId = std::random_device{}();
+        session.fecGroup = forwardErrorCorrection ? network::DEFAULT_MULTICAST_FEC_GROUP : 0;
+        try {
+            session.size = m_fileHandler->getFileInfo(filePath).size;
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error opening {} for multicast: {}", filePath, e.what());
+            return transferIds;
         }
+        swarm->multicast = session;
+
+        return offerSwarm(swarm, peers);
     }
 
+    std::vector<std::string> TransferManager::offerSwarm(const std::shared_ptr<OutgoingSwarm> &swarm,
+                                                         std::span<const std::string> peers) {
+        std::vector<std::string> transferIds(peers.size());
+        swarm->peerIds.assign(peers.begin(), peers.end());
+
+        // Peers are asked concurrently, like a batch; each one joins the swarm when its request goes out
+        std::vector<std::thread> requests;
+        requests.reserve(peers.size());
+        for (std::size_t i = 0; i < peers.size(); ++i) {
+            requests.emplace_back([this, &peers, &transferIds, &swarm, i]() {
+                transferIds[i] = startOutgoingTransfer(peers[i], swarm->filePath, nullptr, nullptr, nullptr, swarm);
+            });
+        }
+        for (auto &request: requests) {
+            request.join();
+        }
 
-    std::shared_ptr<TransferInfo> TransferManager::getTransferInfo(const std::string &transferId) const {
-        std::lock_guard<std::mutex> lock(m_transfersMutex);
+        std::size_t started = std::count_if(transferIds.begin(), transferIds.end(),
+                                            [](const std::string &id) { return !id.empty(); });
+        SPDLOG_INFO("Swarm {} of {} offered to {} of {} peers", swarm->id, swarm->filePath, started, peers.size());
+        if (started == 0) {
+            return transferIds;
+        }
 
-        auto it = m_transfers.find(transferId);
-        if (it != m_transfers.end()) {
-            return it->second;
+        {
+            std::lock_guard<std::mutex> lock(swarm->mutex);
+            swarm->transferIds = transferIds;
         }
 
-        return nullptr;
-    }
+        std::thread seedThread([this, swarm]() {
+            try {
+                seedSwarm(swarm);
+            } catch (const std::exception &e) {
+                SPDLOG_ERROR("Error seeding swarm {}: {}", swarm->id, e.what());
+                for (const auto &transferId: swarm->transferIds) {
+                    auto transfer = transferId.empty() ? nullptr : findTransfer(transferId);
+                    if (transfer && transfer->status == TransferStatus::InProgress) {
+                        updateTransferStatus(transferId, TransferStatus::Failed,
+                                             std::string("Error during transfer: ") + e.what());
+                    }
+                }
+            }
+        });
+        seedThread.detach();
 
-    std::vector<TransferInfo> TransferManager::getAllTransfers() const {
-        std::lock_guard<std::mutex> lock(m_transfersMutex);
+        return transferIds;
+    }
 
-        std::vector<TransferInfo> result;
-        result.reserve(m_transfers.size());
+    void TransferManager::seedSwarm(const std::shared_ptr<OutgoingSwarm> &swarm) {
+        // Members that have not answered by the deadline are sent to directly if they accept later
+        {
+            std::unique_lock<std::mutex> lock(swarm->mutex);
+            swarm->answered.wait_for(lock, SWARM_ANSWER_TIMEOUT, [&swarm]() { return swarm->unanswered.empty(); });
+            swarm->started = true;
+        }
 
-        for (const auto &[id, transfer]: m_transfers) {
-            result.push_back(*transfer);
+        std::vector<std::shared_ptr<TransferInfo>> members;
+        {
+            std::lock_guard<std::mutex> lock(swarm->mutex);
+            for (const auto &transferId: swarm->transferIds) {
+                auto transfer = swarm->joined.contains(transferId) ? findTransfer(transferId) : nullptr;
+                if (transfer && transfer->status == TransferStatus::InProgress) {
+                    members.push_back(std::move(transfer));
+                }
+            }
+        }
+        if (members.empty()) {
+            SPDLOG_INFO("No peer of swarm {} accepted the file", swarm->id);
+            return;
         }
 
-        return result;
-    }
+        if (swarm->multicast) {
+            completeSwarmMembers(members, seedMulticast(swarm, members));
+            return;
+        }
 
-    void TransferManager::registerStatusCallback(TransferStatusCallback callback) {
-        m_statusCallback = std::move(callback);
-    }
+        // A member that dropped out neither takes nor is passed any more chunks
+        std::vector<bool> dropped(members.size(), false);
+        auto isLive = [&members, &dropped](std::size_t member) {
+            return !dropped[member] && members[member]->status == TransferStatus::InProgress;
+        };
 
-    void TransferManager::registerRequestCallback(TransferRequestCallback callback) {
-        m_requestCallback = std::move(callback);
-    }
+        constexpr std::size_t chunkSize = network::DEFAULT_CHUNK_SIZE;
+        const auto &representative = members.front();
+        ReadAheadReader reader(swarm->filePath, chunkSize, 8, representative->cacheMode);
+        std::uintmax_t fileSize = reader.size();
+        std::size_t totalChunks = (fileSize + chunkSize - 1) / chunkSize;
+
+        // The file is read once, hashed with every algorithm the members negotiated
+        std::map<utils::HashAlgorithm, std::unique_ptr<utils::Hasher>> hashers;
+        for (const auto &member: members) {
+            auto algorithm = transferHashAlgorithm(*member);
+            if (!hashers.contains(algorithm)) {
+                hashers.emplace(algorithm, utils::Hashing::create(algorithm));
+            }
+        }
+        auto readChunk = [&](std::vector<uint8_t> &chunk) {
+            reader.readNext(chunk);
+            for (auto &[algorithm, hasher]: hashers) {
+                hasher->update(chunk.data(), chunk.size());
+            }
+        };
 
-    std::string TransferManager::getDefaultDownloadDirectory() const {
-        return m_downloadDirectory;
-    }
+        std::vector<uint8_t> firstChunk;
+        if (totalChunks > 0) {
+            readChunk(firstChunk);
+        }
 
-    void TransferManager::setDefaultDownloadDirectory(const std::string &directory) {
-        m_downloadDirectory = directory;
-        SPDLOG_DEBUG("Default download directory set to: {}", m_downloadDirectory);
-    }
+        // Frames name their compression, so one encoding serves every member whatever it negotiated
+        std::string mimeType = m_fileHandler->identifyMimeType(swarm->filePath, firstChunk);
+        bool tryCompress = representative->compression != "none" &&
+                           !utils::Compression::isPrecompressedMimeType(mimeType);
+
+        ChunkPipeline pipeline([this, representative, totalChunks, tryCompress](uint32_t chunkIndex,
+                                                                                ChunkBuffer &&chunk) {
+            auto dataMsg = encodeChunk(*representative, chunkIndex, totalChunks, std::move(chunk), tryCompress);
+            dataMsg.offset = static_cast<uint64_t>(chunkIndex) * chunkSize;
+            return dataMsg;
+        }, m_transformWorkers);
+
+        const std::size_t maxInFlight = pipeline.workerCount() * 2;
+        std::size_t chunksSubmitted = 0;
+
+        SPDLOG_INFO("Seeding swarm {}: {} in {} chunks to {} peers", swarm->id, swarm->filePath, totalChunks,
+                    members.size());
+
+        for (std::size_t i = 0; i < totalChunks; ++i) {
+            while (chunksSubmitted < totalChunks && pipeline.inFlight() < maxInFlight) {
+                std::vector<uint8_t> chunk;
+                if (chunksSubmitted == 0) {
+                    chunk = std::move(firstChunk);
+                } else {
+                    readChunk(chunk);
+                }
+                pipeline.submit(static_cast<uint32_t>(chunksSubmitted), std::move(chunk));
+                chunksSubmitted++;
+            }
 
-    void TransferManager::handleIncomingData(const std::vector<uint8_t> &data, const std::string &endpoint) {
-        try {
-            // Deserialize the message
-            auto message = network::Protocol::deserialize(data);
+            auto dataMsg = pipeline.next();
+            if (!dataMsg) {
+                throw std::runtime_error("Chunk pipeline stopped unexpectedly");
+            }
 
-            // Process based on message type
-            switch (message->type) {
-                case network::MessageType::TransferRequest: {
-                    auto request = dynamic_cast<network::TransferRequestMessage *>(message.get());
-                    processTransferRequest(*request, endpoint);
-                    break;
-                }
-                case network::MessageType::TransferResponse: {
-                    auto response = dynamic_cast<network::TransferResponseMessage *>(message.get());
-                    processTransferResponse(*response, endpoint);
-                    break;
+            // Members take chunks in turn and pass them on to the others; if one cannot, the next takes it
+            bool sent = false;
+            for (std::size_t attempt = 0; attempt < members.size() && !sent; ++attempt) {
+                std::size_t owner = (i + attempt) % members.size();
+                if (!isLive(owner)) {
+                    continue;
                 }
-                case network::MessageType::FileData: {
-                    auto fileData = dynamic_cast<network::FileDataMessage *>(message.get());
-                    processFileData(*fileData, endpoint);
-                    break;
+
+                dataMsg->transferId = members[owner]->id;
+                dataMsg->relayTo.clear();
+                for (std::size_t member = 0; member < members.size(); ++member) {
+                    if (member != owner && isLive(member)) {
+                        dataMsg->relayTo.push_back(members[member]->peerId);
+                    }
                 }
-                case network::MessageType::TransferComplete: {
-                    auto complete = dynamic_cast<network::TransferCompleteMessage *>(message.get());
-                    processTransferComplete(*complete, endpoint);
-                    break;
+
+                auto msgData = network::Protocol::serialize(*dataMsg);
+                if (m_socketHandler->sendTcp(members[owner]->peerAddress, msgData).get() < 0) {
+                    SPDLOG_ERROR("Failed to send chunk {}/{} to swarm peer {}", i, totalChunks,
+                                 members[owner]->peerName);
+                    updateTransferStatus(members[owner]->id, TransferStatus::Failed, "Failed to send file data");
+                    dropped[owner] = true;
+                    continue;
                 }
-                case network::MessageType::TransferCancel: {
-                    auto cancel = dynamic_cast<network::TransferCancelMessage *>(message.get());
-                    processTransferCancel(*cancel, endpoint);
-                    break;
+                sent = true;
+            }
+
+            if (!sent) {
+                SPDLOG_ERROR("Every peer of swarm {} dropped out", swarm->id);
+                return;
+            }
+
+            for (std::size_t member = 0; member < members.size(); ++member) {
+                if (isLive(member)) {
+                    updateTransferProgress(members[member]->id, fileSize * (i + 1) / totalChunks);
                 }
-                default:
-                    SPDLOG_ERROR("Unknown message type from {}", endpoint);
-                    break;
             }
+        }
 
-        } catch (const std::exception &e) {
-            SPDLOG_ERROR("Error processing message from {}: {}", endpoint, e.what());
+        std::map<utils::HashAlgorithm, std::string> fileHashes;
+        for (auto &[algorithm, hasher]: hashers) {
+            fileHashes[algorithm] = utils::Hashing::toHex(hasher->finish());
         }
+
+        std::erase_if(members, [](const auto &transfer) { return transfer->status != TransferStatus::InProgress; });
+        completeSwarmMembers(members, fileHashes);
+        SPDLOG_INFO("Swarm {} seeded: {} bytes read once for {} peers", swarm->id, fileSize, members.size());
     }
 
+    std::map<utils::HashAlgorithm, std::string> TransferManager::seedMulticast(
+            const std::shared_ptr<OutgoingSwarm> &swarm, const std::vector<std::shared_ptr<TransferInfo>> &members) {
+        FileReader reader(swarm->filePath);
+        reader.setCacheMode(members.front()->cacheMode == CacheMode::Normal ? CacheMode::Normal
+                                                                           : CacheMode::DropBehind);
+
+        // The first pass reads the file in order, so it is hashed on the way; repairs read behind it
+        std::map<utils::HashAlgorithm, std::unique_ptr<utils::Hasher>> hashers;
+        for (const auto &member: members) {
+            auto algorithm = transferHashAlgorithm(*member);
+            if (!hashers.contains(algorithm)) {
+                hashers.emplace(algorithm, utils::Hashing::create(algorithm));
+            }
+        }
+        uint64_t hashed = 0;
 
-    void TransferManager::handleConnectionStatus(network::ConnectionStatus status, const std::string &endpoint,
-                                                 const std::string &errorMessage) {
-        // Find transfers associated with this endpoint
-        auto transfer = findTransferByEndpoint(endpoint);
+        network::MulticastSender sender(*swarm->multicast, [&](uint64_t offset, std::span<uint8_t> buffer) {
+            std::size_t bytesRead = reader.readChunk(offset, buffer);
+            if (offset == hashed) {
+                for (auto &[algorithm, hasher]: hashers) {
+                    hasher->update(buffer.data(), bytesRead);
+                }
+                hashed += bytesRead;
+            }
+            return bytesRead;
+        }, members.size(), m_multicastRate, m_multicastInterface);
 
-        if (!transfer) {
-            // No transfer associated with this endpoint
-            return;
+        bool allDone = sender.run([this, &members](uint64_t bytesSent) {
+            for (const auto &member: members) {
+                if (member->status == TransferStatus::InProgress) {
+                    updateTransferProgress(member->id, bytesSent);
+                }
+            }
+        });
+        if (!allDone) {
+            SPDLOG_WARN("Not every receiver of multicast swarm {} confirmed the whole file", swarm->id);
         }
 
-        switch (status) {
-            case network::ConnectionStatus::Connected:
-                SPDLOG_DEBUG("Connection established for transfer {}", transfer->id);
-                break;
+        if (hashed != swarm->multicast->size) {
+            throw std::runtime_error("File changed during transfer: " + swarm->filePath);
+        }
 
-            case network::ConnectionStatus::Disconnected:
-                SPDLOG_INFO("Connection closed for transfer {}", transfer->id);
+        std::map<utils::HashAlgorithm, std::string> fileHashes;
+        for (auto &[algorithm, hasher]: hashers) {
+            fileHashes[algorithm] = utils::Hashing::toHex(hasher->finish());
+        }
+        return fileHashes;
+    }
 
-                // If the transfer was still in progress, mark it as failed
-                if (transfer->status == TransferStatus::InProgress ||
-                    transfer->status == TransferStatus::Initializing ||
-                    transfer->status == TransferStatus::Waiting) {
-                    updateTransferStatus(transfer->id, TransferStatus::Failed, "Connection closed unexpectedly");
-                }
-                break;
+    void TransferManager::completeSwarmMembers(const std::vector<std::shared_ptr<TransferInfo>> &members,
+                                               const std::map<utils::HashAlgorithm, std::string> &fileHashes) {
+        // A member only completes once it confirms, as data it is still missing may be on its way
+        for (const auto &transfer: members) {
+            if (transfer->status != TransferStatus::InProgress) {
+                continue;
+            }
 
-            case network::ConnectionStatus::Error:
-                SPDLOG_ERROR("Connection error for transfer {}: {}", transfer->id, errorMessage);
+            transfer->fileHash = fileHashes.at(transferHashAlgorithm(*transfer));
 
-                // Mark the transfer as failed
-                updateTransferStatus(transfer->id, TransferStatus::Failed, "Connection error: " + errorMessage);
-                break;
+            network::TransferCompleteMessage completeMsg;
+            completeMsg.transferId = transfer->id;
+            completeMsg.success = true;
+            completeMsg.fileHash = transfer->fileHash;
+
+            auto completeData = network::Protocol::serialize(completeMsg);
+            if (m_socketHandler->sendTcp(transfer->peerAddress, completeData).get() < 0) {
+                SPDLOG_ERROR("Failed to send transfer complete message for {}", transfer->id);
+                updateTransferStatus(transfer->id, TransferStatus::Failed, "Failed to send transfer complete message");
+            }
         }
     }
 
-    void TransferManager::processTransferRequest(const network::TransferRequestMessage &request,
-                                                 const std::string &endpoint) {
-        SPDLOG_INFO("Transfer request received from {} for file: {} ({})",
-                    request.senderName, request.fileName, request.fileSize);
+    bool TransferManager::answerSwarm(const std::string &transferId, bool multicastJoined) {
+        std::shared_ptr<OutgoingSwarm> swarm;
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            auto it = m_swarmMembers.find(transferId);
+            if (it == m_swarmMembers.end()) {
+                return false;
+            }
+            swarm = it->second;
+        }
 
-        // Create a new transfer record
-        auto transfer = std::make_shared<TransferInfo>();
+        bool seeded;
+        {
+            std::lock_guard<std::mutex> lock(swarm->mutex);
+            seeded = swarm->unanswered.erase(transferId) > 0 && !swarm->started &&
+                     (!swarm->multicast || multicastJoined);
+            if (seeded) {
+                swarm->joined.insert(transferId);
+            }
+        }
+        swarm->answered.notify_all();
 
-        transfer->id = request.transferId;
-        transfer->peerId = request.senderId;
-        transfer->peerName = request.senderName;
-        transfer->peerAddress = endpoint;
-        transfer->direction = TransferDirection::Incoming;
-        transfer->status = TransferStatus::Waiting;
-        transfer->fileName = request.fileName;
-        transfer->fileSize = request.fileSize;
-        transfer->bytesTransferred = 0;
-        transfer->progress = 0.0f;
-        transfer->startTime = duration_cast<milliseconds>(
-                system_clock::now().time_since_epoch()).count();
-        transfer->endTime = 0;
+        return seeded;
+    }
 
-        // Generate file path
-        //TODO: fix this conversion
-//        std::string filePath = fs::path(m_downloadDirectory) /
-//                               m_fileHandler->getUniqueFilename(m_downloadDirectory, request.fileName);
-        std::string filePath = "";
+    void TransferManager::releaseSwarmMember(const std::string &transferId) {
+        std::shared_ptr<OutgoingSwarm> swarm;
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            std::erase_if(m_incomingSwarms, [&transferId](const auto &entry) {
+                return entry.second->transferId == transferId;
+            });
+
+            auto it = m_swarmMembers.find(transferId);
+            if (it == m_swarmMembers.end()) {
+                return;
+            }
+            swarm = std::move(it->second);
+            m_swarmMembers.erase(it);
 
-        transfer->filePath = filePath;
+            if (std::none_of(m_swarmMembers.begin(), m_swarmMembers.end(),
+                             [&swarm](const auto &entry) { return entry.second == swarm; })) {
+                m_outgoingSwarms.erase(swarm->id);
+            }
+        }
 
-        // Store the transfer
+        // A member that ends before answering no longer holds up seeding
         {
-            std::lock_guard<std::mutex> lock(m_transfersMutex);
-            m_transfers[request.transferId] = transfer;
+            std::lock_guard<std::mutex> lock(swarm->mutex);
+            swarm->unanswered.erase(transferId);
         }
+        swarm->answered.notify_all();
+    }
 
-        // Check if we should accept the transfer
-        bool accepted = true;
+    void TransferManager::processChunkMissing(const network::ChunkMissingMessage &missing,
+                                              const std::string &endpoint) {
+        // A member asking for a chunk itself reports under its own transfer ID
+        std::shared_ptr<OutgoingSwarm> swarm;
+        std::string transferId;
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            if (auto it = m_outgoingSwarms.find(missing.transferId); it != m_outgoingSwarms.end()) {
+                swarm = it->second;
+            } else if (auto member = m_swarmMembers.find(missing.transferId);
+                    member != m_swarmMembers.end() && missing.peerId.empty()) {
+                swarm = member->second;
+                transferId = missing.transferId;
+            }
+        }
+        if (!swarm) {
+            SPDLOG_WARN("Chunk {} reported missing by {} for unknown swarm {}", missing.chunkIndex, endpoint,
+                        missing.transferId);
+            return;
+        }
 
-        if (m_requestCallback) {
-            accepted = m_requestCallback(*transfer);
+        if (transferId.empty()) {
+            std::lock_guard<std::mutex> lock(swarm->mutex);
+            auto it = std::find(swarm->peerIds.begin(), swarm->peerIds.end(), missing.peerId);
+            if (it != swarm->peerIds.end() && swarm->transferIds.size() == swarm->peerIds.size()) {
+                transferId = swarm->transferIds[it - swarm->peerIds.begin()];
+            }
         }
 
-        // Create and send response message
-        network::TransferResponseMessage response;
-        response.transferId = request.transferId;
-        response.accepted = accepted;
-        response.receiverId = m_discoveryService->getPeerId();
-        response.receiverName = m_discoveryService->getDisplayName();
-        response.filePath = filePath;
+        auto transfer = transferId.empty() ? nullptr : findTransfer(transferId);
+        if (!transfer || transfer->status != TransferStatus::InProgress) {
+            return;
+        }
 
-        // Serialize and send the message
-        auto data = network::Protocol::serialize(response);
+        SPDLOG_INFO("Resending chunk {} of swarm {} to {}", missing.chunkIndex, swarm->id, transfer->peerName);
 
-        auto sendFuture = m_socketHandler->sendTcp(endpoint, data);
-        int result = sendFuture.get();
+        // Read and sent from its own thread, as the report arrives on the io thread
+        std::thread resendThread([this, transfer, filePath = swarm->filePath, chunkIndex = missing.chunkIndex]() {
+            try {
+                constexpr std::size_t chunkSize = network::DEFAULT_CHUNK_SIZE;
+                std::uintmax_t offset = static_cast<std::uintmax_t>(chunkIndex) * chunkSize;
+                if (offset >= transfer->fileSize) {
+                    throw std::runtime_error("Chunk " + std::to_string(chunkIndex) + " is past the end of the file");
+                }
 
-        if (result < 0) {
-            SPDLOG_ERROR("Failed to send transfer response to {}", endpoint);
+                FileReader reader(filePath);
+                std::vector<uint8_t> chunk(static_cast<std::size_t>(
+                        std::min<std::uintmax_t>(chunkSize, transfer->fileSize - offset)));
+                if (reader.readChunk(offset, chunk) != chunk.size()) {
+                    throw std::runtime_error("File changed during transfer: " + filePath);
+                }
 
-            // Update transfer status
-            updateTransferStatus(request.transferId, TransferStatus::Failed, "Failed to send transfer response");
+                std::size_t totalChunks = (transfer->fileSize + chunkSize - 1) / chunkSize;
+                auto dataMsg = encodeChunk(*transfer, chunkIndex, static_cast<uint32_t>(totalChunks), std::move(chunk),
+                                           transfer->compression != "none");
+                dataMsg.offset = offset;
 
-            return;
+                auto msgData = network::Protocol::serialize(dataMsg);
+                if (m_socketHandler->sendTcp(transfer->peerAddress, msgData).get() < 0) {
+                    throw std::runtime_error("Failed to send file data");
+                }
+            } catch (const std::exception &e) {
+                SPDLOG_ERROR("Error resending chunk {} of transfer {}: {}", chunkIndex, transfer->id, e.what());
+                updateTransferStatus(transfer->id, TransferStatus::Failed,
+                                     std::string("Error during transfer: ") + e.what());
+            }
+        });
+        resendThread.detach();
+    }
+
+    void TransferManager::queueRelay(const std::string &swarmId, const std::shared_ptr<IncomingSwarm> &swarm,
+                                     const network::FileDataMessage &fileData) {
+        IncomingSwarm::Relay relay;
+        relay.message = fileData;
+        relay.message.transferId = swarmId;
+        relay.message.relayTo.clear();
+        relay.peerIds = fileData.relayTo;
+
+        bool startRelaying;
+        {
+            std::lock_guard<std::mutex> lock(swarm->mutex);
+            swarm->relays.push_back(std::move(relay));
+            startRelaying = !swarm->relaying;
+            swarm->relaying = true;
         }
 
-        // Update transfer status based on response
-        if (accepted) {
-            updateTransferStatus(request.transferId, TransferStatus::Waiting, "Waiting for file data");
-            SPDLOG_INFO("Transfer accepted: {}", request.transferId);
-        } else {
-            updateTransferStatus(request.transferId, TransferStatus::Canceled, "Transfer rejected by user");
-            SPDLOG_INFO("Transfer rejected: {}", request.transferId);
+        // Frames are serialized and sent off the io thread, which must keep draining the sockets
+        if (startRelaying) {
+            std::thread relayThread([this, swarmId, swarm]() {
+                relayChunks(swarmId, swarm);
+            });
+            relayThread.detach();
         }
     }
 
+    void TransferManager::relayChunks(const std::string &swarmId, const std::shared_ptr<IncomingSwarm> &swarm) {
+        while (true) {
+            IncomingSwarm::Relay relay;
+            {
+                std::lock_guard<std::mutex> lock(swarm->mutex);
+                if (swarm->relays.empty()) {
+                    swarm->relaying = false;
+                    return;
+                }
+                relay = std::move(swarm->relays.front());
+                swarm->relays.pop_front();
+            }
 
-    void TransferManager::processTransferResponse(const network::TransferResponseMessage &response,
-                                                  const std::string &endpoint) {
-        auto transfer = findTransfer(response.transferId);
+            auto msgData = network::Protocol::serialize(relay.message);
+            for (const auto &peerId: relay.peerIds) {
+                bool sent = false;
+                if (auto peer = getPeerInfo(peerId)) {
+                    auto endpoint = peer->ipAddress + ":" + std::to_string(peer->port);
 
-        if (!transfer) {
-            SPDLOG_ERROR("Received response for unknown transfer: {}", response.transferId);
-            return;
-        }
+                    bool connect;
+                    {
+                        std::lock_guard<std::mutex> lock(swarm->mutex);
+                        connect = swarm->connected.insert(endpoint).second;
+                    }
+                    if (connect && !connectToPeer(*peer)) {
+                        std::lock_guard<std::mutex> lock(swarm->mutex);
+                        swarm->connected.erase(endpoint);
+                    } else {
+                        for (int attempt = 0; attempt < SWARM_RELAY_ATTEMPTS && !sent; ++attempt) {
+                            if (attempt > 0) {
+                                std::this_thread::sleep_for(SWARM_RELAY_RETRY_DELAY);
+                            }
+                            sent = m_socketHandler->sendTcp(endpoint, msgData).get() >= 0;
+                        }
+                    }
+                }
 
-        SPDLOG_INFO("Transfer response received from {}: {}",
-                    response.receiverName, response.accepted ? "Accepted" : "Rejected");
+                if (sent) {
+                    continue;
+                }
 
-        if (!response.accepted) {
-            // Transfer was rejected
-            updateTransferStatus(response.transferId, TransferStatus::Canceled, "Transfer rejected by recipient");
-            return;
+                // The sender sends the chunk itself instead
+                SPDLOG_WARN("Could not pass chunk {} of swarm {} on to peer {}", relay.message.chunkIndex, swarmId,
+                            peerId);
+
+                network::ChunkMissingMessage missing;
+                missing.transferId = swarmId;
+                missing.chunkIndex = relay.message.chunkIndex;
+                missing.peerId = peerId;
+
+                auto transfer = findTransfer(swarm->transferId);
+                if (!transfer ||
+                    m_socketHandler->sendTcp(transfer->peerAddress, network::Protocol::serialize(missing)).get() < 0) {
+                    SPDLOG_ERROR("Could not report chunk {} of swarm {} missing", relay.message.chunkIndex, swarmId);
+                }
+            }
         }
+    }
 
-        // Transfer was accepted, begin sending file data
-        updateTransferStatus(response.transferId, TransferStatus::InProgress);
+    void TransferManager::awaitRelayedChunks(const std::shared_ptr<IncomingSwarm> &swarm, uint32_t before) {
+        bool startWatching = false;
+        {
+            std::lock_guard<std::mutex> lock(swarm->mutex);
+            auto deadline = std::chrono::steady_clock::now() + SWARM_RELAY_DEADLINE;
+            for (; swarm->awaitedFrom < before; ++swarm->awaitedFrom) {
+                swarm->awaited.emplace(swarm->awaitedFrom, deadline);
+            }
 
-        // Start a new thread to handle the file transfer
-        std::thread transferThread([this, transfer, endpoint]() {
-            try {
-                // Calculate file hash before transfer
-                std::string fileHash;
-#ifdef ENABLE_ENCRYPTION
-                fileHash = utils::Encryption::calculateFileHash(transfer->filePath);
-                SPDLOG_DEBUG("File hash calculated: {}", fileHash);
-#endif
+            startWatching = !swarm->awaited.empty() && !swarm->watching;
+            swarm->watching = swarm->watching || startWatching;
+        }
 
-                // Read the file
-                std::vector<uint8_t> fileData = m_fileHandler->readFile(
-                        transfer->filePath,
-                        [this, transfer](std::uintmax_t bytesProcessed, std::uintmax_t totalBytes,
-                                         const std::string &fileName) {
-                            // Update progress during file read
-                            float progress = static_cast<float>(bytesProcessed) / totalBytes * 50.0f; // 50% for read
-                            updateTransferProgress(transfer->id, bytesProcessed);
-//                            updateTransferProgress(transfer->id, bytesProcessed);
-                        }
-                );
+        if (startWatching) {
+            std::thread watchThread([this, swarm]() {
+                watchRelayedChunks(swarm);
+            });
+            watchThread.detach();
+        }
+    }
 
-                // Encrypt file data if encryption is enabled
-#ifdef ENABLE_ENCRYPTION
-                if (!m_encryptionPassword.empty()) {
-                    SPDLOG_INFO("Encrypting file data for transfer: {}", transfer->id);
-                    std::vector<uint8_t> encryptedData;
-                    if (utils::Encryption::encrypt(fileData, m_encryptionPassword, encryptedData)) {
-                        fileData = std::move(encryptedData);
-                        SPDLOG_INFO("File data encrypted successfully: {} -> {} bytes",
-                                    transfer->fileSize, fileData.size());
+    void TransferManager::watchRelayedChunks(const std::shared_ptr<IncomingSwarm> &swarm) {
+        while (true) {
+            std::this_thread::sleep_for(SWARM_RELAY_CHECK_INTERVAL);
+
+            auto transfer = findTransfer(swarm->transferId);
+            std::vector<uint32_t> overdue;
+            {
+                std::lock_guard<std::mutex> lock(swarm->mutex);
+                bool active = transfer && (transfer->status == TransferStatus::Waiting ||
+                                           transfer->status == TransferStatus::InProgress);
+                {
+                    std::lock_guard<std::mutex> dataLock(m_transferDataMutex);
+                    auto chunkMap = m_chunkMaps.find(swarm->transferId);
+                    if (!active || chunkMap == m_chunkMaps.end()) {
+                        swarm->awaited.clear();
                     } else {
-                        SPDLOG_ERROR("Failed to encrypt file data, continuing with unencrypted transfer");
+                        const auto &map = chunkMap->second;
+                        std::erase_if(swarm->awaited, [&map](const auto &entry) {
+                            return entry.first / 8 < map.size() && (map[entry.first / 8] & (1u << (entry.first % 8)));
+                        });
                     }
                 }
-#endif
-
-                // Calculate the number of chunks needed
-                constexpr std::size_t chunkSize = 1024 * 1024; // 1MB chunks
-                std::size_t totalChunks = (fileData.size() + chunkSize - 1) / chunkSize;
 
-                SPDLOG_INFO("Starting file transfer: {} in {} chunks", transfer->fileName, totalChunks);
+                if (swarm->awaited.empty()) {
+                    swarm->watching = false;
+                    return;
+                }
 
-                // Send file in chunks
-                for (std::size_t i = 0; i < totalChunks; ++i) {
-                    // Check if transfer has been canceled
-                    auto updatedTransfer = findTransfer(transfer->id);
-                    if (!updatedTransfer ||
-                        updatedTransfer->status == TransferStatus::Canceled ||
-                        updatedTransfer->status == TransferStatus::Failed) {
-                        SPDLOG_INFO("Transfer aborted during file send: {}", transfer->id);
-                        return;
+                // Asked for again after another deadline, in case the sender's copy goes astray too
+                auto now = std::chrono::steady_clock::now();
+                for (auto &[chunkIndex, deadline]: swarm->awaited) {
+                    if (deadline <= now) {
+                        overdue.push_back(chunkIndex);
+                        deadline = now + SWARM_RELAY_DEADLINE;
                     }
+                }
+            }
 
-                    // Calculate chunk bounds
-                    std::size_t startPos = i * chunkSize;
-                    std::size_t endPos = std::min(startPos + chunkSize, fileData.size());
-                    std::size_t chunkBytes = endPos - startPos;
-
-                    // Create a data chunk
-                    std::vector<uint8_t> chunkData(fileData.begin() + startPos, fileData.begin() + endPos);
+            for (uint32_t chunkIndex: overdue) {
+                SPDLOG_WARN("Chunk {} of transfer {} was not passed on in time, asking the sender", chunkIndex,
+                            transfer->id);
 
-                    // Create file data message
-                    network::FileDataMessage dataMsg;
-                    dataMsg.transferId = transfer->id;
-                    dataMsg.chunkIndex = i;
-                    dataMsg.totalChunks = totalChunks;
-                    dataMsg.data = std::move(chunkData);
+                network::ChunkMissingMessage missing;
+                missing.transferId = transfer->id;
+                missing.chunkIndex = chunkIndex;
 
-                    // Serialize and send the message
-                    auto msgData = network::Protocol::serialize(dataMsg);
-                    auto sendFuture = m_socketHandler->sendTcp(endpoint, msgData);
-                    int result = sendFuture.get();
+                if (m_socketHandler->sendTcp(transfer->peerAddress, network::Protocol::serialize(missing)).get() < 0) {
+                    SPDLOG_ERROR("Could not ask for chunk {} of transfer {}", chunkIndex, transfer->id);
+                }
+            }
+        }
+    }
 
-                    if (result < 0) {
-                        SPDLOG_ERROR("Failed to send file chunk {}/{} for transfer {}",
-                                     i, totalChunks, transfer->id);
-                        updateTransferStatus(transfer->id, TransferStatus::Failed,
-                                             "Failed to send file data");
-                        return;
-                    }
+    std::shared_ptr<TransferManager::IncomingSwarm> TransferManager::findIncomingSwarm(const std::string &transferId,
+                                                                                        std::string *swarmId) const {
+        std::lock_guard<std::mutex> lock(m_transferDataMutex);
+        for (const auto &[id, swarm]: m_incomingSwarms) {
+            if (swarm->transferId == transferId) {
+                if (swarmId) {
+                    *swarmId = id;
+                }
+                return swarm;
+            }
+        }
+        return nullptr;
+    }
 
-                    // Update progress - 50% (file read) + 50% (file send progress)
-                    std::uintmax_t totalProgress = transfer->fileSize / 2 +
-                                                   (transfer->fileSize / 2) * (i + 1) / totalChunks;
-                    updateTransferProgress(transfer->id, totalProgress);
+    std::string TransferManager::pullFile(std::span<const std::string> peers, const std::string &fileHash,
+                                          utils::HashAlgorithm hashAlgorithm) {
+        if (!m_initialized) {
+            SPDLOG_ERROR("TransferManager not initialized");
+            return "";
+        }
 
-                    // Add a small delay to avoid overwhelming the network
-                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                }
+        if (peers.empty() || fileHash.empty()) {
+            SPDLOG_ERROR("A pull needs a file hash and at least one peer");
+            return "";
+        }
 
-                // Send transfer complete message
-                network::TransferCompleteMessage completeMsg;
-                completeMsg.transferId = transfer->id;
-                completeMsg.success = true;
-                completeMsg.fileHash = ""; // TODO: Implement file hashing
+        auto pull = std::make_shared<IncomingPull>();
+        pull->fileHash = fileHash;
+        pull->hashAlgorithm = hashAlgorithm;
+        for (const auto &peerId: peers) {
+            IncomingPull::Source source;
+            source.peerId = peerId;
+            if (auto peer = getPeerInfo(peerId)) {
+                source.endpoint = peer->ipAddress + ":" + std::to_string(peer->port);
+                source.peerName = peer->name;
+            } else {
+                SPDLOG_WARN("Peer not found, not pulling from it: {}", peerId);
+                source.answered = true;
+            }
+            pull->sources.push_back(std::move(source));
+        }
 
-                // Serialize and send the message
-                auto completeData = network::Protocol::serialize(completeMsg);
-                auto completeFuture = m_socketHandler->sendTcp(endpoint, completeData);
-                int completeResult = completeFuture.get();
+        // Named after the hash until a source tells us the file's name and size
+        auto transfer = std::make_shared<TransferInfo>();
+        transfer->id = generateTransferId();
+        transfer->direction = TransferDirection::Incoming;
+        transfer->status = TransferStatus::Initializing;
+        transfer->fileName = fileHash;
+        transfer->fileSize = 0;
+        transfer->bytesTransferred = 0;
+        transfer->progress = 0.0f;
+        transfer->startTime = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        transfer->endTime = 0;
+        transfer->hashAlgorithm = utils::Hashing::toString(hashAlgorithm);
+        transfer->compression = utils::Compression::toString(m_compressionAlgorithm);
 
-                if (completeResult < 0) {
-                    SPDLOG_ERROR("Failed to send transfer complete message for {}", transfer->id);
-                    updateTransferStatus(transfer->id, TransferStatus::Failed,
-                                         "Failed to send transfer complete message");
-                    return;
-                }
+        {
+            std::lock_guard<std::mutex> lock(m_transfersMutex);
+            m_transfers[transfer->id] = transfer;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            m_incomingPulls[transfer->id] = pull;
+        }
 
-                // Update transfer status
-                updateTransferProgress(transfer->id, transfer->fileSize);
-                updateTransferStatus(transfer->id, TransferStatus::Completed);
+        if (m_statusCallback) {
+            m_statusCallback(*transfer);
+        }
 
-                SPDLOG_INFO("Transfer completed: {}", transfer->id);
+        std::thread pullThread([this, transfer, pull]() {
+            try {
+                runPull(transfer, pull);
             } catch (const std::exception &e) {
-                SPDLOG_ERROR("Error during file transfer {}: {}", transfer->id, e.what());
-                updateTransferStatus(transfer->id, TransferStatus::Failed,
-                                     std::string("Error during transfer: ") + e.what());
+                SPDLOG_ERROR("Error pulling {}: {}", pull->fileHash, e.what());
+                if (transfer->status == TransferStatus::Initializing ||
+                    transfer->status == TransferStatus::InProgress) {
+                    updateTransferStatus(transfer->id, TransferStatus::Failed,
+                                         std::string("Error during transfer: ") + e.what());
+                    releaseIncomingFile(transfer->id, false);
+                }
             }
         });
+        pullThread.detach();
 
-        // Detach the thread so it runs independently
-        transferThread.detach();
+        SPDLOG_INFO("Pulling {} from {} peers as transfer {}", fileHash, peers.size(), transfer->id);
+        return transfer->id;
     }
 
-    std::shared_ptr<TransferInfo> TransferManager::findTransferByEndpoint(const std::string &endpoint) {
-        std::lock_guard<std::mutex> lock(m_transfersMutex);
-
-        for (const auto &[id, transfer]: m_transfers) {
-            if (transfer->peerAddress == endpoint) {
-                return transfer;
-            }
+    std::string TransferManager::shareFile(const std::string &filePath, utils::HashAlgorithm hashAlgorithm) {
+        std::string fileHash = utils::Hashing::hashFile(filePath, hashAlgorithm);
+        if (fileHash.empty()) {
+            SPDLOG_ERROR("Failed to hash {} for sharing", filePath);
+            return "";
         }
 
-        return nullptr;
+        registerSharedFile(filePath, hashAlgorithm, fileHash);
+        SPDLOG_INFO("Sharing {} as {}", filePath, fileHash);
+        return fileHash;
     }
 
-    bool TransferManager::connectToPeer(const PeerInfo &peer) {
-        auto endpointStr = peer.ipAddress + ":" + std::to_string(peer.port);
+    void TransferManager::runPull(const std::shared_ptr<TransferInfo> &transfer,
+                                  const std::shared_ptr<IncomingPull> &pull) {
+        // Ask every source whether it holds the file; the chunks asked for later come back on the same connection
+        network::RangeRequestMessage probe;
+        probe.transferId = transfer->id;
+        probe.requesterId = m_discoveryService->getPeerId();
+        probe.fileHash = pull->fileHash;
+        probe.hashAlgorithm = transfer->hashAlgorithm;
+        auto probeData = network::Protocol::serialize(probe);
+
+        for (auto &source: pull->sources) {
+            if (source.endpoint.empty()) {
+                continue;
+            }
 
-        SPDLOG_INFO("Connecting to peer: {} ({}) at {}", peer.name, peer.id, endpointStr);
+            bool sent = false;
+            auto peer = getPeerInfo(source.peerId);
+            if (peer && connectToPeer(*peer)) {
+                for (int attempt = 0; attempt < PULL_REQUEST_ATTEMPTS && !sent; ++attempt) {
+                    if (attempt > 0) {
+                        std::this_thread::sleep_for(PULL_RETRY_DELAY);
+                    }
+                    sent = m_socketHandler->sendTcp(source.endpoint, probeData).get() >= 0;
+                }
+            }
 
-        // Check if we're already connected
+            if (!sent) {
+                SPDLOG_WARN("Could not ask peer {} for {}", source.peerId, pull->fileHash);
+                std::lock_guard<std::mutex> lock(pull->mutex);
+                source.answered = true;
+            }
+        }
+
+        // Start as soon as one source holds the file; the others join in as their answers arrive
+        std::string fileName;
+        std::uintmax_t fileSize = 0;
         {
-            std::lock_guard<std::mutex> lock(m_transfersMutex);
-            for (const auto &[id, transfer]: m_transfers) {
-                if (transfer->peerAddress == endpointStr) {
-                    return true; // Already connected
+            std::unique_lock<std::mutex> lock(pull->mutex);
+            auto firstAvailable = [&pull]() {
+                return std::find_if(pull->sources.begin(), pull->sources.end(),
+                                    [](const IncomingPull::Source &source) { return source.available; });
+            };
+            pull->changed.wait_for(lock, PULL_ANSWER_TIMEOUT, [&pull, &firstAvailable]() {
+                return firstAvailable() != pull->sources.end() ||
+                       std::all_of(pull->sources.begin(), pull->sources.end(),
+                                   [](const IncomingPull::Source &source) { return source.answered; });
+            });
+
+            auto source = firstAvailable();
+            if (source == pull->sources.end()) {
+                throw std::runtime_error("No peer holds the file");
+            }
+
+            fileName = fs::path(source->fileName).filename().string();
+            if (fileName.empty() || fileName == "." || fileName == "..") {
+                fileName = pull->fileHash;
+            }
+            fileSize = source->fileSize;
+            transfer->peerId = source->peerId;
+            transfer->peerName = source->peerName;
+            transfer->peerAddress = source->endpoint;
+        }
+
+        if (transfer->status != TransferStatus::Initializing) {
+            return;
+        }
+
+        transfer->fileName = fileName;
+        transfer->fileSize = fileSize;
+        transfer->cacheMode = cacheModeForSize(fileSize);
+
+        std::error_code error;
+        auto fileWriter = m_fileHandler->createUniqueWriter(m_downloadDirectory, fileName, fileSize, nullptr, &error);
+        if (!fileWriter) {
+            throw std::runtime_error(error == std::errc::no_space_on_device ? "Not enough disk space"
+                                                                            : "Failed to create file");
+        }
+        fileWriter->setDurability(m_durability);
+        fileWriter->setCacheMode(transfer->cacheMode);
+        transfer->filePath = fileWriter->path();
+
+        auto writer = std::make_shared<WriteBehindWriter>(std::move(fileWriter), network::DEFAULT_CHUNK_SIZE,
+                                                          writeBehindDepth(fileSize));
+        auto totalChunks = static_cast<uint32_t>((fileSize + network::DEFAULT_CHUNK_SIZE - 1) /
+                                                 network::DEFAULT_CHUNK_SIZE);
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            m_fileWriters[transfer->id] = writer;
+            m_chunkMaps[transfer->id].assign((totalChunks + 7) / 8, 0);
+            m_transferChunksReceived[transfer->id] = 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(pull->mutex);
+            pull->fileSize = fileSize;
+            pull->totalChunks = totalChunks;
+            for (uint32_t first = 0; first < totalChunks; first += PULL_RANGE_CHUNKS) {
+                pull->pending.push_back(first);
+            }
+            for (auto &source: pull->sources) {
+                if (source.available && source.fileSize != fileSize) {
+                    SPDLOG_WARN("Peer {} holds {} with a different size, not pulling from it", source.peerName,
+                                pull->fileHash);
+                    source.available = false;
+                }
+            }
+            pull->started = true;
+        }
+
+        SPDLOG_INFO("File will be saved to: {}", transfer->filePath);
+        updateTransferStatus(transfer->id, TransferStatus::InProgress);
+
+        if (totalChunks == 0) {
+            completeIncomingData(transfer, writer, transfer->peerAddress);
+            return;
+        }
+
+        // Keep every source busy until the file is in or no source is left
+        while (transfer->status == TransferStatus::InProgress) {
+            std::vector<std::pair<std::string, network::RangeRequestMessage>> requests;
+            {
+                std::unique_lock<std::mutex> lock(pull->mutex);
+                requests = assignPullRanges(*transfer, *pull);
+
+                bool anySource = std::any_of(pull->sources.begin(), pull->sources.end(),
+                                             [](const IncomingPull::Source &source) { return source.available; });
+                if (!anySource && !pull->pending.empty()) {
+                    lock.unlock();
+                    SPDLOG_ERROR("No peer left to pull {} from", pull->fileHash);
+                    updateTransferStatus(transfer->id, TransferStatus::Failed, "No peer left to pull the file from");
+                    releaseIncomingFile(transfer->id, false);
+                    return;
+                }
+
+                if (requests.empty()) {
+                    pull->changed.wait_for(lock, PULL_SCHEDULE_INTERVAL);
+                    continue;
+                }
+            }
+
+            for (const auto &[endpoint, request]: requests) {
+                if (m_socketHandler->sendTcp(endpoint, network::Protocol::serialize(request)).get() >= 0) {
+                    continue;
+                }
+
+                SPDLOG_WARN("Could not ask {} for chunks {}-{} of {}", endpoint, request.firstChunk,
+                            request.firstChunk + request.chunkCount - 1, pull->fileHash);
+                std::lock_guard<std::mutex> lock(pull->mutex);
+                for (auto &source: pull->sources) {
+                    if (source.endpoint == endpoint && source.available) {
+                        dropPullSource(*pull, source);
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<std::pair<std::string, network::RangeRequestMessage>> TransferManager::assignPullRanges(
+            const TransferInfo &transfer, IncomingPull &pull) {
+        std::vector<std::pair<std::string, network::RangeRequestMessage>> requests;
+        auto now = steady_clock::now();
+
+        // A source that has delivered nothing for too long loses its ranges to the others
+        for (auto &source: pull.sources) {
+            if (source.available && !source.ranges.empty() &&
+                now - source.ranges.front().lastProgress > PULL_STALL_TIMEOUT) {
+                SPDLOG_WARN("Peer {} stalled on transfer {}, handing its chunks to the others", source.peerName,
+                            transfer.id);
+                dropPullSource(pull, source);
+            }
+        }
+
+        auto ask = [this, &transfer, &pull, &requests, now](IncomingPull::Source &source, uint32_t first,
+                                                             bool duplicated) {
+            IncomingPull::Range range;
+            range.first = first;
+            range.count = std::min(PULL_RANGE_CHUNKS, pull.totalChunks - first);
+            range.duplicated = duplicated;
+            range.requested = now;
+            range.lastProgress = now;
+            source.ranges.push_back(range);
+
+            network::RangeRequestMessage request;
+            request.transferId = transfer.id;
+            request.requesterId = m_discoveryService->getPeerId();
+            request.fileHash = pull.fileHash;
+            request.hashAlgorithm = transfer.hashAlgorithm;
+            if (m_compressionAlgorithm != utils::CompressionAlgorithm::None) {
+                request.compressionAlgorithms.push_back(utils::Compression::toString(m_compressionAlgorithm));
+                for (auto algorithm: {utils::CompressionAlgorithm::Lz4, utils::CompressionAlgorithm::Zstd}) {
+                    if (algorithm != m_compressionAlgorithm) {
+                        request.compressionAlgorithms.push_back(utils::Compression::toString(algorithm));
+                    }
+                }
+            }
+            request.firstChunk = range.first;
+            request.chunkCount = range.count;
+            requests.emplace_back(source.endpoint, std::move(request));
+        };
+
+        // Sources take the next pending range whenever they have room, so each one's share follows its speed
+        for (auto &source: pull.sources) {
+            while (source.available && source.ranges.size() < PULL_SOURCE_DEPTH && !pull.pending.empty()) {
+                ask(source, pull.pending.front(), false);
+                pull.pending.pop_front();
+            }
+        }
+
+        if (!pull.pending.empty()) {
+            return requests;
+        }
+
+        // With nothing left to hand out, an idle source also takes the range a slower one would finish last,
+        // if it would be done with it sooner; whichever copy arrives first is kept
+        constexpr double chunkSize = network::DEFAULT_CHUNK_SIZE;
+        for (auto &source: pull.sources) {
+            if (!source.available || !source.ranges.empty() || source.bytesPerSecond <= 0) {
+                continue;
+            }
+
+            IncomingPull::Range *slowest = nullptr;
+            double slowestFinish = 0;
+            for (auto &other: pull.sources) {
+                if (&other == &source || !other.available) {
+                    continue;
+                }
+
+                double finish = 0;
+                for (auto &range: other.ranges) {
+                    double remaining = (range.count - range.received) * chunkSize;
+                    finish += other.bytesPerSecond > 0 ? remaining / other.bytesPerSecond
+                                                       : std::numeric_limits<double>::infinity();
+                    if (!range.duplicated && finish > slowestFinish) {
+                        slowest = &range;
+                        slowestFinish = finish;
+                    }
+                }
+            }
+
+            if (slowest && slowestFinish > slowest->count * chunkSize / source.bytesPerSecond) {
+                slowest->duplicated = true;
+                ask(source, slowest->first, true);
+            }
+        }
+
+        return requests;
+    }
+
+    void TransferManager::notePullChunk(IncomingPull &pull, const std::string &endpoint, uint32_t chunkIndex) {
+        std::lock_guard<std::mutex> lock(pull.mutex);
+        auto source = std::find_if(pull.sources.begin(), pull.sources.end(),
+                                   [&endpoint](const IncomingPull::Source &source) {
+                                       return source.endpoint == endpoint;
+                                   });
+        if (source == pull.sources.end()) {
+            return;
+        }
+
+        // Chunks of a range another source already finished count for nothing
+        auto range = std::find_if(source->ranges.begin(), source->ranges.end(),
+                                  [chunkIndex](const IncomingPull::Range &range) {
+                                      return chunkIndex >= range.first && chunkIndex - range.first < range.count;
+                                  });
+        if (range == source->ranges.end()) {
+            return;
+        }
+
+        auto now = steady_clock::now();
+        range->lastProgress = now;
+        if (++range->received < range->count) {
+            return;
+        }
+
+        // Timed from when the source got to the range, not from when it was queued behind the one before
+        double seconds = duration<double>(now - std::max(range->requested, source->lastCompleted)).count();
+        if (seconds > 0) {
+            double rate = range->count * static_cast<double>(network::DEFAULT_CHUNK_SIZE) / seconds;
+            source->bytesPerSecond = source->bytesPerSecond > 0 ? (source->bytesPerSecond + rate) / 2 : rate;
+        }
+        source->lastCompleted = now;
+
+        uint32_t first = range->first;
+        bool duplicated = range->duplicated;
+        source->ranges.erase(range);
+        if (!source->ranges.empty()) {
+            source->ranges.front().lastProgress = now;
+        }
+
+        // The other copy of the range is no longer waited for
+        if (duplicated) {
+            for (auto &other: pull.sources) {
+                std::erase_if(other.ranges, [first](const IncomingPull::Range &range) { return range.first == first; });
+            }
+        }
+
+        pull.changed.notify_all();
+    }
+
+    void TransferManager::dropPullSource(IncomingPull &pull, IncomingPull::Source &source) {
+        source.available = false;
+
+        // Ranges no other source is working on are asked for next
+        for (auto range = source.ranges.rbegin(); range != source.ranges.rend(); ++range) {
+            bool elsewhere = false;
+            for (auto &other: pull.sources) {
+                for (auto &copy: other.ranges) {
+                    if (&other != &source && copy.first == range->first) {
+                        copy.duplicated = false;
+                        elsewhere = true;
+                    }
+                }
+            }
+            if (!elsewhere) {
+                pull.pending.push_front(range->first);
+            }
+        }
+        source.ranges.clear();
+
+        pull.changed.notify_all();
+    }
+
+    void TransferManager::dropPullSources(const std::string &endpoint) {
+        std::vector<std::shared_ptr<IncomingPull>> pulls;
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            for (const auto &[id, pull]: m_incomingPulls) {
+                pulls.push_back(pull);
+            }
+        }
+
+        for (const auto &pull: pulls) {
+            std::lock_guard<std::mutex> lock(pull->mutex);
+            for (auto &source: pull->sources) {
+                if (source.endpoint != endpoint) {
+                    continue;
+                }
+
+                source.answered = true;
+                if (source.available) {
+                    SPDLOG_WARN("Lost peer {} as a source of {}", source.peerName, pull->fileHash);
+                    dropPullSource(*pull, source);
+                }
+            }
+            pull->changed.notify_all();
+        }
+    }
+
+    std::shared_ptr<TransferManager::IncomingPull> TransferManager::findIncomingPull(
+            const std::string &transferId) const {
+        std::lock_guard<std::mutex> lock(m_transferDataMutex);
+        if (auto it = m_incomingPulls.find(transferId); it != m_incomingPulls.end()) {
+            return it->second;
+        }
+        return nullptr;
+    }
+
+    void TransferManager::registerSharedFile(const std::string &filePath, utils::HashAlgorithm hashAlgorithm,
+                                             const std::string &fileHash) {
+        std::lock_guard<std::mutex> lock(m_transferDataMutex);
+        m_sharedFiles[utils::Hashing::toString(hashAlgorithm) + ":" + fileHash] = filePath;
+    }
+
+    void TransferManager::processRangeRequest(const network::RangeRequestMessage &request,
+                                              const std::string &endpoint) {
+        bool serving;
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            auto &queue = m_rangeQueues[endpoint];
+            queue.requests.push_back(request);
+            serving = std::exchange(queue.serving, true);
+        }
+        if (serving) {
+            return;
+        }
+
+        // Answered from its own thread, as the request arrives on the io thread
+        std::thread rangeThread([this, endpoint]() {
+            while (true) {
+                network::RangeRequestMessage next;
+                {
+                    std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                    auto it = m_rangeQueues.find(endpoint);
+                    if (it == m_rangeQueues.end() || it->second.requests.empty()) {
+                        m_rangeQueues.erase(endpoint);
+                        return;
+                    }
+                    next = std::move(it->second.requests.front());
+                    it->second.requests.pop_front();
+                }
+                answerRangeRequest(next, endpoint);
+            }
+        });
+        rangeThread.detach();
+    }
+
+    void TransferManager::answerRangeRequest(const network::RangeRequestMessage &request,
+                                             const std::string &endpoint) {
+        std::string filePath;
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            if (auto it = m_sharedFiles.find(request.hashAlgorithm + ":" + request.fileHash);
+                    it != m_sharedFiles.end()) {
+                filePath = it->second;
+            }
+        }
+
+        network::RangeResponseMessage response;
+        response.transferId = request.transferId;
+        response.senderId = m_discoveryService->getPeerId();
+        response.senderName = m_discoveryService->getDisplayName();
+
+        try {
+            std::error_code ec;
+            std::uintmax_t fileSize = filePath.empty() ? 0 : fs::file_size(filePath, ec);
+            if (filePath.empty() || ec) {
+                throw std::runtime_error("File not shared");
+            }
+
+            if (request.chunkCount == 0) {
+                response.available = true;
+                response.fileName = fs::path(filePath).filename().string();
+                response.fileSize = fileSize;
+                if (m_socketHandler->sendTcp(endpoint, network::Protocol::serialize(response)).get() < 0) {
+                    SPDLOG_ERROR("Failed to answer range request from {}", endpoint);
+                }
+                return;
+            }
+
+            SPDLOG_DEBUG("Sending chunks {}-{} of {} to {}", request.firstChunk,
+                         request.firstChunk + request.chunkCount - 1, filePath, endpoint);
+
+            // Only what encoding a chunk needs; the requester keeps the transfer record
+            TransferInfo pull;
+            pull.id = request.transferId;
+            pull.compression = utils::Compression::toString(
+                    utils::Compression::negotiate(request.compressionAlgorithms));
+
+            constexpr std::size_t chunkSize = network::DEFAULT_CHUNK_SIZE;
+            auto totalChunks = static_cast<uint32_t>((fileSize + chunkSize - 1) / chunkSize);
+            auto end = static_cast<uint32_t>(std::min<uint64_t>(
+                    static_cast<uint64_t>(request.firstChunk) + request.chunkCount, totalChunks));
+
+            FileReader reader(filePath);
+            if (reader.size() != fileSize) {
+                throw std::runtime_error("File changed: " + filePath);
+            }
+
+            for (uint32_t chunkIndex = request.firstChunk; chunkIndex < end; ++chunkIndex) {
+                std::uintmax_t offset = static_cast<std::uintmax_t>(chunkIndex) * chunkSize;
+                std::vector<uint8_t> chunk(static_cast<std::size_t>(std::min<std::uintmax_t>(chunkSize,
+                                                                                             fileSize - offset)));
+                if (reader.readChunk(offset, chunk) != chunk.size()) {
+                    throw std::runtime_error("File changed: " + filePath);
+                }
+
+                auto dataMsg = encodeChunk(pull, chunkIndex, totalChunks, std::move(chunk),
+                                           pull.compression != "none");
+                dataMsg.offset = offset;
+
+                if (m_socketHandler->sendTcp(endpoint, network::Protocol::serialize(dataMsg)).get() < 0) {
+                    SPDLOG_ERROR("Failed to send chunk {} of {} to {}", chunkIndex, filePath, endpoint);
+                    break;
+                }
+            }
+        } catch (const std::exception &e) {
+            SPDLOG_WARN("Cannot serve {} to {}: {}", request.fileHash, endpoint, e.what());
+
+            // The requester asks another peer for the range
+            response.available = false;
+            response.reason = e.what();
+            if (m_socketHandler->sendTcp(endpoint, network::Protocol::serialize(response)).get() < 0) {
+                SPDLOG_ERROR("Failed to answer range request from {}", endpoint);
+            }
+        }
+
+#ifdef ENABLE_ENCRYPTION
+        // The transfer is the requester's, so the key used for it here lasts only as long as the request
+        std::lock_guard<std::mutex> lock(m_encryptionKeysMutex);
+        m_sendKeys.erase(request.transferId);
+#endif
+    }
+
+    void TransferManager::processRangeResponse(const network::RangeResponseMessage &response,
+                                               const std::string &endpoint) {
+        auto pull = findIncomingPull(response.transferId);
+        if (!pull) {
+            SPDLOG_DEBUG("Range response from {} for a pull that has ended: {}", endpoint, response.transferId);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(pull->mutex);
+        auto source = std::find_if(pull->sources.begin(), pull->sources.end(),
+                                   [&endpoint](const IncomingPull::Source &source) {
+                                       return source.endpoint == endpoint;
+                                   });
+        if (source == pull->sources.end()) {
+            SPDLOG_WARN("Range response for transfer {} from unexpected peer {}", response.transferId, endpoint);
+            return;
+        }
+
+        source->answered = true;
+        if (!response.senderName.empty()) {
+            source->peerName = response.senderName;
+        }
+
+        if (!response.available) {
+            SPDLOG_INFO("Peer {} cannot provide {}: {}", source->peerName, pull->fileHash, response.reason);
+            if (source->available) {
+                dropPullSource(*pull, *source);
+            }
+        } else if (pull->started && response.fileSize != pull->fileSize) {
+            SPDLOG_WARN("Peer {} holds {} with a different size, not pulling from it", source->peerName,
+                        pull->fileHash);
+        } else {
+            SPDLOG_INFO("Peer {} holds {} ({} bytes)", source->peerName, pull->fileHash, response.fileSize);
+            source->fileName = response.fileName;
+            source->fileSize = response.fileSize;
+            source->available = true;
+        }
+
+        pull->changed.notify_all();
+    }
+
+    std::string TransferManager::startOutgoingTransfer(const std::string &peerId, const std::string &filePath,
+                                                       const ReadTurn *readTurn,
+                                                       std::shared_ptr<OutgoingDirectory> directory,
+                                                       const FanOutSlot *fanOut,
+                                                       const std::shared_ptr<OutgoingSwarm> &swarm) {
+        if (!m_initialized) {
+            SPDLOG_ERROR("TransferManager not initialized");
+            return "";
+        }
+
+        // Check if file exists
+        if (!m_fileHandler->fileExists(filePath)) {
+            SPDLOG_ERROR("File doesn't exist: {}", filePath);
+            return "";
+        }
+
+        // Get peer information
+        auto peer = getPeerInfo(peerId);
+        if (!peer) {
+            SPDLOG_ERROR("Peer not found: {}", peerId);
+            return "";
+        }
+
+        // Connect to peer if not already connected
+        if (!connectToPeer(*peer)) {
+            SPDLOG_ERROR("Failed to connect to peer: {}  ({})", peer->name, peer->id);
+            return "";
+        }
+
+        try {
+            // Get file information; a directory is named after its last component and sized by its files
+            FileInfo fileInfo;
+            if (directory) {
+                fs::path normalized = fs::absolute(filePath).lexically_normal();
+                if (!normalized.has_filename()) {
+                    normalized = normalized.parent_path();
+                }
+                fileInfo.name = normalized.filename().string();
+                fileInfo.size = 0;
+                for (const auto &entry: directory->entries) {
+                    fileInfo.size += entry.size;
+                }
+            } else {
+                fileInfo = m_fileHandler->getFileInfo(filePath);
+            }
+
+            // Create a new transfer record
+            auto transferId = generateTransferId();
+            auto transfer = std::make_shared<TransferInfo>();
+
+            transfer->id = transferId;
+            transfer->peerId = peerId;
+            transfer->peerName = peer->name;
+            transfer->peerAddress = peer->ipAddress + ":" + std::to_string(peer->port);
+            transfer->direction = TransferDirection::Outgoing;
+            transfer->status = TransferStatus::Initializing;
+            transfer->filePath = filePath;
+            transfer->fileName = fileInfo.name;
+            transfer->fileSize = fileInfo.size;
+            transfer->cacheMode = cacheModeForSize(fileInfo.size);
+            transfer->bytesTransferred = 0;
+            transfer->progress = 0.0f;
+            transfer->startTime = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+            transfer->endTime = 0;
+
+            // Store the transfer
+            {
+                std::lock_guard<std::mutex> lock(m_transfersMutex);
+                m_transfers[transferId] = transfer;
+            }
+
+            // Registered before the request goes out, as the response may arrive right after it
+            if (readTurn || fanOut) {
+                std::lock_guard<std::mutex> lock(m_readTurnsMutex);
+                if (readTurn) {
+                    m_readTurns[transferId] = *readTurn;
+                }
+                if (fanOut) {
+                    m_fanOuts[transferId] = *fanOut;
+                }
+            }
+            if (directory) {
+                std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                m_outgoingDirectories[transferId] = directory;
+            }
+            if (swarm) {
+                {
+                    std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                    m_swarmMembers[transferId] = swarm;
+                    m_outgoingSwarms[swarm->id] = swarm;
+                }
+                std::lock_guard<std::mutex> lock(swarm->mutex);
+                swarm->unanswered.insert(transferId);
+            }
+
+            // Notify the status callback
+            if (m_statusCallback) {
+                m_statusCallback(*transfer);
+            }
+
+            // Create and send transfer request message
+            network::TransferRequestMessage request;
+            request.transferId = transferId;
+            request.senderId = m_discoveryService->getPeerId();
+            request.senderName = m_discoveryService->getDisplayName();
+            request.fileName = fileInfo.name;
+            request.fileSize = fileInfo.size;
+#ifdef ENABLE_ENCRYPTION
+            // Delta literals travel unencrypted, so only offer it for plain transfers
+            request.deltaSupported = m_encryptionPassword.empty();
+#else
+            request.deltaSupported = true;
+#endif
+
+            // Offer our preferred file hash first, then everything else we support
+            request.hashAlgorithms.push_back(utils::Hashing::toString(m_hashAlgorithm));
+            for (const auto &name: utils::Hashing::supportedFileHashes()) {
+                if (name != request.hashAlgorithms.front()) {
+                    request.hashAlgorithms.push_back(name);
+                }
+            }
+
+            // Offer our preferred compression first; the other algorithm remains acceptable
+            if (m_compressionAlgorithm != utils::CompressionAlgorithm::None) {
+                request.compressionAlgorithms.push_back(utils::Compression::toString(m_compressionAlgorithm));
+                for (auto algorithm: {utils::CompressionAlgorithm::Lz4, utils::CompressionAlgorithm::Zstd}) {
+                    if (algorithm != m_compressionAlgorithm) {
+                        request.compressionAlgorithms.push_back(utils::Compression::toString(algorithm));
+                    }
+                }
+            }
+
+            request.rawDataSupported = network::SocketHandler::isZeroCopySupported();
+
+            // A directory goes over as its manifest followed by encoded chunks of every file
+            if (directory) {
+                request.directory = true;
+                request.entryCount = static_cast<uint32_t>(directory->entries.size());
+                request.deltaSupported = false;
+                request.rawDataSupported = false;
+            }
+
+            // Every peer of a fan-out takes the same chunks from the shared reader, so none may skip ahead
+            if (fanOut) {
+                request.deltaSupported = false;
+                request.rawDataSupported = false;
+            }
+
+            // Swarm peers pass each other the frames they get, so every frame must be one any of them can take
+            if (swarm) {
+                request.swarmId = swarm->id;
+                request.deltaSupported = false;
+                request.rawDataSupported = false;
+
+                if (swarm->multicast) {
+                    request.multicastGroup = swarm->multicast->group;
+                    request.multicastPort = swarm->multicast->port;
+                    request.multicastSessionId = swarm->multicast->sessionId;
+                    request.multicastPacketSize = swarm->multicast->packetSize;
+                    request.multicastFecGroup = swarm->multicast->fecGroup;
+                }
+            }
+
+            // A large plain file may be striped across several connections, at least one per data interface
+            std::size_t streams = m_parallelStreams == 0 ? StreamStriper::MAX_STREAMS : m_parallelStreams;
+            if (!m_dataInterfaces.empty()) {
+                streams = std::max(streams, m_dataInterfaces.size() + 1);
+            }
+            if (!directory && !fanOut && !swarm && streams > 1 && fileInfo.size >= STRIPE_MIN_FILE_SIZE) {
+                request.streams = static_cast<uint32_t>(std::min(streams, StreamStriper::MAX_STREAMS));
+            }
+
+            // Serialize and send the message
+            auto data = network::Protocol::serialize(request);
+            auto endpoint = peer->ipAddress + ":" + std::to_string(peer->port);
+
+            auto sendFuture = m_socketHandler->sendTcp(endpoint, data);
+            int result = sendFuture.get();
+
+            if (result < 0) {
+                SPDLOG_ERROR("Failed to send transfer request to {}", endpoint);
+
+                // Update transfer status
+                updateTransferStatus(transferId, TransferStatus::Failed, "Failed to send transfer request");
+
+                {
+                    std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                    m_outgoingDirectories.erase(transferId);
+                }
+
+                // The fan-out's consumer is released by the caller
+                std::lock_guard<std::mutex> lock(m_readTurnsMutex);
+                m_fanOuts.erase(transferId);
+
+                return "";
+            }
+
+            // Update transfer status
+            updateTransferStatus(transferId, TransferStatus::Waiting);
+
+            SPDLOG_INFO("Transfer request sent to {}: {}", peer->name, fileInfo.name);
+
+            return transferId;
+
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error sending file: {}", e.what());
+            return "";
+        }
+    }
+
+
+    bool TransferManager::cancelTransfer(const std::string &transferId) {
+        if (!m_initialized) {
+            SPDLOG_ERROR("TransferManager not initialized");
+            return false;
+        }
+
+        auto transfer = findTransfer(transferId);
+        if (!transfer) {
+            SPDLOG_ERROR("Transfer not found: {}", transferId);
+            return false;
+        }
+
+        // Only cancel if the transfer is active
+        if (transfer->status != TransferStatus::InProgress &&
+            transfer->status != TransferStatus::Initializing &&
+            transfer->status != TransferStatus::Waiting) {
+            SPDLOG_WARN("Transfer already completed or canceled: {}", transferId);
+            return false;
+        }
+
+        try {
+            // Create and send cancel message
+            network::TransferCancelMessage cancel;
+            cancel.transferId = transferId;
+            cancel.reason = "Canceled by user";
+
+            // Serialize and send the message
+            auto data = network::Protocol::serialize(cancel);
+            auto endpoint = transfer->peerAddress;
+
+            auto sendFuture = m_socketHandler->sendTcp(endpoint, data);
+            sendFuture.get(); // Wait for send to complete, but ignore result
+
+            // Update transfer status
+            updateTransferStatus(transferId, TransferStatus::Canceled, "Canceled by user");
+
+            // Drop the partially written file
+            releaseIncomingFile(transferId, false);
+
+            SPDLOG_INFO("Transfer canceled: {}", transferId);
+
+            return true;
+
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error canceling transfer: {}", e.what());
+
+            // Update transfer status even if we couldn't send the cancel message
+            updateTransferStatus(transferId, TransferStatus::Canceled,
+                                 "Canceled by user (error: " + std::string(e.what()) + ")");
+
+            return true;
+        }
+    }
+
+
+    std::shared_ptr<TransferInfo> TransferManager::getTransferInfo(const std::string &transferId) const {
+        std::lock_guard<std::mutex> lock(m_transfersMutex);
+
+        auto it = m_transfers.find(transferId);
+        if (it != m_transfers.end()) {
+            return it->second;
+        }
+
+        return nullptr;
+    }
+
+    std::vector<TransferInfo> TransferManager::getAllTransfers() const {
+        std::lock_guard<std::mutex> lock(m_transfersMutex);
+
+        std::vector<TransferInfo> result;
+        result.reserve(m_transfers.size());
+
+        for (const auto &[id, transfer]: m_transfers) {
+            result.push_back(*transfer);
+        }
+
+        return result;
+    }
+
+    void TransferManager::registerStatusCallback(TransferStatusCallback callback) {
+        m_statusCallback = std::move(callback);
+    }
+
+    void TransferManager::registerRequestCallback(TransferRequestCallback callback) {
+        m_requestCallback = std::move(callback);
+    }
+
+    std::string TransferManager::getDefaultDownloadDirectory() const {
+        return m_downloadDirectory;
+    }
+
+    void TransferManager::setDefaultDownloadDirectory(const std::string &directory) {
+        m_downloadDirectory = directory;
+        SPDLOG_DEBUG("Default download directory set to: {}", m_downloadDirectory);
+    }
+
+    void TransferManager::handleIncomingData(const std::vector<uint8_t> &data, const std::string &endpoint) {
+        try {
+            // Deserialize the message
+            auto message = network::Protocol::deserialize(data);
+
+            // Process based on message type
+            switch (message->type) {
+                case network::MessageType::TransferRequest: {
+                    auto request = dynamic_cast<network::TransferRequestMessage *>(message.get());
+                    processTransferRequest(*request, endpoint);
+                    break;
+                }
+                case network::MessageType::TransferResponse: {
+                    auto response = dynamic_cast<network::TransferResponseMessage *>(message.get());
+                    processTransferResponse(*response, endpoint);
+                    break;
+                }
+                case network::MessageType::FileData: {
+                    auto fileData = dynamic_cast<network::FileDataMessage *>(message.get());
+                    processFileData(*fileData, endpoint);
+                    break;
+                }
+                case network::MessageType::TransferComplete: {
+                    auto complete = dynamic_cast<network::TransferCompleteMessage *>(message.get());
+                    processTransferComplete(*complete, endpoint);
+                    break;
+                }
+                case network::MessageType::TransferCancel: {
+                    auto cancel = dynamic_cast<network::TransferCancelMessage *>(message.get());
+                    processTransferCancel(*cancel, endpoint);
+                    break;
+                }
+                case network::MessageType::DeltaSignature: {
+                    auto signature = dynamic_cast<network::DeltaSignatureMessage *>(message.get());
+                    processDeltaSignature(*signature, endpoint);
+                    break;
+                }
+                case network::MessageType::DeltaData: {
+                    auto deltaData = dynamic_cast<network::DeltaDataMessage *>(message.get());
+                    processDeltaData(*deltaData, endpoint);
+                    break;
+                }
+                case network::MessageType::Dictionary: {
+                    auto dictionary = dynamic_cast<network::DictionaryMessage *>(message.get());
+                    processDictionary(*dictionary, endpoint);
+                    break;
+                }
+                case network::MessageType::Manifest: {
+                    auto manifest = dynamic_cast<network::ManifestMessage *>(message.get());
+                    processManifest(*manifest, endpoint);
+                    break;
+                }
+                case network::MessageType::ChunkMissing: {
+                    auto missing = dynamic_cast<network::ChunkMissingMessage *>(message.get());
+                    processChunkMissing(*missing, endpoint);
+                    break;
+                }
+                case network::MessageType::RangeRequest: {
+                    auto request = dynamic_cast<network::RangeRequestMessage *>(message.get());
+                    processRangeRequest(*request, endpoint);
+                    break;
+                }
+                case network::MessageType::RangeResponse: {
+                    auto response = dynamic_cast<network::RangeResponseMessage *>(message.get());
+                    processRangeResponse(*response, endpoint);
+                    break;
+                }
+                default:
+                    SPDLOG_ERROR("Unknown message type from {}", endpoint);
+                    break;
+            }
+
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error processing message from {}: {}", endpoint, e.what());
+        }
+    }
+
+
+    void TransferManager::handleConnectionStatus(network::ConnectionStatus status, const std::string &endpoint,
+                                                 const std::string &errorMessage) {
+        // A pull only loses the source, its other sources carry on
+        if (status != network::ConnectionStatus::Connected) {
+            dropPullSources(endpoint);
+        }
+
+        // Find transfers associated with this endpoint
+        auto transfer = findTransferByEndpoint(endpoint);
+
+        if (!transfer || findIncomingPull(transfer->id)) {
+            // No transfer associated with this endpoint, or a pull that already dropped the source
+            return;
+        }
+
+        switch (status) {
+            case network::ConnectionStatus::Connected:
+                SPDLOG_DEBUG("Connection established for transfer {}", transfer->id);
+                break;
+
+            case network::ConnectionStatus::Disconnected:
+                SPDLOG_INFO("Connection closed for transfer {}", transfer->id);
+
+                // If the transfer was still in progress, mark it as failed
+                if (transfer->status == TransferStatus::InProgress ||
+                    transfer->status == TransferStatus::Initializing ||
+                    transfer->status == TransferStatus::Waiting) {
+                    updateTransferStatus(transfer->id, TransferStatus::Failed, "Connection closed unexpectedly");
+
+                    // What has arrived so far is kept for the next attempt
+                    if (transfer->direction == TransferDirection::Incoming) {
+                        releaseIncomingFile(transfer->id, true);
+                    }
+                }
+                break;
+
+            case network::ConnectionStatus::Error:
+                SPDLOG_ERROR("Connection error for transfer {}: {}", transfer->id, errorMessage);
+
+                // Mark the transfer as failed
+                updateTransferStatus(transfer->id, TransferStatus::Failed, "Connection error: " + errorMessage);
+
+                if (transfer->direction == TransferDirection::Incoming) {
+                    releaseIncomingFile(transfer->id, true);
+                }
+                break;
+        }
+    }
+
+    void TransferManager::processTransferRequest(const network::TransferRequestMessage &request,
+                                                 const std::string &endpoint) {
+        SPDLOG_INFO("Transfer request received from {} for file: {} ({})",
+                    request.senderName, request.fileName, request.fileSize);
+
+        // Create a new transfer record
+        auto transfer = std::make_shared<TransferInfo>();
+
+        transfer->id = request.transferId;
+        transfer->peerId = request.senderId;
+        transfer->peerName = request.senderName;
+        transfer->peerAddress = endpoint;
+        transfer->direction = TransferDirection::Incoming;
+        transfer->status = TransferStatus::Waiting;
+        transfer->fileName = request.fileName;
+        transfer->fileSize = request.fileSize;
+        transfer->cacheMode = cacheModeForSize(request.fileSize);
+        transfer->bytesTransferred = 0;
+        transfer->progress = 0.0f;
+        transfer->startTime = duration_cast<milliseconds>(
+                system_clock::now().time_since_epoch()).count();
+        transfer->endTime = 0;
+        transfer->hashAlgorithm = utils::Hashing::toString(utils::Hashing::negotiate(request.hashAlgorithms));
+        transfer->compression = utils::Compression::toString(
+                utils::Compression::negotiate(request.compressionAlgorithms));
+
+        // The file path is generated once the transfer is accepted
+        std::string filePath = "";
+
+        // An older copy of the same file can serve as the basis for a delta transfer, which replaces it; any other
+        // file of that name is left alone and the new one saved beside it
+        std::error_code ec;
+        auto basisPath = fs::path(m_downloadDirectory) / fs::path(request.fileName).filename();
+        bool useDelta = request.deltaSupported && !request.directory && request.swarmId.empty() &&
+                        !isEncryptionEnabled() &&
+                        fs::is_regular_file(basisPath, ec) &&
+                        fs::file_size(basisPath, ec) >= DeltaSync::MIN_BASIS_SIZE &&
+                        isDeltaBasis(basisPath, request.senderId);
+        if (useDelta) {
+            filePath = basisPath.string();
+        }
+
+        transfer->filePath = filePath;
+
+        // Store the transfer
+        {
+            std::lock_guard<std::mutex> lock(m_transfersMutex);
+            m_transfers[request.transferId] = transfer;
+        }
+
+        // Check if we should accept the transfer
+        bool accepted = true;
+
+        if (m_requestCallback) {
+            accepted = m_requestCallback(*transfer);
+        }
+
+        // Reserve the whole file as soon as it is accepted, so a full disk fails the transfer before any data is sent
+        std::string rejectReason;
+        std::vector<uint8_t> resumeChunks;
+        std::shared_ptr<IncomingSwarm> incomingSwarm;
+        std::shared_ptr<WriteBehindWriter> swarmWriter;
+        if (accepted && request.directory) {
+            // Only the last component of the offered name is used, so the tree always lands in the download directory
+            std::string name = fs::path(request.fileName).filename().string();
+            if (name.empty() || name == "." || name == "..") {
+                name = "received";
+            }
+
+            filePath = m_fileHandler->createUniqueDirectory(m_downloadDirectory, name);
+            transfer->filePath = filePath;
+
+            if (filePath.empty()) {
+                accepted = false;
+                rejectReason = "Failed to create directory";
+            } else {
+                SPDLOG_INFO("Directory will be saved to: {} ({} entries)", filePath, request.entryCount);
+
+                auto directory = std::make_shared<IncomingDirectory>();
+                directory->root = filePath;
+                directory->entryCount = request.entryCount;
+
+                std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                m_incomingDirectories[transfer->id] = std::move(directory);
+            }
+        } else if (accepted && !useDelta) {
+            std::error_code error;
+            std::shared_ptr<FileWriter> fileWriter;
+
+            // Pick up the partial file of an interrupted attempt so its chunks are not sent again
+            filePath = findResumePoint(request, resumeChunks);
+            if (!filePath.empty()) {
+                fileWriter = m_fileHandler->resumeWriter(filePath, request.fileSize);
+            }
+
+            std::shared_ptr<WriteBehindWriter> writer;
+            while (!writer) {
+                if (!fileWriter) {
+                    resumeChunks.clear();
+                    fileWriter = m_fileHandler->createUniqueWriter(m_downloadDirectory, request.fileName,
+                                                                   request.fileSize, nullptr, &error);
+                    filePath = fileWriter ? fileWriter->path()
+                                          : (fs::path(m_downloadDirectory) / request.fileName).string();
+                    if (!fileWriter) {
+                        break;
+                    }
+                }
+
+                fileWriter->setDurability(m_durability);
+                fileWriter->setCacheMode(transfer->cacheMode);
+
+                int chunksKept = 0;
+                for (uint8_t byte: resumeChunks) {
+                    chunksKept += std::popcount(byte);
+                }
+
+                // Queue writes behind the io thread so it keeps draining the socket
+                auto candidate = std::make_shared<WriteBehindWriter>(std::move(fileWriter),
+                                                                     network::DEFAULT_CHUNK_SIZE,
+                                                                     writeBehindDepth(request.fileSize));
+
+                std::size_t totalChunks = (request.fileSize + network::DEFAULT_CHUNK_SIZE - 1) /
+                                          network::DEFAULT_CHUNK_SIZE;
+                std::vector<uint8_t> chunkMap = resumeChunks;
+                chunkMap.resize((totalChunks + 7) / 8);
+
+                std::lock_guard<std::mutex> lock(m_transferDataMutex);
+
+                // Checked in the same critical section that claims the file, so two attempts at the same transfer
+                // never both resume into one partial file; the loser starts a new one
+                bool inUse = std::any_of(m_fileWriters.begin(), m_fileWriters.end(), [&candidate](const auto &entry) {
+                    return entry.second->tempPath() == candidate->tempPath();
+                });
+                if (inUse) {
+                    SPDLOG_INFO("Partial file {} is already being written, starting a new one", filePath);
+                    continue;
+                }
+
+                writer = std::move(candidate);
+                m_fileWriters[transfer->id] = writer;
+                m_chunkMaps[transfer->id] = std::move(chunkMap);
+                m_transferChunksReceived[transfer->id] = chunksKept;
+
+                if (chunksKept > 0) {
+                    SPDLOG_INFO("Resuming {} with {} chunks already received", filePath, chunksKept);
+                } else {
+                    SPDLOG_INFO("File will be saved to: {}", filePath);
+                }
+
+                // Chunks other swarm peers pass on arrive under the swarm ID
+                if (!request.swarmId.empty()) {
+                    incomingSwarm = std::make_shared<IncomingSwarm>();
+                    incomingSwarm->transferId = transfer->id;
+                    m_incomingSwarms[request.swarmId] = incomingSwarm;
+                    swarmWriter = writer;
+                }
+            }
+            transfer->filePath = filePath;
+
+            if (!writer) {
+                accepted = false;
+                rejectReason = error == std::errc::no_space_on_device ? "Not enough disk space"
+                                                                      : "Failed to create file";
+            }
+        }
+
+        // Joined before answering, so we are in the group before the stream starts; a peer that cannot join is
+        // sent the file directly
+        bool multicastJoined = false;
+        if (incomingSwarm && !request.multicastGroup.empty()) {
+            network::MulticastSession session;
+            session.group = request.multicastGroup;
+            session.port = request.multicastPort;
+            session.sessionId = request.multicastSessionId;
+            session.size = request.fileSize;
+            session.packetSize = request.multicastPacketSize;
+            session.fecGroup = request.multicastFecGroup;
+            multicastJoined = joinMulticast(transfer, swarmWriter, incomingSwarm, session);
+        }
+
+        // Create and send response message
+        network::TransferResponseMessage response;
+        response.transferId = request.transferId;
+        response.accepted = accepted;
+        response.receiverId = m_discoveryService->getPeerId();
+        response.receiverName = m_discoveryService->getDisplayName();
+        response.filePath = filePath;
+        response.deltaRequested = accepted && useDelta;
+        response.hashAlgorithm = transfer->hashAlgorithm;
+        response.compression = transfer->compression;
+        response.dictionarySupported = true;
+        response.dictionaryIds = m_dictionaryStore.cachedIds();
+        response.rawDataAccepted = request.rawDataSupported && !request.directory &&
+                                   network::SocketHandler::isZeroCopySupported();
+        response.sparseSupported = !request.directory;
+        response.packedSupported = request.directory;
+        response.multicastJoined = multicastJoined;
+        response.reason = rejectReason;
+        response.resumeChunks = resumeChunks;
+
+        // Chunks may come over as many connections as offered, up to our limit; delta data keeps to one
+        if (accepted && !useDelta && !request.directory && request.swarmId.empty() && request.streams > 1) {
+            response.streams = static_cast<uint32_t>(std::min<std::size_t>(request.streams,
+                                                                           StreamStriper::MAX_STREAMS));
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            m_stripedTransfers[transfer->id].reset();
+        }
+
+        // Serialize and send the message
+        auto data = network::Protocol::serialize(response);
+
+        auto sendFuture = m_socketHandler->sendTcp(endpoint, data);
+        int result = sendFuture.get();
+
+        if (result < 0) {
+            SPDLOG_ERROR("Failed to send transfer response to {}", endpoint);
+
+            // Update transfer status
+            updateTransferStatus(request.transferId, TransferStatus::Failed, "Failed to send transfer response");
+
+            return;
+        }
+
+        // Update transfer status based on response
+        if (accepted) {
+            updateTransferStatus(request.transferId, TransferStatus::Waiting, "Waiting for file data");
+            SPDLOG_INFO("Transfer accepted: {}", request.transferId);
+
+            if (response.deltaRequested) {
+                // Send the signature of our existing copy so the sender only ships what changed
+                std::thread signatureThread([this, transfer, endpoint]() {
+                    try {
+                        FileSignature signature = DeltaSync::computeSignature(transfer->filePath);
+
+                        {
+                            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                            m_deltaAppliers[transfer->id] = std::make_shared<DeltaApplier>(
+                                    transfer->filePath, signature.blockSize, transfer->filePath,
+                                    transferHashAlgorithm(*transfer));
+                            m_transferChunksReceived[transfer->id] = 0;
+                        }
+
+                        network::DeltaSignatureMessage signatureMsg;
+                        signatureMsg.transferId = transfer->id;
+                        signatureMsg.blockSize = signature.blockSize;
+                        signatureMsg.basisSize = signature.fileSize;
+                        signatureMsg.signature = signature.pack();
+
+                        auto data = network::Protocol::serialize(signatureMsg);
+                        if (m_socketHandler->sendTcp(endpoint, data).get() < 0) {
+                            throw std::runtime_error("Failed to send delta signature");
+                        }
+
+                        SPDLOG_INFO("Delta signature sent for transfer {}: {} blocks",
+                                    transfer->id, signature.blocks.size());
+                    } catch (const std::exception &e) {
+                        SPDLOG_ERROR("Error preparing delta for transfer {}: {}", transfer->id, e.what());
+                        {
+                            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                            m_deltaAppliers.erase(transfer->id);
+                            m_transferChunksReceived.erase(transfer->id);
+                        }
+                        updateTransferStatus(transfer->id, TransferStatus::Failed,
+                                             std::string("Error preparing delta: ") + e.what());
+                    }
+                });
+                signatureThread.detach();
+            }
+        } else if (!rejectReason.empty()) {
+            updateTransferStatus(request.transferId, TransferStatus::Failed, rejectReason);
+            SPDLOG_ERROR("Transfer refused: {} ({})", request.transferId, rejectReason);
+        } else {
+            updateTransferStatus(request.transferId, TransferStatus::Canceled, "Transfer rejected by user");
+            SPDLOG_INFO("Transfer rejected: {}", request.transferId);
+        }
+    }
+
+
+    void TransferManager::processTransferResponse(const network::TransferResponseMessage &response,
+                                                  const std::string &endpoint) {
+        auto transfer = findTransfer(response.transferId);
+
+        if (!transfer) {
+            SPDLOG_ERROR("Received response for unknown transfer: {}", response.transferId);
+            return;
+        }
+
+        SPDLOG_INFO("Transfer response received from {}: {}",
+                    response.receiverName, response.accepted ? "Accepted" : "Rejected");
+
+        // The manifest of a directory transfer is only needed once, to send it
+        std::shared_ptr<OutgoingDirectory> directory;
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            if (auto it = m_outgoingDirectories.find(response.transferId); it != m_outgoingDirectories.end()) {
+                directory = std::move(it->second);
+                m_outgoingDirectories.erase(it);
+            }
+        }
+        if (directory) {
+            directory->packFiles = response.packedSupported;
+        }
+
+        if (!response.accepted) {
+            // Transfer was rejected
+            updateTransferStatus(response.transferId, TransferStatus::Canceled,
+                                 response.reason.empty() ? "Transfer rejected by recipient"
+                                                         : "Transfer refused by recipient: " + response.reason);
+            return;
+        }
+
+        // Use the hash algorithm the receiver picked from our offer
+        transfer->hashAlgorithm = utils::Hashing::fromString(response.hashAlgorithm)
+                ? response.hashAlgorithm : utils::Hashing::toString(utils::HashAlgorithm::Sha256);
+        transfer->compression = utils::Compression::fromString(response.compression)
+                ? response.compression : utils::Compression::toString(utils::CompressionAlgorithm::None);
+
+        // Transfer was accepted, begin sending file data
+        updateTransferStatus(response.transferId, TransferStatus::InProgress);
+
+        // Swarm members that answer in time are seeded together; later ones are sent the file directly below
+        if (answerSwarm(response.transferId, response.multicastJoined)) {
+            SPDLOG_INFO("Transfer {} joins its swarm", transfer->id);
+            return;
+        }
+
+        if (directory) {
+            std::thread directoryThread([this, transfer, endpoint, directory]() {
+                try {
+                    waitForReadTurn(transfer->id);
+                    sendDirectoryData(transfer, endpoint, *directory);
+                } catch (const std::exception &e) {
+                    SPDLOG_ERROR("Error during directory transfer {}: {}", transfer->id, e.what());
+                    updateTransferStatus(transfer->id, TransferStatus::Failed,
+                                         std::string("Error during transfer: ") + e.what());
+                }
+            });
+            directoryThread.detach();
+            return;
+        }
+
+        if (response.deltaRequested) {
+            // The receiver has an older copy; data is sent once its signature arrives
+            SPDLOG_INFO("Receiver requested a delta transfer for {}, waiting for signature", transfer->id);
+            return;
+        }
+
+        // Dictionaries the receiver can use without us shipping them again
+        bool dictionarySupported = response.dictionarySupported;
+        std::vector<uint32_t> receiverDictionaries = response.dictionaryIds;
+        bool rawDataAccepted = response.rawDataAccepted;
+        bool sparseSupported = response.sparseSupported;
+
+        // Chunks the receiver kept from an interrupted attempt are read for the hash but not sent
+        std::vector<uint8_t> resumeChunks = response.resumeChunks;
+
+        // Connections the receiver takes the chunks on, at most as many as we offered
+        std::size_t streams = std::clamp<std::size_t>(response.streams, 1, StreamStriper::MAX_STREAMS);
+
+        // Start a new thread to handle the file transfer
+        std::thread transferThread([this, transfer, endpoint, dictionarySupported, receiverDictionaries,
+                                    rawDataAccepted, sparseSupported, resumeChunks, streams]() {
+            try {
+                // Files of a multi-file send are read one at a time in on-disk order
+                waitForReadTurn(transfer->id);
+                if (transfer->status != TransferStatus::InProgress) {
+                    SPDLOG_INFO("Transfer {} ended while waiting to read its file", transfer->id);
+                    return;
+                }
+
+                // Chunks are compressed then encrypted individually; skip formats that are already compressed
+                bool compressing = transfer->compression != "none";
+
+#ifdef ENABLE_ENCRYPTION
+                bool encrypting = !m_encryptionPassword.empty();
+#else
+                bool encrypting = false;
+#endif
+
+                // A file going to several peers is read once, through the fan-out's shared reader
+                FanOutSlot fanOut = findFanOut(transfer->id);
+
+                // Chunks that would go out unchanged skip user space entirely; whether they would depends on
+                // the content, so only its first bytes are read here
+                bool sendRaw = rawDataAccepted && !encrypting && !fanOut.source;
+                if (sendRaw && compressing) {
+                    sendRaw = utils::Compression::isPrecompressedMimeType(
+                            m_fileHandler->identifyMimeType(transfer->filePath));
+                }
+                if (sendRaw) {
+                    sendRawFileData(transfer, endpoint, sparseSupported, resumeChunks, streams);
+                    return;
+                }
+
+                constexpr std::size_t chunkSize = network::DEFAULT_CHUNK_SIZE;
+                constexpr std::size_t prefetchChunks = 8;
+
+                // Queue reads through io_uring when the kernel allows it, otherwise map the file;
+                // files that must not fill the page cache are always streamed so their pages can be dropped
+                std::unique_ptr<ReadAheadReader> reader;
+                std::unique_ptr<MappedFile> mappedFile;
+                if (fanOut.source) {
+                    // Chunks come from the shared reader
+                } else if (ReadAheadReader::isIoUringAvailable() || transfer->cacheMode != CacheMode::Normal) {
+                    reader = std::make_unique<ReadAheadReader>(transfer->filePath, chunkSize, prefetchChunks,
+                                                               transfer->cacheMode);
+                } else {
+                    mappedFile = m_fileHandler->mapFile(transfer->filePath);
+                    if (!mappedFile) {
+                        throw std::runtime_error("Failed to open file: " + transfer->filePath);
+                    }
+                }
+                std::uintmax_t fileSize = fanOut.source ? fanOut.source->size()
+                                                        : reader ? reader->size() : mappedFile->size();
+                std::size_t totalChunks = (fileSize + chunkSize - 1) / chunkSize;
+
+                // Chunks that fall entirely in a hole of a sparse file are announced rather than sent
+                std::vector<bool> holeChunks;
+                if (sparseSupported) {
+                    holeChunks = findHoleChunks(transfer->filePath, totalChunks);
+                }
+
+                // The file hash is computed as chunks are read, so the file is only read once
+                auto hasher = utils::Hashing::create(transferHashAlgorithm(*transfer));
+                std::size_t chunksRead = 0;
+                auto readChunk = [&](ChunkBuffer &chunk) {
+                    if (fanOut.source) {
+                        // Copied, as the pipeline compresses and encrypts each peer's chunk in place
+                        auto shared = fanOut.source->chunk(fanOut.consumer, chunksRead);
+                        chunk.owned.assign(shared->begin(), shared->end());
+                    } else if (reader) {
+                        reader->readNext(chunk.owned);
+                    } else {
+                        // Mapped chunks are read in place by the workers; touching pages the file no longer
+                        // has would raise SIGBUS, so a file truncated under us ends the transfer here instead
+                        std::uintmax_t offset = chunksRead * chunkSize;
+                        chunk.view = mappedFile->chunk(offset, chunkSize);
+                        if (!mappedFile->covers(offset, chunk.view.size())) {
+                            throw std::runtime_error("File changed during transfer: " + transfer->filePath);
+                        }
+                        mappedFile->willNeed((chunksRead + prefetchChunks) * chunkSize, chunkSize);
+                    }
+                    auto bytes = chunk.bytes();
+                    hasher->update(bytes.data(), bytes.size());
+                    chunksRead++;
+                };
+
+                ChunkBuffer firstChunk;
+                if (totalChunks > 0) {
+                    readChunk(firstChunk);
+                }
+
+                // The first chunk doubles as the sample for content detection
+                std::string mimeType = m_fileHandler->identifyMimeType(transfer->filePath, firstChunk.bytes());
+                bool tryCompress = compressing && !utils::Compression::isPrecompressedMimeType(mimeType);
+
+                // Small text files compress far better against a dictionary shared across the session
+                std::shared_ptr<const utils::CompressionDictionary> dictionary;
+                if (tryCompress && dictionarySupported &&
+                    utils::Compression::isDictionaryEligible(mimeType, fileSize)) {
+                    // Eligible files are smaller than a chunk, so the first chunk is the whole file
+                    dictionary = m_dictionaryStore.addSample(transfer->peerId, firstChunk.bytes());
+
+                    if (dictionary && std::find(receiverDictionaries.begin(), receiverDictionaries.end(),
+                                                dictionary->id()) == receiverDictionaries.end()) {
+                        network::DictionaryMessage dictionaryMsg;
+                        dictionaryMsg.transferId = transfer->id;
+                        dictionaryMsg.dictionaryId = dictionary->id();
+                        dictionaryMsg.dictionary = dictionary->data();
+
+                        auto dictionaryData = network::Protocol::serialize(dictionaryMsg);
+                        if (m_socketHandler->sendTcp(endpoint, dictionaryData).get() < 0) {
+                            SPDLOG_WARN("Failed to ship dictionary to {}, compressing without it", endpoint);
+                            dictionary.reset();
+                        }
+                    }
+                }
+
+                std::uintmax_t wireBytes = 0;
+
+                // Compress/encrypt chunks on a worker pool; frames come back in index order
+                ChunkPipeline pipeline([this, transfer, totalChunks, tryCompress, dictionary, holeChunks,
+                                        resumeChunks](uint32_t chunkIndex, ChunkBuffer &&chunk) {
+                    if (hasChunk(resumeChunks, chunkIndex)) {
+                        network::FileDataMessage skippedMsg;
+                        skippedMsg.transferId = transfer->id;
+                        skippedMsg.chunkIndex = chunkIndex;
+                        return skippedMsg;
+                    }
+
+                    if (!holeChunks.empty() && holeChunks[chunkIndex]) {
+                        network::FileDataMessage holeMsg;
+                        holeMsg.transferId = transfer->id;
+                        holeMsg.chunkIndex = chunkIndex;
+                        holeMsg.totalChunks = static_cast<uint32_t>(totalChunks);
+                        holeMsg.offset = static_cast<uint64_t>(chunkIndex) * chunkSize;
+                        holeMsg.originalSize = static_cast<uint32_t>(chunk.bytes().size());
+                        holeMsg.hole = true;
+                        return holeMsg;
+                    }
+
+                    auto dataMsg = encodeChunk(*transfer, chunkIndex, totalChunks, std::move(chunk), tryCompress,
+                                               dictionary.get());
+                    dataMsg.offset = static_cast<uint64_t>(chunkIndex) * chunkSize;
+                    return dataMsg;
+                }, m_transformWorkers);
+
+                // Keep a bounded number of chunks in flight so memory does not grow with the file
+                const std::size_t maxInFlight = pipeline.workerCount() * 2;
+                std::size_t chunksSubmitted = 0;
+
+                // Each connection takes the next chunk once its last one is out
+                StreamStriper striper(*m_socketHandler, openStreams(transfer, endpoint, streams),
+                                      m_parallelStreams == 0);
+
+                SPDLOG_INFO("Starting file transfer: {} in {} chunks (compression: {}, {} workers, {} connections)",
+                            transfer->fileName, totalChunks, tryCompress ? transfer->compression : "none",
+                            pipeline.workerCount(), striper.activeStreams());
+
+                // Send file in chunks
+                for (std::size_t i = 0; i < totalChunks; ++i) {
+                    // Check if transfer has been canceled
+                    auto updatedTransfer = findTransfer(transfer->id);
+                    if (!updatedTransfer ||
+                        updatedTransfer->status == TransferStatus::Canceled ||
+                        updatedTransfer->status == TransferStatus::Failed) {
+                        SPDLOG_INFO("Transfer aborted during file send: {}", transfer->id);
+                        return;
+                    }
+
+                    // Top up the pipeline
+                    while (chunksSubmitted < totalChunks && pipeline.inFlight() < maxInFlight) {
+                        ChunkBuffer chunk;
+                        if (chunksSubmitted == 0) {
+                            chunk = std::move(firstChunk);
+                        } else {
+                            readChunk(chunk);
+                        }
+                        pipeline.submit(static_cast<uint32_t>(chunksSubmitted), std::move(chunk));
+                        chunksSubmitted++;
+                    }
+
+                    // Take the next file data message in order
+                    auto dataMsg = pipeline.next();
+                    if (!dataMsg) {
+                        throw std::runtime_error("Chunk pipeline stopped unexpectedly");
+                    }
+
+                    if (hasChunk(resumeChunks, i)) {
+                        continue;
+                    }
+                    wireBytes += dataMsg->data.size();
+
+                    // Serialize and send the message
+                    auto msgData = network::Protocol::serialize(*dataMsg);
+                    if (!striper.send(static_cast<uint32_t>(i), std::move(msgData))) {
+                        SPDLOG_ERROR("Failed to send file chunk {}/{} for transfer {}",
+                                     i, totalChunks, transfer->id);
+                        updateTransferStatus(transfer->id, TransferStatus::Failed,
+                                             "Failed to send file data");
+                        return;
+                    }
+
+                    // Update progress
+                    updateTransferProgress(transfer->id, transfer->fileSize * (i + 1) / totalChunks);
+                }
+
+                // Every chunk must be out before the completion, which goes on the transfer's own connection
+                if (!striper.flush()) {
+                    SPDLOG_ERROR("Failed to send the last file chunks for transfer {}", transfer->id);
+                    updateTransferStatus(transfer->id, TransferStatus::Failed, "Failed to send file data");
+                    return;
+                }
+
+                transfer->fileHash = utils::Hashing::toHex(hasher->finish());
+                SPDLOG_DEBUG("File hash calculated ({}): {}", transfer->hashAlgorithm, transfer->fileHash);
+
+                // Send transfer complete message
+                network::TransferCompleteMessage completeMsg;
+                completeMsg.transferId = transfer->id;
+                completeMsg.success = true;
+                completeMsg.fileHash = transfer->fileHash;
+
+                // Serialize and send the message
+                auto completeData = network::Protocol::serialize(completeMsg);
+                auto completeFuture = m_socketHandler->sendTcp(endpoint, completeData);
+                int completeResult = completeFuture.get();
+
+                if (completeResult < 0) {
+                    SPDLOG_ERROR("Failed to send transfer complete message for {}", transfer->id);
+                    updateTransferStatus(transfer->id, TransferStatus::Failed,
+                                         "Failed to send transfer complete message");
+                    return;
+                }
+
+                // Update transfer status
+                updateTransferProgress(transfer->id, transfer->fileSize);
+                updateTransferStatus(transfer->id, TransferStatus::Completed);
+
+                SPDLOG_INFO("Transfer completed: {} ({} bytes on the wire for {} bytes of data)",
+                            transfer->id, wireBytes, fileSize);
+            } catch (const std::exception &e) {
+                SPDLOG_ERROR("Error during file transfer {}: {}", transfer->id, e.what());
+                updateTransferStatus(transfer->id, TransferStatus::Failed,
+                                     std::string("Error during transfer: ") + e.what());
+            }
+        });
+
+        // Detach the thread so it runs independently
+        transferThread.detach();
+    }
+
+    void TransferManager::sendRawFileData(const std::shared_ptr<TransferInfo> &transfer,
+                                          const std::string &endpoint, bool sparse,
+                                          const std::vector<uint8_t> &resumeChunks, std::size_t streams) {
+#ifndef PLATFORM_WINDOWS
+        auto reader = m_fileHandler->openReader(transfer->filePath);
+        if (!reader) {
+            throw std::runtime_error("Failed to open file: " + transfer->filePath);
+        }
+        std::uintmax_t fileSize = reader->size();
+
+        // sendfile() reads from the page cache, so O_DIRECT does not apply; pages are dropped behind instead.
+        // Each chunk is then read and hashed just before it is sent, rather than hashing the whole file up front
+        std::unique_ptr<utils::Hasher> hasher;
+        std::vector<uint8_t> chunkBuffer;
+        if (transfer->cacheMode != CacheMode::Normal) {
+            reader->setCacheMode(CacheMode::DropBehind);
+            hasher = utils::Hashing::create(transferHashAlgorithm(*transfer));
+        } else {
+            // Hashing through the mapping also pulls the file into the page cache that sendfile() reads from
+            auto mappedFile = m_fileHandler->mapFile(transfer->filePath);
+            if (!mappedFile && fileSize > 0) {
+                throw std::runtime_error("Failed to open file: " + transfer->filePath);
+            }
+            std::span<const uint8_t> fileData = mappedFile ? mappedFile->data() : std::span<const uint8_t>();
+            transfer->fileHash = utils::Hashing::hashBuffer(fileData.data(), fileData.size(),
+                                                            transferHashAlgorithm(*transfer));
+            SPDLOG_DEBUG("File hash calculated ({}): {}", transfer->hashAlgorithm, transfer->fileHash);
+        }
+
+        constexpr std::size_t chunkSize = network::DEFAULT_CHUNK_SIZE;
+        std::size_t totalChunks = (fileSize + chunkSize - 1) / chunkSize;
+
+        std::vector<bool> holeChunks;
+        if (sparse) {
+            holeChunks = findHoleChunks(transfer->filePath, totalChunks);
+        }
+
+        StreamStriper striper(*m_socketHandler, openStreams(transfer, endpoint, streams), m_parallelStreams == 0);
+
+        SPDLOG_INFO("Starting raw file transfer: {} in {} chunks ({} connections)", transfer->fileName, totalChunks,
+                    striper.activeStreams());
+
+        for (std::size_t i = 0; i < totalChunks; ++i) {
+            // Check if transfer has been canceled
+            auto updatedTransfer = findTransfer(transfer->id);
+            if (!updatedTransfer ||
+                updatedTransfer->status == TransferStatus::Canceled ||
+                updatedTransfer->status == TransferStatus::Failed) {
+                SPDLOG_INFO("Transfer aborted during file send: {}", transfer->id);
+                return;
+            }
+
+            std::uint64_t offset = static_cast<std::uint64_t>(i) * chunkSize;
+            std::size_t length = static_cast<std::size_t>(std::min<std::uintmax_t>(chunkSize, fileSize - offset));
+
+            if (hasher) {
+                chunkBuffer.resize(length);
+                if (reader->readChunk(offset, chunkBuffer) != length) {
+                    throw std::runtime_error("Unexpected end of file: " + transfer->filePath);
+                }
+                hasher->update(chunkBuffer.data(), chunkBuffer.size());
+            }
+
+            if (hasChunk(resumeChunks, i)) {
+                continue;
+            }
+
+            // Announce the chunk, then move its bytes from the page cache to the socket
+            network::FileDataMessage dataMsg;
+            dataMsg.transferId = transfer->id;
+            dataMsg.chunkIndex = static_cast<uint32_t>(i);
+            dataMsg.totalChunks = static_cast<uint32_t>(totalChunks);
+            dataMsg.offset = offset;
+            dataMsg.originalSize = static_cast<uint32_t>(length);
+            dataMsg.hole = !holeChunks.empty() && holeChunks[i];
+            dataMsg.raw = !dataMsg.hole;
+
+            auto msgData = network::Protocol::serialize(dataMsg);
+            bool sent = dataMsg.raw ? striper.sendRaw(dataMsg.chunkIndex, std::move(msgData), reader->descriptor(),
+                                                      offset, length)
+                                    : striper.send(dataMsg.chunkIndex, std::move(msgData));
+            if (!sent) {
+                SPDLOG_ERROR("Failed to send file chunk {}/{} for transfer {}", i, totalChunks, transfer->id);
+                updateTransferStatus(transfer->id, TransferStatus::Failed, "Failed to send file data");
+                return;
+            }
+
+            // Update progress
+            updateTransferProgress(transfer->id, offset + length);
+        }
+
+        if (!striper.flush()) {
+            SPDLOG_ERROR("Failed to send the last file chunks for transfer {}", transfer->id);
+            updateTransferStatus(transfer->id, TransferStatus::Failed, "Failed to send file data");
+            return;
+        }
+
+        if (hasher) {
+            transfer->fileHash = utils::Hashing::toHex(hasher->finish());
+            SPDLOG_DEBUG("File hash calculated ({}): {}", transfer->hashAlgorithm, transfer->fileHash);
+        }
+
+        // Send transfer complete message
+        network::TransferCompleteMessage completeMsg;
+        completeMsg.transferId = transfer->id;
+        completeMsg.success = true;
+        completeMsg.fileHash = transfer->fileHash;
+
+        auto completeData = network::Protocol::serialize(completeMsg);
+        if (m_socketHandler->sendTcp(endpoint, completeData).get() < 0) {
+            SPDLOG_ERROR("Failed to send transfer complete message for {}", transfer->id);
+            updateTransferStatus(transfer->id, TransferStatus::Failed, "Failed to send transfer complete message");
+            return;
+        }
+
+        // Update transfer status
+        updateTransferProgress(transfer->id, transfer->fileSize);
+        updateTransferStatus(transfer->id, TransferStatus::Completed);
+
+        SPDLOG_INFO("Raw transfer completed: {} ({} bytes)", transfer->id, fileSize);
+#else
+        throw std::runtime_error("Raw file data is not supported on this platform");
+#endif
+    }
+
+    void TransferManager::sendDirectoryData(const std::shared_ptr<TransferInfo> &transfer,
+                                            const std::string &endpoint, OutgoingDirectory &directory) {
+        auto &entries = directory.entries;
+        fs::path root(transfer->filePath);
+
+        auto aborted = [this, &transfer]() {
+            auto updatedTransfer = findTransfer(transfer->id);
+            return !updatedTransfer ||
+                   updatedTransfer->status == TransferStatus::Canceled ||
+                   updatedTransfer->status == TransferStatus::Failed;
+        };
+
+        if (directory.hashFiles && directory.sources.empty()) {
+            DirectoryWalker::hashFiles(transfer->filePath, entries, transferHashAlgorithm(*transfer));
+        }
+
+        // The receiver creates directories and empty files from the manifest, so it goes first, in pages
+        std::size_t first = 0;
+        do {
+            std::size_t last = std::min(entries.size(), first + MANIFEST_PAGE_ENTRIES);
+
+            network::ManifestMessage page;
+            page.transferId = transfer->id;
+            page.firstEntry = static_cast<uint32_t>(first);
+            page.lastPage = last == entries.size();
+            page.entries.assign(entries.begin() + static_cast<std::ptrdiff_t>(first),
+                                entries.begin() + static_cast<std::ptrdiff_t>(last));
+
+            if (aborted()) {
+                SPDLOG_INFO("Transfer aborted during manifest send: {}", transfer->id);
+                return;
+            }
+
+            if (m_socketHandler->sendTcp(endpoint, network::Protocol::serialize(page)).get() < 0) {
+                SPDLOG_ERROR("Failed to send manifest page at entry {} for transfer {}", first, transfer->id);
+                updateTransferStatus(transfer->id, TransferStatus::Failed, "Failed to send manifest");
+                return;
+            }
+            first = last;
+        } while (first < entries.size());
+
+        // Every chunk names its manifest entry, so files can be read in on-disk order
+        std::vector<uint32_t> files;
+        std::vector<std::string> filePaths;
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            if (!entries[i].directory && entries[i].size > 0) {
+                files.push_back(static_cast<uint32_t>(i));
+                filePaths.push_back(directory.sources.empty() ? (root / entries[i].path).string()
+                                                              : directory.sources[i]);
+            }
+        }
+        std::vector<std::size_t> readOrder = m_fileHandler->diskOrder(filePaths);
+
+        constexpr std::size_t chunkSize = network::DEFAULT_CHUNK_SIZE;
+        bool tryCompress = transfer->compression != "none";
+
+        // Chunks of all files share one pipeline, which numbers them in submission order; frames come back in
+        // that order, so each number is swapped for the chunk's place in its file as it comes out
+        struct ChunkPlace {
+            uint32_t fileIndex;
+            uint32_t chunkIndex;
+            uint32_t totalChunks;
+            uint64_t offset;
+            bool packed;
+        };
+        std::deque<ChunkPlace> places;
+
+        ChunkPipeline pipeline([this, transfer, tryCompress](uint32_t sequence, ChunkBuffer &&chunk) {
+            return encodeChunk(*transfer, sequence, 0, std::move(chunk), tryCompress);
+        }, m_transformWorkers);
+        const std::size_t maxInFlight = pipeline.workerCount() * 2;
+
+        std::size_t nextFile = 0;
+        std::unique_ptr<FileReader> reader;
+        const std::string *readerPath = nullptr;
+        ChunkPlace reading{};
+        uint32_t sequence = 0;
+
+        // Small files are gathered whole into a pack, which goes out once full, between the chunks of large files
+        std::vector<uint8_t> pack;
+        std::size_t packedFiles = 0;
+        auto submitPack = [&]() {
+            places.push_back({0, 0, 0, 0, true});
+            pipeline.submit(sequence++, std::move(pack));
+            pack.clear();
+            packedFiles = 0;
+        };
+
+        auto submitNext = [&]() {
+            while (!reader) {
+                if (nextFile == readOrder.size()) {
+                    if (pack.empty()) {
+                        return false;
+                    }
+                    submitPack();
+                    return true;
+                }
+
+                std::size_t file = readOrder[nextFile++];
+                auto fileReader = m_fileHandler->openReader(filePaths[file]);
+                if (!fileReader || fileReader->size() != entries[files[file]].size) {
+                    throw std::runtime_error("File changed or vanished during transfer: " + filePaths[file]);
+                }
+                if (transfer->cacheMode != CacheMode::Normal) {
+                    fileReader->setCacheMode(CacheMode::DropBehind);
+                }
+
+                if (directory.packFiles && fileReader->size() <= PACK_FILE_LIMIT) {
+                    std::vector<uint8_t> content(static_cast<std::size_t>(fileReader->size()));
+                    if (fileReader->readChunk(0, content) != content.size()) {
+                        throw std::runtime_error("File changed during transfer: " + filePaths[file]);
+                    }
+
+                    bool full = packedFiles == PACK_MAX_FILES ||
+                                pack.size() + network::PACKED_FILE_HEADER_SIZE + content.size() > chunkSize;
+                    if (full) {
+                        submitPack();
+                    }
+                    network::appendPackedFile(pack, files[file], content);
+                    packedFiles++;
+                    if (full) {
+                        return true;
+                    }
+                    continue;
+                }
+
+                reader = std::move(fileReader);
+                readerPath = &filePaths[file];
+                reading.fileIndex = files[file];
+                reading.chunkIndex = 0;
+                reading.totalChunks = static_cast<uint32_t>((reader->size() + chunkSize - 1) / chunkSize);
+                reading.offset = 0;
+            }
+
+            std::uintmax_t fileSize = entries[reading.fileIndex].size;
+            std::vector<uint8_t> chunk(static_cast<std::size_t>(std::min<std::uintmax_t>(chunkSize,
+                                                                                          fileSize - reading.offset)));
+            if (reader->readChunk(reading.offset, chunk) != chunk.size()) {
+                throw std::runtime_error("File changed during transfer: " + *readerPath);
+            }
+
+            places.push_back(reading);
+            reading.offset += chunk.size();
+            reading.chunkIndex++;
+            pipeline.submit(sequence++, std::move(chunk));
+            if (reading.chunkIndex == reading.totalChunks) {
+                reader.reset();
+            }
+            return true;
+        };
+
+        SPDLOG_INFO("Starting directory transfer: {} ({} entries, {} files, {} bytes, {} workers)",
+                    transfer->fileName, entries.size(), files.size(), transfer->fileSize, pipeline.workerCount());
+
+        std::uintmax_t bytesSent = 0;
+        std::uintmax_t wireBytes = 0;
+        bool moreChunks = true;
+        while (true) {
+            if (aborted()) {
+                SPDLOG_INFO("Transfer aborted during directory send: {}", transfer->id);
+                return;
+            }
+
+            // Top up the pipeline
+            while (moreChunks && pipeline.inFlight() < maxInFlight) {
+                moreChunks = submitNext();
+            }
+            if (places.empty()) {
+                break;
+            }
+
+            auto dataMsg = pipeline.next();
+            if (!dataMsg) {
+                throw std::runtime_error("Chunk pipeline stopped unexpectedly");
+            }
+
+            ChunkPlace place = places.front();
+            places.pop_front();
+            dataMsg->packed = place.packed;
+            dataMsg->fileIndex = place.fileIndex;
+            dataMsg->chunkIndex = place.chunkIndex;
+            dataMsg->totalChunks = place.totalChunks;
+            dataMsg->offset = place.offset;
+            bytesSent += dataMsg->originalSize;
+            wireBytes += dataMsg->data.size();
+
+            if (m_socketHandler->sendTcp(endpoint, network::Protocol::serialize(*dataMsg)).get() < 0) {
+                SPDLOG_ERROR("Failed to send chunk {}/{} of {} for transfer {}", place.chunkIndex, place.totalChunks,
+                             entries[place.fileIndex].path, transfer->id);
+                updateTransferStatus(transfer->id, TransferStatus::Failed, "Failed to send file data");
+                return;
+            }
+
+            // Pack headers make the data sent slightly larger than the files
+            updateTransferProgress(transfer->id, std::min(bytesSent, transfer->fileSize));
+        }
+
+        // Files are verified one by one against the manifest, so there is no hash for the whole tree
+        network::TransferCompleteMessage completeMsg;
+        completeMsg.transferId = transfer->id;
+        completeMsg.success = true;
+
+        if (m_socketHandler->sendTcp(endpoint, network::Protocol::serialize(completeMsg)).get() < 0) {
+            SPDLOG_ERROR("Failed to send transfer complete message for {}", transfer->id);
+            updateTransferStatus(transfer->id, TransferStatus::Failed, "Failed to send transfer complete message");
+            return;
+        }
+
+        updateTransferProgress(transfer->id, transfer->fileSize);
+        updateTransferStatus(transfer->id, TransferStatus::Completed);
+
+        SPDLOG_INFO("Directory transfer completed: {} ({} bytes on the wire for {} bytes of data)",
+                    transfer->id, wireBytes, bytesSent);
+    }
+
+    void TransferManager::waitForReadTurn(const std::string &transferId) {
+        ReadTurn readTurn;
+        {
+            std::lock_guard<std::mutex> lock(m_readTurnsMutex);
+            auto it = m_readTurns.find(transferId);
+            if (it == m_readTurns.end()) {
+                return;
+            }
+            readTurn = it->second;
+        }
+
+        SPDLOG_DEBUG("Transfer {} waiting for read turn {}", transferId, readTurn.turn);
+        readTurn.scheduler->waitTurn(readTurn.turn);
+    }
+
+    void TransferManager::finishReadTurn(const std::string &transferId) {
+        ReadTurn readTurn;
+        {
+            std::lock_guard<std::mutex> lock(m_readTurnsMutex);
+            auto it = m_readTurns.find(transferId);
+            if (it == m_readTurns.end()) {
+                return;
+            }
+            readTurn = std::move(it->second);
+            m_readTurns.erase(it);
+        }
+
+        readTurn.scheduler->finish(readTurn.turn);
+    }
+
+    TransferManager::FanOutSlot TransferManager::findFanOut(const std::string &transferId) const {
+        std::lock_guard<std::mutex> lock(m_readTurnsMutex);
+        auto it = m_fanOuts.find(transferId);
+        return it != m_fanOuts.end() ? it->second : FanOutSlot{};
+    }
+
+    void TransferManager::releaseFanOut(const std::string &transferId) {
+        FanOutSlot slot;
+        {
+            std::lock_guard<std::mutex> lock(m_readTurnsMutex);
+            auto it = m_fanOuts.find(transferId);
+            if (it == m_fanOuts.end()) {
+                return;
+            }
+            slot = std::move(it->second);
+            m_fanOuts.erase(it);
+        }
+
+        slot.source->release(slot.consumer);
+    }
+
+    std::vector<bool> TransferManager::findHoleChunks(const std::string &filePath, std::size_t totalChunks) const {
+        constexpr std::uintmax_t chunkSize = network::DEFAULT_CHUNK_SIZE;
+
+        auto reader = m_fileHandler->openReader(filePath);
+        if (!reader) {
+            return std::vector<bool>(totalChunks, false);
+        }
+
+        // A chunk is a hole unless some data range touches it
+        std::vector<bool> holes(totalChunks, true);
+        for (const auto &[offset, length]: reader->dataRanges()) {
+            if (length == 0) {
+                continue;
+            }
+            std::size_t last = std::min<std::size_t>((offset + length - 1) / chunkSize, totalChunks - 1);
+            for (std::size_t i = offset / chunkSize; i <= last; ++i) {
+                holes[i] = false;
+            }
+        }
+
+        auto holeCount = std::count(holes.begin(), holes.end(), true);
+        if (holeCount > 0) {
+            SPDLOG_INFO("{} of {} chunks of {} are holes and will not be sent", holeCount, totalChunks, filePath);
+        }
+
+        return holes;
+    }
+
+    std::shared_ptr<TransferInfo> TransferManager::findTransferByEndpoint(const std::string &endpoint) {
+        std::lock_guard<std::mutex> lock(m_transfersMutex);
+
+        for (const auto &[id, transfer]: m_transfers) {
+            if (transfer->peerAddress == endpoint) {
+                return transfer;
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool TransferManager::connectToPeer(const PeerInfo &peer) {
+        auto endpointStr = peer.ipAddress + ":" + std::to_string(peer.port);
+
+        SPDLOG_INFO("Connecting to peer: {} ({}) at {}", peer.name, peer.id, endpointStr);
+
+        // Check if we're already connected
+        {
+            std::lock_guard<std::mutex> lock(m_transfersMutex);
+            for (const auto &[id, transfer]: m_transfers) {
+                if (transfer->peerAddress == endpointStr) {
+                    return true; // Already connected
+                }
+            }
+        }
+
+        // Connect to the peer
+        bool success = m_socketHandler->connectTcp(
+                peer.ipAddress,
+                peer.port,
+                [this](const std::vector<uint8_t> &data, const std::string &endpoint) {
+                    this->handleIncomingData(data, endpoint);
+                },
+                [this](network::ConnectionStatus status, const std::string &endpoint, const std::string &errorMessage) {
+                    this->handleConnectionStatus(status, endpoint, errorMessage);
+                }
+        );
+
+        return success;
+    }
+
+    std::vector<StreamStriper::Path> TransferManager::openStreams(const std::shared_ptr<TransferInfo> &transfer,
+                                                                  const std::string &endpoint, std::size_t streams) {
+        std::vector<StreamStriper::Path> paths{{endpoint, ""}};
+        if (streams <= 1) {
+            return paths;
+        }
+
+        auto peer = getPeerInfo(transfer->peerId);
+        if (!peer) {
+            SPDLOG_WARN("Peer of transfer {} is no longer known, sending over one connection", transfer->id);
+            return paths;
+        }
+
+        // Interfaces are looked up now, as addresses may have changed since they were chosen
+        std::vector<std::string> localAddresses;
+        if (!m_dataInterfaces.empty()) {
+            auto addresses = m_discoveryService->getInterfaceAddresses();
+            for (const auto &name: m_dataInterfaces) {
+                if (auto it = addresses.find(name); it != addresses.end()) {
+                    localAddresses.push_back(it->second);
+                } else {
+                    SPDLOG_WARN("Data interface {} has no IPv4 address, leaving it out", name);
+                }
+            }
+        }
+
+        // Each connection is labelled with the transfer and its stripe, so it is told apart from the others
+        struct Connecting {
+            StreamStriper::Path path;
+            std::future<bool> connected;
+            std::shared_ptr<std::atomic<bool>> answered;
+        };
+        std::vector<Connecting> connecting;
+        for (std::size_t i = 1; i < streams; ++i) {
+            std::string localAddress = localAddresses.empty() ? "" : localAddresses[(i - 1) % localAddresses.size()];
+            std::string label = transfer->id + "/" + std::to_string(i);
+            auto connected = std::make_shared<std::promise<bool>>();
+            auto answered = std::make_shared<std::atomic<bool>>(false);
+            auto future = connected->get_future();
+
+            // Only the first status matters; once the transfer is done with it the connection just goes away,
+            // and one that comes up after we stopped waiting is closed straight away
+            bool initiated = m_socketHandler->connectTcp(
+                    peer->ipAddress,
+                    peer->port,
+                    [this](const std::vector<uint8_t> &data, const std::string &from) {
+                        this->handleIncomingData(data, from);
+                    },
+                    [this, connected, answered](network::ConnectionStatus status, const std::string &from,
+                                                const std::string &) {
+                        if (!answered->exchange(true)) {
+                            connected->set_value(status == network::ConnectionStatus::Connected);
+                        } else if (status == network::ConnectionStatus::Connected) {
+                            m_socketHandler->closeTcp(from);
+                        }
+                    },
+                    label, localAddress);
+            if (initiated) {
+                StreamStriper::Path path{peer->ipAddress + ":" + std::to_string(peer->port) + "#" + label,
+                                         localAddress};
+                connecting.push_back({std::move(path), std::move(future), answered});
+            }
+        }
+
+        auto deadline = steady_clock::now() + STREAM_CONNECT_TIMEOUT;
+        for (auto &[path, connected, answered]: connecting) {
+            bool ready = connected.wait_until(deadline) == std::future_status::ready;
+            if (ready && connected.get()) {
+                paths.push_back(std::move(path));
+                continue;
+            }
+
+            SPDLOG_WARN("Extra connection {} for transfer {} did not come up", path.endpoint, transfer->id);
+            if (ready || answered->exchange(true)) {
+                m_socketHandler->closeTcp(path.endpoint);
+            }
+        }
+
+        SPDLOG_INFO("Transfer {} may stripe its chunks across {} connections", transfer->id, paths.size());
+        return paths;
+    }
+
+    std::shared_ptr<PeerInfo> TransferManager::getPeerInfo(const std::string &peerId) const {
+        // Get all known peers
+        std::vector<PeerInfo> peers = m_discoveryService->getKnownPeers();
+
+        // Find the peer with matching id
+        for (const auto &peer: peers) {
+            if (peer.id == peerId) {
+                return std::make_shared<PeerInfo>(peer);
+            }
+        }
+
+        return nullptr;
+    }
+
+    std::string TransferManager::generateTransferId() {
+        // Generate a unique ID based on timestamp and counter
+        auto now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        int id = m_nextTransferId.fetch_add(1);
+
+        std::stringstream ss;
+        ss << std::hex << now << "-" << id;
+        return ss.str();
+    }
+
+    void TransferManager::updateTransferProgress(const std::string &transferId, std::uintmax_t bytesTransferred) {
+        auto transfer = findTransfer(transferId);
+        if (!transfer) {
+            SPDLOG_ERROR("Failed to update the progress: transfer not found: {}", transferId);
+            return;
+        }
+
+        // Update the transfer of the progress
+        transfer->bytesTransferred = bytesTransferred;
+
+        // Calculate progress percentage
+        if (transfer->fileSize > 0) {
+            transfer->progress = static_cast<float>(bytesTransferred) / static_cast<float>(transfer->fileSize) * 100.0f;
+        } else {
+            transfer->progress = 100.0f; // Avoid division by zero
+        }
+
+        // Notify the callback
+        if (m_statusCallback) {
+            m_statusCallback(*transfer);
+        }
+
+        SPDLOG_DEBUG("Transfer progress updated: {} - {}%", transferId, transfer->progress);
+    }
+
+    void TransferManager::updateTransferStatus(const std::string &transferId, TransferStatus status,
+                                               const std::string &errorMessage) {
+        auto transfer = findTransfer(transferId);
+        if (!transfer) {
+            SPDLOG_ERROR("Failed to update status: transfer not found: {}", transferId);
+            return;
+        }
+
+        // Update the transfer status
+        transfer->status = status;
+
+        // Set the error message if provided
+        if (!errorMessage.empty()) {
+            transfer->errorMessage = errorMessage;
+        }
+
+        // Record the end time for complete, failed or canceled transfers
+        if (status == TransferStatus::Completed ||
+            status == TransferStatus::Failed ||
+            status == TransferStatus::Canceled) {
+            transfer->endTime = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+            finishReadTurn(transferId);
+            releaseFanOut(transferId);
+            releaseSwarmMember(transferId);
+
+#ifdef ENABLE_ENCRYPTION
+            {
+                std::lock_guard<std::mutex> lock(m_encryptionKeysMutex);
+                m_sendKeys.erase(transferId);
+            }
+#endif
+
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            m_incomingPulls.erase(transferId);
+            m_stripedTransfers.erase(transferId);
+        }
+
+        // Notify the callback
+        if (m_statusCallback) {
+            m_statusCallback(*transfer);
+        }
+
+        SPDLOG_INFO("Transfer status update: {} - {}", transferId, static_cast<int>(status));
+
+    }
+
+    std::shared_ptr<TransferInfo> TransferManager::findTransfer(const std::string &transferId) {
+        std::lock_guard<std::mutex> lock(m_transfersMutex);
+
+        if (auto it = m_transfers.find(transferId); it != m_transfers.end()) {
+            return it->second;
+        }
+
+        return nullptr;
+    }
+
+    void
+    TransferManager::processTransferCancel(const network::TransferCancelMessage &cancel, const std::string &endpoint) {
+        auto transfer = findTransfer(cancel.transferId);
+
+        if (!transfer) {
+            SPDLOG_ERROR("Received cancel for unknown transfer: {}", cancel.transferId);
+            return;
+        }
+
+        SPDLOG_INFO("Transfer canceled by peer: {} - {}", transfer->id, cancel.reason);
+
+        // Update transfer status
+        updateTransferStatus(cancel.transferId, TransferStatus::Canceled,
+                             "Canceled by peer: " + cancel.reason);
+
+        // Drop the partially written file
+        releaseIncomingFile(transfer->id, false);
+    }
+
+    void TransferManager::processTransferComplete(const network::TransferCompleteMessage &complete,
+                                                  const std::string &endpoint) {
+        auto transfer = findTransfer(complete.transferId);
+
+        if (!transfer) {
+            SPDLOG_ERROR("Received completion for unknown transfer: {}", complete.transferId);
+            return;
+        }
+
+        if (complete.success) {
+            SPDLOG_INFO("Transfer complete successfully: {}", transfer->id);
+
+            if (transfer->direction == TransferDirection::Incoming) {
+                if (auto directory = findIncomingDirectory(transfer->id)) {
+                    bool dataComplete;
+                    {
+                        std::lock_guard<std::mutex> lock(directory->mutex);
+                        dataComplete = directory->entries.size() == directory->entryCount &&
+                                       directory->filesDone == directory->filesExpected;
+                        if (dataComplete) {
+                            // Deepest first, as filling a directory changes its modification time
+                            for (auto it = directory->entries.rbegin(); it != directory->entries.rend(); ++it) {
+                                if (it->directory) {
+                                    DirectoryWalker::applyMetadata((fs::path(directory->root) / it->path).string(),
+                                                                   *it);
+                                }
+                            }
+                        }
+                    }
+
+                    if (!dataComplete) {
+                        releaseIncomingFile(transfer->id, false);
+                        updateTransferStatus(complete.transferId, TransferStatus::Failed, "Directory data incomplete");
+                        return;
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                        m_incomingDirectories.erase(transfer->id);
+                    }
+
+                    updateTransferProgress(complete.transferId, transfer->fileSize);
+                    updateTransferStatus(complete.transferId, TransferStatus::Completed);
+                    return;
+                }
+
+                // A file rebuilt from a delta replaces the old copy only once it matches the sender's hash
+                std::shared_ptr<DeltaApplier> applier;
+                {
+                    std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                    if (auto it = m_deltaAppliers.find(transfer->id); it != m_deltaAppliers.end()) {
+                        applier = std::move(it->second);
+                        m_deltaAppliers.erase(it);
+                    }
+                }
+                if (applier) {
+                    finishDeltaTransfer(*transfer, *applier, complete, endpoint);
+                    return;
+                }
+
+                // Chunks striped across the other connections may still be on their way; likewise for a swarm below
+                {
+                    std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                    if (auto striped = m_stripedTransfers.find(transfer->id); striped != m_stripedTransfers.end()) {
+                        std::size_t totalChunks = (transfer->fileSize + network::DEFAULT_CHUNK_SIZE - 1) /
+                                                  network::DEFAULT_CHUNK_SIZE;
+                        auto received = m_transferChunksReceived.find(transfer->id);
+                        int chunksReceived = received != m_transferChunksReceived.end() ? received->second : 0;
+                        if (m_fileWriters.contains(transfer->id) && chunksReceived < static_cast<int>(totalChunks)) {
+                            SPDLOG_INFO("Transfer {} waits for chunks on its other connections", transfer->id);
+                            striped->second = complete;
+                            return;
+                        }
+                    }
+                }
+
+                // Chunks other swarm peers pass on may still be on their way; the hash is checked once they are in
+                if (auto swarm = findIncomingSwarm(transfer->id)) {
+                    std::size_t totalChunks = (transfer->fileSize + network::DEFAULT_CHUNK_SIZE - 1) /
+                                              network::DEFAULT_CHUNK_SIZE;
+                    bool waiting = false;
+                    {
+                        std::lock_guard<std::mutex> swarmLock(swarm->mutex);
+                        std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                        auto received = m_transferChunksReceived.find(transfer->id);
+                        waiting = m_fileWriters.contains(transfer->id) && received != m_transferChunksReceived.end() &&
+                                  received->second < static_cast<int>(totalChunks);
+                        if (waiting) {
+                            swarm->pendingComplete = complete;
+                        }
+                    }
+                    if (waiting) {
+                        // Every chunk has left the sender, so any still missing is awaited from here on
+                        SPDLOG_INFO("Transfer {} waits for chunks passed on by other swarm peers", transfer->id);
+                        awaitRelayedChunks(swarm, static_cast<uint32_t>(totalChunks));
+                        return;
+                    }
+                }
+
+                // For incoming transfers, we should have the complete file now
+                // The received file stays under its temporary name until it has been verified
+                std::shared_ptr<WriteBehindWriter> writer;
+                bool dataComplete = true;
+                {
+                    std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                    if (auto it = m_fileWriters.find(transfer->id); it != m_fileWriters.end()) {
+                        writer = it->second;
+
+                        std::size_t totalChunks = (transfer->fileSize + network::DEFAULT_CHUNK_SIZE - 1) /
+                                                  network::DEFAULT_CHUNK_SIZE;
+                        auto received = m_transferChunksReceived.find(transfer->id);
+                        dataComplete = received == m_transferChunksReceived.end() ||
+                                       received->second == static_cast<int>(totalChunks);
+                    }
+                }
+
+                if (!dataComplete) {
+                    releaseIncomingFile(transfer->id, true);
+                    updateTransferStatus(complete.transferId, TransferStatus::Failed, "File data incomplete");
+                    return;
+                }
+
+                try {
+                    // Verify our copy against the sender's hash
+                    if (!complete.fileHash.empty()) {
+                        if (transfer->fileHash.empty()) {
+                            if (writer) {
+                                writer->sync();
+                            }
+                            transfer->fileHash = utils::Hashing::hashFile(writer ? writer->tempPath()
+                                                                                 : transfer->filePath,
+                                                                          transferHashAlgorithm(*transfer));
+                        }
+
+                        if (transfer->fileHash != complete.fileHash) {
+                            SPDLOG_ERROR("File hash mismatch for {}: expected {}, got {}",
+                                         transfer->id, complete.fileHash, transfer->fileHash);
+                            releaseIncomingFile(transfer->id, false);
+                            updateTransferStatus(complete.transferId, TransferStatus::Failed, "File hash mismatch");
+                            return;
+                        }
+                    }
+
+                    // Only a verified file is moved into place
+                    if (writer) {
+                        writer->finalize();
+
+                        std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                        m_fileWriters.erase(transfer->id);
+                        m_chunkMaps.erase(transfer->id);
+                        m_transferChunksReceived.erase(transfer->id);
+                    }
+                    recordReceivedFile(*transfer);
+                } catch (const std::exception &e) {
+                    SPDLOG_ERROR("Error finalizing file for transfer {}: {}", transfer->id, e.what());
+                    releaseIncomingFile(transfer->id, true);
+                    updateTransferStatus(complete.transferId, TransferStatus::Failed,
+                                         std::string("Error finalizing file: ") + e.what());
+                    return;
+                }
+
+                // A verified copy can be pulled from us by its hash, if received files are shared
+                if (m_shareReceivedFiles && !complete.fileHash.empty()) {
+                    registerSharedFile(transfer->filePath, transferHashAlgorithm(*transfer), complete.fileHash);
+                }
+
+                // Update transfer as completed
+                updateTransferProgress(complete.transferId, transfer->fileSize);
+                updateTransferStatus(complete.transferId, TransferStatus::Completed);
+            } else {
+                // For outgoing transfers, this is a confirmation from the receiver
+                updateTransferStatus(complete.transferId, TransferStatus::Completed);
+            }
+        } else {
+            SPDLOG_ERROR("Transfer failed: {}", transfer->id);
+            updateTransferStatus(complete.transferId, TransferStatus::Failed,
+                                 "Transfer failed on the remote side");
+        }
+    }
+
+    void TransferManager::processDeltaSignature(const network::DeltaSignatureMessage &signatureMsg,
+                                                const std::string &endpoint) {
+        auto transfer = findTransfer(signatureMsg.transferId);
+
+        if (!transfer) {
+            SPDLOG_ERROR("Received delta signature for unknown transfer: {}", signatureMsg.transferId);
+            return;
+        }
+
+        if (transfer->direction != TransferDirection::Outgoing) {
+            SPDLOG_ERROR("Received delta signature for an incoming transfer: {}", signatureMsg.transferId);
+            return;
+        }
+
+        SPDLOG_INFO("Delta signature received for transfer {}: basis of {} bytes",
+                    transfer->id, signatureMsg.basisSize);
+
+        FileSignature signature;
+        try {
+            signature = FileSignature::unpack(signatureMsg.blockSize, signatureMsg.basisSize, signatureMsg.signature);
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Bad delta signature for transfer {}: {}", transfer->id, e.what());
+            updateTransferStatus(transfer->id, TransferStatus::Failed, std::string("Bad delta signature: ") + e.what());
+
+            network::TransferCancelMessage cancel;
+            cancel.transferId = transfer->id;
+            cancel.reason = "Bad delta signature: " + std::string(e.what());
+            m_socketHandler->sendTcp(endpoint, network::Protocol::serialize(cancel));
+            return;
+        }
+
+        std::thread transferThread([this, transfer, endpoint, signature = std::move(signature)]() {
+            try {
+                waitForReadTurn(transfer->id);
+                if (transfer->status != TransferStatus::InProgress) {
+                    SPDLOG_INFO("Transfer {} ended while waiting to read its file", transfer->id);
+                    return;
+                }
+
+                uint32_t chunkIndex = 0;
+
+                auto sendBatch = [&](std::vector<DeltaInstruction> &&instructions, bool finalChunk) {
+                    // Check if transfer has been canceled
+                    auto updatedTransfer = findTransfer(transfer->id);
+                    if (!updatedTransfer ||
+                        updatedTransfer->status == TransferStatus::Canceled ||
+                        updatedTransfer->status == TransferStatus::Failed) {
+                        SPDLOG_INFO("Transfer aborted during delta send: {}", transfer->id);
+                        return false;
+                    }
+
+                    network::DeltaDataMessage dataMsg;
+                    dataMsg.transferId = transfer->id;
+                    dataMsg.chunkIndex = chunkIndex++;
+                    dataMsg.finalChunk = finalChunk;
+                    dataMsg.instructions = DeltaSync::packInstructions(instructions);
+
+                    auto msgData = network::Protocol::serialize(dataMsg);
+                    if (m_socketHandler->sendTcp(endpoint, msgData).get() < 0) {
+                        SPDLOG_ERROR("Failed to send delta chunk {} for transfer {}", dataMsg.chunkIndex, transfer->id);
+                        updateTransferStatus(transfer->id, TransferStatus::Failed, "Failed to send delta data");
+                        return false;
+                    }
+                    return true;
+                };
+
+                // The file hash is computed as the delta reads the file, so the file is only read once
+                auto hasher = utils::Hashing::create(transferHashAlgorithm(*transfer));
+                bool completed = DeltaSync::computeDelta(
+                        signature, transfer->filePath,
+                        [&](std::vector<DeltaInstruction> &&instructions) {
+                            return sendBatch(std::move(instructions), false);
+                        },
+                        [this, transfer](std::uintmax_t bytesProcessed, std::uintmax_t, const std::string &) {
+                            updateTransferProgress(transfer->id, bytesProcessed);
+                        },
+                        1024 * 1024, hasher.get());
+
+                if (!completed || !sendBatch({}, true)) {
+                    return;
+                }
+
+                transfer->fileHash = utils::Hashing::toHex(hasher->finish());
+
+                // Send transfer complete message
+                network::TransferCompleteMessage completeMsg;
+                completeMsg.transferId = transfer->id;
+                completeMsg.success = true;
+                completeMsg.fileHash = transfer->fileHash;
+
+                auto completeData = network::Protocol::serialize(completeMsg);
+                if (m_socketHandler->sendTcp(endpoint, completeData).get() < 0) {
+                    SPDLOG_ERROR("Failed to send transfer complete message for {}", transfer->id);
+                    updateTransferStatus(transfer->id, TransferStatus::Failed,
+                                         "Failed to send transfer complete message");
+                    return;
+                }
+
+                updateTransferProgress(transfer->id, transfer->fileSize);
+                updateTransferStatus(transfer->id, TransferStatus::Completed);
+
+                SPDLOG_INFO("Delta transfer completed: {}", transfer->id);
+            } catch (const std::exception &e) {
+                SPDLOG_ERROR("Error during delta transfer {}: {}", transfer->id, e.what());
+                updateTransferStatus(transfer->id, TransferStatus::Failed,
+                                     std::string("Error during delta transfer: ") + e.what());
+            }
+        });
+
+        // Detach the thread so it runs independently
+        transferThread.detach();
+    }
+
+    void TransferManager::processDeltaData(const network::DeltaDataMessage &deltaData, const std::string &endpoint) {
+        auto transfer = findTransfer(deltaData.transferId);
+
+        if (!transfer) {
+            SPDLOG_ERROR("Received delta data for unknown transfer: {}", deltaData.transferId);
+            return;
+        }
+
+        if (transfer->direction != TransferDirection::Incoming) {
+            SPDLOG_ERROR("Received delta data for an outgoing transfer: {}", deltaData.transferId);
+            return;
+        }
+
+        SPDLOG_DEBUG("Received delta chunk {} for transfer {}", deltaData.chunkIndex, deltaData.transferId);
+
+        try {
+            std::shared_ptr<DeltaApplier> applier;
+            {
+                std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                auto it = m_deltaAppliers.find(transfer->id);
+                if (it == m_deltaAppliers.end()) {
+                    throw std::runtime_error("Delta data received without a signature");
+                }
+
+                // Instructions reference positions in the output, so they must be applied in order
+                if (static_cast<int>(deltaData.chunkIndex) != m_transferChunksReceived[transfer->id]) {
+                    throw std::runtime_error("Delta chunk received out of order");
+                }
+                m_transferChunksReceived[transfer->id]++;
+                applier = it->second;
+            }
+
+            if (deltaData.chunkIndex == 0) {
+                updateTransferStatus(deltaData.transferId, TransferStatus::InProgress);
+            }
+
+            applier->apply(DeltaSync::unpackInstructions(deltaData.instructions));
+            updateTransferProgress(deltaData.transferId,
+                                   std::min<std::uintmax_t>(applier->bytesWritten(), transfer->fileSize));
+
+            if (!deltaData.finalChunk) {
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                m_transferChunksReceived.erase(transfer->id);
+            }
+
+            // The old file stays in place until the sender's hash confirms the new one
+            if (!applier->finish()) {
+                throw std::runtime_error("Failed to write delta result: " + transfer->filePath);
+            }
+            transfer->fileHash = applier->fileHash();
+
+            SPDLOG_INFO("Delta applied for transfer {}: {} bytes, waiting for the sender's hash",
+                        transfer->id, applier->bytesWritten());
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Error processing delta data for transfer {}: {}", deltaData.transferId, e.what());
+
+            updateTransferStatus(deltaData.transferId, TransferStatus::Failed,
+                                 std::string("Error processing delta data: ") + e.what());
+
+            // Send cancel message to the sender
+            network::TransferCancelMessage cancel;
+            cancel.transferId = deltaData.transferId;
+            cancel.reason = "Failed to process delta data: " + std::string(e.what());
+
+            auto data = network::Protocol::serialize(cancel);
+            m_socketHandler->sendTcp(endpoint, data);
+
+            // Clean up any temporary data
+            {
+                std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                m_deltaAppliers.erase(transfer->id);
+                m_transferChunksReceived.erase(transfer->id);
+            }
+        }
+    }
+
+    void TransferManager::finishDeltaTransfer(TransferInfo &transfer, DeltaApplier &applier,
+                                              const network::TransferCompleteMessage &complete,
+                                              const std::string &endpoint) {
+        // Dropping the applier on any failure below removes the new file and keeps the old one
+        if (!applier.finished()) {
+            SPDLOG_ERROR("Delta data incomplete for transfer {}", transfer.id);
+            updateTransferStatus(transfer.id, TransferStatus::Failed, "Delta data incomplete");
+            return;
+        }
+
+        if (!complete.fileHash.empty() && applier.fileHash() != complete.fileHash) {
+            SPDLOG_ERROR("File hash mismatch for {}: expected {}, got {}",
+                         transfer.id, complete.fileHash, applier.fileHash());
+            updateTransferStatus(transfer.id, TransferStatus::Failed, "File hash mismatch");
+            return;
+        }
+
+        if (!applier.install()) {
+            updateTransferStatus(transfer.id, TransferStatus::Failed,
+                                 "Failed to install delta result: " + transfer.filePath);
+            return;
+        }
+
+        recordReceivedFile(transfer);
+
+        // Acknowledge with the hash of the file now in place
+        network::TransferCompleteMessage ack;
+        ack.transferId = transfer.id;
+        ack.success = true;
+        ack.fileHash = transfer.fileHash;
+
+        if (m_socketHandler->sendTcp(endpoint, network::Protocol::serialize(ack)).get() < 0) {
+            SPDLOG_WARN("Failed to acknowledge delta transfer {}", transfer.id);
+        }
+
+        if (m_shareReceivedFiles && !complete.fileHash.empty()) {
+            registerSharedFile(transfer.filePath, transferHashAlgorithm(transfer), complete.fileHash);
+        }
+
+        updateTransferProgress(transfer.id, transfer.fileSize);
+        updateTransferStatus(transfer.id, TransferStatus::Completed);
+
+        SPDLOG_INFO("Transfer completed successfully: {}", transfer.id);
+    }
+
+    void TransferManager::processDictionary(const network::DictionaryMessage &dictionary,
+                                            const std::string &endpoint) {
+        uint32_t id = m_dictionaryStore.store(dictionary.dictionary);
+
+        if (id == 0 || id != dictionary.dictionaryId) {
+            SPDLOG_ERROR("Invalid compression dictionary {} from {}", dictionary.dictionaryId, endpoint);
+            return;
+        }
+
+        SPDLOG_INFO("Cached compression dictionary {} from {} ({} bytes)",
+                    id, endpoint, dictionary.dictionary.size());
+    }
+
+    void TransferManager::processFileData(const network::FileDataMessage &fileData, const std::string &endpoint) {
+        auto transfer = findTransfer(fileData.transferId);
+
+        if (!transfer) {
+            // Chunks passed on by another swarm peer carry the swarm ID and are taken as if from the sender
+            std::shared_ptr<IncomingSwarm> swarm;
+            {
+                std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                if (auto it = m_incomingSwarms.find(fileData.transferId); it != m_incomingSwarms.end()) {
+                    swarm = it->second;
+                }
+            }
+            if (swarm && (transfer = findTransfer(swarm->transferId))) {
+                awaitRelayedChunks(swarm, fileData.chunkIndex);
+
+                network::FileDataMessage relayed = fileData;
+                relayed.transferId = transfer->id;
+                relayed.relayTo.clear();
+                processFileData(relayed, transfer->peerAddress);
+                return;
+            }
+
+            SPDLOG_ERROR("Received file data for unknown transfer: {}", fileData.transferId);
+            return;
+        }
+
+        // Ensure this is an incoming transfer
+        if (transfer->direction != TransferDirection::Incoming) {
+            SPDLOG_ERROR("Received file data for an outgoing transfer: {}", fileData.transferId);
+            return;
+        }
+
+        // Chunks still on their way when the transfer ended, such as the second copy of a range a pull asked of two
+        // peers, are dropped rather than failing it
+        if (transfer->status == TransferStatus::Completed || transfer->status == TransferStatus::Failed ||
+            transfer->status == TransferStatus::Canceled) {
+            SPDLOG_DEBUG("Dropping chunk {} of ended transfer {}", fileData.chunkIndex, fileData.transferId);
+            return;
+        }
+
+        SPDLOG_DEBUG("Received file data chunk {}/{} for transfer {}",
+                     fileData.chunkIndex, fileData.totalChunks, fileData.transferId);
+
+        try {
+            // Verify the per-frame checksum (absent from older peers)
+            if (!fileData.raw && !fileData.hole && fileData.checksum &&
+                utils::Hashing::crc32c(fileData.data.data(), fileData.data.size()) != *fileData.checksum) {
+                throw std::runtime_error("Checksum mismatch in chunk " + std::to_string(fileData.chunkIndex));
+            }
+
+            // A swarm peer passes the chunk on as it arrived, before spending any time on it
+            if (!fileData.relayTo.empty()) {
+                std::string swarmId;
+                if (auto swarm = findIncomingSwarm(transfer->id, &swarmId)) {
+                    queueRelay(swarmId, swarm, fileData);
+                    awaitRelayedChunks(swarm, fileData.chunkIndex);
+                }
+            }
+
+            // Raw chunks arrive in the next frame and holes carry no data at all
+            std::vector<uint8_t> chunkData;
+            bool hasData = !fileData.raw && !fileData.hole;
+            if (hasData) {
+                chunkData = decodeChunk(fileData);
+            }
+            std::size_t chunkSize = hasData ? chunkData.size() : fileData.originalSize;
+
+            // Chunks of a directory transfer go to the file their manifest entry names
+            if (auto directory = findIncomingDirectory(transfer->id)) {
+                if (!hasData) {
+                    throw std::runtime_error("Raw or hole chunk in a directory transfer");
+                }
+                if (transfer->status == TransferStatus::Waiting) {
+                    updateTransferStatus(fileData.transferId, TransferStatus::InProgress);
+                }
+                if (fileData.packed) {
+                    receivePackedFiles(transfer, *directory, chunkData);
+                } else {
+                    receiveDirectoryChunk(transfer, *directory, fileData, chunkData);
+                }
+                return;
+            }
+
+            // The output file was created and preallocated when the transfer was accepted
+            std::shared_ptr<WriteBehindWriter> writer;
+            {
+                std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                auto it = m_fileWriters.find(transfer->id);
+                if (it != m_fileWriters.end()) {
+                    writer = it->second;
+                }
+            }
+
+            if (!writer) {
+                throw std::runtime_error("No open file for transfer");
+            }
+
+            if (transfer->status == TransferStatus::Waiting) {
+                updateTransferStatus(fileData.transferId, TransferStatus::InProgress);
+            }
+
+            if (fileData.chunkIndex >= fileData.totalChunks ||
+                fileData.offset + chunkSize > transfer->fileSize) {
+                throw std::runtime_error("Invalid chunk index or offset");
+            }
+
+            if (fileData.hole) {
+                writer->writeHole(fileData.offset, chunkSize);
+                completeChunk(transfer, writer, fileData, endpoint);
+                return;
+            }
+
+            if (fileData.raw) {
+#ifndef PLATFORM_WINDOWS
+                // Claim the frame that follows; the socket handler splices it straight into the file
+                network::RawDataSink sink;
+                sink.fd = writer->descriptor();
+                sink.offset = fileData.offset;
+                sink.length = chunkSize;
+                sink.onComplete = [this, transfer, writer, fileData, endpoint](bool success,
+                                                                              const std::string &errorMessage) {
+                    if (!success) {
+                        abortIncomingTransfer(fileData.transferId, endpoint, errorMessage);
+                        return;
+                    }
+
+                    try {
+                        writer->recordExternalWrite(fileData.offset, fileData.originalSize);
+                        completeChunk(transfer, writer, fileData, endpoint);
+                    } catch (const std::exception &e) {
+                        abortIncomingTransfer(fileData.transferId, endpoint, e.what());
+                    }
+                };
+                m_socketHandler->expectRawData(endpoint, std::move(sink));
+                return;
+#else
+                throw std::runtime_error("Raw file data is not supported on this platform");
+#endif
+            }
+
+            writer->writeAt(fileData.offset, chunkData);
+            completeChunk(transfer, writer, fileData, endpoint);
+        } catch (const std::exception &e) {
+            abortIncomingTransfer(fileData.transferId, endpoint, e.what());
+        }
+    }
+
+    void TransferManager::completeChunk(const std::shared_ptr<TransferInfo> &transfer,
+                                        const std::shared_ptr<WriteBehindWriter> &writer,
+                                        const network::FileDataMessage &fileData, const std::string &endpoint) {
+        // A pull hands a source its next range once the last one is in
+        if (auto pull = findIncomingPull(transfer->id)) {
+            notePullChunk(*pull, endpoint, fileData.chunkIndex);
+        }
+
+        int chunksReceived = 0;
+        std::vector<uint8_t> checkpointMap;
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+
+            // A chunk kept from an earlier attempt may be sent again by a peer that does not resume
+            auto &chunkMap = m_chunkMaps[transfer->id];
+            if (hasChunk(chunkMap, fileData.chunkIndex)) {
+                return;
+            }
+            if (chunkMap.size() <= fileData.chunkIndex / 8) {
+                chunkMap.resize(fileData.chunkIndex / 8 + 1);
+            }
+            chunkMap[fileData.chunkIndex / 8] |= static_cast<uint8_t>(1u << (fileData.chunkIndex % 8));
+
+            chunksReceived = ++m_transferChunksReceived[transfer->id];
+            if (chunksReceived % CHECKPOINT_INTERVAL == 0 && chunksReceived < static_cast<int>(fileData.totalChunks)) {
+                checkpointMap = chunkMap;
+            }
+        }
+
+        // Record a resume point now and then, so a crash loses at most the chunks since the last one
+        if (!checkpointMap.empty()) {
+            checkpointIncomingFile(*transfer, *writer, checkpointMap);
+        }
+
+        // Update progress
+        updateTransferProgress(fileData.transferId,
+                               std::min<std::uintmax_t>(static_cast<std::uintmax_t>(chunksReceived) *
+                                                        network::DEFAULT_CHUNK_SIZE, transfer->fileSize));
+
+        // Check if all chunks have been received
+        if (chunksReceived == static_cast<int>(fileData.totalChunks)) {
+            SPDLOG_INFO("All chunks received for transfer {}, verifying file", fileData.transferId);
+            completeIncomingData(transfer, writer, endpoint);
+        }
+    }
+
+    void TransferManager::completeIncomingData(const std::shared_ptr<TransferInfo> &transfer,
+                                               const std::shared_ptr<WriteBehindWriter> &writer,
+                                               const std::string &endpoint) {
+        // Flush and hash the file under its temporary name; it is moved into place once the sender's hash matches
+        writer->sync();
+        transfer->fileHash = utils::Hashing::hashFile(writer->tempPath(), transferHashAlgorithm(*transfer));
+
+        // A pull has no sender to confirm to; its file must match the hash it was pulled by
+        if (auto pull = findIncomingPull(transfer->id)) {
+            network::TransferCompleteMessage complete;
+            complete.transferId = transfer->id;
+            complete.success = true;
+            complete.fileHash = pull->fileHash;
+            processTransferComplete(complete, endpoint);
+            return;
+        }
+
+        // Send transfer complete message
+        network::TransferCompleteMessage complete;
+        complete.transferId = transfer->id;
+        complete.success = true;
+        complete.fileHash = transfer->fileHash;
+
+        // Serialize and send the message; the last chunk may have come over one of the connections a striped
+        // transfer closes when done, so it goes over the transfer's own
+        auto data = network::Protocol::serialize(complete);
+        auto sendFuture = m_socketHandler->sendTcp(transfer->peerAddress, data);
+        int result = sendFuture.get();
+
+        if (result < 0) {
+            SPDLOG_ERROR("Failed to send transfer complete message for {}", transfer->id);
+            updateTransferStatus(transfer->id, TransferStatus::Failed, "Failed to send completion acknowledgment");
+            releaseIncomingFile(transfer->id, true);
+            return;
+        }
+
+        SPDLOG_INFO("File data complete for transfer {}, waiting for the sender's hash", transfer->id);
+
+        // In a swarm or a striped transfer the sender's hash may have come before the last of the data
+        std::optional<network::TransferCompleteMessage> pendingComplete;
+        if (auto swarm = findIncomingSwarm(transfer->id)) {
+            std::lock_guard<std::mutex> lock(swarm->mutex);
+            pendingComplete = std::move(swarm->pendingComplete);
+            swarm->pendingComplete.reset();
+        } else {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            if (auto striped = m_stripedTransfers.find(transfer->id); striped != m_stripedTransfers.end()) {
+                pendingComplete = std::move(striped->second);
+                striped->second.reset();
+            }
+        }
+        if (pendingComplete) {
+            processTransferComplete(*pendingComplete, endpoint);
+        }
+    }
+
+    bool TransferManager::joinMulticast(const std::shared_ptr<TransferInfo> &transfer,
+                                        const std::shared_ptr<WriteBehindWriter> &writer,
+                                        const std::shared_ptr<IncomingSwarm> &swarm,
+                                        const network::MulticastSession &session) {
+        std::string transferId = transfer->id;
+        auto bytesReceived = std::make_shared<std::uintmax_t>(0);
+
+        auto sink = [this, transfer, writer, bytesReceived](uint64_t offset, std::span<const uint8_t> data) {
+            if (transfer->status == TransferStatus::Waiting) {
+                updateTransferStatus(transfer->id, TransferStatus::InProgress);
+            }
+            writer->writeAt(offset, data);
+            *bytesReceived += data.size();
+            updateTransferProgress(transfer->id, std::min<std::uintmax_t>(*bytesReceived, transfer->fileSize));
+        };
+
+        // Finished off the receiver's thread, as finishing the transfer stops the receiver
+        auto onFinished = [this, transferId, writer](bool success, const std::string &errorMessage) {
+            std::thread finishThread([this, transferId, writer, success, errorMessage]() {
+                auto transfer = findTransfer(transferId);
+                if (!transfer || transfer->status == TransferStatus::Failed ||
+                    transfer->status == TransferStatus::Canceled) {
+                    return;
+                }
+
+                if (!success) {
+                    abortIncomingTransfer(transferId, transfer->peerAddress, errorMessage);
+                    return;
+                }
+
+                try {
+                    // The stream covers the whole file, so every chunk counts as received
+                    std::size_t totalChunks = (transfer->fileSize + network::DEFAULT_CHUNK_SIZE - 1) /
+                                              network::DEFAULT_CHUNK_SIZE;
+                    {
+                        std::lock_guard<std::mutex> lock(m_transferDataMutex);
+                        m_chunkMaps[transferId].assign((totalChunks + 7) / 8, 0xFF);
+                        m_transferChunksReceived[transferId] = static_cast<int>(totalChunks);
+                    }
+
+                    if (transfer->status == TransferStatus::Waiting) {
+                        updateTransferStatus(transferId, TransferStatus::InProgress);
+                    }
+                    updateTransferProgress(transferId, transfer->fileSize);
+                    completeIncomingData(transfer, writer, transfer->peerAddress);
+                } catch (const std::exception &e) {
+                    abortIncomingTransfer(transferId, transfer->peerAddress, e.what());
+                }
+            });
+            finishThread.detach();
+        };
+
+        auto receiver = std::make_unique<network::MulticastReceiver>(session, std::move(sink), std::move(onFinished),
+                                                                     m_multicastInterface);
+        if (!receiver->start()) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(swarm->mutex);
+        swarm->multicast = std::move(receiver);
+        return true;
+    }
+
+    void TransferManager::processManifest(const network::ManifestMessage &manifest, const std::string &endpoint) {
+        auto directory = findIncomingDirectory(manifest.transferId);
+        if (!directory) {
+            SPDLOG_ERROR("Received manifest for unknown directory transfer: {}", manifest.transferId);
+            return;
+        }
+
+        try {
+            std::lock_guard<std::mutex> lock(directory->mutex);
+            if (manifest.firstEntry != directory->entries.size() ||
+                directory->entries.size() + manifest.entries.size() > directory->entryCount) {
+                throw std::runtime_error("Manifest page out of order");
+            }
+
+            fs::path root(directory->root);
+            for (const auto &entry: manifest.entries) {
+                if (!DirectoryWalker::isSafePath(entry.path)) {
+                    throw std::runtime_error("Unsafe path in manifest: " + entry.path);
+                }
+
+                std::string path = (root / entry.path).string();
+                if (entry.directory) {
+                    fs::create_directories(path);
+                } else if (entry.size == 0) {
+                    // Empty files get no chunks, so they are created as the manifest arrives
+                    FileWriter writer(path);
+                    writer.finalize();
+                    DirectoryWalker::applyMetadata(path, entry);
+                    directory->filesExpected++;
+                    directory->filesDone++;
+                } else {
+                    directory->filesExpected++;
+                }
+
+                directory->entries.push_back(entry);
+            }
+
+            if (manifest.lastPage && directory->entries.size() != directory->entryCount) {
+                throw std::runtime_error("Manifest has " + std::to_string(directory->entries.size()) +
+                                         " entries, expected " + std::to_string(directory->entryCount));
+            }
+
+            SPDLOG_DEBUG("Received manifest entries {}-{} of {} for transfer {}", manifest.firstEntry,
+                         directory->entries.size(), directory->entryCount, manifest.transferId);
+        } catch (const std::exception &e) {
+            abortIncomingTransfer(manifest.transferId, endpoint, e.what());
+        }
+    }
+
+    void TransferManager::receiveDirectoryChunk(const std::shared_ptr<TransferInfo> &transfer,
+                                                IncomingDirectory &directory, const network::FileDataMessage &fileData,
+                                                std::span<const uint8_t> chunk) {
+        std::uintmax_t bytesReceived;
+        {
+            std::lock_guard<std::mutex> lock(directory.mutex);
+            if (fileData.fileIndex >= directory.entries.size()) {
+                throw std::runtime_error("Chunk for unknown manifest entry " + std::to_string(fileData.fileIndex));
+            }
+
+            const auto &entry = directory.entries[fileData.fileIndex];
+            std::uintmax_t totalChunks = (entry.size + network::DEFAULT_CHUNK_SIZE - 1) / network::DEFAULT_CHUNK_SIZE;
+            if (entry.directory || fileData.totalChunks != totalChunks || fileData.chunkIndex >= totalChunks ||
+                fileData.offset + chunk.size() > entry.size) {
+                throw std::runtime_error("Invalid chunk index or offset for " + entry.path);
+            }
+
+            // Only the first copy of a chunk counts, so a repeat cannot complete a file early
+            directory.finished.resize(directory.entries.size(), false);
+            if (directory.finished[fileData.fileIndex]) {
+                SPDLOG_DEBUG("Ignoring chunk {} of {}, which is already complete", fileData.chunkIndex, entry.path);
+                return;
+            }
+
+            auto &file = directory.openFiles[fileData.fileIndex];
+            if (!file.writer) {
+                file.writer = std::make_unique<FileWriter>((fs::path(directory.root) / entry.path).string(),
+                                                           entry.size);
+                file.writer->setDurability(m_durability);
+                file.received.assign(totalChunks, false);
+            }
+
+            if (file.received[fileData.chunkIndex]) {
+                SPDLOG_DEBUG("Ignoring repeated chunk {} of {}", fileData.chunkIndex, entry.path);
+                return;
+            }
+            file.received[fileData.chunkIndex] = true;
+
+            file.writer->writeAt(fileData.offset, chunk);
+            if (++file.chunksReceived == totalChunks) {
+                finishDirectoryFile(*transfer, directory, fileData.fileIndex, *file.writer);
+                directory.openFiles.erase(fileData.fileIndex);
+                directory.finished[fileData.fileIndex] = true;
+            }
+
+            directory.bytesReceived += chunk.size();
+            bytesReceived = directory.bytesReceived;
+        }
+
+        updateTransferProgress(transfer->id, std::min(bytesReceived, transfer->fileSize));
+    }
+
+    void TransferManager::receivePackedFiles(const std::shared_ptr<TransferInfo> &transfer,
+                                             IncomingDirectory &directory, std::span<const uint8_t> pack) {
+        std::vector<network::PackedFile> packed = network::unpackFiles(pack);
+
+        std::uintmax_t bytesReceived;
+        {
+            std::lock_guard<std::mutex> lock(directory.mutex);
+
+            std::vector<SmallFile> batch;
+            batch.reserve(packed.size());
+            for (const auto &file: packed) {
+                if (file.fileIndex >= directory.entries.size()) {
+                    throw std::runtime_error("Packed file for unknown manifest entry " +
+                                             std::to_string(file.fileIndex));
                 }
+
+                const auto &entry = directory.entries[file.fileIndex];
+                if (entry.directory || entry.size == 0 || entry.size != file.data.size()) {
+                    throw std::runtime_error("Packed file does not match its manifest entry: " + entry.path);
+                }
+
+                // The whole file is at hand, so it is verified before it is written
+                if (!entry.hash.empty() &&
+                    utils::Hashing::hashBuffer(file.data.data(), file.data.size(),
+                                               transferHashAlgorithm(*transfer)) != entry.hash) {
+                    throw std::runtime_error("File hash mismatch for " + entry.path);
+                }
+
+                batch.push_back({(fs::path(directory.root) / entry.path).string(), file.data});
+            }
+
+            m_fileHandler->writeFiles(batch, m_durability);
+
+            for (std::size_t i = 0; i < packed.size(); ++i) {
+                DirectoryWalker::applyMetadata(batch[i].path, directory.entries[packed[i].fileIndex]);
+                directory.bytesReceived += packed[i].data.size();
             }
-        }
+            directory.filesDone += packed.size();
+            bytesReceived = directory.bytesReceived;
 
-        // Connect to the peer
-        bool success = m_socketHandler->connectTcp(
-                peer.ipAddress,
-                peer.port,
-                [this](const std::vector<uint8_t> &data, const std::string &endpoint) {
-                    this->handleIncomingData(data, endpoint);
-                },
-                [this](network::ConnectionStatus status, const std::string &endpoint, const std::string &errorMessage) {
-                    this->handleConnectionStatus(status, endpoint, errorMessage);
-                }
-        );
+            SPDLOG_DEBUG("Unpacked {} files ({} of {} files)", packed.size(), directory.filesDone,
+                         directory.filesExpected);
+        }
 
-        return success;
+        updateTransferProgress(transfer->id, std::min(bytesReceived, transfer->fileSize));
     }
 
-    std::shared_ptr<PeerInfo> TransferManager::getPeerInfo(const std::string &peerId) const {
-        // Get all known peers
-        std::vector<PeerInfo> peers = m_discoveryService->getKnownPeers();
+    void TransferManager::finishDirectoryFile(const TransferInfo &transfer, IncomingDirectory &directory,
+                                              uint32_t fileIndex, FileWriter &writer) {
+        const auto &entry = directory.entries[fileIndex];
 
-        // Find the peer with matching id
-        for (const auto &peer: peers) {
-            if (peer.id == peerId) {
-                return std::make_shared<PeerInfo>(peer);
+        // The hash is only in the manifest if the sender was asked to compute it
+        if (!entry.hash.empty()) {
+            writer.sync();
+            std::string hash = utils::Hashing::hashFile(writer.tempPath(), transferHashAlgorithm(transfer));
+            if (hash != entry.hash) {
+                throw std::runtime_error("File hash mismatch for " + entry.path);
             }
         }
 
-        return nullptr;
-    }
+        writer.finalize();
+        DirectoryWalker::applyMetadata(writer.path(), entry);
+        directory.filesDone++;
 
-    std::string TransferManager::generateTransferId() {
-        // Generate a unique ID based on timestamp and counter
-        auto now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
-        int id = m_nextTransferId.fetch_add(1);
+        SPDLOG_DEBUG("Received {} ({} of {} files)", entry.path, directory.filesDone, directory.filesExpected);
+    }
 
-        std::stringstream ss;
-        ss << std::hex << now << "-" << id;
-        return ss.str();
+    std::shared_ptr<TransferManager::IncomingDirectory> TransferManager::findIncomingDirectory(
+            const std::string &transferId) const {
+        std::lock_guard<std::mutex> lock(m_transferDataMutex);
+        auto it = m_incomingDirectories.find(transferId);
+        return it != m_incomingDirectories.end() ? it->second : nullptr;
     }
 
-    void TransferManager::updateTransferProgress(const std::string &transferId, std::uintmax_t bytesTransferred) {
-        auto transfer = findTransfer(transferId);
-        if (!transfer) {
-            SPDLOG_ERROR("Failed to update the progress: transfer not found: {}", transferId);
-            return;
-        }
+    void TransferManager::abortIncomingTransfer(const std::string &transferId, const std::string &endpoint,
+                                                const std::string &reason) {
+        SPDLOG_ERROR("Error processing file data for transfer {}: {}", transferId, reason);
 
-        // Update the transfer of the progress
-        transfer->bytesTransferred = bytesTransferred;
+        // Update transfer status to failed
+        updateTransferStatus(transferId, TransferStatus::Failed, "Error processing file data: " + reason);
 
-        // Calculate progress percentage
-        if (transfer->fileSize > 0) {
-            transfer->progress = static_cast<float>(bytesTransferred) / static_cast<float>(transfer->fileSize) * 100.0f;
-        } else {
-            transfer->progress = 100.0f; // Avoid division by zero
-        }
+        // Send cancel message to the sender
+        network::TransferCancelMessage cancel;
+        cancel.transferId = transferId;
+        cancel.reason = "Failed to process file data: " + reason;
 
-        // Notify the callback
-        if (m_statusCallback) {
-            m_statusCallback(*transfer);
-        }
+        // Serialize and send the message
+        auto data = network::Protocol::serialize(cancel);
+        m_socketHandler->sendTcp(endpoint, data);
 
-        SPDLOG_DEBUG("Transfer progress updated: {} - {}%", transferId, transfer->progress);
+        // Chunks that reached the file intact are kept for the next attempt
+        releaseIncomingFile(transferId, true);
     }
 
-    void TransferManager::updateTransferStatus(const std::string &transferId, TransferStatus status,
-                                               const std::string &errorMessage) {
-        auto transfer = findTransfer(transferId);
-        if (!transfer) {
-            SPDLOG_ERROR("Failed to update status: transfer not found: {}", transferId);
-            return;
+    void TransferManager::releaseIncomingFile(const std::string &transferId, bool keepResumePoint) {
+        std::shared_ptr<WriteBehindWriter> writer;
+        std::vector<uint8_t> chunkMap;
+        std::shared_ptr<IncomingDirectory> directory;
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            if (auto it = m_incomingDirectories.find(transferId); it != m_incomingDirectories.end()) {
+                directory = std::move(it->second);
+                m_incomingDirectories.erase(it);
+            }
+            if (auto it = m_fileWriters.find(transferId); it != m_fileWriters.end()) {
+                writer = std::move(it->second);
+                m_fileWriters.erase(it);
+            }
+            if (auto it = m_chunkMaps.find(transferId); it != m_chunkMaps.end()) {
+                chunkMap = std::move(it->second);
+                m_chunkMaps.erase(it);
+            }
+            m_transferChunksReceived.erase(transferId);
+
+            // Dropping a delta applier removes its output, leaving the old copy of the file in place
+            m_deltaAppliers.erase(transferId);
         }
 
-        // Update the transfer status
-        transfer->status = status;
+        // Files of a directory that were already moved into place are kept; partial ones cannot be resumed
+        if (directory) {
+            std::lock_guard<std::mutex> lock(directory->mutex);
+            for (auto &[index, file]: directory->openFiles) {
+                file.writer->discard();
+            }
+            directory->openFiles.clear();
+        }
 
-        // Set the error message if provided
-        if (!errorMessage.empty()) {
-            transfer->errorMessage = errorMessage;
+        if (!writer) {
+            return;
         }
 
-        // Record the end time for complete, failed or canceled transfers
-        if (status == TransferStatus::Completed ||
-            status == TransferStatus::Failed ||
-            status == TransferStatus::Canceled) {
-            transfer->endTime = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        auto transfer = findTransfer(transferId);
+        bool anyChunks = std::any_of(chunkMap.begin(), chunkMap.end(), [](uint8_t byte) { return byte != 0; });
+        if (!keepResumePoint || !transfer || !anyChunks) {
+            writer->discard();
+            return;
         }
 
-        // Notify the callback
-        if (m_statusCallback) {
-            m_statusCallback(*transfer);
+        try {
+            checkpointIncomingFile(*transfer, *writer, chunkMap);
+            SPDLOG_INFO("Kept partial file of transfer {} to resume from: {}", transferId, writer->tempPath());
+        } catch (const std::exception &e) {
+            SPDLOG_WARN("Could not save resume point for transfer {}: {}", transferId, e.what());
         }
+    }
 
-        SPDLOG_INFO("Transfer status update: {} - {}", transferId, static_cast<int>(status));
+    void TransferManager::checkpointIncomingFile(const TransferInfo &transfer, WriteBehindWriter &writer,
+                                                 const std::vector<uint8_t> &chunkMap) {
+        // Enough to recognise the same file offered again by the same peer
+        json state = {
+                {"senderId",  transfer.peerId},
+                {"fileName",  transfer.fileName},
+                {"fileSize",  transfer.fileSize},
+                {"chunkSize", network::DEFAULT_CHUNK_SIZE},
+                {"chunks",    network::encodeBase64(chunkMap)}
+        };
 
+        writer.checkpoint(state.dump());
     }
 
-    std::shared_ptr<TransferInfo> TransferManager::findTransfer(const std::string &transferId) {
-        std::lock_guard<std::mutex> lock(m_transfersMutex);
+    bool TransferManager::isDeltaBasis(const fs::path &basisPath, const std::string &senderId) const {
+        if (m_deltaUpdates) {
+            return true;
+        }
 
-        if (auto it = m_transfers.find(transferId); it != m_transfers.end()) {
-            return it->second;
+        std::error_code ec;
+        auto size = fs::file_size(basisPath, ec);
+        if (ec) {
+            return false;
+        }
+        auto modified = fs::last_write_time(basisPath, ec);
+        if (ec) {
+            return false;
         }
 
-        return nullptr;
+        std::lock_guard<std::mutex> lock(m_transferDataMutex);
+        auto it = m_receivedFiles.find(basisPath.string());
+        if (it == m_receivedFiles.end() || it->second.senderId != senderId || it->second.size != size ||
+            it->second.modified != modified) {
+            SPDLOG_DEBUG("{} is not a copy received from {}, not updating it by delta", basisPath.string(), senderId);
+            return false;
+        }
+        return true;
     }
 
-    void
-    TransferManager::processTransferCancel(const network::TransferCancelMessage &cancel, const std::string &endpoint) {
-        auto transfer = findTransfer(cancel.transferId);
-
-        if (!transfer) {
-            SPDLOG_ERROR("Received cancel for unknown transfer: {}", cancel.transferId);
+    void TransferManager::recordReceivedFile(const TransferInfo &transfer) {
+        std::error_code ec;
+        auto size = fs::file_size(transfer.filePath, ec);
+        if (ec) {
+            return;
+        }
+        auto modified = fs::last_write_time(transfer.filePath, ec);
+        if (ec) {
             return;
         }
 
-        SPDLOG_INFO("Transfer canceled by peer: {} - {}", transfer->id, cancel.reason);
-
-        // Update transfer status
-        updateTransferStatus(cancel.transferId, TransferStatus::Canceled,
-                             "Canceled by peer: " + cancel.reason);
+        std::lock_guard<std::mutex> lock(m_transferDataMutex);
+        m_receivedFiles[transfer.filePath] = ReceivedFile{transfer.peerId, size, modified};
     }
 
-    void TransferManager::processTransferComplete(const network::TransferCompleteMessage &complete,
-                                                  const std::string &endpoint) {
-        auto transfer = findTransfer(complete.transferId);
-
-        if (!transfer) {
-            SPDLOG_ERROR("Received completion for unknown transfer: {}", complete.transferId);
-            return;
+    std::string TransferManager::findResumePoint(const network::TransferRequestMessage &request,
+                                                 std::vector<uint8_t> &chunkMap) const {
+        fs::path dir(m_downloadDirectory);
+        std::size_t totalChunks = (request.fileSize + network::DEFAULT_CHUNK_SIZE - 1) / network::DEFAULT_CHUNK_SIZE;
+
+        // Numbers handed out by createUniqueWriter() may have gaps once files are deleted, so every partial file
+        // is looked at; its checkpoint names the file it belongs to
+        std::vector<std::string> partialFiles;
+        std::error_code ec;
+        for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            const auto &entry = it->path();
+            if (entry.extension() == ".part") {
+                partialFiles.push_back((dir / entry.stem()).string());
+            }
         }
+        std::sort(partialFiles.begin(), partialFiles.end());
 
-        if (complete.success) {
-            SPDLOG_INFO("Transfer complete successfully: {}", transfer->id);
+        for (const auto &path: partialFiles) {
+            std::string state = FileWriter::loadCheckpoint(path);
+            if (state.empty()) {
+                continue;
+            }
 
-            // For incoming transfers, we should have the complete file now
-            if (transfer->direction == TransferDirection::Incoming) {
-                // TODO: Verify file hash if implemented
+            try {
+                auto j = json::parse(state);
+                if (j.value("senderId", std::string()) != request.senderId ||
+                    j.value("fileName", std::string()) != request.fileName ||
+                    j.value("fileSize", std::uintmax_t{0}) != request.fileSize ||
+                    j.value("chunkSize", std::size_t{0}) != network::DEFAULT_CHUNK_SIZE) {
+                    continue;
+                }
 
-                // Update transfer as completed
-                updateTransferProgress(complete.transferId, transfer->fileSize);
-                updateTransferStatus(complete.transferId, TransferStatus::Completed);
-            } else {
-                // For outgoing transfers, this is a confirmation from the receiver
-                updateTransferStatus(complete.transferId, TransferStatus::Completed);
+                auto chunks = network::decodeBase64(j.value("chunks", std::string()));
+                if (chunks.size() != (totalChunks + 7) / 8) {
+                    continue;
+                }
+
+                chunkMap = std::move(chunks);
+                return path;
+            } catch (const std::exception &e) {
+                SPDLOG_WARN("Ignoring unreadable resume point for {}: {}", path, e.what());
             }
-        } else {
-            SPDLOG_ERROR("Transfer failed: {}", transfer->id);
-            updateTransferStatus(complete.transferId, TransferStatus::Failed,
-                                 "Transfer failed on the remote side");
         }
+
+        return {};
     }
 
-    void TransferManager::processFileData(const network::FileDataMessage &fileData, const std::string &endpoint) {
-        auto transfer = findTransfer(fileData.transferId);
+    utils::HashAlgorithm TransferManager::transferHashAlgorithm(const TransferInfo &transfer) const {
+        return utils::Hashing::fromString(transfer.hashAlgorithm).value_or(utils::HashAlgorithm::Sha256);
+    }
 
-        if (!transfer) {
-            SPDLOG_ERROR("Received file data for unknown transfer: {}", fileData.transferId);
-            return;
+    network::FileDataMessage TransferManager::encodeChunk(const TransferInfo &transfer, uint32_t chunkIndex,
+                                                          uint32_t totalChunks, ChunkBuffer chunk,
+                                                          bool tryCompress,
+                                                          const utils::CompressionDictionary *dictionary) {
+        network::FileDataMessage dataMsg;
+        dataMsg.transferId = transfer.id;
+        dataMsg.chunkIndex = chunkIndex;
+        dataMsg.totalChunks = totalChunks;
+        dataMsg.originalSize = static_cast<uint32_t>(chunk.bytes().size());
+
+        // Compress only when the entropy probe says it is worthwhile and the result is actually smaller
+        // Dictionaries are zstd dictionaries, whatever algorithm was negotiated for large files
+        auto algorithm = dictionary ? utils::CompressionAlgorithm::Zstd
+                                    : utils::Compression::fromString(transfer.compression)
+                                            .value_or(utils::CompressionAlgorithm::None);
+        auto plain = chunk.bytes();
+        if (tryCompress && algorithm != utils::CompressionAlgorithm::None &&
+            utils::Compression::looksCompressible(plain.data(), plain.size())) {
+            std::vector<uint8_t> compressed;
+            if (utils::Compression::compress(algorithm, plain, compressed, 0, dictionary) &&
+                compressed.size() < plain.size() - plain.size() / 32) {
+                chunk = std::move(compressed);
+                dataMsg.compression = utils::Compression::toString(algorithm);
+                dataMsg.dictionaryId = dictionary ? dictionary->id() : 0;
+            }
         }
 
-        // Ensure this is an incoming transfer
-        if (transfer->direction != TransferDirection::Incoming) {
-            SPDLOG_ERROR("Received file data for an outgoing transfer: {}", fileData.transferId);
-            return;
+#ifdef ENABLE_ENCRYPTION
+        if (!m_encryptionPassword.empty()) {
+            std::vector<uint8_t> encrypted;
+            try {
+                if (sendKey(transfer.id)->encrypt(chunk.bytes(), encrypted)) {
+                    chunk = std::move(encrypted);
+                    dataMsg.encrypted = true;
+                }
+            } catch (const std::exception &e) {
+                SPDLOG_ERROR("Encryption error: {}", e.what());
+            }
+            if (!dataMsg.encrypted) {
+                SPDLOG_ERROR("Failed to encrypt chunk {} of transfer {}, sending unencrypted",
+                             chunkIndex, transfer.id);
+            }
         }
+#endif
 
-        SPDLOG_DEBUG("Received file data chunk {}/{} for transfer {}",
-                     fileData.chunkIndex, fileData.totalChunks, fileData.transferId);
+        dataMsg.data = chunk.take();
+        dataMsg.checksum = utils::Hashing::crc32c(dataMsg.data.data(), dataMsg.data.size());
+        return dataMsg;
+    }
 
-        try {
-            // Check if this is the first chunk
-            if (fileData.chunkIndex == 0) {
-                // Create the download directory if it doesn't exist
-                auto dirPath = fs::path(m_downloadDirectory);
-                if (!fs::exists(dirPath)) {
-                    fs::create_directories(dirPath);
-                }
+    std::vector<uint8_t> TransferManager::decodeChunk(const network::FileDataMessage &fileData) {
+        std::vector<uint8_t> chunk = fileData.data;
 
-                // Set the file path if it wasn't set yet
-                if (transfer->filePath.empty()) {
-                    transfer->filePath = (dirPath / m_fileHandler->getUniqueFilename(
-                            m_downloadDirectory, transfer->fileName)).string();
-                    SPDLOG_INFO("File will be saved to: {}", transfer->filePath);
-                }
+        if (fileData.encrypted) {
+#ifdef ENABLE_ENCRYPTION
+            std::vector<uint8_t> decrypted;
+            if (m_encryptionPassword.empty() || !receiveKey(chunk)->decrypt(chunk, decrypted)) {
+                throw std::runtime_error("Failed to decrypt chunk " + std::to_string(fileData.chunkIndex));
+            }
+            chunk = std::move(decrypted);
+#else
+            throw std::runtime_error("Received encrypted data but encryption support is not compiled in");
+#endif
+        }
 
-                // Update status to InProgress
-                updateTransferStatus(fileData.transferId, TransferStatus::InProgress);
+        auto algorithm = utils::Compression::fromString(fileData.compression);
+        if (!algorithm) {
+            throw std::runtime_error("Unsupported compression: " + fileData.compression);
+        }
 
-                // Initialize the temporary buffer for collecting file chunks
-                {
-                    std::lock_guard<std::mutex> lock(m_transferDataMutex);
-                    m_transferData[transfer->id] = std::vector<std::vector<uint8_t>>(fileData.totalChunks);
-                    m_transferData[transfer->id][0] = fileData.data;
-                    m_transferChunksReceived[transfer->id] = 1;
-                }
-            } else {
-                // Store the chunk in the buffer
-                {
-                    std::lock_guard<std::mutex> lock(m_transferDataMutex);
-                    if (m_transferData.find(transfer->id) == m_transferData.end() ||
-                        fileData.chunkIndex >= m_transferData[transfer->id].size()) {
-                        throw std::runtime_error("Invalid chunk index or transfer data not initialized");
-                    }
+        std::shared_ptr<const utils::CompressionDictionary> dictionary;
+        if (fileData.dictionaryId != 0) {
+            dictionary = m_dictionaryStore.find(fileData.dictionaryId);
+            if (!dictionary) {
+                throw std::runtime_error("Unknown compression dictionary " + std::to_string(fileData.dictionaryId));
+            }
+        }
 
-                    m_transferData[transfer->id][fileData.chunkIndex] = fileData.data;
-                    m_transferChunksReceived[transfer->id]++;
-                }
+        if (*algorithm != utils::CompressionAlgorithm::None) {
+            // The size comes from the peer, and decompression allocates it up front
+            if (fileData.originalSize > network::DEFAULT_CHUNK_SIZE) {
+                throw std::runtime_error("Chunk " + std::to_string(fileData.chunkIndex) + " claims " +
+                                         std::to_string(fileData.originalSize) + " bytes, more than a chunk");
             }
 
-            // Calculate current progress based on chunks received
-            int chunksReceived = 0;
-            int totalChunks = 0;
-            {
-                std::lock_guard<std::mutex> lock(m_transferDataMutex);
-                if (m_transferChunksReceived.find(transfer->id) != m_transferChunksReceived.end()) {
-                    chunksReceived = m_transferChunksReceived[transfer->id];
-                }
-                if (m_transferData.find(transfer->id) != m_transferData.end()) {
-                    totalChunks = m_transferData[transfer->id].size();
-                }
+            std::vector<uint8_t> decompressed;
+            if (!utils::Compression::decompress(*algorithm, chunk, fileData.originalSize, decompressed,
+                                                dictionary.get())) {
+                throw std::runtime_error("Failed to decompress chunk " + std::to_string(fileData.chunkIndex));
             }
+            chunk = std::move(decompressed);
+        }
 
-            // Update progress
-            std::uintmax_t bytesTransferred = 0;
-            if (totalChunks > 0) {
-                bytesTransferred = static_cast<std::uintmax_t>(
-                        (static_cast<double>(chunksReceived) / totalChunks) * transfer->fileSize);
-            }
-            updateTransferProgress(fileData.transferId, bytesTransferred);
-            // Check if all chunks have been received
-            if (chunksReceived == totalChunks) {
-                SPDLOG_INFO("All chunks received for transfer {}, reassembling file", fileData.transferId);
-
-                // Reassemble the file from chunks
-                std::vector<uint8_t> completeData;
-                {
-                    std::lock_guard<std::mutex> lock(m_transferDataMutex);
-                    // Calculate total size
-                    size_t totalSize = 0;
-                    for (const auto &chunk: m_transferData[transfer->id]) {
-                        totalSize += chunk.size();
-                    }
+        return chunk;
+    }
 
-                    // Allocate space and copy all chunks
-                    completeData.reserve(totalSize);
-                    for (const auto &chunk: m_transferData[transfer->id]) {
-                        completeData.insert(completeData.end(), chunk.begin(), chunk.end());
-                    }
+#ifdef ENABLE_ENCRYPTION
+    std::shared_ptr<utils::EncryptionKey> TransferManager::sendKey(const std::string &transferId) {
+        // Held while deriving, so the workers of one transfer wait for a single derivation
+        std::lock_guard<std::mutex> lock(m_encryptionKeysMutex);
+        auto &key = m_sendKeys[transferId];
+        if (!key) {
+            key = std::make_shared<utils::EncryptionKey>(m_encryptionPassword);
+        }
+        return key;
+    }
 
-                    // Clear the temporary data
-                    m_transferData.erase(transfer->id);
-                    m_transferChunksReceived.erase(transfer->id);
-                }
+    std::shared_ptr<utils::EncryptionKey> TransferManager::receiveKey(const std::vector<uint8_t> &ciphertext) {
+        std::vector<uint8_t> salt = utils::EncryptionKey::saltOf(ciphertext);
+        if (salt.empty()) {
+            throw std::runtime_error("Encrypted chunk is too short");
+        }
 
-                // Decrypt the data if encryption is enabled
-#ifdef ENABLE_ENCRYPTION
-                if (m_encryptionEnabled && !m_encryptionPassword.empty()) {
-                    SPDLOG_INFO("Decrypting file data for transfer: {}", transfer->id);
-                    std::vector<uint8_t> decryptedData;
-                    if (utils::Encryption::decrypt(completeData, m_encryptionPassword, decryptedData)) {
-                        SPDLOG_INFO("File data decrypted successfully: {} -> {} bytes",
-                                    completeData.size(), decryptedData.size());
-                        completeData = std::move(decryptedData);
-                    } else {
-                        SPDLOG_ERROR("Failed to decrypt file data, saving as is");
-                    }
-                }
+        std::lock_guard<std::mutex> lock(m_encryptionKeysMutex);
+        auto it = std::find_if(m_receiveKeys.begin(), m_receiveKeys.end(), [&salt](const auto &key) {
+            return key->salt() == salt;
+        });
+
+        std::shared_ptr<utils::EncryptionKey> key;
+        if (it != m_receiveKeys.end()) {
+            key = *it;
+            m_receiveKeys.erase(it);
+        } else {
+            key = std::make_shared<utils::EncryptionKey>(m_encryptionPassword, std::move(salt));
+            if (m_receiveKeys.size() >= RECEIVE_KEY_CACHE_SIZE) {
+                m_receiveKeys.pop_back();
+            }
+        }
+        m_receiveKeys.push_front(key);
+        return key;
+    }
 #endif
 
-                // Write the complete file
-                if (!m_fileHandler->writeFile(transfer->filePath, completeData)) {
-                    throw std::runtime_error("Failed to write file: " + transfer->filePath);
-                }
+    void TransferManager::setHashAlgorithm(utils::HashAlgorithm algorithm) {
+        m_hashAlgorithm = algorithm;
+        SPDLOG_INFO("Preferred file hash set to {} ({})", utils::Hashing::toString(algorithm),
+                    utils::Hashing::implementationName(algorithm));
+    }
 
-                // Verify the file hash if provided
-                std::string receivedHash;
-                bool hashVerified = false;
+    utils::HashAlgorithm TransferManager::getHashAlgorithm() const {
+        return m_hashAlgorithm;
+    }
 
-                // Send transfer complete message
-                network::TransferCompleteMessage complete;
-                complete.transferId = fileData.transferId;
-                complete.success = true;
+    void TransferManager::setCompressionAlgorithm(utils::CompressionAlgorithm algorithm) {
+        m_compressionAlgorithm = algorithm;
+        SPDLOG_INFO("Preferred chunk compression set to {}", utils::Compression::toString(algorithm));
+    }
 
-#ifdef ENABLE_ENCRYPTION
-                // Calculate and set the file hash
-                std::string fileHash = utils::Encryption::calculateFileHash(transfer->filePath);
-                complete.fileHash = fileHash;
-#endif
+    utils::CompressionAlgorithm TransferManager::getCompressionAlgorithm() const {
+        return m_compressionAlgorithm;
+    }
 
-                // Serialize and send the message
-                auto data = network::Protocol::serialize(complete);
-                auto sendFuture = m_socketHandler->sendTcp(endpoint, data);
-                int result = sendFuture.get();
-
-                if (result < 0) {
-                    SPDLOG_ERROR("Failed to send transfer complete message for {}", fileData.transferId);
-                    updateTransferStatus(fileData.transferId, TransferStatus::Failed,
-                                         "Failed to send completion acknowledgment");
-                    return;
-                }
+    void TransferManager::setMulticastOptions(const std::string &group, uint16_t port, uint64_t rateLimit,
+                                              const std::string &interfaceAddress) {
+        m_multicastGroup = group;
+        m_multicastPort = port;
+        m_multicastRate = rateLimit;
+        m_multicastInterface = interfaceAddress;
+    }
 
-                // Update transfer status to completed
-                updateTransferProgress(fileData.transferId, transfer->fileSize);
-                updateTransferStatus(fileData.transferId, TransferStatus::Completed);
+    void TransferManager::setDeltaUpdatesEnabled(bool enabled) {
+        m_deltaUpdates = enabled;
+        SPDLOG_INFO("Delta updates of same-named files {}", enabled ? "enabled" : "disabled");
+    }
 
-                SPDLOG_INFO("Transfer completed successfully: {}", fileData.transferId);
-            }
+    void TransferManager::setShareReceivedFiles(bool enabled) {
+        m_shareReceivedFiles = enabled;
+        SPDLOG_INFO("Sharing of received files {}", enabled ? "enabled" : "disabled");
+    }
 
-        } catch (const std::exception &e) {
-            SPDLOG_ERROR("Error processing file data for transfer {}: {}",
-                         fileData.transferId, e.what());
+    void TransferManager::setParallelStreams(std::size_t streams) {
+        m_parallelStreams = std::min(streams, StreamStriper::MAX_STREAMS);
+        SPDLOG_INFO("Parallel streams per transfer set to {}",
+                    streams == 0 ? "auto" : std::to_string(m_parallelStreams));
+    }
+
+    void TransferManager::setDataInterfaces(const std::vector<std::string> &interfaces) {
+        m_dataInterfaces = interfaces;
+        if (interfaces.empty()) {
+            SPDLOG_INFO("Striped transfers use the interfaces the routing table picks");
+        } else {
+            SPDLOG_INFO("Striped transfers spread over {} data interfaces", interfaces.size());
+        }
+    }
 
-            // Update transfer status to failed
-            updateTransferStatus(fileData.transferId, TransferStatus::Failed,
-                                 std::string("Error processing file data: ") + e.what());
+    void TransferManager::setTransformWorkers(std::size_t workers) {
+        m_transformWorkers = workers;
+        SPDLOG_INFO("Transform workers per transfer set to {}", workers == 0 ? "auto" : std::to_string(workers));
+    }
 
-            // Send cancel message to the sender
-            network::TransferCancelMessage cancel;
-            cancel.transferId = fileData.transferId;
-            cancel.reason = "Failed to process file data: " + std::string(e.what());
+    void TransferManager::setDurabilityPolicy(DurabilityPolicy policy) {
+        m_durability = policy;
+        SPDLOG_INFO("Durability policy for received files set to {}", static_cast<int>(policy));
+    }
 
-            // Serialize and send the message
-            auto data = network::Protocol::serialize(cancel);
-            m_socketHandler->sendTcp(endpoint, data);
+    void TransferManager::setCacheThresholds(std::uintmax_t dropBehindThreshold, std::uintmax_t directIoThreshold) {
+        m_dropBehindThreshold = dropBehindThreshold;
+        m_directIoThreshold = directIoThreshold;
+        SPDLOG_INFO("Page cache thresholds set to {} bytes (drop behind), {} bytes (direct I/O)",
+                    dropBehindThreshold, directIoThreshold);
+    }
 
-            // Clean up any temporary data
-            {
-                std::lock_guard<std::mutex> lock(m_transferDataMutex);
-                m_transferData.erase(transfer->id);
-                m_transferChunksReceived.erase(transfer->id);
+    bool TransferManager::setTransferCacheMode(const std::string &transferId, CacheMode mode) {
+        auto transfer = findTransfer(transferId);
+        if (!transfer) {
+            SPDLOG_ERROR("Transfer not found: {}", transferId);
+            return false;
+        }
+
+        transfer->cacheMode = mode;
+        return true;
+    }
+
+    CacheMode TransferManager::cacheModeForSize(std::uintmax_t fileSize) const {
+        if (m_directIoThreshold > 0 && fileSize >= m_directIoThreshold) {
+            return CacheMode::Direct;
+        }
+        if (m_dropBehindThreshold > 0 && fileSize >= m_dropBehindThreshold) {
+            return CacheMode::DropBehind;
+        }
+        return CacheMode::Normal;
+    }
+
+    unsigned TransferManager::writeBehindDepth(std::uintmax_t fileSize) const {
+        std::size_t inUse = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_transferDataMutex);
+            for (const auto &[id, writer]: m_fileWriters) {
+                inUse += writer->queueDepth();
             }
         }
+
+        std::size_t chunks = (fileSize + network::DEFAULT_CHUNK_SIZE - 1) / network::DEFAULT_CHUNK_SIZE;
+        std::size_t available = inUse < WRITE_BEHIND_BUFFERS ? WRITE_BEHIND_BUFFERS - inUse : 0;
+        return static_cast<unsigned>(std::clamp<std::size_t>(std::min(available, chunks), 1,
+                                                             WRITE_BEHIND_MAX_DEPTH));
     }
 
     // Methods for enabling/disabling encryption
@@ -1007,6 +4610,11 @@ namespace core {
     void TransferManager::setEncryptionPassword(const std::string& password) {
 #ifdef ENABLE_ENCRYPTION
         m_encryptionPassword = password;
+        {
+            std::lock_guard<std::mutex> lock(m_encryptionKeysMutex);
+            m_sendKeys.clear();
+            m_receiveKeys.clear();
+        }
         SPDLOG_INFO("Encryption password set");
 #else
         SPDLOG_WARN("Encryption support not compiled in, ignoring setEncryptionPassword");
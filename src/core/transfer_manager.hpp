@@ -2,8 +2,20 @@
 
 #include "file_handler.hpp"
 #include "discovery_service.hpp"
+#include "delta_sync.hpp"
+#include "chunk_pipeline.hpp"
+#include "dictionary_store.hpp"
+#include "async_file_io.hpp"
+#include "read_scheduler.hpp"
+#include "fan_out_source.hpp"
+#include "stream_striper.hpp"
+#include "directory_walker.hpp"
 #include "../network/socket_handler.hpp"
 #include "../network/protocol.hpp"
+#include "../network/multicast.hpp"
+#include "../utils/hashing.hpp"
+#include "../utils/compression.hpp"
+#include "../utils/encryption.hpp"
 
 #include <string>
 #include <vector>
@@ -13,6 +25,12 @@
 #include <mutex>
 #include <atomic>
 #include <future>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <unordered_set>
+#include <condition_variable>
+#include <span>
 
 namespace core{
 
@@ -54,6 +72,10 @@ namespace core{
         int64_t startTime;               // Timestamp when the transfer started
         int64_t endTime;                 // Timestamp when the transfer completed/failed
         std::string errorMessage;        // Error message if the transfer failed
+        std::string hashAlgorithm;       // Negotiated file hash algorithm
+        std::string fileHash;            // Hash of the local copy of the file
+        std::string compression;         // Negotiated chunk compression
+        CacheMode cacheMode = CacheMode::Normal; // How reads and writes of the file treat the page cache
 
         // For serialization/deserialization
         nlohmann::json toJson() const;
@@ -93,15 +115,266 @@ namespace core{
 
         // Store file data during transfers
         mutable std::mutex m_transferDataMutex;
-        std::unordered_map<std::string, std::vector<std::vector<uint8_t>>> m_transferData;
+        std::unordered_map<std::string, std::shared_ptr<WriteBehindWriter>> m_fileWriters;
+
+        // Staging buffers of a chunk each shared out among the write-behind queues of incoming files; every queue
+        // registers its own with io_uring, so many transfers at once get shallower queues instead of 8 MB each
+        static constexpr std::size_t WRITE_BEHIND_BUFFERS = 32;
+        static constexpr std::size_t WRITE_BEHIND_MAX_DEPTH = 8;
         std::unordered_map<std::string, int> m_transferChunksReceived;
+        std::unordered_map<std::string, std::vector<uint8_t>> m_chunkMaps; // Bitmap of chunks written per transfer
+        std::unordered_map<std::string, std::shared_ptr<DeltaApplier>> m_deltaAppliers;
+
+        // Files received this session, by final path; a later version from the same sender may update one in place
+        // with a delta transfer as long as it still has the size and modification time it was received with
+        struct ReceivedFile {
+            std::string senderId;
+            std::uintmax_t size = 0;
+            std::filesystem::file_time_type modified;
+        };
+        std::unordered_map<std::string, ReceivedFile> m_receivedFiles; // Guarded by m_transferDataMutex
+
+        // Whether any file of the offered name may serve as a delta basis and be replaced, not only received ones
+        bool m_deltaUpdates = false;
+
+        // Whether files received and verified against a hash are served to peers pulling them, not only shared ones
+        bool m_shareReceivedFiles = false;
+
+        // Read turns of outgoing transfers that belong to a multi-file send
+        struct ReadTurn {
+            std::shared_ptr<ReadScheduler> scheduler;
+            std::size_t turn = 0;
+        };
+        mutable std::mutex m_readTurnsMutex;
+        std::unordered_map<std::string, ReadTurn> m_readTurns;
+
+        // Shared reader of outgoing transfers that send the same file to several peers, guarded by m_readTurnsMutex
+        struct FanOutSlot {
+            std::shared_ptr<FanOutSource> source;
+            std::size_t consumer = 0;
+        };
+        std::unordered_map<std::string, FanOutSlot> m_fanOuts;
+
+        // Chunks a fan-out buffers ahead of its slowest peer, and how long the others wait before cutting it loose
+        static constexpr std::size_t FAN_OUT_RING_CHUNKS = 16;
+        static constexpr std::chrono::milliseconds FAN_OUT_DETACH_AFTER{2000};
+
+        // Manifest of an outgoing directory transfer, kept until the receiver accepts it
+        struct OutgoingDirectory {
+            std::vector<network::ManifestEntry> entries;
+            bool hashFiles = false; // Fill in file hashes once the hash algorithm is negotiated
+            bool packFiles = false; // The receiver takes small files packed together in one frame
+            std::vector<std::string> sources; // Local path per entry for a batch of loose files, empty for a tree
+        };
+
+        // Receive state of an incoming directory transfer
+        struct IncomingDirectory {
+            std::mutex mutex;
+            std::string root;                             // Local directory the tree is written into
+            uint32_t entryCount = 0;                      // Manifest entries announced in the request
+            std::vector<network::ManifestEntry> entries;  // Manifest entries received so far
+            std::size_t filesExpected = 0;                // Regular files in the manifest so far
+            std::size_t filesDone = 0;                    // Files written, verified and moved into place
+            std::uintmax_t bytesReceived = 0;
+
+            // Files are written directly; a write-behind queue per file costs more than it saves on small files
+            struct OpenFile {
+                std::unique_ptr<FileWriter> writer;
+                std::vector<bool> received; // Per chunk, so a repeated chunk is not counted twice
+                uint32_t chunksReceived = 0;
+            };
+            std::unordered_map<uint32_t, OpenFile> openFiles;
+            std::vector<bool> finished; // Per manifest entry, set once the file is in place
+        };
+
+        std::unordered_map<std::string, std::shared_ptr<OutgoingDirectory>> m_outgoingDirectories;
+        std::unordered_map<std::string, std::shared_ptr<IncomingDirectory>> m_incomingDirectories;
+
+        // Sender side of a swarm: one outgoing transfer per receiver, seeded together once all of them have answered
+        struct OutgoingSwarm {
+            std::string id;
+            std::string filePath;
+            std::vector<std::string> peerIds;     // Per member
+            std::vector<std::string> transferIds; // Per member, empty if its request could not be sent
+            std::mutex mutex;
+            std::condition_variable answered;
+            std::unordered_set<std::string> unanswered; // Members that have neither accepted nor dropped out yet
+            std::unordered_set<std::string> joined;     // Members that accepted in time to be seeded
+            std::optional<network::MulticastSession> multicast; // Seeded over IP multicast rather than by relaying
+            bool started = false;                       // Seeding began; members accepting later are sent to directly
+        };
+
+        // Receiver side of a swarm
+        struct IncomingSwarm {
+            std::string transferId; // Local transfer receiving the file
+            std::mutex mutex;
+
+            // Chunks waiting to be passed on, already under the swarm ID
+            struct Relay {
+                network::FileDataMessage message;
+                std::vector<std::string> peerIds;
+            };
+            std::deque<Relay> relays;
+            bool relaying = false;                        // A relay thread is draining the queue
+            std::unordered_set<std::string> connected;    // Endpoints of peers connected to for relaying
+
+            // Chunks the sender handed to other members, by when they should have been passed on to us; the sender
+            // sends in order, so every chunk before one that arrived has left it
+            std::map<uint32_t, std::chrono::steady_clock::time_point> awaited;
+            uint32_t awaitedFrom = 0;                     // Chunks before it are awaited or in
+            bool watching = false;                        // A thread is reporting overdue chunks to the sender
+
+            // The sender's completion, if it arrived before the last chunk relayed by another peer
+            std::optional<network::TransferCompleteMessage> pendingComplete;
+
+            std::unique_ptr<network::MulticastReceiver> multicast; // Set if the swarm is streamed to a group
+        };
+
+        // Guarded by m_transferDataMutex; a swarm is kept until its last member ends, as repairs may be asked for
+        std::unordered_map<std::string, std::shared_ptr<OutgoingSwarm>> m_outgoingSwarms; // By swarm ID
+        std::unordered_map<std::string, std::shared_ptr<OutgoingSwarm>> m_swarmMembers;   // By member transfer ID
+        std::unordered_map<std::string, std::shared_ptr<IncomingSwarm>> m_incomingSwarms; // By swarm ID
+
+        // Receive state of a file pulled by its hash from several peers that hold it
+        struct IncomingPull {
+            std::string fileHash;
+            utils::HashAlgorithm hashAlgorithm = utils::HashAlgorithm::Sha256;
+            std::mutex mutex;
+            std::condition_variable changed; // A source answered, finished a range or dropped out
+
+            // Chunks [first, first + count) asked of one source
+            struct Range {
+                uint32_t first = 0;
+                uint32_t count = 0;
+                uint32_t received = 0;
+                bool duplicated = false; // Also asked of another source, so the slower one does not hold up the end
+                std::chrono::steady_clock::time_point requested;
+                std::chrono::steady_clock::time_point lastProgress;
+            };
+
+            struct Source {
+                std::string peerId;
+                std::string endpoint;
+                std::string peerName;
+                std::string fileName;
+                std::uintmax_t fileSize = 0;
+                bool answered = false;
+                bool available = false;   // Holds the file and takes range requests
+                std::deque<Range> ranges; // Outstanding, oldest first
+                double bytesPerSecond = 0; // Smoothed over the ranges it completed, 0 until the first
+                std::chrono::steady_clock::time_point lastCompleted;
+            };
+            std::vector<Source> sources;
+
+            std::uintmax_t fileSize = 0;  // Size agreed on by the sources, set once the pull starts
+            uint32_t totalChunks = 0;
+            std::deque<uint32_t> pending; // First chunk of each range not asked of any source yet
+            bool started = false;         // The output file is open and ranges are being asked for
+        };
+
+        // Guarded by m_transferDataMutex
+        std::unordered_map<std::string, std::shared_ptr<IncomingPull>> m_incomingPulls; // By transfer ID
+        std::unordered_map<std::string, std::string> m_sharedFiles; // Path by "<hash algorithm>:<hash>"
+
+        // Range requests of one requester, answered in order by one thread so their frames do not interleave
+        struct RangeQueue {
+            std::deque<network::RangeRequestMessage> requests;
+            bool serving = false;
+        };
+        std::unordered_map<std::string, RangeQueue> m_rangeQueues; // By requester endpoint, m_transferDataMutex
+
+        // Chunks asked of a pull source at once, and how many such ranges it has outstanding; a source is given
+        // the next range as it finishes one, so faster sources end up serving more of the file
+        static constexpr uint32_t PULL_RANGE_CHUNKS = 4;
+        static constexpr std::size_t PULL_SOURCE_DEPTH = 2;
+
+        // How long pull sources have to answer, and how long one may go without delivering before its ranges are
+        // handed to the others
+        static constexpr std::chrono::seconds PULL_ANSWER_TIMEOUT{10};
+        static constexpr std::chrono::seconds PULL_STALL_TIMEOUT{10};
+        static constexpr std::chrono::milliseconds PULL_SCHEDULE_INTERVAL{200};
+
+        // Attempts to reach a pull source right after connecting to it
+        static constexpr int PULL_REQUEST_ATTEMPTS = 3;
+        static constexpr std::chrono::milliseconds PULL_RETRY_DELAY{100};
+
+        // Incoming transfers whose chunks arrive over several connections; the sender's completion can overtake
+        // the last of them, in which case it is kept here until they are in. By transfer ID, m_transferDataMutex
+        std::unordered_map<std::string, std::optional<network::TransferCompleteMessage>> m_stripedTransfers;
+
+        // Files smaller than this go over one connection, as extra ones would not get past slow start
+        static constexpr std::uintmax_t STRIPE_MIN_FILE_SIZE = 64 * 1024 * 1024;
+
+        // How long the extra connections of a striped transfer have to come up; the transfer goes without the rest
+        static constexpr std::chrono::seconds STREAM_CONNECT_TIMEOUT{5};
+
+        // How long a swarm waits for its members to answer before seeding those that accepted
+        static constexpr std::chrono::seconds SWARM_ANSWER_TIMEOUT{60};
+
+        // Attempts to pass a chunk on to a swarm peer before asking the sender to; a new connection needs a moment
+        static constexpr int SWARM_RELAY_ATTEMPTS = 3;
+        static constexpr std::chrono::milliseconds SWARM_RELAY_RETRY_DELAY{100};
+
+        // How long a chunk handed to another swarm member may take to be passed on before the sender is asked for it,
+        // in case that member went quiet without reporting it; overdue chunks are looked for this often
+        static constexpr std::chrono::seconds SWARM_RELAY_DEADLINE{5};
+        static constexpr std::chrono::milliseconds SWARM_RELAY_CHECK_INTERVAL{500};
+
+        // Manifest entries per page sent to the receiver
+        static constexpr std::size_t MANIFEST_PAGE_ENTRIES = 4096;
+
+        // Files up to this size are packed together into shared frames, at most PACK_MAX_FILES per frame;
+        // the receiver keeps a file open for each until the frame is written
+        static constexpr std::uintmax_t PACK_FILE_LIMIT = 64 * 1024;
+        static constexpr std::size_t PACK_MAX_FILES = 256;
 
         // Encryption settings
 #ifdef ENABLE_ENCRYPTION
         bool m_encryptionEnabled = false;
         std::string m_encryptionPassword;
+
+        // Chunk keys derived from the password: one per outgoing transfer, and the last few seen on incoming chunks,
+        // most recently used first; dropped when the password changes
+        static constexpr std::size_t RECEIVE_KEY_CACHE_SIZE = 32;
+        std::mutex m_encryptionKeysMutex;
+        std::unordered_map<std::string, std::shared_ptr<utils::EncryptionKey>> m_sendKeys;
+        std::deque<std::shared_ptr<utils::EncryptionKey>> m_receiveKeys;
 #endif
 
+        // Preferred file hash, offered first in the handshake
+        utils::HashAlgorithm m_hashAlgorithm = utils::HashAlgorithm::Sha256;
+
+        // Preferred chunk compression, offered first in the handshake
+        utils::CompressionAlgorithm m_compressionAlgorithm = utils::CompressionAlgorithm::Lz4;
+
+        // Number of compression/encryption workers per outgoing transfer, 0 for one per core
+        std::size_t m_transformWorkers = 0;
+
+        // How hard received files are flushed before they are moved into place
+        DurabilityPolicy m_durability = DurabilityPolicy::Data;
+
+        // File sizes from which transfers spare the page cache, 0 to disable
+        std::uintmax_t m_dropBehindThreshold = 0;
+        std::uintmax_t m_directIoThreshold = 0;
+
+        // Where multicast swarms are streamed to, how fast, and the local interface used for it
+        std::string m_multicastGroup = network::DEFAULT_MULTICAST_GROUP;
+        uint16_t m_multicastPort = network::DEFAULT_MULTICAST_PORT;
+        uint64_t m_multicastRate = network::DEFAULT_MULTICAST_RATE;
+        std::string m_multicastInterface;
+
+        // Connections large transfers are striped across: 1 for none, 0 to tune the count to measured throughput
+        std::size_t m_parallelStreams = 1;
+
+        // Local interfaces the extra connections of striped transfers are bound to in turn, by name
+        std::vector<std::string> m_dataInterfaces;
+
+        // Chunks received between resume points saved next to a partial file
+        static constexpr int CHECKPOINT_INTERVAL = 64;
+
+        // Shared dictionaries for small text files, trained per peer when sending
+        DictionaryStore m_dictionaryStore;
+
         TransferStatusCallback m_statusCallback;
         TransferRequestCallback m_requestCallback;
 
@@ -147,6 +420,422 @@ namespace core{
         void processFileData(const network::FileDataMessage& fileData,
                              const std::string& endpoint);
 
+        /**
+         * Account for a chunk that has reached the output file; after the last one the file is synced,
+         * hashed and left under its temporary name until the sender's hash confirms it
+         * @param transfer The incoming transfer
+         * @param writer Writer of the output file
+         * @param fileData The file data message of the chunk
+         * @param endpoint The sender's endpoint
+         */
+        void completeChunk(const std::shared_ptr<TransferInfo>& transfer,
+                           const std::shared_ptr<WriteBehindWriter>& writer,
+                           const network::FileDataMessage& fileData, const std::string& endpoint);
+
+        /**
+         * Sync and hash a file whose data has all arrived, confirm it to the sender and check the sender's hash
+         * if it came first
+         * @param transfer The incoming transfer
+         * @param writer Writer of the output file
+         * @param endpoint The sender's endpoint
+         */
+        void completeIncomingData(const std::shared_ptr<TransferInfo>& transfer,
+                                  const std::shared_ptr<WriteBehindWriter>& writer, const std::string& endpoint);
+
+        /**
+         * Join the multicast group a swarm is streamed to and write what arrives into the transfer's file
+         * @param transfer The incoming transfer
+         * @param writer Writer of the output file
+         * @param swarm Receive state of the swarm, which keeps the receiver
+         * @param session The stream as described in the request
+         * @return True if the group was joined
+         */
+        bool joinMulticast(const std::shared_ptr<TransferInfo>& transfer,
+                           const std::shared_ptr<WriteBehindWriter>& writer,
+                           const std::shared_ptr<IncomingSwarm>& swarm, const network::MulticastSession& session);
+
+        /**
+         * Fail an incoming transfer, keep its partial file as a resume point and tell the sender
+         * @param transferId The transfer ID
+         * @param endpoint The sender's endpoint
+         * @param reason Why the transfer failed
+         */
+        void abortIncomingTransfer(const std::string& transferId, const std::string& endpoint,
+                                   const std::string& reason);
+
+        /**
+         * Stop writing the file of an incoming transfer
+         * @param transferId The transfer ID
+         * @param keepResumePoint True to save the chunks received so far so a later attempt can resume,
+         *                        false to remove the partial file
+         */
+        void releaseIncomingFile(const std::string& transferId, bool keepResumePoint);
+
+        /**
+         * Save a resume point for an incoming transfer next to its partial file
+         * @param transfer The incoming transfer
+         * @param writer Writer of the partial file
+         * @param chunkMap Bitmap of the chunks that have reached the file
+         */
+        void checkpointIncomingFile(const TransferInfo& transfer, WriteBehindWriter& writer,
+                                    const std::vector<uint8_t>& chunkMap);
+
+        /**
+         * Find a partial file left by an interrupted attempt at the same transfer
+         * The file may still be held by another attempt; whoever resumes it checks that when claiming it
+         * @param request The transfer request
+         * @param chunkMap Output bitmap of the chunks the partial file already holds
+         * @return Final path of the partial file, or an empty string if there is nothing to resume
+         */
+        std::string findResumePoint(const network::TransferRequestMessage& request,
+                                    std::vector<uint8_t>& chunkMap) const;
+
+        /**
+         * Check whether a local file is an earlier copy of the file a peer offers, so a delta may replace it
+         * @param basisPath The local file of the offered name
+         * @param senderId ID of the offering peer
+         * @return True if the file was received from that peer and has not changed since, or delta updates are on
+         */
+        bool isDeltaBasis(const std::filesystem::path& basisPath, const std::string& senderId) const;
+
+        /**
+         * Remember a file that was just received and verified, as the basis for later delta transfers
+         * @param transfer The completed incoming transfer
+         */
+        void recordReceivedFile(const TransferInfo& transfer);
+
+        /**
+         * Send a file as raw frames moved from the page cache to the socket, for plain transfers
+         * @param transfer The outgoing transfer
+         * @param endpoint The receiver's endpoint
+         * @param sparse True if the receiver recreates holes, so they need not be sent
+         * @param resumeChunks Bitmap of chunks the receiver already holds, which are skipped
+         * @param streams Number of connections the receiver takes the chunks on
+         */
+        void sendRawFileData(const std::shared_ptr<TransferInfo>& transfer, const std::string& endpoint,
+                             bool sparse, const std::vector<uint8_t>& resumeChunks, std::size_t streams);
+
+        /**
+         * Open the extra connections a transfer's chunks are striped across
+         * @param transfer The outgoing transfer
+         * @param endpoint The receiver's endpoint
+         * @param streams Number of connections the receiver takes, its own included
+         * @return The transfer's own connection followed by the extra ones that came up, bound to the data
+         *         interfaces in turn if any are set
+         */
+        std::vector<StreamStriper::Path> openStreams(const std::shared_ptr<TransferInfo>& transfer,
+                                                     const std::string& endpoint, std::size_t streams);
+
+        /**
+         * Create an outgoing transfer and send its request
+         * @param peerId ID of the peer to send to
+         * @param filePath Path to the file to send
+         * @param readTurn Turn the transfer waits for before reading the file, if it is part of a multi-file send
+         * @param directory Manifest to send, if filePath is a directory or the transfer is a batch
+         * @param fanOut Shared reader to take the file's chunks from, if it goes to several peers at once
+         * @param swarm Swarm the transfer is a member of, if any
+         * @return Transfer ID if the transfer was initiated, empty string otherwise
+         */
+        std::string startOutgoingTransfer(const std::string& peerId, const std::string& filePath,
+                                          const ReadTurn* readTurn,
+                                          std::shared_ptr<OutgoingDirectory> directory = nullptr,
+                                          const FanOutSlot* fanOut = nullptr,
+                                          const std::shared_ptr<OutgoingSwarm>& swarm = nullptr);
+
+        /**
+         * Send the manifest and then the contents of every file of an accepted directory transfer
+         * @param transfer The outgoing transfer
+         * @param endpoint The receiver's endpoint
+         * @param directory Manifest of the directory
+         */
+        void sendDirectoryData(const std::shared_ptr<TransferInfo>& transfer, const std::string& endpoint,
+                               OutgoingDirectory& directory);
+
+        /**
+         * Process a page of the manifest of an incoming directory transfer
+         * @param manifest The manifest message
+         * @param endpoint The sender's endpoint
+         */
+        void processManifest(const network::ManifestMessage& manifest, const std::string& endpoint);
+
+        /**
+         * Write a decoded chunk of an incoming directory transfer; a file is verified and moved into place
+         * as soon as its last chunk arrives
+         * @param transfer The incoming transfer
+         * @param directory Receive state of the directory
+         * @param fileData The file data message of the chunk
+         * @param chunk Decoded chunk data
+         * @throws std::runtime_error if the chunk does not fit the manifest or cannot be written
+         */
+        void receiveDirectoryChunk(const std::shared_ptr<TransferInfo>& transfer, IncomingDirectory& directory,
+                                   const network::FileDataMessage& fileData, std::span<const uint8_t> chunk);
+
+        /**
+         * Write the small files of a packed chunk of an incoming directory transfer as one batch
+         * @param transfer The incoming transfer
+         * @param directory Receive state of the directory
+         * @param pack Decoded data of the packed chunk
+         * @throws std::runtime_error if a file does not fit the manifest or cannot be written
+         */
+        void receivePackedFiles(const std::shared_ptr<TransferInfo>& transfer, IncomingDirectory& directory,
+                                std::span<const uint8_t> pack);
+
+        /**
+         * Verify a completely received file of a directory transfer against its manifest entry and move it into
+         * place; the caller holds the directory's mutex
+         * @param transfer The incoming transfer
+         * @param directory Receive state of the directory
+         * @param fileIndex Manifest index of the file
+         * @param writer Writer of the file
+         * @throws std::runtime_error if the file does not match its hash or cannot be finalized
+         */
+        void finishDirectoryFile(const TransferInfo& transfer, IncomingDirectory& directory, uint32_t fileIndex,
+                                 FileWriter& writer);
+
+        /**
+         * Find the receive state of an incoming directory transfer
+         * @param transferId The transfer ID
+         * @return The state, or nullptr if the transfer is not an incoming directory transfer
+         */
+        std::shared_ptr<IncomingDirectory> findIncomingDirectory(const std::string& transferId) const;
+
+        /**
+         * Wait until an outgoing transfer may read its file
+         * @param transferId The transfer ID
+         */
+        void waitForReadTurn(const std::string& transferId);
+
+        /**
+         * Let the next file of a multi-file send be read once a transfer no longer reads its own
+         * @param transferId The transfer ID
+         */
+        void finishReadTurn(const std::string& transferId);
+
+        /**
+         * Read a file once and hand each chunk to one member of a swarm, which passes it on to the others
+         * Members that fail are dropped and their chunks handed to the next member
+         * @param swarm The swarm
+         */
+        void seedSwarm(const std::shared_ptr<OutgoingSwarm>& swarm);
+
+        /**
+         * Stream a file once to the multicast group of a swarm and repair what its members lose
+         * @param swarm The swarm
+         * @param members Transfers of the members that joined the group
+         * @return Hash of the file per hash algorithm the members negotiated
+         */
+        std::map<utils::HashAlgorithm, std::string> seedMulticast(
+                const std::shared_ptr<OutgoingSwarm>& swarm, const std::vector<std::shared_ptr<TransferInfo>>& members);
+
+        /**
+         * Send each swarm member still in progress the sender's hash of the file, once it has all been sent
+         * @param members Transfers of the members
+         * @param fileHashes Hash of the file per hash algorithm the members negotiated
+         */
+        void completeSwarmMembers(const std::vector<std::shared_ptr<TransferInfo>>& members,
+                                  const std::map<utils::HashAlgorithm, std::string>& fileHashes);
+
+        /**
+         * Ask peers to join a swarm and seed those that accept in time
+         * @param swarm The swarm, with its ID and file set
+         * @param peers IDs of the peers to send to
+         * @return Transfer ID per peer in the given order, empty for peers whose transfer was not initiated
+         */
+        std::vector<std::string> offerSwarm(const std::shared_ptr<OutgoingSwarm>& swarm,
+                                            std::span<const std::string> peers);
+
+        /**
+         * Record a swarm member's answer to its transfer request
+         * @param transferId The member's transfer ID
+         * @param multicastJoined Whether the member joined the group, if the swarm is streamed to one
+         * @return True if the swarm will seed the member, false if it is to be sent the file directly
+         */
+        bool answerSwarm(const std::string& transferId, bool multicastJoined);
+
+        /**
+         * Forget a transfer that ended as a member of a swarm, on either side
+         * @param transferId The transfer ID
+         */
+        void releaseSwarmMember(const std::string& transferId);
+
+        /**
+         * Send a chunk a swarm member did not get from the peer that was to pass it on
+         * @param missing The report of the peer that failed to pass it on, or of the member itself
+         * @param endpoint The endpoint of the reporting peer
+         */
+        void processChunkMissing(const network::ChunkMissingMessage& missing, const std::string& endpoint);
+
+        /**
+         * Queue a chunk of an incoming swarm transfer to be passed on to other members
+         * @param swarmId The swarm ID
+         * @param swarm Receive state of the swarm
+         * @param fileData The chunk as received from the sender
+         */
+        void queueRelay(const std::string& swarmId, const std::shared_ptr<IncomingSwarm>& swarm,
+                        const network::FileDataMessage& fileData);
+
+        /**
+         * Pass queued chunks on until the swarm's transfer ends; runs on its own thread
+         * @param swarmId The swarm ID
+         * @param swarm Receive state of the swarm
+         */
+        void relayChunks(const std::string& swarmId, const std::shared_ptr<IncomingSwarm>& swarm);
+
+        /**
+         * Start the relay deadline of chunks another swarm member is to pass on to us
+         * @param swarm Receive state of the swarm
+         * @param before Chunks before this one have left the sender
+         */
+        void awaitRelayedChunks(const std::shared_ptr<IncomingSwarm>& swarm, uint32_t before);
+
+        /**
+         * Ask the sender for awaited chunks that are overdue, until none is awaited; runs on its own thread
+         * @param swarm Receive state of the swarm
+         */
+        void watchRelayedChunks(const std::shared_ptr<IncomingSwarm>& swarm);
+
+        /**
+         * Find the receive state of the swarm an incoming transfer belongs to
+         * @param transferId The local transfer ID
+         * @param swarmId Optional output for the swarm ID
+         * @return The state, or nullptr if the transfer is not part of a swarm
+         */
+        std::shared_ptr<IncomingSwarm> findIncomingSwarm(const std::string& transferId,
+                                                         std::string* swarmId = nullptr) const;
+
+        /**
+         * Queue a range request of a peer pulling a file by its hash, to be answered after its earlier ones
+         * @param request The range request
+         * @param endpoint The requester's endpoint
+         */
+        void processRangeRequest(const network::RangeRequestMessage& request, const std::string& endpoint);
+
+        /**
+         * Tell a peer pulling a file whether we hold it, or send it the chunks it asked for
+         * @param request The range request
+         * @param endpoint The requester's endpoint
+         */
+        void answerRangeRequest(const network::RangeRequestMessage& request, const std::string& endpoint);
+
+        /**
+         * Record a pull source's answer on whether it holds the file
+         * @param response The range response
+         * @param endpoint The source's endpoint
+         */
+        void processRangeResponse(const network::RangeResponseMessage& response, const std::string& endpoint);
+
+        /**
+         * Ask the sources of a pull whether they hold the file, open the output file and keep every source busy
+         * with ranges until the file is in; runs on its own thread
+         * @param transfer The incoming transfer
+         * @param pull Receive state of the pull
+         */
+        void runPull(const std::shared_ptr<TransferInfo>& transfer, const std::shared_ptr<IncomingPull>& pull);
+
+        /**
+         * Hand pending ranges to sources with room for more, duplicate the ranges of slow sources once nothing
+         * is pending, and drop sources that stalled; the caller holds the pull's mutex
+         * @param transfer The incoming transfer
+         * @param pull Receive state of the pull
+         * @return Requests to send, with the endpoint of the source each goes to
+         */
+        std::vector<std::pair<std::string, network::RangeRequestMessage>> assignPullRanges(
+                const TransferInfo& transfer, IncomingPull& pull);
+
+        /**
+         * Account for a chunk a pull source delivered, and finish its range once the whole range is in
+         * @param pull Receive state of the pull
+         * @param endpoint The source's endpoint
+         * @param chunkIndex Index of the chunk
+         */
+        void notePullChunk(IncomingPull& pull, const std::string& endpoint, uint32_t chunkIndex);
+
+        /**
+         * Stop asking a source of a pull for chunks and put its ranges back for the others; the caller holds the
+         * pull's mutex
+         * @param pull Receive state of the pull
+         * @param source The source
+         */
+        void dropPullSource(IncomingPull& pull, IncomingPull::Source& source);
+
+        /**
+         * Drop a peer from every pull it is a source of, e.g. once its connection is gone
+         * @param endpoint The peer's endpoint
+         */
+        void dropPullSources(const std::string& endpoint);
+
+        /**
+         * Find the receive state of a pull
+         * @param transferId The transfer ID
+         * @return The state, or nullptr if the transfer is not a pull
+         */
+        std::shared_ptr<IncomingPull> findIncomingPull(const std::string& transferId) const;
+
+        /**
+         * Record a local file as available to peers pulling it by its hash
+         * @param filePath Path to the file
+         * @param hashAlgorithm Algorithm of the hash
+         * @param fileHash Hash of the file
+         */
+        void registerSharedFile(const std::string& filePath, utils::HashAlgorithm hashAlgorithm,
+                                const std::string& fileHash);
+
+        /**
+         * Find the shared reader of an outgoing transfer that is part of a fan-out
+         * @param transferId The transfer ID
+         * @return The reader and the transfer's consumer number, or an empty slot if the transfer reads by itself
+         */
+        FanOutSlot findFanOut(const std::string& transferId) const;
+
+        /**
+         * Stop the shared reader of a fan-out from buffering for a transfer that no longer reads
+         * @param transferId The transfer ID
+         */
+        void releaseFanOut(const std::string& transferId);
+
+        /**
+         * Find the chunks of a file that lie entirely in holes
+         * @param filePath Path to the file
+         * @param totalChunks Number of chunks in the file
+         * @return One flag per chunk, true for holes
+         */
+        std::vector<bool> findHoleChunks(const std::string& filePath, std::size_t totalChunks) const;
+
+        /**
+         * Process the block signatures of the receiver's existing copy and send the delta
+         * @param signature The delta signature message
+         * @param endpoint The sender's endpoint
+         */
+        void processDeltaSignature(const network::DeltaSignatureMessage& signature,
+                                   const std::string& endpoint);
+
+        /**
+         * Process a batch of delta instructions
+         * @param deltaData The delta data message
+         * @param endpoint The sender's endpoint
+         */
+        void processDeltaData(const network::DeltaDataMessage& deltaData,
+                              const std::string& endpoint);
+
+        /**
+         * Verify a file rebuilt from a delta against the sender's hash and only then move it over the old copy
+         * @param transfer The incoming transfer
+         * @param applier The applier holding the rebuilt file
+         * @param complete The sender's completion message
+         * @param endpoint The sender's endpoint
+         */
+        void finishDeltaTransfer(TransferInfo& transfer, DeltaApplier& applier,
+                                 const network::TransferCompleteMessage& complete,
+                                 const std::string& endpoint);
+
+        /**
+         * Cache a shared compression dictionary shipped by a sender
+         * @param dictionary The dictionary message
+         * @param endpoint The sender's endpoint
+         */
+        void processDictionary(const network::DictionaryMessage& dictionary,
+                               const std::string& endpoint);
+
         /**
          * Process a transfer complete notification
          * @param complete The transfer complete message
@@ -187,6 +876,54 @@ namespace core{
         void updateTransferProgress(const std::string& transferId,
                                     std::uintmax_t bytesTransferred);
 
+        /**
+         * Get the negotiated file hash algorithm of a transfer
+         * @param transfer The transfer
+         * @return The algorithm, SHA-256 if none was negotiated
+         */
+        utils::HashAlgorithm transferHashAlgorithm(const TransferInfo& transfer) const;
+
+        /**
+         * Build the data message for one chunk, compressing and encrypting it as negotiated
+         * @param transfer The outgoing transfer
+         * @param chunkIndex Index of the chunk
+         * @param totalChunks Total number of chunks
+         * @param chunk Plain chunk data, read in place if it is a view
+         * @param tryCompress False to skip compression, e.g. for already-compressed formats
+         * @param dictionary Shared dictionary to compress against, if any
+         * @return The file data message ready to serialize
+         */
+        network::FileDataMessage encodeChunk(const TransferInfo& transfer, uint32_t chunkIndex,
+                                             uint32_t totalChunks, ChunkBuffer chunk,
+                                             bool tryCompress,
+                                             const utils::CompressionDictionary* dictionary = nullptr);
+
+        /**
+         * Recover the plain chunk data from a data message
+         * @param fileData The file data message
+         * @return Decrypted and decompressed chunk data
+         * @throws std::runtime_error if the chunk cannot be decoded
+         */
+        std::vector<uint8_t> decodeChunk(const network::FileDataMessage& fileData);
+
+#ifdef ENABLE_ENCRYPTION
+        /**
+         * Get the key chunks of an outgoing transfer are encrypted with, deriving it on first use
+         * @param transferId ID of the transfer
+         * @return The key
+         * @throws std::runtime_error if the key cannot be derived
+         */
+        std::shared_ptr<utils::EncryptionKey> sendKey(const std::string& transferId);
+
+        /**
+         * Get the key for an incoming encrypted chunk, deriving it if its salt is not among the cached keys
+         * @param ciphertext The encrypted chunk
+         * @return The key
+         * @throws std::runtime_error if the chunk is malformed or the key cannot be derived
+         */
+        std::shared_ptr<utils::EncryptionKey> receiveKey(const std::vector<uint8_t>& ciphertext);
+#endif
+
         /**
          * Generate a unique transfer ID
          * @return A unique ID string
@@ -207,6 +944,20 @@ namespace core{
          */
         bool connectToPeer(const PeerInfo& peer);
 
+        /**
+         * Pick the cache mode for a file from the configured size thresholds
+         * @param fileSize Size of the file in bytes
+         * @return Cache mode
+         */
+        CacheMode cacheModeForSize(std::uintmax_t fileSize) const;
+
+        /**
+         * Pick the queue depth of a new write-behind queue from the staging buffers the others leave free
+         * @param fileSize Size of the file in bytes; a file never needs more buffers than it has chunks
+         * @return Queue depth, at least 1
+         */
+        unsigned writeBehindDepth(std::uintmax_t fileSize) const;
+
         /**
          * Find a transfer by peer endpoint
          * @param endpoint The peer endpoint
@@ -252,6 +1003,107 @@ namespace core{
          */
         std::string sendFile(const std::string& peerId, const std::string& filePath);
 
+        /**
+         * Send several files to a peer
+         * Requests go out in the given order, but the files can be read in the order their data lies on disk,
+         * one at a time, which avoids seeking between files on spinning disks
+         * @param peerId ID of the peer to send to
+         * @param filePaths Paths to the files to send
+         * @param diskOrder True to read the files in on-disk order, false to read them concurrently
+         * @return Transfer ID per file in the given order, empty for files whose transfer was not initiated
+         */
+        std::vector<std::string> sendFiles(const std::string& peerId, const std::vector<std::string>& filePaths,
+                                           bool diskOrder = true);
+
+        /**
+         * Send a directory tree to a peer as a single transfer
+         * The tree is listed in parallel, its manifest streamed to the receiver in pages once it accepts,
+         * and then the contents of every file follow under the same transfer ID
+         * @param peerId ID of the peer to send to
+         * @param directoryPath Path to the directory to send
+         * @param hashFiles True to hash every file up front so the receiver verifies each one; costs a second
+         *                  read of the tree, without it chunks are only protected by their checksums
+         * @return Transfer ID if the transfer was initiated, empty string otherwise
+         */
+        std::string sendDirectory(const std::string& peerId, const std::string& directoryPath,
+                                  bool hashFiles = false);
+
+        /**
+         * Send the same files to several peers, with one request per peer covering all of them
+         * Each peer gets a directory transfer with one entry per file, named after the files' common parent
+         * directory, so it accepts or rejects the batch once and receives it through a single pipeline.
+         * Peers are connected to and asked concurrently
+         * @param peers IDs of the peers to send to
+         * @param files Paths to the files to send; files with the same name are numbered
+         * @return Transfer ID per peer in the given order, empty for peers whose transfer was not initiated
+         */
+        std::vector<std::string> sendBatch(std::span<const std::string> peers, std::span<const std::string> files);
+
+        /**
+         * Send one file to several peers, reading it from disk only once
+         * One reader fills a ring of shared chunk buffers that every peer's transfer encodes and sends from.
+         * The ring bounds how far the fastest peer runs ahead of the slowest; a peer that holds the others up
+         * for too long can be detached to read the rest of the file by itself
+         * @param peers IDs of the peers to send to
+         * @param filePath Path to the file to send
+         * @param detachSlowPeers True to detach a peer the others have waited on for too long, false to keep
+         *                        every peer on the shared reader
+         * @return Transfer ID per peer in the given order, empty for peers whose transfer was not initiated
+         */
+        std::vector<std::string> sendFanOut(std::span<const std::string> peers, const std::string& filePath,
+                                            bool detachSlowPeers = true);
+
+        /**
+         * Send one file to several peers that pass its chunks on to each other, so the upload is shared
+         * The sender hands each chunk to one member, round robin, and that member relays it to the others; the
+         * sender only steps in for chunks a member could not pass on. Members that accept after seeding began
+         * are sent the file directly
+         * @param peers IDs of the peers to send to; they must see each other through discovery
+         * @param filePath Path to the file to send
+         * @return Transfer ID per peer in the given order, empty for peers whose transfer was not initiated
+         */
+        std::vector<std::string> sendSwarm(std::span<const std::string> peers, const std::string& filePath);
+
+        /**
+         * Send one file to several peers at once over IP multicast, so it crosses the network once
+         * Receivers report lost packets and the sender sends them again; with forward error correction a parity
+         * packet follows each group of data packets, so one loss per group is rebuilt without asking. Peers that
+         * cannot join the group or accept late are sent the file directly. Not available with encryption, as
+         * packets go out in the clear
+         * @param peers IDs of the peers to send to
+         * @param filePath Path to the file to send
+         * @param forwardErrorCorrection Send parity packets
+         * @return Transfer ID per peer in the given order, empty for peers whose transfer was not initiated
+         */
+        std::vector<std::string> sendMulticast(std::span<const std::string> peers, const std::string& filePath,
+                                               bool forwardErrorCorrection = true);
+
+        /**
+         * Pull a file by its hash from several peers that hold it, taking different ranges of chunks from each
+         * at once. Every source is kept busy with a couple of ranges and given the next as it finishes one, so
+         * faster sources serve more of the file; sources that stall have their ranges handed to the others, and
+         * the last ranges are also asked of idle sources so a slow one does not hold up the end. The file is
+         * verified against the hash before it is moved into place
+         * Peers only serve files they chose to share, with shareFile() or setShareReceivedFiles()
+         * @param peers IDs of the peers to pull from; those that do not hold the file are skipped
+         * @param fileHash Hash of the file, as shared by the peers
+         * @param hashAlgorithm Algorithm of the hash
+         * @return Transfer ID if the pull was started, empty string otherwise
+         */
+        std::string pullFile(std::span<const std::string> peers, const std::string& fileHash,
+                             utils::HashAlgorithm hashAlgorithm = utils::HashAlgorithm::Sha256);
+
+        /**
+         * Make a local file available to peers pulling it by its hash
+         * Any peer on the network that knows the hash can then read the whole file, without being asked to accept
+         * and for as long as this manager runs; received files are only shared when setShareReceivedFiles() is on
+         * @param filePath Path to the file
+         * @param hashAlgorithm Algorithm to hash the file with
+         * @return Hash of the file, or an empty string if it could not be read
+         */
+        std::string shareFile(const std::string& filePath,
+                              utils::HashAlgorithm hashAlgorithm = utils::HashAlgorithm::Sha256);
+
         /**
          * Cancel a transfer
          * @param transferId ID of the transfer to cancel
@@ -314,6 +1166,101 @@ namespace core{
          */
         void setEncryptionPassword(const std::string& password);
 
+        /**
+         * Set the preferred file hash algorithm offered to peers
+         * @param algorithm Sha256 for cryptographic verification, Xxh3 for fast corruption detection
+         */
+        void setHashAlgorithm(utils::HashAlgorithm algorithm);
+
+        /**
+         * Get the preferred file hash algorithm
+         * @return The preferred algorithm
+         */
+        utils::HashAlgorithm getHashAlgorithm() const;
+
+        /**
+         * Set the preferred chunk compression offered to peers
+         * @param algorithm Lz4 for speed, Zstd for ratio, None to disable compression
+         */
+        void setCompressionAlgorithm(utils::CompressionAlgorithm algorithm);
+
+        /**
+         * Get the preferred chunk compression
+         * @return The preferred algorithm
+         */
+        utils::CompressionAlgorithm getCompressionAlgorithm() const;
+
+        /**
+         * Set the number of compression/encryption workers used per outgoing transfer
+         * @param workers Number of worker threads, 0 for one per core
+         */
+        void setTransformWorkers(std::size_t workers);
+
+        /**
+         * Set how hard received files are flushed to stable storage before they are moved into place
+         * @param policy None to trust the OS, Data to sync file contents, Full to also sync the directory
+         */
+        void setDurabilityPolicy(DurabilityPolicy policy);
+
+        /**
+         * Set the file sizes from which transfers stop filling the page cache
+         * @param dropBehindThreshold Files at least this large drop pages behind the cursor, 0 to disable
+         * @param directIoThreshold Files at least this large bypass the page cache with O_DIRECT, 0 to disable
+         */
+        void setCacheThresholds(std::uintmax_t dropBehindThreshold, std::uintmax_t directIoThreshold);
+
+        /**
+         * Set where and how fast multicast transfers are streamed
+         * @param group IPv4 multicast group
+         * @param port UDP port of the group
+         * @param rateLimit Bytes per second sent to the group, 0 for no limit
+         * @param interfaceAddress Local address of the interface to send and receive on, empty for the default
+         */
+        void setMulticastOptions(const std::string& group, uint16_t port, uint64_t rateLimit,
+                                 const std::string& interfaceAddress = "");
+
+        /**
+         * Set how many TCP connections large transfers are striped across; the receiver reassembles the chunks
+         * by offset, and may take fewer connections than offered
+         * @param streams Connections per transfer up to StreamStriper::MAX_STREAMS, 1 to use only the transfer's
+         *                own (the default), 0 to add connections for as long as they raise measured throughput
+         */
+        void setParallelStreams(std::size_t streams);
+
+        /**
+         * Let a file offered under the name of any file in the download directory update that file in place with
+         * a delta transfer; otherwise only files received earlier this session from the same peer, and not changed
+         * since, are updated, and other offers are saved under a new name
+         * @param enabled True to replace same-named files, false to protect them (the default)
+         */
+        void setDeltaUpdatesEnabled(bool enabled);
+
+        /**
+         * Share every file received and verified against a hash, as shareFile() does, so peers can pull it from us
+         * Any peer on the network that knows a received file's hash can then read it without being asked to accept
+         * @param enabled True to serve received files, false to serve only files passed to shareFile() (the default)
+         */
+        void setShareReceivedFiles(bool enabled);
+
+        /**
+         * Spread the connections of striped transfers over several local interfaces, e.g. NICs on the same subnet
+         * Each extra connection is made from one interface's address in turn, so the host must route by source
+         * address; large transfers then use at least one extra connection per interface
+         * Throughput is tracked per connection, and one that stalls has its chunks moved to the others
+         * @param interfaces Interface names as listed by DiscoveryService::getInterfaceAddresses, empty to let the
+         *                   routing table choose (the default)
+         */
+        void setDataInterfaces(const std::vector<std::string>& interfaces);
+
+        /**
+         * Choose how one transfer treats the page cache, overriding the size thresholds
+         * Takes effect if set before the transfer's data starts flowing, e.g. from the request callback
+         * @param transferId ID of the transfer
+         * @param mode Cache mode
+         * @return True if the transfer exists, false otherwise
+         */
+        bool setTransferCacheMode(const std::string& transferId, CacheMode mode);
+
     };
 
 }
\ No newline at end of file
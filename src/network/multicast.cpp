@@ -0,0 +1,784 @@
+#include "multicast.hpp"
+#include "../utils/hashing.hpp"
+
+#include <spdlog/spdlog.h>
+#include <asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace network {
+
+    namespace {
+
+        constexpr uint32_t MULTICAST_MAGIC = 0x434D5446; // "FTMC"
+
+        // Largest UDP payload over IPv4
+        constexpr std::size_t MAX_DATAGRAM_SIZE = 65507;
+
+        // Packets read from the source at a time during the first pass
+        constexpr std::size_t READ_BLOCK_PACKETS = 64;
+
+        // Repairs sent between checks for more requests
+        constexpr std::size_t REPAIR_BATCH = 64;
+
+        // Consecutive packets passed to the sink in one call, at most
+        constexpr std::size_t SINK_RUN_SIZE = 1024 * 1024;
+
+        // How often the sender announces the end while serving repairs, and how long it waits for requests
+        constexpr std::chrono::milliseconds END_INTERVAL{100};
+        constexpr std::chrono::milliseconds REPAIR_LINGER{3000};
+
+        // How often receivers report gaps, and how long they wait for the stream to begin
+        constexpr std::chrono::milliseconds NACK_INTERVAL{50};
+        constexpr std::chrono::seconds START_TIMEOUT{120};
+
+        void putLe16(uint8_t *out, uint16_t value) {
+            out[0] = static_cast<uint8_t>(value);
+            out[1] = static_cast<uint8_t>(value >> 8);
+        }
+
+        void putLe32(uint8_t *out, uint32_t value) {
+            for (int i = 0; i < 4; ++i) {
+                out[i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+
+        uint16_t getLe16(const uint8_t *in) {
+            return static_cast<uint16_t>(in[0] | (in[1] << 8));
+        }
+
+        uint32_t getLe32(const uint8_t *in) {
+            return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+                   (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+        }
+
+        struct Packet {
+            MulticastPacketType type;
+            uint32_t sequence;
+            std::span<const uint8_t> payload;
+        };
+
+        std::vector<uint8_t> makePacket(uint32_t sessionId, MulticastPacketType type, uint32_t sequence,
+                                        std::span<const uint8_t> payload) {
+            std::vector<uint8_t> packet(MULTICAST_HEADER_SIZE + payload.size());
+            putLe32(packet.data(), MULTICAST_MAGIC);
+            putLe32(packet.data() + 4, sessionId);
+            packet[8] = static_cast<uint8_t>(type);
+            packet[9] = 0;
+            putLe16(packet.data() + 10, static_cast<uint16_t>(payload.size()));
+            putLe32(packet.data() + 12, sequence);
+            putLe32(packet.data() + 16, utils::Hashing::crc32c(payload.data(), payload.size()));
+            std::copy(payload.begin(), payload.end(), packet.begin() + MULTICAST_HEADER_SIZE);
+            return packet;
+        }
+
+        // Packets of other sessions, truncated or damaged packets are ignored
+        std::optional<Packet> parsePacket(std::span<const uint8_t> datagram, uint32_t sessionId) {
+            if (datagram.size() < MULTICAST_HEADER_SIZE || getLe32(datagram.data()) != MULTICAST_MAGIC ||
+                getLe32(datagram.data() + 4) != sessionId) {
+                return std::nullopt;
+            }
+
+            auto type = static_cast<MulticastPacketType>(datagram[8]);
+            if (type > MulticastPacketType::Done) {
+                return std::nullopt;
+            }
+
+            auto payload = datagram.subspan(MULTICAST_HEADER_SIZE);
+            if (getLe16(datagram.data() + 10) != payload.size() ||
+                getLe32(datagram.data() + 16) != utils::Hashing::crc32c(payload.data(), payload.size())) {
+                return std::nullopt;
+            }
+
+            return Packet{type, getLe32(datagram.data() + 12), payload};
+        }
+
+        std::size_t packetLength(const MulticastSession &session, uint32_t index) {
+            uint64_t offset = static_cast<uint64_t>(index) * session.packetSize;
+            return static_cast<std::size_t>(std::min<uint64_t>(session.packetSize, session.size - offset));
+        }
+
+        void checkSession(const MulticastSession &session) {
+            if (session.packetSize == 0 || session.packetSize > MAX_DATAGRAM_SIZE - MULTICAST_HEADER_SIZE) {
+                throw std::runtime_error("Invalid multicast packet size " + std::to_string(session.packetSize));
+            }
+            if (session.size > static_cast<uint64_t>(UINT32_MAX) * session.packetSize) {
+                throw std::runtime_error("Stream too large for multicast packet size " +
+                                         std::to_string(session.packetSize));
+            }
+        }
+    }
+
+    class MulticastSender::Impl {
+    public:
+        Impl(MulticastSession session, Source source, std::size_t receivers, uint64_t rateLimit,
+             std::string interfaceAddress)
+                : m_session(std::move(session)), m_source(std::move(source)), m_receivers(receivers),
+                  m_rateLimit(rateLimit), m_interfaceAddress(std::move(interfaceAddress)), m_socket(m_ioContext),
+                  m_controlBuffer(MAX_DATAGRAM_SIZE) {
+        }
+
+        bool run(const ProgressCallback &progress) {
+            checkSession(m_session);
+            openSocket();
+
+            const uint32_t count = m_session.packetCount();
+            const uint32_t fecGroup = m_session.fecGroup;
+            SPDLOG_INFO("Multicasting {} bytes to {}:{} in {} packets (session {}, parity every {})", m_session.size,
+                        m_session.group, m_session.port, count, m_session.sessionId, fecGroup);
+
+            // First pass: every packet once, with a parity packet after each FEC group
+            std::vector<uint8_t> block(READ_BLOCK_PACKETS * m_session.packetSize);
+            std::vector<uint8_t> parity;
+            std::size_t parityLength = 0;
+            for (uint32_t index = 0; index < count; ++index) {
+                if (index % READ_BLOCK_PACKETS == 0) {
+                    uint64_t offset = static_cast<uint64_t>(index) * m_session.packetSize;
+                    auto length = static_cast<std::size_t>(std::min<uint64_t>(block.size(), m_session.size - offset));
+                    if (m_source(offset, std::span<uint8_t>(block.data(), length)) != length) {
+                        throw std::runtime_error("Multicast source ended early");
+                    }
+
+                    // Gaps are filled as they are reported, so receivers do not hold them until the end
+                    pollControl();
+                    sendRepairs();
+
+                    if (progress) {
+                        progress(offset);
+                    }
+                }
+
+                std::span<const uint8_t> payload(block.data() + (index % READ_BLOCK_PACKETS) * m_session.packetSize,
+                                                 packetLength(m_session, index));
+                sendPacket(MulticastPacketType::Data, index, payload);
+
+                if (fecGroup > 0) {
+                    if (index % fecGroup == 0) {
+                        parity.assign(m_session.packetSize, 0);
+                        parityLength = 0;
+                    }
+                    for (std::size_t i = 0; i < payload.size(); ++i) {
+                        parity[i] ^= payload[i];
+                    }
+                    parityLength = std::max(parityLength, payload.size());
+
+                    if (index % fecGroup == fecGroup - 1 || index == count - 1) {
+                        sendPacket(MulticastPacketType::Parity, index / fecGroup,
+                                   std::span<const uint8_t>(parity.data(), parityLength));
+                    }
+                }
+            }
+
+            if (progress) {
+                progress(m_session.size);
+            }
+
+            // Repair phase: announce the end so receivers report their last gaps, until all are done or quiet
+            m_lastRequest = std::chrono::steady_clock::now();
+            std::chrono::steady_clock::time_point lastEnd;
+            while (m_receivers == 0 || m_done.size() < m_receivers) {
+                pollControl();
+                if (!m_repairs.empty()) {
+                    sendRepairs();
+                    continue;
+                }
+
+                auto now = std::chrono::steady_clock::now();
+                if (now - m_lastRequest >= REPAIR_LINGER) {
+                    break;
+                }
+                if (now - lastEnd >= END_INTERVAL) {
+                    sendPacket(MulticastPacketType::End, count, {});
+                    lastEnd = now;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            SPDLOG_INFO("Multicast session {} ended: {} of {} receivers done, {} packets repaired",
+                        m_session.sessionId, m_done.size(), m_receivers, m_repairsSent.load());
+            return m_done.size() >= m_receivers;
+        }
+
+        std::size_t repairsSent() const {
+            return m_repairsSent;
+        }
+
+    private:
+        void openSocket() {
+            // Bound to a port of our own, where receivers send their repair requests
+            m_socket.open(asio::ip::udp::v4());
+            m_socket.bind(asio::ip::udp::endpoint(asio::ip::udp::v4(), 0));
+            m_socket.set_option(asio::ip::multicast::hops(1));
+            m_socket.set_option(asio::ip::multicast::enable_loopback(true));
+            if (!m_interfaceAddress.empty()) {
+                m_socket.set_option(asio::ip::multicast::outbound_interface(
+                        asio::ip::make_address_v4(m_interfaceAddress)));
+            }
+
+            asio::error_code ec;
+            m_socket.set_option(asio::socket_base::send_buffer_size(4 * 1024 * 1024), ec);
+
+            m_group = asio::ip::udp::endpoint(asio::ip::make_address_v4(m_session.group), m_session.port);
+        }
+
+        void sendPacket(MulticastPacketType type, uint32_t sequence, std::span<const uint8_t> payload) {
+            auto packet = makePacket(m_session.sessionId, type, sequence, payload);
+
+            // Paced in bursts of at most a millisecond, as sleeping per packet overshoots
+            if (m_rateLimit > 0) {
+                auto now = std::chrono::steady_clock::now();
+                if (m_nextSend > now + std::chrono::milliseconds(1)) {
+                    std::this_thread::sleep_until(m_nextSend);
+                } else if (m_nextSend < now - std::chrono::milliseconds(10)) {
+                    m_nextSend = now; // No catching up in a burst after an idle spell
+                }
+                m_nextSend += std::chrono::nanoseconds(packet.size() * 1000000000ull / m_rateLimit);
+            }
+
+            // A full send queue drains quickly, anything else ends the stream
+            for (int attempt = 0;; ++attempt) {
+                asio::error_code ec;
+                m_socket.send_to(asio::buffer(packet), m_group, 0, ec);
+                if (!ec) {
+                    return;
+                }
+                if (ec != asio::error::no_buffer_space && ec != asio::error::would_block) {
+                    throw std::runtime_error("Failed to send multicast packet: " + ec.message());
+                }
+                if (attempt == 100) {
+                    throw std::runtime_error("Multicast send queue stayed full");
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        void pollControl() {
+            asio::error_code ec;
+            while (m_socket.available(ec) > 0 && !ec) {
+                asio::ip::udp::endpoint from;
+                std::size_t received = m_socket.receive_from(asio::buffer(m_controlBuffer), from, 0, ec);
+                if (ec) {
+                    break;
+                }
+
+                auto packet = parsePacket(std::span<const uint8_t>(m_controlBuffer.data(), received),
+                                          m_session.sessionId);
+                if (!packet) {
+                    continue;
+                }
+
+                if (packet->type == MulticastPacketType::Nack) {
+                    const uint32_t count = m_session.packetCount();
+                    std::size_t ranges = std::min<std::size_t>(packet->sequence, packet->payload.size() / 8);
+                    for (std::size_t i = 0; i < ranges; ++i) {
+                        uint32_t first = getLe32(packet->payload.data() + i * 8);
+                        uint32_t length = getLe32(packet->payload.data() + i * 8 + 4);
+                        for (uint32_t index = first; index < count && index - first < length; ++index) {
+                            m_repairs.insert(index);
+                        }
+                    }
+                    m_lastRequest = std::chrono::steady_clock::now();
+                } else if (packet->type == MulticastPacketType::Done) {
+                    if (m_done.insert(from.address().to_string() + ":" + std::to_string(from.port())).second) {
+                        SPDLOG_DEBUG("Multicast receiver {} done", from.address().to_string());
+                    }
+                    m_lastRequest = std::chrono::steady_clock::now();
+                }
+            }
+        }
+
+        void sendRepairs() {
+            // Repairs go to the whole group, as receivers tend to lose the same packets
+            std::vector<uint8_t> buffer(m_session.packetSize);
+            for (std::size_t i = 0; i < REPAIR_BATCH && !m_repairs.empty(); ++i) {
+                uint32_t index = *m_repairs.begin();
+                m_repairs.erase(m_repairs.begin());
+
+                std::size_t length = packetLength(m_session, index);
+                if (m_source(static_cast<uint64_t>(index) * m_session.packetSize,
+                             std::span<uint8_t>(buffer.data(), length)) != length) {
+                    throw std::runtime_error("Multicast source ended early");
+                }
+                sendPacket(MulticastPacketType::Data, index, std::span<const uint8_t>(buffer.data(), length));
+                m_repairsSent++;
+            }
+        }
+
+        MulticastSession m_session;
+        Source m_source;
+        std::size_t m_receivers;
+        uint64_t m_rateLimit;
+        std::string m_interfaceAddress;
+
+        asio::io_context m_ioContext;
+        asio::ip::udp::socket m_socket;
+        asio::ip::udp::endpoint m_group;
+        std::vector<uint8_t> m_controlBuffer;
+
+        std::set<uint32_t> m_repairs;             // Packets to send again, merged across receivers
+        std::unordered_set<std::string> m_done;   // Endpoints of receivers that have every packet
+        std::chrono::steady_clock::time_point m_nextSend;
+        std::chrono::steady_clock::time_point m_lastRequest;
+        std::atomic<std::size_t> m_repairsSent{0};
+    };
+
+    MulticastSender::MulticastSender(MulticastSession session, Source source, std::size_t receivers,
+                                     uint64_t rateLimit, std::string interfaceAddress)
+            : m_impl(std::make_unique<Impl>(std::move(session), std::move(source), receivers, rateLimit,
+                                            std::move(interfaceAddress))) {
+    }
+
+    MulticastSender::~MulticastSender() = default;
+
+    bool MulticastSender::run(ProgressCallback progress) {
+        return m_impl->run(progress);
+    }
+
+    std::size_t MulticastSender::repairsSent() const {
+        return m_impl->repairsSent();
+    }
+
+    class MulticastReceiver::Impl {
+    public:
+        Impl(MulticastSession session, Sink sink, FinishCallback onFinished, std::string interfaceAddress,
+             std::chrono::milliseconds stallTimeout)
+                : m_session(std::move(session)), m_sink(std::move(sink)), m_onFinished(std::move(onFinished)),
+                  m_interfaceAddress(std::move(interfaceAddress)), m_stallTimeout(stallTimeout),
+                  m_groupSocket(m_ioContext), m_controlSocket(m_ioContext), m_timer(m_ioContext),
+                  m_receiveBuffer(MAX_DATAGRAM_SIZE), m_random(std::random_device{}()) {
+        }
+
+        ~Impl() {
+            m_ioContext.stop();
+            if (m_thread.joinable()) {
+                m_thread.join();
+            }
+        }
+
+        bool start() {
+            try {
+                checkSession(m_session);
+
+                // Several receivers on one host share the group's port
+                auto group = asio::ip::make_address_v4(m_session.group);
+                m_groupSocket.open(asio::ip::udp::v4());
+                m_groupSocket.set_option(asio::socket_base::reuse_address(true));
+                m_groupSocket.bind(asio::ip::udp::endpoint(asio::ip::address_v4::any(), m_session.port));
+                if (m_interfaceAddress.empty()) {
+                    m_groupSocket.set_option(asio::ip::multicast::join_group(group));
+                } else {
+                    m_groupSocket.set_option(asio::ip::multicast::join_group(
+                            group, asio::ip::make_address_v4(m_interfaceAddress)));
+                }
+
+                // Bursts arrive faster than the sink may take them
+                asio::error_code ec;
+                m_groupSocket.set_option(asio::socket_base::receive_buffer_size(8 * 1024 * 1024), ec);
+
+                // Requests go out from a port of our own, so the sender tells receivers on one host apart
+                m_controlSocket.open(asio::ip::udp::v4());
+                m_controlSocket.bind(asio::ip::udp::endpoint(asio::ip::udp::v4(), 0));
+            } catch (const std::exception &e) {
+                SPDLOG_ERROR("Failed to join multicast group {}:{}: {}", m_session.group, m_session.port, e.what());
+                return false;
+            }
+
+            m_count = m_session.packetCount();
+            m_received.assign(m_count, false);
+            m_startTime = std::chrono::steady_clock::now();
+            m_lastPacket = m_startTime;
+
+            receive();
+            scheduleTick();
+            if (m_count == 0) {
+                asio::post(m_ioContext, [this]() { checkComplete(); });
+            }
+
+            m_thread = std::thread([this]() {
+                try {
+                    m_ioContext.run();
+                } catch (const std::exception &e) {
+                    SPDLOG_ERROR("Exception in multicast receiver thread: {}", e.what());
+                }
+            });
+
+            SPDLOG_INFO("Joined multicast group {}:{} for session {} ({} packets)", m_session.group, m_session.port,
+                        m_session.sessionId, m_count);
+            return true;
+        }
+
+        void setSimulatedLoss(double rate) {
+            m_simulatedLoss = std::clamp(rate, 0.0, 1.0);
+        }
+
+        std::size_t packetsRecovered() const {
+            return m_recovered;
+        }
+
+        std::size_t nacksSent() const {
+            return m_nacksSent;
+        }
+
+    private:
+        // Running XOR of the packets of a FEC group received so far, and its parity once that arrives
+        struct Group {
+            std::vector<uint8_t> received;
+            std::vector<uint8_t> parity;
+            uint32_t count = 0;
+        };
+
+        void receive() {
+            m_groupSocket.async_receive_from(
+                    asio::buffer(m_receiveBuffer), m_from,
+                    [this](const asio::error_code &error, std::size_t bytesReceived) {
+                        if (error == asio::error::operation_aborted || m_stopped) {
+                            return;
+                        }
+
+                        if (!error) {
+                            try {
+                                handleDatagram(std::span<const uint8_t>(m_receiveBuffer.data(), bytesReceived));
+                            } catch (const std::exception &e) {
+                                fail(e.what());
+                                return;
+                            }
+                        }
+
+                        receive();
+                    });
+        }
+
+        void scheduleTick() {
+            m_timer.expires_after(NACK_INTERVAL);
+            m_timer.async_wait([this](const asio::error_code &error) {
+                if (error || m_stopped) {
+                    return;
+                }
+
+                if (!m_complete) {
+                    auto now = std::chrono::steady_clock::now();
+                    if (!m_started && now - m_startTime > START_TIMEOUT) {
+                        fail("No multicast data received");
+                        return;
+                    }
+                    if (m_started && now - m_lastPacket > m_stallTimeout) {
+                        fail("Multicast stream stalled");
+                        return;
+                    }
+                    sendNacks();
+                }
+
+                scheduleTick();
+            });
+        }
+
+        void handleDatagram(std::span<const uint8_t> datagram) {
+            auto packet = parsePacket(datagram, m_session.sessionId);
+            if (!packet) {
+                return;
+            }
+
+            bool dataOrParity = packet->type == MulticastPacketType::Data ||
+                                packet->type == MulticastPacketType::Parity;
+            if (dataOrParity && m_simulatedLoss > 0 &&
+                std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < m_simulatedLoss) {
+                return;
+            }
+
+            m_sender = m_from;
+            m_started = true;
+            m_lastPacket = std::chrono::steady_clock::now();
+
+            switch (packet->type) {
+                case MulticastPacketType::Data:
+                    receiveData(packet->sequence, packet->payload);
+                    break;
+                case MulticastPacketType::Parity:
+                    receiveParity(packet->sequence, packet->payload);
+                    break;
+                case MulticastPacketType::End:
+                    // The sender waits for the last gaps, or for us to say there are none
+                    m_endSeen = true;
+                    if (m_complete) {
+                        sendControl(MulticastPacketType::Done, 0, {});
+                    } else {
+                        sendNacks();
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        void receiveData(uint32_t index, std::span<const uint8_t> payload) {
+            if (index >= m_count || m_received[index] || payload.size() != packetLength(m_session, index)) {
+                return;
+            }
+
+            store(index, payload);
+
+            if (m_session.fecGroup > 0) {
+                uint32_t groupIndex = index / m_session.fecGroup;
+                Group &group = groupOf(groupIndex);
+                for (std::size_t i = 0; i < payload.size(); ++i) {
+                    group.received[i] ^= payload[i];
+                }
+                group.count++;
+                recover(groupIndex);
+            }
+
+            checkComplete();
+        }
+
+        void receiveParity(uint32_t groupIndex, std::span<const uint8_t> payload) {
+            if (m_session.fecGroup == 0 || static_cast<uint64_t>(groupIndex) * m_session.fecGroup >= m_count ||
+                payload.size() > m_session.packetSize) {
+                return;
+            }
+
+            // Parity of a group that is already whole is of no use
+            auto it = m_groups.find(groupIndex);
+            if (it == m_groups.end() && missingIn(groupIndex) == 0) {
+                return;
+            }
+
+            Group &group = it != m_groups.end() ? it->second : groupOf(groupIndex);
+            group.parity.assign(payload.begin(), payload.end());
+            group.parity.resize(m_session.packetSize, 0);
+            recover(groupIndex);
+            checkComplete();
+        }
+
+        Group &groupOf(uint32_t groupIndex) {
+            auto [it, inserted] = m_groups.try_emplace(groupIndex);
+            if (inserted) {
+                it->second.received.assign(m_session.packetSize, 0);
+            }
+            return it->second;
+        }
+
+        uint32_t groupSize(uint32_t groupIndex) const {
+            uint32_t first = groupIndex * m_session.fecGroup;
+            return std::min(m_session.fecGroup, m_count - first);
+        }
+
+        uint32_t missingIn(uint32_t groupIndex) const {
+            uint32_t first = groupIndex * m_session.fecGroup;
+            uint32_t missing = 0;
+            for (uint32_t index = first; index < first + groupSize(groupIndex); ++index) {
+                missing += m_received[index] ? 0 : 1;
+            }
+            return missing;
+        }
+
+        void recover(uint32_t groupIndex) {
+            auto it = m_groups.find(groupIndex);
+            if (it == m_groups.end()) {
+                return;
+            }
+
+            Group &group = it->second;
+            uint32_t size = groupSize(groupIndex);
+            if (group.count == size) {
+                m_groups.erase(it);
+                return;
+            }
+            if (group.count + 1 != size || group.parity.empty()) {
+                return;
+            }
+
+            // The one missing packet is the parity with every other packet of the group XORed out
+            uint32_t first = groupIndex * m_session.fecGroup;
+            uint32_t missing = first;
+            while (m_received[missing]) {
+                missing++;
+            }
+
+            std::vector<uint8_t> payload(packetLength(m_session, missing));
+            for (std::size_t i = 0; i < payload.size(); ++i) {
+                payload[i] = group.parity[i] ^ group.received[i];
+            }
+            m_groups.erase(it);
+
+            store(missing, payload);
+            m_recovered++;
+        }
+
+        void store(uint32_t index, std::span<const uint8_t> payload) {
+            m_received[index] = true;
+            m_receivedCount++;
+            m_highest = std::max(m_highest, index);
+
+            // Runs of consecutive packets reach the sink together
+            uint64_t offset = static_cast<uint64_t>(index) * m_session.packetSize;
+            if (m_run.empty() || offset != m_runOffset + m_run.size() ||
+                m_run.size() + payload.size() > SINK_RUN_SIZE) {
+                flush();
+                m_runOffset = offset;
+            }
+            m_run.insert(m_run.end(), payload.begin(), payload.end());
+        }
+
+        void flush() {
+            if (!m_run.empty()) {
+                m_sink(m_runOffset, m_run);
+                m_run.clear();
+            }
+        }
+
+        void checkComplete() {
+            if (m_complete || m_receivedCount != m_count) {
+                return;
+            }
+
+            flush();
+            m_complete = true;
+            m_groups.clear();
+            SPDLOG_INFO("Multicast session {} complete: {} packets rebuilt from parity, {} repair requests",
+                        m_session.sessionId, m_recovered.load(), m_nacksSent.load());
+
+            // Stays in the group to tell the sender again if this gets lost
+            sendControl(MulticastPacketType::Done, 0, {});
+            if (m_onFinished) {
+                m_onFinished(true, "");
+            }
+        }
+
+        void fail(const std::string &reason) {
+            if (m_stopped) {
+                return;
+            }
+            m_stopped = true;
+
+            SPDLOG_ERROR("Multicast session {} failed: {}", m_session.sessionId, reason);
+            asio::error_code ec;
+            m_groupSocket.close(ec);
+            m_controlSocket.close(ec);
+            m_timer.cancel();
+
+            if (m_onFinished) {
+                m_onFinished(false, reason);
+            }
+        }
+
+        void sendNacks() {
+            if (!m_sender || m_complete) {
+                return;
+            }
+
+            // Packets of the current FEC group may still be rebuilt from its parity, so they are not asked for
+            while (m_firstMissing < m_count && m_received[m_firstMissing]) {
+                m_firstMissing++;
+            }
+            uint32_t horizon = m_endSeen ? m_count
+                                         : m_session.fecGroup > 0 ? m_highest / m_session.fecGroup * m_session.fecGroup
+                                                                  : m_highest;
+
+            std::vector<uint8_t> ranges;
+            std::size_t rangeCount = 0;
+            const std::size_t maxRanges = m_session.packetSize / 8;
+            for (uint32_t index = m_firstMissing; index < horizon && rangeCount < maxRanges;) {
+                if (m_received[index]) {
+                    index++;
+                    continue;
+                }
+
+                uint32_t first = index;
+                while (index < horizon && !m_received[index]) {
+                    index++;
+                }
+
+                ranges.resize(ranges.size() + 8);
+                putLe32(ranges.data() + ranges.size() - 8, first);
+                putLe32(ranges.data() + ranges.size() - 4, index - first);
+                rangeCount++;
+            }
+
+            if (rangeCount > 0) {
+                sendControl(MulticastPacketType::Nack, static_cast<uint32_t>(rangeCount), ranges);
+                m_nacksSent++;
+            }
+        }
+
+        void sendControl(MulticastPacketType type, uint32_t sequence, std::span<const uint8_t> payload) {
+            if (!m_sender) {
+                return;
+            }
+
+            // A lost request is sent again on the next tick
+            asio::error_code ec;
+            m_controlSocket.send_to(asio::buffer(makePacket(m_session.sessionId, type, sequence, payload)),
+                                    *m_sender, 0, ec);
+            if (ec) {
+                SPDLOG_DEBUG("Failed to send multicast control packet: {}", ec.message());
+            }
+        }
+
+        MulticastSession m_session;
+        Sink m_sink;
+        FinishCallback m_onFinished;
+        std::string m_interfaceAddress;
+        std::chrono::milliseconds m_stallTimeout;
+
+        asio::io_context m_ioContext;
+        asio::ip::udp::socket m_groupSocket;
+        asio::ip::udp::socket m_controlSocket;
+        asio::steady_timer m_timer;
+        std::thread m_thread;
+        std::vector<uint8_t> m_receiveBuffer;
+        asio::ip::udp::endpoint m_from;
+        std::optional<asio::ip::udp::endpoint> m_sender; // Where the packets come from, and requests go
+
+        // Only touched on the receiver's thread
+        uint32_t m_count = 0;
+        std::vector<bool> m_received;
+        uint32_t m_receivedCount = 0;
+        uint32_t m_firstMissing = 0;  // No packet before it is missing
+        uint32_t m_highest = 0;       // Highest packet received
+        std::unordered_map<uint32_t, Group> m_groups; // FEC groups with packets received but not yet whole
+        uint64_t m_runOffset = 0;
+        std::vector<uint8_t> m_run;
+        bool m_started = false;
+        bool m_endSeen = false;
+        bool m_complete = false;
+        bool m_stopped = false;
+        std::chrono::steady_clock::time_point m_startTime;
+        std::chrono::steady_clock::time_point m_lastPacket;
+
+        std::atomic<double> m_simulatedLoss{0.0};
+        std::mt19937 m_random;
+        std::atomic<std::size_t> m_recovered{0};
+        std::atomic<std::size_t> m_nacksSent{0};
+    };
+
+    MulticastReceiver::MulticastReceiver(MulticastSession session, Sink sink, FinishCallback onFinished,
+                                         std::string interfaceAddress, std::chrono::milliseconds stallTimeout)
+            : m_impl(std::make_unique<Impl>(std::move(session), std::move(sink), std::move(onFinished),
+                                            std::move(interfaceAddress), stallTimeout)) {
+    }
+
+    MulticastReceiver::~MulticastReceiver() = default;
+
+    bool MulticastReceiver::start() {
+        return m_impl->start();
+    }
+
+    void MulticastReceiver::setSimulatedLoss(double rate) {
+        m_impl->setSimulatedLoss(rate);
+    }
+
+    std::size_t MulticastReceiver::packetsRecovered() const {
+        return m_impl->packetsRecovered();
+    }
+
+    std::size_t MulticastReceiver::nacksSent() const {
+        return m_impl->nacksSent();
+    }
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+namespace network {
+
+    // Group and port multicast transfers are streamed to unless configured otherwise; the group is
+    // administratively scoped, so routers keep it on the local network
+    constexpr const char *DEFAULT_MULTICAST_GROUP = "239.255.34.67";
+    constexpr uint16_t DEFAULT_MULTICAST_PORT = 34569;
+
+    // File bytes per data packet; with the header and the IPv4 and UDP headers a packet fits an Ethernet frame
+    constexpr uint32_t DEFAULT_MULTICAST_PACKET_SIZE = 1400;
+
+    // Bytes per second streamed to a group unless configured otherwise, most of a gigabit link
+    constexpr uint64_t DEFAULT_MULTICAST_RATE = 100 * 1024 * 1024;
+
+    // Data packets covered by each parity packet; one lost packet per group is rebuilt without a repair round trip
+    constexpr uint32_t DEFAULT_MULTICAST_FEC_GROUP = 16;
+
+    // Multicast packets start with a magic number, session ID, packet type, a reserved byte, the payload length,
+    // a sequence number and the CRC32C of the payload, all little-endian
+    constexpr std::size_t MULTICAST_HEADER_SIZE = 20;
+
+    /**
+     * Kind of multicast packet
+     */
+    enum class MulticastPacketType : uint8_t {
+        Data = 0,   // Sender to group: payload is packet <sequence> of the stream
+        Parity = 1, // Sender to group: payload is the XOR of the data packets of FEC group <sequence>
+        End = 2,    // Sender to group: every packet was sent once, <sequence> is the packet count
+        Nack = 3,   // Receiver to sender: payload is <sequence> ranges of missing packets, first and count each
+        Done = 4    // Receiver to sender: every packet arrived
+    };
+
+    /**
+     * Parameters of a multicast stream, agreed on before it starts
+     */
+    struct MulticastSession {
+        std::string group;  // IPv4 multicast group
+        uint16_t port = DEFAULT_MULTICAST_PORT;
+        uint32_t sessionId = 0; // Tells apart streams sharing a group and port
+        uint64_t size = 0;      // Bytes in the stream
+        uint32_t packetSize = DEFAULT_MULTICAST_PACKET_SIZE;
+        uint32_t fecGroup = 0;  // Data packets per parity packet, 0 to send no parity
+
+        /**
+         * Get the number of data packets of the stream
+         * @return Packet count
+         */
+        uint32_t packetCount() const {
+            return packetSize == 0 ? 0 : static_cast<uint32_t>((size + packetSize - 1) / packetSize);
+        }
+    };
+
+    /**
+     * Streams bytes to a multicast group once, then repeats packets the receivers report missing
+     * Receivers report gaps to the address the packets come from, so the sender listens on the socket it sends from
+     */
+    class MulticastSender {
+    public:
+        /**
+         * Reads part of the stream
+         * @param offset Position of the first byte
+         * @param buffer Where to put the bytes
+         * @return Number of bytes read, less than the buffer only at the end of the stream
+         */
+        using Source = std::function<std::size_t(uint64_t offset, std::span<uint8_t> buffer)>;
+
+        /**
+         * Called as the first pass over the stream progresses
+         * @param bytesSent Bytes sent so far
+         */
+        using ProgressCallback = std::function<void(uint64_t bytesSent)>;
+
+        /**
+         * Constructor
+         * @param session The stream to send
+         * @param source Reads the stream; data is read in order during the first pass, repairs read anywhere
+         * @param receivers Number of receivers expected to report completion, 0 to send until repairs stop
+         * @param rateLimit Bytes per second sent to the group, 0 for no limit
+         * @param interfaceAddress Local address of the interface to send from, empty for the default route
+         */
+        MulticastSender(MulticastSession session, Source source, std::size_t receivers, uint64_t rateLimit = 0,
+                        std::string interfaceAddress = "");
+
+        ~MulticastSender();
+
+        MulticastSender(const MulticastSender &) = delete;
+        MulticastSender &operator=(const MulticastSender &) = delete;
+
+        /**
+         * Send the stream and serve repairs until every receiver is done or none has asked for a while
+         * @param progress Optional progress callback
+         * @return True if the expected receivers all reported completion
+         * @throws std::runtime_error if the socket cannot be set up or the source fails
+         */
+        bool run(ProgressCallback progress = nullptr);
+
+        /**
+         * Get the number of packets sent again on request
+         * @return Repaired packets
+         */
+        std::size_t repairsSent() const;
+
+    private:
+        class Impl;
+        std::unique_ptr<Impl> m_impl;
+    };
+
+    /**
+     * Receives a multicast stream, rebuilding single losses per FEC group from parity and asking the sender
+     * for the rest
+     */
+    class MulticastReceiver {
+    public:
+        /**
+         * Takes received bytes; runs on the receiver's thread
+         * @param offset Position of the first byte in the stream
+         * @param data The bytes
+         * @throws std::exception to abort the stream
+         */
+        using Sink = std::function<void(uint64_t offset, std::span<const uint8_t> data)>;
+
+        /**
+         * Called on the receiver's thread once the stream is complete or has failed
+         * @param success True if every byte was passed to the sink
+         * @param errorMessage Reason for failure
+         */
+        using FinishCallback = std::function<void(bool success, const std::string &errorMessage)>;
+
+        /**
+         * Constructor
+         * @param session The stream to receive
+         * @param sink Takes the received bytes; runs of consecutive packets are passed in one call
+         * @param onFinished Called once the stream is complete or has failed
+         * @param interfaceAddress Local address of the interface to join the group on, empty for the default
+         * @param stallTimeout How long the stream may go silent before it fails, once the first packet arrived
+         */
+        MulticastReceiver(MulticastSession session, Sink sink, FinishCallback onFinished,
+                          std::string interfaceAddress = "",
+                          std::chrono::milliseconds stallTimeout = std::chrono::seconds(10));
+
+        /**
+         * Destructor, stops receiving; must not run on the receiver's thread
+         */
+        ~MulticastReceiver();
+
+        MulticastReceiver(const MulticastReceiver &) = delete;
+        MulticastReceiver &operator=(const MulticastReceiver &) = delete;
+
+        /**
+         * Join the group and start receiving on a thread of our own
+         * @return True if the group was joined
+         */
+        bool start();
+
+        /**
+         * Drop a share of the data and parity packets as if the network lost them, to exercise repair on loopback
+         * @param rate Share of packets to drop, from 0 to 1
+         */
+        void setSimulatedLoss(double rate);
+
+        /**
+         * Get the number of packets rebuilt from parity
+         * @return Recovered packets
+         */
+        std::size_t packetsRecovered() const;
+
+        /**
+         * Get the number of repair requests sent to the sender
+         * @return Requests sent
+         */
+        std::size_t nacksSent() const;
+
+    private:
+        class Impl;
+        std::unique_ptr<Impl> m_impl;
+    };
+}
@@ -1,5 +1,122 @@
 #include "protocol.hpp"
 
+#include <array>
+#include <stdexcept>
+
 namespace network {
 
-}
\ No newline at end of file
+    namespace {
+        constexpr char BASE64_ALPHABET[] =
+                "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        constexpr std::array<int8_t, 256> makeDecodeTable() {
+            std::array<int8_t, 256> table{};
+            for (auto &entry: table) {
+                entry = -1;
+            }
+            for (int i = 0; i < 64; ++i) {
+                table[static_cast<uint8_t>(BASE64_ALPHABET[i])] = static_cast<int8_t>(i);
+            }
+            return table;
+        }
+
+        constexpr auto BASE64_DECODE = makeDecodeTable();
+    }
+
+    std::string encodeBase64(const std::vector<uint8_t> &data) {
+        std::string encoded;
+        encoded.reserve((data.size() + 2) / 3 * 4);
+
+        std::size_t i = 0;
+        for (; i + 3 <= data.size(); i += 3) {
+            uint32_t triple = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+            encoded.push_back(BASE64_ALPHABET[(triple >> 18) & 0x3F]);
+            encoded.push_back(BASE64_ALPHABET[(triple >> 12) & 0x3F]);
+            encoded.push_back(BASE64_ALPHABET[(triple >> 6) & 0x3F]);
+            encoded.push_back(BASE64_ALPHABET[triple & 0x3F]);
+        }
+
+        // Pad the remaining one or two bytes
+        if (std::size_t remaining = data.size() - i; remaining > 0) {
+            uint32_t triple = data[i] << 16;
+            if (remaining == 2) {
+                triple |= data[i + 1] << 8;
+            }
+            encoded.push_back(BASE64_ALPHABET[(triple >> 18) & 0x3F]);
+            encoded.push_back(BASE64_ALPHABET[(triple >> 12) & 0x3F]);
+            encoded.push_back(remaining == 2 ? BASE64_ALPHABET[(triple >> 6) & 0x3F] : '=');
+            encoded.push_back('=');
+        }
+
+        return encoded;
+    }
+
+    std::vector<uint8_t> decodeBase64(const std::string &encoded) {
+        std::vector<uint8_t> data;
+        data.reserve(encoded.size() / 4 * 3);
+
+        uint32_t buffer = 0;
+        int bits = 0;
+
+        for (char c: encoded) {
+            if (c == '=') {
+                break;
+            }
+
+            int8_t value = BASE64_DECODE[static_cast<uint8_t>(c)];
+            if (value < 0) {
+                throw std::runtime_error("Invalid base64 data");
+            }
+
+            buffer = (buffer << 6) | static_cast<uint32_t>(value);
+            bits += 6;
+
+            if (bits >= 8) {
+                bits -= 8;
+                data.push_back(static_cast<uint8_t>(buffer >> bits));
+            }
+        }
+
+        return data;
+    }
+
+    void appendPackedFile(std::vector<uint8_t> &pack, uint32_t fileIndex, std::span<const uint8_t> data) {
+        uint32_t length = static_cast<uint32_t>(data.size());
+        for (uint32_t field: {fileIndex, length}) {
+            for (int shift = 0; shift < 32; shift += 8) {
+                pack.push_back(static_cast<uint8_t>(field >> shift));
+            }
+        }
+        pack.insert(pack.end(), data.begin(), data.end());
+    }
+
+    std::vector<PackedFile> unpackFiles(std::span<const uint8_t> pack) {
+        auto readField = [&pack](std::size_t position) {
+            uint32_t field = 0;
+            for (int i = 3; i >= 0; --i) {
+                field = (field << 8) | pack[position + i];
+            }
+            return field;
+        };
+
+        std::vector<PackedFile> files;
+        std::size_t position = 0;
+        while (position < pack.size()) {
+            if (pack.size() - position < PACKED_FILE_HEADER_SIZE) {
+                throw std::runtime_error("Truncated packed file header");
+            }
+
+            uint32_t fileIndex = readField(position);
+            uint32_t length = readField(position + 4);
+            position += PACKED_FILE_HEADER_SIZE;
+
+            if (pack.size() - position < length) {
+                throw std::runtime_error("Truncated packed file");
+            }
+            files.push_back({fileIndex, pack.subspan(position, length)});
+            position += length;
+        }
+
+        return files;
+    }
+}
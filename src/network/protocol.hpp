@@ -3,10 +3,57 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
 #include <nlohmann/json.hpp>
 
 namespace network {
 
+    /**
+     * Encode binary data as base64 for embedding in JSON messages
+     * @param data Binary data
+     * @return Base64 string
+     */
+    std::string encodeBase64(const std::vector<uint8_t> &data);
+
+    /**
+     * Decode base64 data embedded in JSON messages
+     * @param encoded Base64 string
+     * @return Binary data
+     */
+    std::vector<uint8_t> decodeBase64(const std::string &encoded);
+
+    /**
+     * A whole small file inside the data of a packed FileData message
+     */
+    struct PackedFile {
+        uint32_t fileIndex;            // Manifest entry of the file
+        std::span<const uint8_t> data; // Its complete content
+    };
+
+    /**
+     * Append a small file to the data of a packed FileData message, behind a header naming its manifest entry
+     * @param pack Data of the packed message
+     * @param fileIndex Manifest entry of the file
+     * @param data Complete content of the file
+     */
+    void appendPackedFile(std::vector<uint8_t> &pack, uint32_t fileIndex, std::span<const uint8_t> data);
+
+    /**
+     * Split the data of a packed FileData message into its files
+     * @param pack Data of the packed message
+     * @return The files, pointing into pack
+     * @throws std::runtime_error if a header or file runs past the end of the data
+     */
+    std::vector<PackedFile> unpackFiles(std::span<const uint8_t> pack);
+
+    // Header in front of each file of a packed FileData message: manifest index and length, little-endian
+    constexpr std::size_t PACKED_FILE_HEADER_SIZE = 8;
+
+    // Size of the file data chunks, also used to place chunks from peers that do not send offsets
+    constexpr std::size_t DEFAULT_CHUNK_SIZE = 1024 * 1024;
+
     /**
      * Message types for the file transfer protocol
      */
@@ -15,7 +62,14 @@ namespace network {
         TransferResponse,
         FileData,
         TransferComplete,
-        TransferCancel
+        TransferCancel,
+        DeltaSignature,
+        DeltaData,
+        Dictionary,
+        Manifest,
+        ChunkMissing,
+        RangeRequest,
+        RangeResponse
     };
 
     /**
@@ -48,7 +102,21 @@ namespace network {
         std::string senderName;
         std::string fileName;
         std::uintmax_t fileSize;
-        std::string fileHash;
+        std::string fileHash; // Left empty and kept on the wire for older peers; the hash is computed as the file
+                              // is sent and travels only in TransferComplete
+        bool deltaSupported = false; // Sender can answer a DeltaSignature with DeltaData
+        std::vector<std::string> hashAlgorithms; // File hash algorithms offered, most preferred first
+        std::vector<std::string> compressionAlgorithms; // Chunk compression offered, most preferred first
+        bool rawDataSupported = false; // Sender can send plain chunks as raw frames
+        bool directory = false; // fileName names a directory whose manifest follows once the transfer is accepted
+        uint32_t entryCount = 0; // Number of manifest entries of a directory
+        std::string swarmId;     // Set if the receiver is one of several that pass the file's chunks on to each other
+        std::string multicastGroup;  // Set if the swarm is seeded over IP multicast instead, see multicast.hpp
+        uint16_t multicastPort = 0;
+        uint32_t multicastSessionId = 0;
+        uint32_t multicastPacketSize = 0;
+        uint32_t multicastFecGroup = 0;
+        uint32_t streams = 1; // Data connections the sender may stripe chunks across
 
         TransferRequestMessage() {
             type = MessageType::TransferRequest;
@@ -61,6 +129,21 @@ namespace network {
             j["fileName"] = fileName;
             j["fileSize"] = fileSize;
             j["fileHash"] = fileHash;
+            j["deltaSupported"] = deltaSupported;
+            j["hashAlgorithms"] = hashAlgorithms;
+            j["compressionAlgorithms"] = compressionAlgorithms;
+            j["rawDataSupported"] = rawDataSupported;
+            j["directory"] = directory;
+            j["entryCount"] = entryCount;
+            j["swarmId"] = swarmId;
+            if (!multicastGroup.empty()) {
+                j["multicastGroup"] = multicastGroup;
+                j["multicastPort"] = multicastPort;
+                j["multicastSessionId"] = multicastSessionId;
+                j["multicastPacketSize"] = multicastPacketSize;
+                j["multicastFecGroup"] = multicastFecGroup;
+            }
+            j["streams"] = streams;
             return j;
         }
 
@@ -70,7 +153,20 @@ namespace network {
             senderName = j["senderName"].get<std::string>();
             fileName = j["fileName"].get<std::string>();
             fileSize = j["fileSize"].get<std::uintmax_t>();
-            fileHash = j["fileHash"].get<std::string>();
+            fileHash = j.value("fileHash", std::string{});
+            deltaSupported = j.value("deltaSupported", false);
+            hashAlgorithms = j.value("hashAlgorithms", std::vector<std::string>{});
+            compressionAlgorithms = j.value("compressionAlgorithms", std::vector<std::string>{});
+            rawDataSupported = j.value("rawDataSupported", false);
+            directory = j.value("directory", false);
+            entryCount = j.value("entryCount", 0u);
+            swarmId = j.value("swarmId", std::string());
+            multicastGroup = j.value("multicastGroup", std::string());
+            multicastPort = j.value("multicastPort", static_cast<uint16_t>(0));
+            multicastSessionId = j.value("multicastSessionId", 0u);
+            multicastPacketSize = j.value("multicastPacketSize", 0u);
+            multicastFecGroup = j.value("multicastFecGroup", 0u);
+            streams = j.value("streams", 1u);
         }
     };
 
@@ -83,6 +179,18 @@ namespace network {
         std::string receiverId;
         std::string receiverName;
         std::string filePath; // Path where the file will be saved (if accepted)
+        bool deltaRequested = false; // Receiver holds an older copy and will send its signature
+        std::string hashAlgorithm;   // File hash algorithm chosen by the receiver
+        std::string compression;     // Chunk compression chosen by the receiver
+        bool dictionarySupported = false;    // Receiver accepts shared compression dictionaries
+        std::vector<uint32_t> dictionaryIds; // Dictionaries the receiver already has cached
+        bool rawDataAccepted = false;        // Receiver splices raw frames straight into the file
+        bool sparseSupported = false;        // Receiver recreates holes announced with FileData hole messages
+        bool packedSupported = false;        // Receiver unpacks small files of a directory sent as packed FileData
+        bool multicastJoined = false;        // Receiver joined the multicast group offered in the request
+        uint32_t streams = 1;                // Data connections the receiver takes chunks on, up to the offer
+        std::string reason;                  // Why the transfer was not accepted, if it was not
+        std::vector<uint8_t> resumeChunks;   // Bitmap of chunks the receiver kept from an interrupted attempt
 
         TransferResponseMessage() {
             type = MessageType::TransferResponse;
@@ -94,6 +202,18 @@ namespace network {
             j["receiverId"] = receiverId;
             j["receiverName"] = receiverName;
             j["filePath"] = filePath;
+            j["deltaRequested"] = deltaRequested;
+            j["hashAlgorithm"] = hashAlgorithm;
+            j["compression"] = compression;
+            j["dictionarySupported"] = dictionarySupported;
+            j["dictionaryIds"] = dictionaryIds;
+            j["rawDataAccepted"] = rawDataAccepted;
+            j["sparseSupported"] = sparseSupported;
+            j["packedSupported"] = packedSupported;
+            j["multicastJoined"] = multicastJoined;
+            j["streams"] = streams;
+            j["reason"] = reason;
+            j["resumeChunks"] = encodeBase64(resumeChunks);
             return j;
         }
 
@@ -103,6 +223,18 @@ namespace network {
             receiverId = j["receiverId"].get<std::string>();
             receiverName = j["receiverName"].get<std::string>();
             filePath = j["filePath"].get<std::string>();
+            deltaRequested = j.value("deltaRequested", false);
+            hashAlgorithm = j.value("hashAlgorithm", std::string("sha256"));
+            compression = j.value("compression", std::string("none"));
+            dictionarySupported = j.value("dictionarySupported", false);
+            dictionaryIds = j.value("dictionaryIds", std::vector<uint32_t>{});
+            rawDataAccepted = j.value("rawDataAccepted", false);
+            sparseSupported = j.value("sparseSupported", false);
+            packedSupported = j.value("packedSupported", false);
+            multicastJoined = j.value("multicastJoined", false);
+            streams = j.value("streams", 1u);
+            reason = j.value("reason", std::string());
+            resumeChunks = decodeBase64(j.value("resumeChunks", std::string()));
         }
     };
 
@@ -112,6 +244,17 @@ namespace network {
     struct FileDataMessage : public Message {
         uint32_t chunkIndex;
         uint32_t totalChunks;
+        uint64_t offset = 0;   // Position of the chunk in the file
+        std::optional<uint32_t> checksum; // CRC32C of data; absent from frames without data and from older peers
+        std::string compression = "none"; // Algorithm this chunk was compressed with
+        uint32_t originalSize = 0;        // Chunk size before compression
+        bool encrypted = false;           // Chunk was encrypted after compression
+        uint32_t dictionaryId = 0;        // Shared dictionary used for compression, 0 for none
+        bool raw = false;                 // originalSize bytes follow in a raw frame instead of in data
+        bool hole = false;                // The originalSize bytes at offset are a hole in a sparse file
+        uint32_t fileIndex = 0;           // Manifest entry the chunk belongs to, for directory transfers
+        bool packed = false;              // data holds whole small files of a directory, see unpackFiles()
+        std::vector<std::string> relayTo; // Swarm peers the receiver passes the chunk on to, under the swarm ID
         std::vector<uint8_t> data;
 
         FileDataMessage() {
@@ -122,12 +265,24 @@ namespace network {
             auto j = Message::toJson();
             j["chunkIndex"] = chunkIndex;
             j["totalChunks"] = totalChunks;
+            j["offset"] = offset;
+            if (checksum) {
+                j["checksum"] = *checksum;
+            }
+            j["compression"] = compression;
+            j["originalSize"] = originalSize;
+            j["encrypted"] = encrypted;
+            j["dictionaryId"] = dictionaryId;
+            j["raw"] = raw;
+            j["hole"] = hole;
+            j["fileIndex"] = fileIndex;
+            j["packed"] = packed;
+            if (!relayTo.empty()) {
+                j["relayTo"] = relayTo;
+            }
 
             // Convert binary data to base64
-            //TODO: Fix this
-//             std::string base64Data = nlohmann::json::to_cbor(data);
-            std::vector<uint8_t> base64Data = nlohmann::json::to_cbor(data);
-            j["data"] = base64Data;
+            j["data"] = encodeBase64(data);
 
             return j;
         }
@@ -136,11 +291,22 @@ namespace network {
             Message::fromJson(j);
             chunkIndex = j["chunkIndex"].get<uint32_t>();
             totalChunks = j["totalChunks"].get<uint32_t>();
+            offset = j.value("offset", static_cast<uint64_t>(chunkIndex) * DEFAULT_CHUNK_SIZE);
+            if (j.contains("checksum")) {
+                checksum = j["checksum"].get<uint32_t>();
+            }
+            compression = j.value("compression", std::string("none"));
+            originalSize = j.value("originalSize", 0u);
+            encrypted = j.value("encrypted", false);
+            dictionaryId = j.value("dictionaryId", 0u);
+            raw = j.value("raw", false);
+            hole = j.value("hole", false);
+            fileIndex = j.value("fileIndex", 0u);
+            packed = j.value("packed", false);
+            relayTo = j.value("relayTo", std::vector<std::string>{});
 
             // Convert base64 back to binary
-            std::string base64Data = j["data"].get<std::string>();
-            auto temp = nlohmann::json::from_cbor(base64Data);
-            data = temp.get<std::vector<uint8_t>>();
+            data = decodeBase64(j["data"].get<std::string>());
         }
     };
 
@@ -149,7 +315,7 @@ namespace network {
     */
     struct TransferCompleteMessage : public Message {
         bool success;
-        std::string fileHash; // For verification
+        std::string fileHash; // Hash of the whole file, which the receiver verifies its copy against
 
         TransferCompleteMessage() {
             type = MessageType::TransferComplete;
@@ -192,6 +358,258 @@ namespace network {
     };
 
 
+    /**
+     * Message sent by the receiver with the block signatures of its existing copy
+     */
+    struct DeltaSignatureMessage : public Message {
+        uint32_t blockSize;
+        std::uintmax_t basisSize;
+        std::vector<uint8_t> signature; // Packed block signatures
+
+        DeltaSignatureMessage() {
+            type = MessageType::DeltaSignature;
+        }
+
+        nlohmann::json toJson() const override {
+            auto j = Message::toJson();
+            j["blockSize"] = blockSize;
+            j["basisSize"] = basisSize;
+            j["signature"] = encodeBase64(signature);
+            return j;
+        }
+
+        void fromJson(const nlohmann::json &j) override {
+            Message::fromJson(j);
+            blockSize = j["blockSize"].get<uint32_t>();
+            basisSize = j["basisSize"].get<std::uintmax_t>();
+            signature = decodeBase64(j["signature"].get<std::string>());
+        }
+    };
+
+    /**
+     * Message containing a batch of delta instructions (literal runs and block references)
+     */
+    struct DeltaDataMessage : public Message {
+        uint32_t chunkIndex;
+        bool finalChunk;
+        std::vector<uint8_t> instructions; // Packed delta instructions
+
+        DeltaDataMessage() {
+            type = MessageType::DeltaData;
+        }
+
+        nlohmann::json toJson() const override {
+            auto j = Message::toJson();
+            j["chunkIndex"] = chunkIndex;
+            j["finalChunk"] = finalChunk;
+            j["instructions"] = encodeBase64(instructions);
+            return j;
+        }
+
+        void fromJson(const nlohmann::json &j) override {
+            Message::fromJson(j);
+            chunkIndex = j["chunkIndex"].get<uint32_t>();
+            finalChunk = j["finalChunk"].get<bool>();
+            instructions = decodeBase64(j["instructions"].get<std::string>());
+        }
+    };
+
+    /**
+     * Message shipping a shared compression dictionary ahead of the files that use it
+     */
+    struct DictionaryMessage : public Message {
+        uint32_t dictionaryId;
+        std::vector<uint8_t> dictionary;
+
+        DictionaryMessage() {
+            type = MessageType::Dictionary;
+        }
+
+        nlohmann::json toJson() const override {
+            auto j = Message::toJson();
+            j["dictionaryId"] = dictionaryId;
+            j["dictionary"] = encodeBase64(dictionary);
+            return j;
+        }
+
+        void fromJson(const nlohmann::json &j) override {
+            Message::fromJson(j);
+            dictionaryId = j["dictionaryId"].get<uint32_t>();
+            dictionary = decodeBase64(j["dictionary"].get<std::string>());
+        }
+    };
+
+
+    /**
+     * One file or directory of a directory transfer
+     */
+    struct ManifestEntry {
+        std::string path;        // Path relative to the transferred directory, '/' separated
+        std::uintmax_t size = 0; // Size in bytes, 0 for directories
+        uint32_t mode = 0;       // Permission bits
+        int64_t mtime = 0;       // Last modification, nanoseconds since the Unix epoch
+        std::string hash;        // File hash with the negotiated algorithm, empty if not computed
+        bool directory = false;
+
+        // Entries are packed as arrays, as a manifest may list a great many of them
+        nlohmann::json toJson() const {
+            return nlohmann::json::array({path, size, mode, mtime, hash, directory});
+        }
+
+        static ManifestEntry fromJson(const nlohmann::json &j) {
+            ManifestEntry entry;
+            entry.path = j.at(0).get<std::string>();
+            entry.size = j.at(1).get<std::uintmax_t>();
+            entry.mode = j.at(2).get<uint32_t>();
+            entry.mtime = j.at(3).get<int64_t>();
+            entry.hash = j.at(4).get<std::string>();
+            entry.directory = j.at(5).get<bool>();
+            return entry;
+        }
+    };
+
+    /**
+     * Message carrying one page of the manifest of a directory transfer
+     */
+    struct ManifestMessage : public Message {
+        uint32_t firstEntry = 0; // Index of the first entry of this page in the manifest
+        bool lastPage = false;
+        std::vector<ManifestEntry> entries;
+
+        ManifestMessage() {
+            type = MessageType::Manifest;
+        }
+
+        nlohmann::json toJson() const override {
+            auto j = Message::toJson();
+            j["firstEntry"] = firstEntry;
+            j["lastPage"] = lastPage;
+
+            auto &packed = j["entries"] = nlohmann::json::array();
+            for (const auto &entry: entries) {
+                packed.push_back(entry.toJson());
+            }
+            return j;
+        }
+
+        void fromJson(const nlohmann::json &j) override {
+            Message::fromJson(j);
+            firstEntry = j["firstEntry"].get<uint32_t>();
+            lastPage = j["lastPage"].get<bool>();
+
+            entries.clear();
+            for (const auto &packed: j["entries"]) {
+                entries.push_back(ManifestEntry::fromJson(packed));
+            }
+        }
+    };
+
+
+    /**
+     * Message sent by a swarm receiver to the sender when a chunk did not get to a member: under the swarm ID when
+     * it could not pass the chunk on to a peer, or under its own transfer ID when a chunk to be passed on to it is
+     * overdue
+     */
+    struct ChunkMissingMessage : public Message {
+        uint32_t chunkIndex = 0;
+        std::string peerId; // Peer that did not get the chunk, empty for the reporting member itself
+
+        ChunkMissingMessage() {
+            type = MessageType::ChunkMissing;
+        }
+
+        nlohmann::json toJson() const override {
+            auto j = Message::toJson();
+            j["chunkIndex"] = chunkIndex;
+            j["peerId"] = peerId;
+            return j;
+        }
+
+        void fromJson(const nlohmann::json &j) override {
+            Message::fromJson(j);
+            chunkIndex = j["chunkIndex"].get<uint32_t>();
+            peerId = j["peerId"].get<std::string>();
+        }
+    };
+
+
+    /**
+     * Message sent by a receiver pulling a file by its hash, asking a peer that holds it for a range of chunks
+     * The chunks come back as FileData under the pull's transfer ID; a request for no chunks only asks whether
+     * the peer has the file
+     */
+    struct RangeRequestMessage : public Message {
+        std::string requesterId;
+        std::string fileHash;
+        std::string hashAlgorithm;                      // Algorithm fileHash was computed with
+        std::vector<std::string> compressionAlgorithms; // Chunk compression accepted, most preferred first
+        uint32_t firstChunk = 0;
+        uint32_t chunkCount = 0;
+
+        RangeRequestMessage() {
+            type = MessageType::RangeRequest;
+        }
+
+        nlohmann::json toJson() const override {
+            auto j = Message::toJson();
+            j["requesterId"] = requesterId;
+            j["fileHash"] = fileHash;
+            j["hashAlgorithm"] = hashAlgorithm;
+            j["compressionAlgorithms"] = compressionAlgorithms;
+            j["firstChunk"] = firstChunk;
+            j["chunkCount"] = chunkCount;
+            return j;
+        }
+
+        void fromJson(const nlohmann::json &j) override {
+            Message::fromJson(j);
+            requesterId = j.value("requesterId", std::string());
+            fileHash = j["fileHash"].get<std::string>();
+            hashAlgorithm = j.value("hashAlgorithm", std::string("sha256"));
+            compressionAlgorithms = j.value("compressionAlgorithms", std::vector<std::string>{});
+            firstChunk = j.value("firstChunk", 0u);
+            chunkCount = j.value("chunkCount", 0u);
+        }
+    };
+
+    /**
+     * Message sent in answer to a range request for no chunks, or instead of the chunks if the file is gone
+     */
+    struct RangeResponseMessage : public Message {
+        bool available = false; // The peer holds a file with the requested hash
+        std::string senderId;
+        std::string senderName;
+        std::string fileName;
+        std::uintmax_t fileSize = 0;
+        std::string reason;     // Why the file is not available, if it is not
+
+        RangeResponseMessage() {
+            type = MessageType::RangeResponse;
+        }
+
+        nlohmann::json toJson() const override {
+            auto j = Message::toJson();
+            j["available"] = available;
+            j["senderId"] = senderId;
+            j["senderName"] = senderName;
+            j["fileName"] = fileName;
+            j["fileSize"] = fileSize;
+            j["reason"] = reason;
+            return j;
+        }
+
+        void fromJson(const nlohmann::json &j) override {
+            Message::fromJson(j);
+            available = j["available"].get<bool>();
+            senderId = j.value("senderId", std::string());
+            senderName = j.value("senderName", std::string());
+            fileName = j.value("fileName", std::string());
+            fileSize = j.value("fileSize", std::uintmax_t{0});
+            reason = j.value("reason", std::string());
+        }
+    };
+
+
     /**
      * Protocol utility class for serializing and deserializing messages
      */
@@ -247,6 +665,34 @@ namespace network {
                     message = std::make_unique<TransferCancelMessage>();
                     break;
 
+                case MessageType::DeltaSignature:
+                    message = std::make_unique<DeltaSignatureMessage>();
+                    break;
+
+                case MessageType::DeltaData:
+                    message = std::make_unique<DeltaDataMessage>();
+                    break;
+
+                case MessageType::Dictionary:
+                    message = std::make_unique<DictionaryMessage>();
+                    break;
+
+                case MessageType::Manifest:
+                    message = std::make_unique<ManifestMessage>();
+                    break;
+
+                case MessageType::ChunkMissing:
+                    message = std::make_unique<ChunkMissingMessage>();
+                    break;
+
+                case MessageType::RangeRequest:
+                    message = std::make_unique<RangeRequestMessage>();
+                    break;
+
+                case MessageType::RangeResponse:
+                    message = std::make_unique<RangeResponseMessage>();
+                    break;
+
                 default:
                     throw std::runtime_error("Unknown message type");
             }
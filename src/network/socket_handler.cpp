@@ -7,8 +7,137 @@
 #include <thread>
 #include <atomic>
 #include <iostream>
+#include <optional>
+#include <algorithm>
+#include <array>
+#include <span>
+
+#include <deque>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define HAS_MSG_ZEROCOPY
+#endif
+#endif
 
 namespace network {
+
+    namespace {
+        using FrameHeader = std::array<uint8_t, FRAME_HEADER_SIZE>;
+
+        FrameHeader makeFrameHeader(FrameType type, std::size_t length) {
+            FrameHeader header{};
+            header[0] = static_cast<uint8_t>(length >> 24);
+            header[1] = static_cast<uint8_t>(length >> 16);
+            header[2] = static_cast<uint8_t>(length >> 8);
+            header[3] = static_cast<uint8_t>(length);
+            header[4] = static_cast<uint8_t>(type);
+            return header;
+        }
+
+        std::size_t frameLength(const uint8_t *header) {
+            return (static_cast<std::size_t>(header[0]) << 24) | (static_cast<std::size_t>(header[1]) << 16) |
+                   (static_cast<std::size_t>(header[2]) << 8) | static_cast<std::size_t>(header[3]);
+        }
+
+        /**
+         * Reusable frame buffers, so sending a chunk does not allocate a new megabyte every time
+         */
+        class FramePool {
+        public:
+            std::vector<uint8_t> acquire(std::size_t size) {
+                std::vector<uint8_t> buffer;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (!m_free.empty()) {
+                        buffer = std::move(m_free.back());
+                        m_free.pop_back();
+                    }
+                }
+                buffer.resize(size);
+                return buffer;
+            }
+
+            void release(std::vector<uint8_t> buffer) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_free.size() < MAX_POOLED) {
+                    m_free.push_back(std::move(buffer));
+                }
+            }
+
+        private:
+            static constexpr std::size_t MAX_POOLED = 16;
+
+            std::mutex m_mutex;
+            std::vector<std::vector<uint8_t>> m_free;
+        };
+
+#ifdef HAS_MSG_ZEROCOPY
+        /**
+         * MSG_ZEROCOPY bookkeeping for one connection
+         * The kernel numbers every zero-copy send call and later reports ranges of completed
+         * numbers on the socket error queue; a buffer is only reusable once its last send has completed
+         */
+        struct ZeroCopyState {
+            bool enabled = false;  // SO_ZEROCOPY is set on the socket
+            bool disabled = false; // SO_ZEROCOPY was refused or the kernel copies anyway
+            bool watching = false; // Waiting for the error queue to become readable
+            uint32_t nextId = 0;   // Number the kernel gives the next zero-copy send call
+            bool completedAny = false;
+            uint32_t completedThrough = 0; // Highest send number reported complete
+            std::deque<std::pair<uint32_t, std::shared_ptr<std::vector<uint8_t>>>> inFlight; // Last ID per buffer
+        };
+
+        // True if zero-copy send a is at or before b, allowing for the counter wrapping
+        bool zeroCopyIdReached(uint32_t a, uint32_t b) {
+            return static_cast<int32_t>(a - b) <= 0;
+        }
+#endif
+
+        /**
+         * Starts one write on a connection; calls its argument once the write is over, whatever the outcome
+         */
+        using WriteOperation = std::function<void(std::function<void()>)>;
+
+        /**
+         * Writes queued for one connection
+         */
+        struct WriteQueue {
+            bool writing = false; // The front write has been started and has not finished
+            std::deque<WriteOperation> pending;
+        };
+
+#ifdef __linux__
+        // Bytes moved through the splice pipe per call
+        constexpr std::size_t SPLICE_PIPE_SIZE = 1024 * 1024;
+
+        /**
+         * A raw frame being spliced from a socket into a file
+         */
+        struct RawReceive {
+            RawDataSink sink;
+            loff_t offset;
+            std::size_t remaining;
+            int pipe[2] = {-1, -1};
+
+            ~RawReceive() {
+                if (pipe[0] >= 0) {
+                    ::close(pipe[0]);
+                    ::close(pipe[1]);
+                }
+            }
+        };
+#endif
+    }
+
     class SocketHandler::Impl {
     private:
         // ASIO context and thread
@@ -27,13 +156,29 @@ namespace network {
         std::mutex m_socketsMutex;
         std::unordered_map<std::string, std::shared_ptr<asio::ip::tcp::socket>> m_tcpSockets;
 
-        // Callbacks
+        // Callbacks; those of outgoing connections are registered from any thread and dropped when the connection ends
         DataReceivedCallback m_tcpDataCallback;
         ConnectionStatusCallback m_tcpStatusCallback;
+        std::mutex m_callbacksMutex;
         std::unordered_map<std::string, DataReceivedCallback> m_tcpDataCallbacks;
         std::unordered_map<std::string, ConnectionStatusCallback> m_tcpStatusCallbacks;
         DataReceivedCallback m_udpDataCallback;
 
+        // Sinks claiming the next raw frame from each endpoint
+        std::mutex m_rawSinksMutex;
+        std::unordered_map<std::string, RawDataSink> m_rawSinks;
+
+        // Outgoing frame buffers and MSG_ZEROCOPY sends
+        FramePool m_framePool;
+        std::atomic<std::size_t> m_zeroCopyThreshold{0};
+#ifdef HAS_MSG_ZEROCOPY
+        std::unordered_map<std::string, std::shared_ptr<ZeroCopyState>> m_zeroCopyStates; // IO thread only
+#endif
+
+        // Writes waiting for each connection; one is in flight at a time, so frames from different threads never
+        // interleave and no write blocks the IO thread
+        std::unordered_map<std::string, std::shared_ptr<WriteQueue>> m_writeQueues; // IO thread only
+
 
         void startAcceptingConnections() {
             if (!m_tcpAcceptor || !m_running) {
@@ -80,18 +225,25 @@ namespace network {
                                         });
         }
 
-        void startReceive(std::shared_ptr<asio::ip::tcp::socket> socket, const std::string &endpoint) {
+        void startReceive(std::shared_ptr<asio::ip::tcp::socket> socket, const std::string &endpoint,
+                          std::shared_ptr<std::vector<uint8_t>> pending = nullptr) {
             if (!socket->is_open() || !m_running) {
                 return;
             }
 
+            // Bytes of a partially received frame carry over to the next read
+            if (!pending) {
+                pending = std::make_shared<std::vector<uint8_t>>();
+            }
+
             // Create a buffer for receiving data
             auto receiveBuffer = std::make_shared<std::vector<uint8_t>>(64 * 1024); // 64KB buffer
 
             // Receive data asynchronously
             socket->async_read_some(
                     asio::buffer(receiveBuffer->data(), receiveBuffer->size()),
-                    [this, socket, endpoint, receiveBuffer](const asio::error_code &error, std::size_t bytesReceived) {
+                    [this, socket, endpoint, receiveBuffer, pending](const asio::error_code &error,
+                                                                     std::size_t bytesReceived) {
                         if (!m_running) {
                             return;
                         }
@@ -99,19 +251,13 @@ namespace network {
                         if (!error) {
                             SPDLOG_DEBUG("Received {} bytes from {}", bytesReceived, endpoint);
 
-                            // Resize the buffer to the actual data size
-                            receiveBuffer->resize(bytesReceived);
+                            pending->insert(pending->end(), receiveBuffer->begin(),
+                                            receiveBuffer->begin() + bytesReceived);
 
-                            // Call the data callback
-                            if (auto it = m_tcpDataCallbacks.find(endpoint); it != m_tcpDataCallbacks.end() &&
-                                                                             it->second) {
-                                it->second(*receiveBuffer, endpoint);
-                            } else if (m_tcpDataCallback) {
-                                m_tcpDataCallback(*receiveBuffer, endpoint);
+                            // Continue receiving unless a raw frame took over the socket
+                            if (processFrames(socket, endpoint, pending)) {
+                                startReceive(socket, endpoint, pending);
                             }
-
-                            // Continue receiving
-                            startReceive(socket, endpoint);
                         } else if (error == asio::error::eof || error == asio::error::connection_reset) {
                             SPDLOG_INFO("Connection closed by peer: {}", endpoint);
 
@@ -121,14 +267,10 @@ namespace network {
                                 socket->close();
                                 m_tcpSockets.erase(endpoint);
                             }
+                            forgetZeroCopyState(endpoint);
 
                             // Notify the status callbacks
-                            if (auto it = m_tcpStatusCallbacks.find(endpoint); it != m_tcpStatusCallbacks.end() &&
-                                                                               it->second) {
-                                it->second(ConnectionStatus::Disconnected, endpoint, "");
-                            } else if (m_tcpStatusCallback) {
-                                m_tcpStatusCallback(ConnectionStatus::Disconnected, endpoint, "");
-                            }
+                            notifyEnded(endpoint, ConnectionStatus::Disconnected, "");
                         } else {
                             SPDLOG_ERROR("Error receiving data from {}: {}", endpoint, error.message());
 
@@ -138,19 +280,306 @@ namespace network {
                                 socket->close();
                                 m_tcpSockets.erase(endpoint);
                             }
+                            forgetZeroCopyState(endpoint);
 
                             // Notify the status callbacks
-                            if (auto it = m_tcpStatusCallbacks.find(endpoint); it != m_tcpStatusCallbacks.end() &&
-                                                                               it->second) {
-                                it->second(ConnectionStatus::Error, endpoint, error.message());
-                            } else if (m_tcpStatusCallback) {
-                                m_tcpStatusCallback(ConnectionStatus::Error, endpoint, error.message());
-                            }
+                            notifyEnded(endpoint, ConnectionStatus::Error, error.message());
                         }
                     }
             );
         }
 
+        void deliverMessage(const std::vector<uint8_t> &data, const std::string &endpoint) {
+            DataReceivedCallback callback;
+            {
+                std::lock_guard<std::mutex> lock(m_callbacksMutex);
+                if (auto it = m_tcpDataCallbacks.find(endpoint); it != m_tcpDataCallbacks.end()) {
+                    callback = it->second;
+                }
+            }
+
+            if (callback) {
+                callback(data, endpoint);
+            } else if (m_tcpDataCallback) {
+                m_tcpDataCallback(data, endpoint);
+            }
+        }
+
+        ConnectionStatusCallback findStatusCallback(const std::string &endpoint) {
+            std::lock_guard<std::mutex> lock(m_callbacksMutex);
+            if (auto it = m_tcpStatusCallbacks.find(endpoint); it != m_tcpStatusCallbacks.end()) {
+                return it->second;
+            }
+            return nullptr;
+        }
+
+        // Report that a connection has ended and drop the callbacks registered for it
+        void notifyEnded(const std::string &endpoint, ConnectionStatus status, const std::string &errorMessage) {
+            ConnectionStatusCallback callback;
+            {
+                std::lock_guard<std::mutex> lock(m_callbacksMutex);
+                if (auto it = m_tcpStatusCallbacks.find(endpoint); it != m_tcpStatusCallbacks.end()) {
+                    callback = std::move(it->second);
+                    m_tcpStatusCallbacks.erase(it);
+                }
+                m_tcpDataCallbacks.erase(endpoint);
+            }
+
+            if (callback) {
+                callback(status, endpoint, errorMessage);
+            } else if (m_tcpStatusCallback) {
+                m_tcpStatusCallback(status, endpoint, errorMessage);
+            }
+        }
+
+        void failConnection(const std::shared_ptr<asio::ip::tcp::socket> &socket, const std::string &endpoint,
+                            const std::string &errorMessage) {
+            SPDLOG_ERROR("Closing connection to {}: {}", endpoint, errorMessage);
+
+            {
+                std::lock_guard<std::mutex> lock(m_socketsMutex);
+                asio::error_code ec;
+                socket->close(ec);
+                m_tcpSockets.erase(endpoint);
+            }
+            forgetZeroCopyState(endpoint);
+
+            notifyEnded(endpoint, ConnectionStatus::Error, errorMessage);
+        }
+
+        std::optional<RawDataSink> takeRawSink(const std::string &endpoint) {
+            std::lock_guard<std::mutex> lock(m_rawSinksMutex);
+
+            auto it = m_rawSinks.find(endpoint);
+            if (it == m_rawSinks.end()) {
+                return std::nullopt;
+            }
+
+            RawDataSink sink = std::move(it->second);
+            m_rawSinks.erase(it);
+            return sink;
+        }
+
+        /**
+         * Deliver every complete frame in the receive buffer
+         * @return False if the socket was handed to a raw frame receive or closed, true to keep reading
+         */
+        bool processFrames(const std::shared_ptr<asio::ip::tcp::socket> &socket, const std::string &endpoint,
+                           const std::shared_ptr<std::vector<uint8_t>> &pending) {
+            std::size_t consumed = 0;
+
+            while (pending->size() - consumed >= FRAME_HEADER_SIZE) {
+                const uint8_t *header = pending->data() + consumed;
+                std::size_t length = frameLength(header);
+                auto type = static_cast<FrameType>(header[4]);
+                std::size_t available = pending->size() - consumed - FRAME_HEADER_SIZE;
+
+                if (length > MAX_FRAME_SIZE) {
+                    failConnection(socket, endpoint, "Frame of " + std::to_string(length) + " bytes is too large");
+                    return false;
+                }
+
+                if (type == FrameType::Raw) {
+                    if (auto sink = takeRawSink(endpoint)) {
+                        if (sink->length != length) {
+                            sink->onComplete(false, "Raw frame length does not match the announced chunk");
+                            failConnection(socket, endpoint, "Unexpected raw frame length");
+                            return false;
+                        }
+
+                        // Write what has already been read, then splice the rest straight into the file
+                        std::size_t buffered = std::min(available, length);
+                        std::span<const uint8_t> head(header + FRAME_HEADER_SIZE, buffered);
+                        std::string errorMessage;
+                        if (!writeRawHead(*sink, head, errorMessage)) {
+                            sink->onComplete(false, errorMessage);
+                            failConnection(socket, endpoint, errorMessage);
+                            return false;
+                        }
+                        consumed += FRAME_HEADER_SIZE + buffered;
+
+                        if (buffered < length) {
+                            pending->clear();
+                            startRawReceive(socket, endpoint, pending, std::move(*sink), buffered);
+                            return false;
+                        }
+
+                        sink->onComplete(true, "");
+                        continue;
+                    }
+                }
+
+                if (available < length) {
+                    break;
+                }
+
+                if (type == FrameType::Message) {
+                    std::vector<uint8_t> message(header + FRAME_HEADER_SIZE, header + FRAME_HEADER_SIZE + length);
+                    consumed += FRAME_HEADER_SIZE + length;
+                    deliverMessage(message, endpoint);
+                } else {
+                    SPDLOG_WARN("Dropping unclaimed frame of type {} ({} bytes) from {}",
+                                static_cast<int>(type), length, endpoint);
+                    consumed += FRAME_HEADER_SIZE + length;
+                }
+            }
+
+            pending->erase(pending->begin(), pending->begin() + consumed);
+            return true;
+        }
+
+        bool writeRawHead(const RawDataSink &sink, std::span<const uint8_t> data, std::string &errorMessage) {
+#ifdef __linux__
+            std::size_t written = 0;
+            while (written < data.size()) {
+                ssize_t result = ::pwrite(sink.fd, data.data() + written, data.size() - written,
+                                          static_cast<off_t>(sink.offset + written));
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    errorMessage = std::string("Failed to write raw data: ") + std::strerror(errno);
+                    return false;
+                }
+                written += static_cast<std::size_t>(result);
+            }
+            return true;
+#else
+            errorMessage = "Raw frames are not supported on this platform";
+            return false;
+#endif
+        }
+
+        void startRawReceive(const std::shared_ptr<asio::ip::tcp::socket> &socket, const std::string &endpoint,
+                             const std::shared_ptr<std::vector<uint8_t>> &pending, RawDataSink sink,
+                             std::size_t alreadyWritten) {
+#ifdef __linux__
+            auto raw = std::make_shared<RawReceive>();
+            raw->offset = static_cast<loff_t>(sink.offset + alreadyWritten);
+            raw->remaining = sink.length - alreadyWritten;
+            raw->sink = std::move(sink);
+
+            if (::pipe2(raw->pipe, O_CLOEXEC) != 0) {
+                std::string errorMessage = std::string("Failed to create splice pipe: ") + std::strerror(errno);
+                raw->sink.onComplete(false, errorMessage);
+                failConnection(socket, endpoint, errorMessage);
+                return;
+            }
+
+            // A larger pipe moves a whole chunk per splice; the default size still works if this is refused
+            ::fcntl(raw->pipe[1], F_SETPIPE_SZ, static_cast<int>(SPLICE_PIPE_SIZE));
+
+            asio::error_code ec;
+            socket->native_non_blocking(true, ec);
+
+            continueRawReceive(socket, endpoint, pending, raw);
+#else
+            sink.onComplete(false, "Raw frames are not supported on this platform");
+            failConnection(socket, endpoint, "Raw frames are not supported on this platform");
+#endif
+        }
+
+#ifdef __linux__
+        void continueRawReceive(const std::shared_ptr<asio::ip::tcp::socket> &socket, const std::string &endpoint,
+                                const std::shared_ptr<std::vector<uint8_t>> &pending,
+                                const std::shared_ptr<RawReceive> &raw) {
+            if (!socket->is_open() || !m_running) {
+                raw->sink.onComplete(false, "Connection closed");
+                return;
+            }
+
+            while (raw->remaining > 0) {
+                // Socket to pipe: only moves page references, no copy into user space
+                ssize_t moved = ::splice(socket->native_handle(), nullptr, raw->pipe[1], nullptr,
+                                         std::min(raw->remaining, SPLICE_PIPE_SIZE),
+                                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (moved < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    socket->async_wait(asio::ip::tcp::socket::wait_read,
+                                       [this, socket, endpoint, pending, raw](const asio::error_code &error) {
+                                           if (error) {
+                                               raw->sink.onComplete(false, error.message());
+                                               failConnection(socket, endpoint, error.message());
+                                               return;
+                                           }
+                                           continueRawReceive(socket, endpoint, pending, raw);
+                                       });
+                    return;
+                }
+                if (moved < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (moved <= 0) {
+                    std::string errorMessage = moved == 0 ? "Connection closed during raw frame"
+                                                          : std::string("splice from socket failed: ") +
+                                                            std::strerror(errno);
+                    raw->sink.onComplete(false, errorMessage);
+                    failConnection(socket, endpoint, errorMessage);
+                    return;
+                }
+
+                // Pipe to file
+                std::size_t inPipe = static_cast<std::size_t>(moved);
+                while (inPipe > 0) {
+                    ssize_t written = ::splice(raw->pipe[0], nullptr, raw->sink.fd, &raw->offset, inPipe,
+                                               SPLICE_F_MOVE);
+                    if (written < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (written <= 0) {
+                        std::string errorMessage = std::string("splice to file failed: ") +
+                                                   (written == 0 ? "no progress" : std::strerror(errno));
+                        raw->sink.onComplete(false, errorMessage);
+                        failConnection(socket, endpoint, errorMessage);
+                        return;
+                    }
+                    inPipe -= static_cast<std::size_t>(written);
+                    raw->remaining -= static_cast<std::size_t>(written);
+                }
+            }
+
+            raw->sink.onComplete(true, "");
+
+            // Back to framed messages
+            startReceive(socket, endpoint, pending);
+        }
+
+        void continueSendFile(const std::shared_ptr<asio::ip::tcp::socket> &socket, const std::string &endpoint,
+                              int fd, off_t offset, std::size_t remaining, std::size_t length,
+                              const std::function<void(int)> &done) {
+            while (remaining > 0) {
+                ssize_t sent = ::sendfile(socket->native_handle(), fd, &offset, remaining);
+                if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    socket->async_wait(asio::ip::tcp::socket::wait_write,
+                                       [this, socket, endpoint, fd, offset, remaining, length, done](
+                                               const asio::error_code &error) {
+                                           if (error) {
+                                               SPDLOG_ERROR("Error sending file data to {}: {}",
+                                                            endpoint, error.message());
+                                               done(-1);
+                                               return;
+                                           }
+                                           continueSendFile(socket, endpoint, fd, offset, remaining, length,
+                                                            done);
+                                       });
+                    return;
+                }
+                if (sent < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (sent <= 0) {
+                    SPDLOG_ERROR("sendfile to {} failed: {}", endpoint,
+                                 sent == 0 ? "file ended early" : std::strerror(errno));
+                    done(-1);
+                    return;
+                }
+                remaining -= static_cast<std::size_t>(sent);
+            }
+
+            SPDLOG_DEBUG("Sent {} bytes of file data to {}", length, endpoint);
+            done(static_cast<int>(length));
+        }
+#endif
+
         void startUdpReceive() {
             if (!m_udpSocket || !m_udpSocket->is_open() || !m_running) {
                 return;
@@ -237,9 +666,11 @@ namespace network {
         bool connectTcp(const std::string &host,
                         uint16_t port,
                         DataReceivedCallback onDataReceived,
-                        ConnectionStatusCallback onConnectionStatus) {
+                        ConnectionStatusCallback onConnectionStatus,
+                        const std::string &label,
+                        const std::string &localAddress) {
             try {
-                SPDLOG_INFO("Connecting to {}:{}", host, port);
+                SPDLOG_INFO("Connecting to {}:{}{}", host, port, localAddress.empty() ? "" : " from " + localAddress);
 
                 // Create a new socket
                 auto socket = std::make_shared<asio::ip::tcp::socket>(m_ioContext);
@@ -250,39 +681,59 @@ namespace network {
 
                 // Store the callbacks
                 std::string endpointStr = host + ":" + std::to_string(port);
-                m_tcpDataCallbacks[endpointStr] = std::move(onDataReceived);
-                m_tcpStatusCallbacks[endpointStr] = std::move(onConnectionStatus);
-
-                asio::async_connect(*socket, endpoints,
-                                    [this, socket, endpointStr](const asio::error_code &error,
-                                                                const asio::ip::tcp::endpoint &endpoint) {
-                                        if (!error) {
-                                            SPDLOG_INFO("Connected to {}", endpointStr);
-
-                                            //Store the socket
-                                            {
-                                                std::lock_guard<std::mutex> lock(m_socketsMutex);
-                                                m_tcpSockets[endpointStr] = socket;
-                                            }
+                if (!label.empty()) {
+                    endpointStr += "#" + label;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(m_callbacksMutex);
+                    m_tcpDataCallbacks[endpointStr] = std::move(onDataReceived);
+                    m_tcpStatusCallbacks[endpointStr] = std::move(onConnectionStatus);
+                }
 
-                                            // Notify the status callback
-                                            if (auto it = m_tcpStatusCallbacks.find(endpointStr); it !=
-                                                                                                  m_tcpStatusCallbacks.end()) {
-                                                it->second(ConnectionStatus::Connected, endpointStr, "");
-                                            }
+                auto onConnected = [this, socket, endpointStr](const asio::error_code &error) {
+                    if (!error) {
+                        SPDLOG_INFO("Connected to {}", endpointStr);
 
-                                            // Start receiving data
-                                            startReceive(socket, endpointStr);
-                                        } else {
-                                            SPDLOG_ERROR("Failed to connect to {}: {}", endpointStr, error.message());
+                        //Store the socket
+                        {
+                            std::lock_guard<std::mutex> lock(m_socketsMutex);
+                            m_tcpSockets[endpointStr] = socket;
+                        }
 
-                                            // Notify the status callback
-                                            if (auto it = m_tcpStatusCallbacks.find(endpointStr); it !=
-                                                                                                  m_tcpStatusCallbacks.end()) {
-                                                it->second(ConnectionStatus::Error, endpointStr, error.message());
-                                            }
-                                        }
-                                    });
+                        // Notify the status callback
+                        if (auto callback = findStatusCallback(endpointStr)) {
+                            callback(ConnectionStatus::Connected, endpointStr, "");
+                        }
+
+                        // Start receiving data
+                        startReceive(socket, endpointStr);
+                    } else {
+                        SPDLOG_ERROR("Failed to connect to {}: {}", endpointStr, error.message());
+
+                        // Notify the status callback
+                        notifyEnded(endpointStr, ConnectionStatus::Error, error.message());
+                    }
+                };
+
+                if (localAddress.empty()) {
+                    asio::async_connect(*socket, endpoints,
+                                        [onConnected](const asio::error_code &error, const asio::ip::tcp::endpoint &) {
+                                            onConnected(error);
+                                        });
+                    return true;
+                }
+
+                // Trying each resolved address in turn reopens the socket and loses the binding,
+                // so a bound connection goes to the first IPv4 address only
+                auto remote = std::find_if(endpoints.begin(), endpoints.end(), [](const auto &entry) {
+                    return entry.endpoint().address().is_v4();
+                });
+                if (remote == endpoints.end()) {
+                    throw std::runtime_error("No IPv4 address for " + host);
+                }
+                socket->open(asio::ip::tcp::v4());
+                socket->bind(asio::ip::tcp::endpoint(asio::ip::make_address_v4(localAddress), 0));
+                socket->async_connect(remote->endpoint(), onConnected);
 
                 return true;
             } catch (const std::exception &e) {
@@ -291,51 +742,400 @@ namespace network {
             }
         }
 
+        std::shared_ptr<asio::ip::tcp::socket> findSocket(const std::string &endpoint) {
+            std::lock_guard<std::mutex> lock(m_socketsMutex);
+            if (auto it = m_tcpSockets.find(endpoint); it != m_tcpSockets.end() && it->second->is_open()) {
+                return it->second;
+            }
+            return nullptr;
+        }
+
+        // IO thread only
+        void queueWrite(const std::string &endpoint, WriteOperation write) {
+            auto &queue = m_writeQueues[endpoint];
+            if (!queue) {
+                queue = std::make_shared<WriteQueue>();
+            }
+
+            queue->pending.push_back(std::move(write));
+            if (!queue->writing) {
+                startNextWrite(endpoint, queue);
+            }
+        }
+
+        void startNextWrite(const std::string &endpoint, const std::shared_ptr<WriteQueue> &queue) {
+            if (queue->pending.empty()) {
+                queue->writing = false;
+                if (auto it = m_writeQueues.find(endpoint); it != m_writeQueues.end() && it->second == queue) {
+                    m_writeQueues.erase(it);
+                }
+                return;
+            }
+
+            queue->writing = true;
+            WriteOperation write = std::move(queue->pending.front());
+            queue->pending.pop_front();
+
+            // Posted, so a run of writes failing at once does not recurse
+            write([this, endpoint, queue]() {
+                m_ioContext.post([this, endpoint, queue]() {
+                    startNextWrite(endpoint, queue);
+                });
+            });
+        }
+
         std::future<int> sendTcp(const std::string &endpoint, const std::vector<uint8_t> &data) {
             // Create a promise to return the result
             auto promise = std::make_shared<std::promise<int>>();
             auto future = promise->get_future();
 
-            m_ioContext.post([this, endpoint, data, promise]() {
-                try {
-                    std::lock_guard<std::mutex> lock(m_socketsMutex);
+            // Frame the message so the receiver can split the stream back into messages
+            auto header = makeFrameHeader(FrameType::Message, data.size());
+            std::vector<uint8_t> frame = m_framePool.acquire(FRAME_HEADER_SIZE + data.size());
+            std::copy(header.begin(), header.end(), frame.begin());
+            std::copy(data.begin(), data.end(), frame.begin() + FRAME_HEADER_SIZE);
+
+            // Replies sent from a data callback run on the IO thread, which cannot wait for its own write; they
+            // are reported as sent once queued, and a failure later shows as the connection's error
+            bool onIoThread = m_ioContext.get_executor().running_in_this_thread();
+            if (onIoThread) {
+                if (!findSocket(endpoint)) {
+                    SPDLOG_ERROR("No connection found for endpoint: {}", endpoint);
+                    m_framePool.release(std::move(frame));
+                    promise->set_value(-1);
+                    return future;
+                }
+                promise->set_value(static_cast<int>(data.size()));
+            }
 
-                    auto it = m_tcpSockets.find(endpoint);
-                    if (it == m_tcpSockets.end()) {
-                        SPDLOG_ERROR("No connection found for endpoint: {}", endpoint);
-                        promise->set_value(-1);
-                        return;
+            // The frame must outlive the asynchronous write
+            auto framed = std::make_shared<std::vector<uint8_t>>(std::move(frame));
+            bool zeroCopy = m_zeroCopyThreshold > 0 && data.size() >= m_zeroCopyThreshold;
+
+            auto write = [this, endpoint, framed, zeroCopy,
+                          promise = onIoThread ? nullptr : promise](std::function<void()> next) {
+                auto done = [promise, next = std::move(next)](int result) {
+                    if (promise) {
+                        promise->set_value(result);
                     }
+                    next();
+                };
+
+                auto socket = findSocket(endpoint);
+                if (!socket) {
+                    SPDLOG_ERROR("No connection found for endpoint: {}", endpoint);
+                    m_framePool.release(std::move(*framed));
+                    done(-1);
+                    return;
+                }
 
-                    auto &socket = it->second;
+#ifdef HAS_MSG_ZEROCOPY
+                if (zeroCopy && enableZeroCopy(socket, endpoint)) {
+                    sendZeroCopy(socket, endpoint, framed, 0, false, done);
+                    return;
+                }
+#endif
+
+                // Send data asynchronously
+                asio::async_write(*socket, asio::buffer(framed->data(), framed->size()),
+                                  [this, endpoint, framed, done](const asio::error_code &error,
+                                                                 std::size_t bytesSent) {
+                                      m_framePool.release(std::move(*framed));
+                                      if (!error) {
+                                          SPDLOG_DEBUG("Sent {} bytes to {}", bytesSent, endpoint);
+                                          done(static_cast<int>(bytesSent - FRAME_HEADER_SIZE));
+                                      } else {
+                                          SPDLOG_ERROR("Error sending data to {}: {}", endpoint, error.message());
+                                          done(-1);
+                                      }
+                                  });
+            };
+
+            if (onIoThread) {
+                queueWrite(endpoint, std::move(write));
+            } else {
+                m_ioContext.post([this, endpoint, write = std::move(write)]() mutable {
+                    queueWrite(endpoint, std::move(write));
+                });
+            }
 
-                    // Check if socket is open
-                    if (!socket->is_open()) {
-                        SPDLOG_ERROR("Socket for {} is not open", endpoint);
-                        promise->set_value(-1);
-                        return;
+            return future;
+        }
+
+        void closeTcp(const std::string &endpoint, bool abort) {
+            m_ioContext.post([this, endpoint, abort]() {
+                // Pending writes fail, and the receive loop cleans up
+                if (abort) {
+                    if (auto socket = findSocket(endpoint)) {
+                        SPDLOG_DEBUG("Aborting connection to {}", endpoint);
+                        asio::error_code ec;
+                        socket->close(ec);
                     }
+                    return;
+                }
 
-                    // Send data asynchronously
-                    asio::async_write(*socket, asio::buffer(data.data(), data.size()),
-                                      [promise, endpoint](const asio::error_code &error, std::size_t bytesSent) {
-                                          if (!error) {
-                                              SPDLOG_DEBUG("Sent {} bytes to {}", bytesSent, endpoint);
-                                              promise->set_value(static_cast<int>(bytesSent));
-                                          } else {
-                                              SPDLOG_ERROR("Error sending data to {}: {}", endpoint, error.message());
-                                              promise->set_value(-1);
-                                          }
-                                      });
-                } catch (const std::exception &e) {
-                    SPDLOG_ERROR("Exception in sendTcp: {}", e.what());
-                    promise->set_value(-1);
+                // Queued behind the writes already pending, so they go out first; the receive loop cleans up once
+                // the peer closes its side in turn
+                queueWrite(endpoint, [this, endpoint](std::function<void()> next) {
+                    if (auto socket = findSocket(endpoint)) {
+                        asio::error_code ec;
+                        socket->shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+                        if (ec) {
+                            SPDLOG_WARN("Error closing connection to {}: {}", endpoint, ec.message());
+                        } else {
+                            SPDLOG_DEBUG("Closing connection to {}", endpoint);
+                        }
+                    }
+                    next();
+                });
+            });
+        }
+
+        void setZeroCopyThreshold(std::size_t threshold) {
+#ifdef HAS_MSG_ZEROCOPY
+            m_zeroCopyThreshold = threshold;
+            SPDLOG_INFO("MSG_ZEROCOPY {} for frames of {} bytes or more", threshold > 0 ? "enabled" : "disabled",
+                        threshold);
+#else
+            if (threshold > 0) {
+                SPDLOG_WARN("MSG_ZEROCOPY is not supported on this platform, ignoring setZeroCopyThreshold");
+            }
+#endif
+        }
+
+        void forgetZeroCopyState(const std::string &endpoint) {
+#ifdef HAS_MSG_ZEROCOPY
+            // Frames still pinned by the kernel stay alive through the state until its last waiter runs
+            m_zeroCopyStates.erase(endpoint);
+#endif
+        }
+
+#ifdef HAS_MSG_ZEROCOPY
+        bool enableZeroCopy(const std::shared_ptr<asio::ip::tcp::socket> &socket, const std::string &endpoint) {
+            auto &state = m_zeroCopyStates[endpoint];
+            if (!state) {
+                state = std::make_shared<ZeroCopyState>();
+            }
+
+            if (!state->enabled && !state->disabled) {
+                int one = 1;
+                if (::setsockopt(socket->native_handle(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0) {
+                    state->enabled = true;
+                } else {
+                    SPDLOG_WARN("SO_ZEROCOPY refused for {}: {}", endpoint, std::strerror(errno));
+                    state->disabled = true;
+                }
+            }
+
+            return state->enabled && !state->disabled;
+        }
+
+        void sendZeroCopy(const std::shared_ptr<asio::ip::tcp::socket> &socket, const std::string &endpoint,
+                          const std::shared_ptr<std::vector<uint8_t>> &frame, std::size_t sent, bool pinned,
+                          const std::function<void(int)> &done) {
+            auto it = m_zeroCopyStates.find(endpoint);
+            if (it == m_zeroCopyStates.end() || !socket->is_open()) {
+                SPDLOG_ERROR("Connection to {} closed during send", endpoint);
+                done(-1);
+                return;
+            }
+            auto state = it->second;
+
+            asio::error_code ec;
+            socket->native_non_blocking(true, ec);
+
+            // Recycle whatever the kernel has finished with before pinning more
+            reapZeroCopy(socket, *state);
+
+            int flags = MSG_ZEROCOPY | MSG_NOSIGNAL;
+            while (sent < frame->size()) {
+                ssize_t result = ::send(socket->native_handle(), frame->data() + sent, frame->size() - sent, flags);
+                if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    socket->async_wait(asio::ip::tcp::socket::wait_write,
+                                       [this, socket, endpoint, frame, sent, pinned, done](
+                                               const asio::error_code &error) {
+                                           if (error) {
+                                               SPDLOG_ERROR("Error sending data to {}: {}",
+                                                            endpoint, error.message());
+                                               done(-1);
+                                               return;
+                                           }
+                                           sendZeroCopy(socket, endpoint, frame, sent, pinned, done);
+                                       });
+                    return;
+                }
+                if (result < 0 && errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                    // Out of notification memory; send the rest of this frame the ordinary way
+                    flags = MSG_NOSIGNAL;
+                    continue;
+                }
+                if (result < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (result < 0) {
+                    SPDLOG_ERROR("Error sending data to {}: {}", endpoint, std::strerror(errno));
+                    if (pinned) {
+                        trackZeroCopy(socket, endpoint, state, frame);
+                    }
+                    done(-1);
+                    return;
                 }
+
+                if (flags & MSG_ZEROCOPY) {
+                    state->nextId++;
+                    pinned = true;
+                }
+                sent += static_cast<std::size_t>(result);
+            }
+
+            SPDLOG_DEBUG("Sent {} bytes to {} with MSG_ZEROCOPY", frame->size(), endpoint);
+            int payloadSize = static_cast<int>(frame->size() - FRAME_HEADER_SIZE);
+            if (pinned) {
+                trackZeroCopy(socket, endpoint, state, frame);
+            } else {
+                m_framePool.release(std::move(*frame));
+            }
+            done(payloadSize);
+        }
+
+        // Hold a frame until the kernel reports its last zero-copy send as complete
+        void trackZeroCopy(const std::shared_ptr<asio::ip::tcp::socket> &socket, const std::string &endpoint,
+                           const std::shared_ptr<ZeroCopyState> &state,
+                           const std::shared_ptr<std::vector<uint8_t>> &frame) {
+            uint32_t lastId = state->nextId - 1;
+            if (state->completedAny && zeroCopyIdReached(lastId, state->completedThrough)) {
+                // Completed while the rest of the frame was still being sent
+                m_framePool.release(std::move(*frame));
+                return;
+            }
+
+            state->inFlight.emplace_back(lastId, frame);
+            watchZeroCopy(socket, endpoint, state);
+        }
+
+        void watchZeroCopy(const std::shared_ptr<asio::ip::tcp::socket> &socket, const std::string &endpoint,
+                           const std::shared_ptr<ZeroCopyState> &state) {
+            if (state->watching || state->inFlight.empty()) {
+                return;
+            }
+
+            // Completions arrive on the error queue, which wakes error waiters
+            state->watching = true;
+            socket->async_wait(asio::ip::tcp::socket::wait_error,
+                               [this, socket, endpoint, state](const asio::error_code &error) {
+                                   state->watching = false;
+                                   if (error || !socket->is_open()) {
+                                       return;
+                                   }
+                                   reapZeroCopy(socket, *state);
+                                   watchZeroCopy(socket, endpoint, state);
+                               });
+        }
+
+        void reapZeroCopy(const std::shared_ptr<asio::ip::tcp::socket> &socket, ZeroCopyState &state) {
+            while (state.nextId != state.completedThrough + (state.completedAny ? 1 : 0)) {
+                char control[128];
+                msghdr msg{};
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof(control);
+
+                if (::recvmsg(socket->native_handle(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                    return;
+                }
+
+                for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                    bool recvErr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                                   (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+                    if (!recvErr) {
+                        continue;
+                    }
+
+                    sock_extended_err err{};
+                    std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+                    if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                        continue;
+                    }
+
+                    // The kernel had to copy after all (e.g. loopback); stop paying for the notifications
+                    if ((err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && !state.disabled) {
+                        SPDLOG_INFO("Kernel copied MSG_ZEROCOPY data, using regular sends on this connection");
+                        state.disabled = true;
+                    }
+
+                    // Sends err.ee_info to err.ee_data have completed; TCP completes them in order
+                    state.completedAny = true;
+                    state.completedThrough = err.ee_data;
+                    while (!state.inFlight.empty() && zeroCopyIdReached(state.inFlight.front().first, err.ee_data)) {
+                        m_framePool.release(std::move(*state.inFlight.front().second));
+                        state.inFlight.pop_front();
+                    }
+                }
+            }
+        }
+#endif
+
+        std::future<int> sendFile(const std::string &endpoint, int fd, std::uint64_t offset, std::size_t length,
+                                  const std::vector<uint8_t> &message) {
+            auto promise = std::make_shared<std::promise<int>>();
+            auto future = promise->get_future();
+
+#ifdef __linux__
+            // The announcing message and the raw frame's header go through the socket as usual in one write, the
+            // payload straight from the page cache
+            auto headers = std::make_shared<std::vector<uint8_t>>();
+            if (!message.empty()) {
+                auto messageHeader = makeFrameHeader(FrameType::Message, message.size());
+                headers->insert(headers->end(), messageHeader.begin(), messageHeader.end());
+                headers->insert(headers->end(), message.begin(), message.end());
+            }
+            auto rawHeader = makeFrameHeader(FrameType::Raw, length);
+            headers->insert(headers->end(), rawHeader.begin(), rawHeader.end());
+
+            auto write = [this, endpoint, fd, offset, length, promise, headers](std::function<void()> next) {
+                auto done = [promise, next = std::move(next)](int result) {
+                    promise->set_value(result);
+                    next();
+                };
+
+                auto socket = findSocket(endpoint);
+                if (!socket) {
+                    SPDLOG_ERROR("No connection found for endpoint: {}", endpoint);
+                    done(-1);
+                    return;
+                }
+
+                asio::async_write(*socket, asio::buffer(*headers),
+                                  [this, socket, endpoint, fd, offset, length, done, headers](
+                                          const asio::error_code &error, std::size_t) {
+                                      if (error) {
+                                          SPDLOG_ERROR("Error sending data to {}: {}", endpoint, error.message());
+                                          done(-1);
+                                          return;
+                                      }
+
+                                      asio::error_code ec;
+                                      socket->native_non_blocking(true, ec);
+                                      continueSendFile(socket, endpoint, fd, static_cast<off_t>(offset), length,
+                                                       length, done);
+                                  });
+            };
+
+            m_ioContext.post([this, endpoint, write = std::move(write)]() mutable {
+                queueWrite(endpoint, std::move(write));
             });
+#else
+            SPDLOG_ERROR("sendFile is not supported on this platform");
+            promise->set_value(-1);
+#endif
 
             return future;
         }
 
+        void expectRawData(const std::string &endpoint, RawDataSink sink) {
+            std::lock_guard<std::mutex> lock(m_rawSinksMutex);
+            m_rawSinks[endpoint] = std::move(sink);
+        }
+
         bool initUdpSocket(uint16_t port, DataReceivedCallback onDataReceived) {
             try {
                 SPDLOG_INFO("Initializing UDP socket on port {}", port);
@@ -478,14 +1278,41 @@ namespace network {
     }
 
     bool SocketHandler::connectTcp(const std::string &host, uint16_t port, network::DataReceivedCallback onDataReceived,
-                                   network::ConnectionStatusCallback onConnectionStatus) {
-        return m_impl->connectTcp(host, port, std::move(onDataReceived), std::move(onConnectionStatus));
+                                   network::ConnectionStatusCallback onConnectionStatus, const std::string &label,
+                                   const std::string &localAddress) {
+        return m_impl->connectTcp(host, port, std::move(onDataReceived), std::move(onConnectionStatus), label,
+                                  localAddress);
+    }
+
+    void SocketHandler::closeTcp(const std::string &endpoint, bool abort) {
+        m_impl->closeTcp(endpoint, abort);
     }
 
     std::future<int> SocketHandler::sendTcp(const std::string &endpoint, const std::vector<uint8_t> &data) {
         return m_impl->sendTcp(endpoint, data);
     }
 
+    std::future<int> SocketHandler::sendFile(const std::string &endpoint, int fd, std::uint64_t offset,
+                                             std::size_t length, const std::vector<uint8_t> &message) {
+        return m_impl->sendFile(endpoint, fd, offset, length, message);
+    }
+
+    void SocketHandler::expectRawData(const std::string &endpoint, network::RawDataSink sink) {
+        m_impl->expectRawData(endpoint, std::move(sink));
+    }
+
+    void SocketHandler::setZeroCopyThreshold(std::size_t threshold) {
+        m_impl->setZeroCopyThreshold(threshold);
+    }
+
+    bool SocketHandler::isZeroCopySupported() {
+#ifdef __linux__
+        return true;
+#else
+        return false;
+#endif
+    }
+
     bool SocketHandler::initUdpSocket(uint16_t port, network::DataReceivedCallback onDataReceived) {
         return m_impl->initUdpSocket(port, std::move(onDataReceived));
     }
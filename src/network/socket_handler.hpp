@@ -5,6 +5,7 @@
 #include <functional>
 #include <memory>
 #include <future>
+#include <cstdint>
 #include <asio.hpp>
 
 namespace network {
@@ -18,6 +19,32 @@ namespace network {
         Error
     };
 
+    /**
+     * Kind of payload carried by a TCP frame
+     */
+    enum class FrameType : uint8_t {
+        Message = 0, // A serialized protocol message, passed to the data callback
+        Raw = 1      // File data, written to the RawDataSink registered for the endpoint
+    };
+
+    // TCP frames start with a 4-byte big-endian payload length, the frame type and 3 reserved bytes
+    constexpr std::size_t FRAME_HEADER_SIZE = 8;
+
+    // Largest frame payload accepted from a peer
+    constexpr std::size_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+    /**
+     * Destination of the next raw frame received from an endpoint
+     */
+    struct RawDataSink {
+        int fd = -1;              // File the data is written to
+        std::uint64_t offset = 0; // Position in the file of the first byte
+        std::size_t length = 0;   // Expected frame length
+
+        // Called on the IO thread once the frame has been written or has failed
+        std::function<void(bool success, const std::string &errorMessage)> onComplete;
+    };
+
     /**
      * Callback for data reception
      * @param data Data received
@@ -67,21 +94,69 @@ namespace network {
          * @param port Port to connect to
          * @param onDataReceived Callback for data reception
          * @param onConnectionStatus Callback for connection status changes
+         * @param label Tells apart several connections to the same host and port; the connection's endpoint
+         *              is "host:port#label", or "host:port" without one
+         * @param localAddress Local IPv4 address to connect from, which picks the interface on hosts that route
+         *                     by source address; empty to let the routing table choose
          * @return True if connection was initiated, false otherwise
          */
         bool connectTcp(const std::string& host, uint16_t port,
                         DataReceivedCallback onDataReceived,
-                        ConnectionStatusCallback onConnectionStatus);
+                        ConnectionStatusCallback onConnectionStatus,
+                        const std::string& label = "", const std::string& localAddress = "");
 
         /**
-         * Send data to a TCP connection
+         * Close a TCP connection once the data queued on it has been sent; the peer sees the end of the stream
+         * after the last byte, and the status callback reports the disconnection once the peer closes its side
+         * @param endpoint Endpoint of the connection
+         * @param abort True to close at once instead, failing the writes still pending on it
+         */
+        void closeTcp(const std::string& endpoint, bool abort = false);
+
+        /**
+         * Send data to a TCP connection; writes to one connection go out whole and in the order they were made
          * @param endpoint Endpoint to send to (in format "host:port")
          * @param data Data to send
-         * @return Future that resolves to number of bytes sent or -1 on error
+         * @return Future that resolves to number of bytes sent or -1 on error; on the IO thread, which cannot
+         *         wait for its own write, it resolves once the data is queued
          */
         std::future<int> sendTcp(const std::string& endpoint,
                                  const std::vector<uint8_t>& data);
 
+        /**
+         * Send a range of a file as a raw frame, moved from the page cache to the socket with sendfile()
+         * @param endpoint Endpoint to send to (in format "host:port")
+         * @param fd File descriptor to read from
+         * @param offset Position of the first byte in the file
+         * @param length Number of bytes to send
+         * @param message Message announcing the frame, sent directly ahead of it with nothing in between
+         * @return Future that resolves to number of bytes sent or -1 on error
+         */
+        std::future<int> sendFile(const std::string& endpoint, int fd, std::uint64_t offset, std::size_t length,
+                                  const std::vector<uint8_t>& message = {});
+
+        /**
+         * Claim the next raw frame from an endpoint; it is spliced from the socket into the sink's file
+         * Must be called before the frame is parsed, normally from the data callback of the message announcing it
+         * @param endpoint Endpoint the frame will arrive from
+         * @param sink Where to write the frame
+         */
+        void expectRawData(const std::string& endpoint, RawDataSink sink);
+
+        /**
+         * Send frames of at least a given size with MSG_ZEROCOPY, so the kernel transmits from our buffer
+         * instead of copying it; buffers go back to the pool once the socket error queue reports completion
+         * Pays off for large frames on fast links, costs more than it saves for small ones
+         * @param threshold Smallest message size sent with MSG_ZEROCOPY, 0 to disable (the default)
+         */
+        void setZeroCopyThreshold(std::size_t threshold);
+
+        /**
+         * Check whether raw frames can be sent and received on this platform
+         * @return True if sendFile and raw frame reception are supported
+         */
+        static bool isZeroCopySupported();
+
         /**
          * Initialize UDP socket for broadcasting/discovery
          * @param port Port to listen on
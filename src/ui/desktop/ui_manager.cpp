@@ -517,20 +517,30 @@ void UIManager::sendFileToPeer() {
     std::string peerId = peer.id;
 
     // Open file dialog
-    QString filePath = QFileDialog::getOpenFileName(this, "Select File to Send",
-                                                    QDir::homePath(), "All Files (*)");
+    QStringList filePaths = QFileDialog::getOpenFileNames(this, "Select Files to Send",
+                                                          QDir::homePath(), "All Files (*)");
 
-    if (filePath.isEmpty()) {
+    if (filePaths.isEmpty()) {
         return; // User canceled
     }
 
-    // Send the file
-    std::string transferId = m_transferManager->sendFile(peerId, filePath.toStdString());
+    // Send the files; several files are read in on-disk order
+    std::vector<std::string> paths;
+    for (const auto &filePath: filePaths) {
+        paths.push_back(filePath.toStdString());
+    }
+    auto transferIds = m_transferManager->sendFiles(peerId, paths);
 
-    if (transferId.empty()) {
+    auto failed = std::count(transferIds.begin(), transferIds.end(), std::string());
+    if (failed == static_cast<std::ptrdiff_t>(transferIds.size())) {
         QMessageBox::critical(this, "Send File",
                               QString("Failed to send file to %1").arg(QString::fromStdString(peer.name)));
     } else {
+        if (failed > 0) {
+            QMessageBox::warning(this, "Send File",
+                                 QString("Failed to send %1 of %2 files to %3").arg(failed)
+                                         .arg(transferIds.size()).arg(QString::fromStdString(peer.name)));
+        }
         m_statusLabel->setText(QString("Sending file to %1...").arg(QString::fromStdString(peer.name)));
     }
 }
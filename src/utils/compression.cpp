@@ -0,0 +1,303 @@
+#include "compression.hpp"
+
+#include <spdlog/spdlog.h>
+#include <lz4.h>
+#include <zstd.h>
+#include <zdict.h>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+namespace utils {
+
+    namespace {
+        // Default zstd level; higher levels cost far more CPU than they save on a LAN
+        constexpr int ZSTD_DEFAULT_LEVEL = 3;
+
+        // Chunks whose sampled entropy is above this are treated as incompressible
+        constexpr double ENTROPY_THRESHOLD = 7.5;
+
+        // Number and size of the samples taken by the entropy probe
+        constexpr std::size_t PROBE_SAMPLES = 4;
+        constexpr std::size_t PROBE_SAMPLE_SIZE = 1024;
+
+        // Files up to this size benefit from a shared dictionary
+        constexpr std::uintmax_t DICTIONARY_FILE_LIMIT = 128 * 1024;
+
+        // Reuse zstd contexts per thread instead of allocating one per chunk
+        ZSTD_CCtx *compressionContext() {
+            thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context(ZSTD_createCCtx(),
+                                                                                    ZSTD_freeCCtx);
+            return context.get();
+        }
+
+        ZSTD_DCtx *decompressionContext() {
+            thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(ZSTD_createDCtx(),
+                                                                                    ZSTD_freeDCtx);
+            return context.get();
+        }
+    }
+
+    CompressionDictionary::CompressionDictionary(std::vector<uint8_t> data, int level)
+            : m_id(0), m_data(std::move(data)), m_compressionDict(nullptr), m_decompressionDict(nullptr) {
+        m_id = ZDICT_getDictID(m_data.data(), m_data.size());
+        if (m_id == 0) {
+            throw std::runtime_error("Not a zstd dictionary");
+        }
+
+        m_compressionDict = ZSTD_createCDict(m_data.data(), m_data.size(),
+                                             level != 0 ? level : ZSTD_DEFAULT_LEVEL);
+        m_decompressionDict = ZSTD_createDDict(m_data.data(), m_data.size());
+        if (!m_compressionDict || !m_decompressionDict) {
+            ZSTD_freeCDict(m_compressionDict);
+            ZSTD_freeDDict(m_decompressionDict);
+            throw std::runtime_error("Failed to load zstd dictionary");
+        }
+    }
+
+    CompressionDictionary::~CompressionDictionary() {
+        ZSTD_freeCDict(m_compressionDict);
+        ZSTD_freeDDict(m_decompressionDict);
+    }
+
+    uint32_t CompressionDictionary::id() const {
+        return m_id;
+    }
+
+    const std::vector<uint8_t> &CompressionDictionary::data() const {
+        return m_data;
+    }
+
+    bool Compression::compress(CompressionAlgorithm algorithm,
+                               std::span<const uint8_t> input,
+                               std::vector<uint8_t> &output,
+                               int level,
+                               const CompressionDictionary *dictionary) {
+        if (dictionary && algorithm != CompressionAlgorithm::Zstd) {
+            SPDLOG_ERROR("Shared dictionaries require zstd");
+            return false;
+        }
+
+        switch (algorithm) {
+            case CompressionAlgorithm::None:
+                output.assign(input.begin(), input.end());
+                return true;
+
+            case CompressionAlgorithm::Lz4: {
+                if (input.size() > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE)) {
+                    SPDLOG_ERROR("Input too large for LZ4: {} bytes", input.size());
+                    return false;
+                }
+
+                output.resize(static_cast<std::size_t>(LZ4_compressBound(static_cast<int>(input.size()))));
+                int compressedSize = LZ4_compress_default(reinterpret_cast<const char *>(input.data()),
+                                                          reinterpret_cast<char *>(output.data()),
+                                                          static_cast<int>(input.size()),
+                                                          static_cast<int>(output.size()));
+                if (compressedSize <= 0) {
+                    SPDLOG_ERROR("LZ4 compression failed");
+                    return false;
+                }
+
+                output.resize(static_cast<std::size_t>(compressedSize));
+                return true;
+            }
+
+            case CompressionAlgorithm::Zstd: {
+                output.resize(ZSTD_compressBound(input.size()));
+                std::size_t compressedSize = dictionary
+                        ? ZSTD_compress_usingCDict(compressionContext(),
+                                                   output.data(), output.size(),
+                                                   input.data(), input.size(),
+                                                   dictionary->m_compressionDict)
+                        : ZSTD_compressCCtx(compressionContext(),
+                                            output.data(), output.size(),
+                                            input.data(), input.size(),
+                                            level != 0 ? level : ZSTD_DEFAULT_LEVEL);
+                if (ZSTD_isError(compressedSize)) {
+                    SPDLOG_ERROR("Zstd compression failed: {}", ZSTD_getErrorName(compressedSize));
+                    return false;
+                }
+
+                output.resize(compressedSize);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool Compression::decompress(CompressionAlgorithm algorithm,
+                                 const std::vector<uint8_t> &input,
+                                 std::size_t originalSize,
+                                 std::vector<uint8_t> &output,
+                                 const CompressionDictionary *dictionary) {
+        if (dictionary && algorithm != CompressionAlgorithm::Zstd) {
+            SPDLOG_ERROR("Shared dictionaries require zstd");
+            return false;
+        }
+
+        if (originalSize > MAX_CHUNK_SIZE) {
+            SPDLOG_ERROR("Refusing to decompress to {} bytes, more than a chunk", originalSize);
+            return false;
+        }
+
+        switch (algorithm) {
+            case CompressionAlgorithm::None:
+                output = input;
+                return true;
+
+            case CompressionAlgorithm::Lz4: {
+                output.resize(originalSize);
+                int decompressedSize = LZ4_decompress_safe(reinterpret_cast<const char *>(input.data()),
+                                                           reinterpret_cast<char *>(output.data()),
+                                                           static_cast<int>(input.size()),
+                                                           static_cast<int>(output.size()));
+                if (decompressedSize < 0 || static_cast<std::size_t>(decompressedSize) != originalSize) {
+                    SPDLOG_ERROR("LZ4 decompression failed");
+                    return false;
+                }
+                return true;
+            }
+
+            case CompressionAlgorithm::Zstd: {
+                output.resize(originalSize);
+                std::size_t decompressedSize = dictionary
+                        ? ZSTD_decompress_usingDDict(decompressionContext(),
+                                                     output.data(), output.size(),
+                                                     input.data(), input.size(),
+                                                     dictionary->m_decompressionDict)
+                        : ZSTD_decompressDCtx(decompressionContext(),
+                                              output.data(), output.size(),
+                                              input.data(), input.size());
+                if (ZSTD_isError(decompressedSize) || decompressedSize != originalSize) {
+                    SPDLOG_ERROR("Zstd decompression failed");
+                    return false;
+                }
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::vector<uint8_t> Compression::trainDictionary(const std::vector<std::vector<uint8_t>> &samples,
+                                                      std::size_t maxSize) {
+        // The trainer takes all samples back to back plus their sizes
+        std::vector<uint8_t> buffer;
+        std::vector<std::size_t> sizes;
+        sizes.reserve(samples.size());
+        for (const auto &sample: samples) {
+            buffer.insert(buffer.end(), sample.begin(), sample.end());
+            sizes.push_back(sample.size());
+        }
+
+        std::vector<uint8_t> dictionary(maxSize);
+        std::size_t dictionarySize = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(),
+                                                           buffer.data(), sizes.data(),
+                                                           static_cast<unsigned>(sizes.size()));
+        if (ZDICT_isError(dictionarySize)) {
+            SPDLOG_DEBUG("Dictionary training failed on {} samples: {}",
+                         samples.size(), ZDICT_getErrorName(dictionarySize));
+            return {};
+        }
+
+        dictionary.resize(dictionarySize);
+        return dictionary;
+    }
+
+    bool Compression::isDictionaryEligible(const std::string &mimeType, std::uintmax_t fileSize) {
+        if (fileSize == 0 || fileSize > DICTIONARY_FILE_LIMIT) {
+            return false;
+        }
+
+        return mimeType.rfind("text/", 0) == 0 ||
+               mimeType == "application/json" || mimeType == "application/xml" ||
+               mimeType == "application/yaml" || mimeType == "application/toml" ||
+               mimeType == "image/svg+xml";
+    }
+
+    double Compression::estimateEntropy(const uint8_t *data, std::size_t length) {
+        if (length == 0) {
+            return 0.0;
+        }
+
+        // Histogram a few slices spread over the buffer rather than every byte
+        std::array<uint32_t, 256> histogram{};
+        std::size_t sampled = 0;
+        std::size_t sampleSize = std::min(PROBE_SAMPLE_SIZE, length);
+        std::size_t stride = length > sampleSize ? (length - sampleSize) / (PROBE_SAMPLES - 1) : 0;
+
+        for (std::size_t s = 0; s < PROBE_SAMPLES; ++s) {
+            const uint8_t *sample = data + std::min(s * stride, length - sampleSize);
+            for (std::size_t i = 0; i < sampleSize; ++i) {
+                histogram[sample[i]]++;
+            }
+            sampled += sampleSize;
+
+            if (stride == 0) {
+                break;
+            }
+        }
+
+        double entropy = 0.0;
+        for (uint32_t count: histogram) {
+            if (count > 0) {
+                double p = static_cast<double>(count) / static_cast<double>(sampled);
+                entropy -= p * std::log2(p);
+            }
+        }
+
+        return entropy;
+    }
+
+    bool Compression::looksCompressible(const uint8_t *data, std::size_t length) {
+        return estimateEntropy(data, length) < ENTROPY_THRESHOLD;
+    }
+
+    bool Compression::isPrecompressedMimeType(const std::string &mimeType) {
+        // Images, audio and video are already compressed, as are archives and zip-based office documents
+        if (mimeType.rfind("video/", 0) == 0) return true;
+        if (mimeType == "image/jpeg" || mimeType == "image/png" || mimeType == "image/gif") return true;
+        if (mimeType == "image/webp") return true;
+        if (mimeType == "audio/mpeg" || mimeType == "audio/ogg" || mimeType == "audio/flac") return true;
+        if (mimeType == "application/zip" || mimeType == "application/pdf") return true;
+        if (mimeType == "application/gzip" || mimeType == "application/zstd" || mimeType == "application/x-xz" ||
+            mimeType == "application/x-bzip2" || mimeType == "application/x-7z-compressed" ||
+            mimeType == "application/vnd.rar" || mimeType == "application/x-lz4") return true;
+        if (mimeType.rfind("application/vnd.openxmlformats-officedocument.", 0) == 0) return true;
+
+        return false;
+    }
+
+    std::string Compression::toString(CompressionAlgorithm algorithm) {
+        switch (algorithm) {
+            case CompressionAlgorithm::None:
+                return "none";
+            case CompressionAlgorithm::Lz4:
+                return "lz4";
+            case CompressionAlgorithm::Zstd:
+                return "zstd";
+        }
+        return "";
+    }
+
+    std::optional<CompressionAlgorithm> Compression::fromString(const std::string &name) {
+        if (name == "none") return CompressionAlgorithm::None;
+        if (name == "lz4") return CompressionAlgorithm::Lz4;
+        if (name == "zstd") return CompressionAlgorithm::Zstd;
+        return std::nullopt;
+    }
+
+    CompressionAlgorithm Compression::negotiate(const std::vector<std::string> &offered) {
+        for (const auto &name: offered) {
+            if (auto algorithm = fromString(name)) {
+                return *algorithm;
+            }
+        }
+
+        return CompressionAlgorithm::None;
+    }
+}
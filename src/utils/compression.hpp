@@ -0,0 +1,166 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <span>
+#include <optional>
+#include <cstdint>
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace utils {
+
+    /**
+     * Compression algorithms available for file data chunks
+     */
+    enum class CompressionAlgorithm {
+        None,
+        Lz4,   // Fast, modest ratio
+        Zstd   // Slower, better ratio
+    };
+
+    /**
+     * Zstd dictionary trained on small files of one peer session
+     * Holds the raw dictionary for shipping and digested forms for fast use
+     */
+    class CompressionDictionary {
+    public:
+        /**
+         * Constructor
+         * @param data Raw dictionary as produced by Compression::trainDictionary
+         * @param level Compression level the dictionary is digested for, 0 for the default
+         * @throws std::runtime_error if the dictionary cannot be loaded
+         */
+        explicit CompressionDictionary(std::vector<uint8_t> data, int level = 0);
+
+        /**
+         * Destructor
+         */
+        ~CompressionDictionary();
+
+        CompressionDictionary(const CompressionDictionary &) = delete;
+        CompressionDictionary &operator=(const CompressionDictionary &) = delete;
+
+        /**
+         * Get the dictionary ID embedded by the trainer
+         * @return Dictionary ID, never 0
+         */
+        uint32_t id() const;
+
+        /**
+         * Get the raw dictionary bytes
+         * @return The dictionary
+         */
+        const std::vector<uint8_t> &data() const;
+
+    private:
+        friend class Compression;
+
+        uint32_t m_id;
+        std::vector<uint8_t> m_data;
+        ZSTD_CDict_s *m_compressionDict;
+        ZSTD_DDict_s *m_decompressionDict;
+    };
+
+    /**
+     * Compression utility class
+     * Provides per-chunk compression and cheap incompressibility detection
+     */
+    class Compression {
+    public:
+        // Largest size decompress() inflates to, so a peer cannot make us allocate more; chunks are never larger
+        static constexpr std::size_t MAX_CHUNK_SIZE = 1024 * 1024;
+
+        /**
+         * Compress a buffer
+         * @param algorithm Algorithm to use
+         * @param input Data to compress
+         * @param output Output buffer for compressed data
+         * @param level Compression level, 0 for the algorithm default
+         * @param dictionary Optional shared dictionary, Zstd only
+         * @return True if compression was successful, false otherwise
+         */
+        static bool compress(CompressionAlgorithm algorithm,
+                             std::span<const uint8_t> input,
+                             std::vector<uint8_t> &output,
+                             int level = 0,
+                             const CompressionDictionary *dictionary = nullptr);
+
+        /**
+         * Decompress a buffer produced by compress()
+         * @param algorithm Algorithm that was used
+         * @param input Compressed data
+         * @param originalSize Size of the uncompressed data, at most MAX_CHUNK_SIZE
+         * @param output Output buffer for decompressed data
+         * @param dictionary Dictionary the data was compressed with, if any
+         * @return True if decompression was successful, false otherwise
+         */
+        static bool decompress(CompressionAlgorithm algorithm,
+                               const std::vector<uint8_t> &input,
+                               std::size_t originalSize,
+                               std::vector<uint8_t> &output,
+                               const CompressionDictionary *dictionary = nullptr);
+
+        /**
+         * Train a Zstd dictionary from sample files
+         * @param samples Sample contents, typically the first few KB of each small file
+         * @param maxSize Maximum dictionary size in bytes
+         * @return The raw dictionary, empty if there were not enough samples to train on
+         */
+        static std::vector<uint8_t> trainDictionary(const std::vector<std::vector<uint8_t>> &samples,
+                                                    std::size_t maxSize = 32 * 1024);
+
+        /**
+         * Check whether a file is a good candidate for shared-dictionary compression
+         * @param mimeType MIME type as reported by FileHandler
+         * @param fileSize Size of the file in bytes
+         * @return True for small text-like files
+         */
+        static bool isDictionaryEligible(const std::string &mimeType, std::uintmax_t fileSize);
+
+        /**
+         * Estimate the Shannon entropy of a buffer from a few samples
+         * @param data Pointer to the data
+         * @param length Number of bytes
+         * @return Entropy in bits per byte (0-8)
+         */
+        static double estimateEntropy(const uint8_t *data, std::size_t length);
+
+        /**
+         * Cheap check whether a chunk is likely to shrink when compressed
+         * @param data Pointer to the data
+         * @param length Number of bytes
+         * @return True if the chunk is worth compressing
+         */
+        static bool looksCompressible(const uint8_t *data, std::size_t length);
+
+        /**
+         * Check whether a MIME type is an already-compressed format
+         * @param mimeType MIME type as reported by FileHandler
+         * @return True if compressing the content would be wasted work
+         */
+        static bool isPrecompressedMimeType(const std::string &mimeType);
+
+        /**
+         * Get the wire name of an algorithm
+         * @param algorithm The algorithm
+         * @return Name such as "lz4"
+         */
+        static std::string toString(CompressionAlgorithm algorithm);
+
+        /**
+         * Parse a wire name
+         * @param name Algorithm name
+         * @return The algorithm or std::nullopt if unknown
+         */
+        static std::optional<CompressionAlgorithm> fromString(const std::string &name);
+
+        /**
+         * Pick the first algorithm offered by a peer that we also support
+         * @param offered Algorithm names offered by the peer, most preferred first
+         * @return Chosen algorithm, None if nothing matches
+         */
+        static CompressionAlgorithm negotiate(const std::vector<std::string> &offered);
+    };
+}
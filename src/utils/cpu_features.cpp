@@ -0,0 +1,88 @@
+#include "cpu_features.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPU_FEATURES_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace utils {
+
+    namespace {
+        struct DetectedFeatures {
+            bool sse42 = false;
+            bool shaNi = false;
+            bool avx2 = false;
+        };
+
+#ifdef CPU_FEATURES_X86
+        void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+            for (int i = 0; i < 4; ++i) {
+                regs[i] = static_cast<unsigned int>(info[i]);
+            }
+#else
+            __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        }
+#endif
+
+        DetectedFeatures detect() {
+            DetectedFeatures features;
+
+#ifdef CPU_FEATURES_X86
+            unsigned int regs[4] = {0, 0, 0, 0};
+            cpuid(0, 0, regs);
+            unsigned int maxLeaf = regs[0];
+
+            if (maxLeaf >= 1) {
+                cpuid(1, 0, regs);
+                features.sse42 = (regs[2] & (1u << 20)) != 0;
+            }
+
+            if (maxLeaf >= 7) {
+                cpuid(7, 0, regs);
+                features.avx2 = (regs[1] & (1u << 5)) != 0;
+                features.shaNi = (regs[1] & (1u << 29)) != 0;
+            }
+#endif
+
+            return features;
+        }
+
+        const DetectedFeatures &features() {
+            static const DetectedFeatures detected = detect();
+            return detected;
+        }
+    }
+
+    bool CpuFeatures::hasSse42() {
+        return features().sse42;
+    }
+
+    bool CpuFeatures::hasShaNi() {
+        return features().shaNi;
+    }
+
+    bool CpuFeatures::hasAvx2() {
+        return features().avx2;
+    }
+
+    std::string CpuFeatures::describe() {
+        std::string summary;
+        if (hasSse42()) summary += "sse4.2 ";
+        if (hasShaNi()) summary += "sha-ni ";
+        if (hasAvx2()) summary += "avx2 ";
+
+        if (summary.empty()) {
+            return "none";
+        }
+        summary.pop_back();
+        return summary;
+    }
+}
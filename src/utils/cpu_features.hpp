@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+namespace utils {
+
+    /**
+     * CPU feature detection used to pick accelerated code paths at runtime
+     */
+    class CpuFeatures {
+    public:
+        /**
+         * Check for SSE4.2 (hardware CRC32C instruction)
+         * @return True if the CPU supports SSE4.2
+         */
+        static bool hasSse42();
+
+        /**
+         * Check for the SHA extensions (SHA-NI)
+         * @return True if the CPU supports SHA-NI
+         */
+        static bool hasShaNi();
+
+        /**
+         * Check for AVX2
+         * @return True if the CPU supports AVX2
+         */
+        static bool hasAvx2();
+
+        /**
+         * Get a short human-readable summary of the detected features
+         * @return Feature summary, e.g. "sse4.2 sha-ni avx2"
+         */
+        static std::string describe();
+    };
+}
@@ -2,10 +2,75 @@
 
 #include <string>
 #include <vector>
+#include <span>
+#include <array>
+#include <atomic>
 #include <cstdint>
 
 namespace utils {
 
+    /**
+     * AES-256-GCM key derived once from a password, for encrypting many messages without running PBKDF2 for each
+     * Messages have the layout of Encryption::encrypt output, so either side can be used with the other;
+     * every message gets its own IV from a random per-key prefix and a counter
+     */
+    class EncryptionKey {
+    public:
+        // Size of the salt that starts every message
+        static constexpr std::size_t SALT_SIZE = 8;
+
+        /**
+         * Derive a key with PBKDF2
+         * @param password Password
+         * @param salt Salt of SALT_SIZE bytes, empty to pick a random one
+         * @throws std::runtime_error if the key cannot be derived
+         */
+        explicit EncryptionKey(const std::string &password, std::vector<uint8_t> salt = {});
+
+        /**
+         * Destructor, wipes the key
+         */
+        ~EncryptionKey();
+
+        EncryptionKey(const EncryptionKey &) = delete;
+        EncryptionKey &operator=(const EncryptionKey &) = delete;
+
+        /**
+         * Get the salt the key was derived with
+         * @return The salt
+         */
+        const std::vector<uint8_t> &salt() const { return m_salt; }
+
+        /**
+         * Encrypt a message; safe to call from several threads at once
+         * @param plaintext Data to encrypt
+         * @param ciphertext Output buffer for the salt, IV, encrypted data and tag
+         * @return True if encryption was successful, false otherwise
+         */
+        bool encrypt(std::span<const uint8_t> plaintext, std::vector<uint8_t> &ciphertext);
+
+        /**
+         * Decrypt a message whose salt matches this key's
+         * @param ciphertext Encrypted message
+         * @param plaintext Output buffer for decrypted data
+         * @return True if the message was authentic and decrypted, false otherwise
+         */
+        bool decrypt(const std::vector<uint8_t> &ciphertext, std::vector<uint8_t> &plaintext) const;
+
+        /**
+         * Get the salt an encrypted message was made with, to find the key for it
+         * @param ciphertext Encrypted message
+         * @return The salt, empty if the message is too short
+         */
+        static std::vector<uint8_t> saltOf(const std::vector<uint8_t> &ciphertext);
+
+    private:
+        std::vector<uint8_t> m_salt;
+        std::array<uint8_t, 32> m_key{};
+        std::array<uint8_t, 4> m_ivPrefix{};
+        std::atomic<uint64_t> m_ivCounter{0};
+    };
+
     /**
      * Encryption utility class
      * Provides encryption, decryption, and hashing functions
@@ -23,7 +88,7 @@ namespace utils {
         static void shutdown();
 
         /**
-         * Encrypt data using AES-256-GCM with a password
+         * Encrypt data using AES-256-GCM with a password; derives a key on every call, see EncryptionKey
          * @param plaintext Data to encrypt
          * @param password Password for encryption
          * @param ciphertext Output buffer for encrypted data
@@ -60,19 +125,6 @@ namespace utils {
         static bool verifyFileHash(const std::string &filePath, const std::string &expectedHash);
 
     private:
-        /**
-         * Derive key and IV from password and salt using PBKDF2
-         * @param password Password
-         * @param salt Salt value
-         * @param key Output buffer for key
-         * @param iv Output buffer for IV
-         * @return True if derivation was successful, false otherwise
-         */
-        static bool deriveKeyAndIV(const std::string &password,
-                                   const std::vector<uint8_t> &salt,
-                                   std::vector<uint8_t> &key,
-                                   std::vector<uint8_t> &iv);
-
         /**
          * Flag indicating whether the encryption system is initialized
          */
@@ -0,0 +1,465 @@
+#include "hashing.hpp"
+#include "cpu_features.hpp"
+
+#include <spdlog/spdlog.h>
+#include <fstream>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <stdexcept>
+
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define HASHING_X86
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define HASHING_TARGET(features) __attribute__((target(features)))
+#else
+#define HASHING_TARGET(features)
+#endif
+#endif
+
+namespace utils {
+
+    namespace {
+        constexpr uint32_t SHA256_K[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        constexpr uint32_t SHA256_INIT[8] = {
+                0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+
+        inline uint32_t rotr(uint32_t x, int n) {
+            return (x >> n) | (x << (32 - n));
+        }
+
+        using Sha256BlockFunction = void (*)(uint32_t state[8], const uint8_t *data, std::size_t blocks);
+
+        void sha256BlocksGeneric(uint32_t state[8], const uint8_t *data, std::size_t blocks) {
+            uint32_t w[64];
+
+            for (; blocks > 0; --blocks, data += 64) {
+                for (int i = 0; i < 16; ++i) {
+                    w[i] = (uint32_t(data[4 * i]) << 24) | (uint32_t(data[4 * i + 1]) << 16) |
+                           (uint32_t(data[4 * i + 2]) << 8) | uint32_t(data[4 * i + 3]);
+                }
+                for (int i = 16; i < 64; ++i) {
+                    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                }
+
+                uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+                uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+                for (int i = 0; i < 64; ++i) {
+                    uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+                    uint32_t ch = (e & f) ^ (~e & g);
+                    uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+                    uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+                    uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+                    uint32_t t2 = s0 + maj;
+
+                    h = g;
+                    g = f;
+                    f = e;
+                    e = d + t1;
+                    d = c;
+                    c = b;
+                    b = a;
+                    a = t1 + t2;
+                }
+
+                state[0] += a;
+                state[1] += b;
+                state[2] += c;
+                state[3] += d;
+                state[4] += e;
+                state[5] += f;
+                state[6] += g;
+                state[7] += h;
+            }
+        }
+
+#ifdef HASHING_X86
+        HASHING_TARGET("sha,sse4.1,ssse3")
+        void sha256BlocksShaNi(uint32_t state[8], const uint8_t *data, std::size_t blocks) {
+            const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+            // Rearrange the state into the ABEF/CDGH layout the instructions expect
+            __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[0])), 0xB1);
+            __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[4])), 0x1B);
+            __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+            state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+            for (; blocks > 0; --blocks, data += 64) {
+                __m128i abefSave = state0;
+                __m128i cdghSave = state1;
+                __m128i msg[4];
+
+                // 16 groups of 4 rounds; the message schedule is kept in a rotating window of 4 registers
+                for (int i = 0; i < 16; ++i) {
+                    __m128i &current = msg[i % 4];
+
+                    if (i < 4) {
+                        current = _mm_shuffle_epi8(
+                                _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i)), byteSwap);
+                    }
+
+                    __m128i roundInput = _mm_add_epi32(
+                            current, _mm_loadu_si128(reinterpret_cast<const __m128i *>(&SHA256_K[4 * i])));
+                    state1 = _mm_sha256rnds2_epu32(state1, state0, roundInput);
+
+                    // Finish the next schedule words while the previous ones are still unmodified
+                    if (i >= 3 && i <= 14) {
+                        __m128i &next = msg[(i + 1) % 4];
+                        tmp = _mm_alignr_epi8(current, msg[(i - 1) % 4], 4);
+                        next = _mm_sha256msg2_epu32(_mm_add_epi32(next, tmp), current);
+                    }
+
+                    roundInput = _mm_shuffle_epi32(roundInput, 0x0E);
+                    state0 = _mm_sha256rnds2_epu32(state0, state1, roundInput);
+
+                    if (i >= 1 && i <= 12) {
+                        msg[(i - 1) % 4] = _mm_sha256msg1_epu32(msg[(i - 1) % 4], current);
+                    }
+                }
+
+                state0 = _mm_add_epi32(state0, abefSave);
+                state1 = _mm_add_epi32(state1, cdghSave);
+            }
+
+            // Back to the linear A..H layout
+            tmp = _mm_shuffle_epi32(state0, 0x1B);
+            state1 = _mm_shuffle_epi32(state1, 0xB1);
+            state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+            state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[0]), state0);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[4]), state1);
+        }
+#endif
+
+        Sha256BlockFunction selectSha256(bool allowHardware) {
+#ifdef HASHING_X86
+            if (allowHardware && CpuFeatures::hasShaNi() && CpuFeatures::hasSse42()) {
+                return sha256BlocksShaNi;
+            }
+#endif
+            return sha256BlocksGeneric;
+        }
+
+        // CRC32C (Castagnoli), reflected polynomial
+        constexpr uint32_t CRC32C_POLY = 0x82F63B78;
+
+        constexpr std::array<uint32_t, 256> makeCrc32cTable() {
+            std::array<uint32_t, 256> table{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit) {
+                    crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+                }
+                table[i] = crc;
+            }
+            return table;
+        }
+
+        constexpr auto CRC32C_TABLE = makeCrc32cTable();
+
+        uint32_t crc32cGeneric(const uint8_t *data, std::size_t length, uint32_t crc) {
+            crc = ~crc;
+            for (std::size_t i = 0; i < length; ++i) {
+                crc = CRC32C_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+#ifdef HASHING_X86
+        HASHING_TARGET("sse4.2")
+        uint32_t crc32cSse42(const uint8_t *data, std::size_t length, uint32_t crc) {
+            crc = ~crc;
+
+#if defined(__x86_64__) || defined(_M_X64)
+            uint64_t crc64 = crc;
+            for (; length >= 8; length -= 8, data += 8) {
+                uint64_t word;
+                std::memcpy(&word, data, sizeof(word));
+                crc64 = _mm_crc32_u64(crc64, word);
+            }
+            crc = static_cast<uint32_t>(crc64);
+#endif
+
+            for (; length > 0; --length, ++data) {
+                crc = _mm_crc32_u8(crc, *data);
+            }
+            return ~crc;
+        }
+#endif
+
+        using Crc32cFunction = uint32_t (*)(const uint8_t *data, std::size_t length, uint32_t crc);
+
+        Crc32cFunction selectCrc32c(bool allowHardware) {
+#ifdef HASHING_X86
+            if (allowHardware && CpuFeatures::hasSse42()) {
+                return crc32cSse42;
+            }
+#endif
+            return crc32cGeneric;
+        }
+
+        std::vector<uint8_t> bigEndianBytes(uint64_t value, std::size_t bytes) {
+            std::vector<uint8_t> out(bytes);
+            for (std::size_t i = 0; i < bytes; ++i) {
+                out[bytes - 1 - i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+            return out;
+        }
+
+        /**
+         * Streaming SHA-256 on top of a block function
+         */
+        class Sha256Hasher : public Hasher {
+        public:
+            explicit Sha256Hasher(Sha256BlockFunction blocks) : m_blocks(blocks) {
+                std::memcpy(m_state, SHA256_INIT, sizeof(m_state));
+            }
+
+            void update(const uint8_t *data, std::size_t length) override {
+                m_totalLength += length;
+
+                if (m_bufferLength > 0) {
+                    std::size_t take = std::min(length, sizeof(m_buffer) - m_bufferLength);
+                    std::memcpy(m_buffer + m_bufferLength, data, take);
+                    m_bufferLength += take;
+                    data += take;
+                    length -= take;
+
+                    if (m_bufferLength < sizeof(m_buffer)) {
+                        return;
+                    }
+                    m_blocks(m_state, m_buffer, 1);
+                    m_bufferLength = 0;
+                }
+
+                if (std::size_t fullBlocks = length / 64; fullBlocks > 0) {
+                    m_blocks(m_state, data, fullBlocks);
+                    data += fullBlocks * 64;
+                    length -= fullBlocks * 64;
+                }
+
+                std::memcpy(m_buffer, data, length);
+                m_bufferLength = length;
+            }
+
+            std::vector<uint8_t> finish() override {
+                uint64_t bitLength = m_totalLength * 8;
+
+                // Padding: 0x80, zeros, then the 64-bit big-endian message length
+                uint8_t padding[72] = {0x80};
+                std::size_t padLength = (m_bufferLength < 56 ? 56 : 120) - m_bufferLength;
+                update(padding, padLength);
+                update(bigEndianBytes(bitLength, 8).data(), 8);
+
+                std::vector<uint8_t> digest(32);
+                for (int i = 0; i < 8; ++i) {
+                    digest[4 * i] = static_cast<uint8_t>(m_state[i] >> 24);
+                    digest[4 * i + 1] = static_cast<uint8_t>(m_state[i] >> 16);
+                    digest[4 * i + 2] = static_cast<uint8_t>(m_state[i] >> 8);
+                    digest[4 * i + 3] = static_cast<uint8_t>(m_state[i]);
+                }
+                return digest;
+            }
+
+        private:
+            Sha256BlockFunction m_blocks;
+            uint32_t m_state[8];
+            uint8_t m_buffer[64];
+            std::size_t m_bufferLength = 0;
+            uint64_t m_totalLength = 0;
+        };
+
+        /**
+         * XXH3 64-bit hasher (xxHash does its own SIMD dispatch)
+         */
+        class Xxh3Hasher : public Hasher {
+        public:
+            Xxh3Hasher() : m_state(XXH3_createState()) {
+                if (!m_state) {
+                    throw std::runtime_error("Failed to allocate XXH3 state");
+                }
+                XXH3_64bits_reset(m_state);
+            }
+
+            ~Xxh3Hasher() override {
+                XXH3_freeState(m_state);
+            }
+
+            void update(const uint8_t *data, std::size_t length) override {
+                XXH3_64bits_update(m_state, data, length);
+            }
+
+            std::vector<uint8_t> finish() override {
+                return bigEndianBytes(XXH3_64bits_digest(m_state), 8);
+            }
+
+        private:
+            XXH3_state_t *m_state;
+        };
+
+        class Crc32cHasher : public Hasher {
+        public:
+            explicit Crc32cHasher(Crc32cFunction crc) : m_crc(crc) {}
+
+            void update(const uint8_t *data, std::size_t length) override {
+                m_value = m_crc(data, length, m_value);
+            }
+
+            std::vector<uint8_t> finish() override {
+                return bigEndianBytes(m_value, 4);
+            }
+
+        private:
+            Crc32cFunction m_crc;
+            uint32_t m_value = 0;
+        };
+    }
+
+    std::unique_ptr<Hasher> Hashing::create(HashAlgorithm algorithm, bool allowHardware) {
+        switch (algorithm) {
+            case HashAlgorithm::Sha256:
+                return std::make_unique<Sha256Hasher>(selectSha256(allowHardware));
+            case HashAlgorithm::Xxh3:
+                return std::make_unique<Xxh3Hasher>();
+            case HashAlgorithm::Crc32c:
+                return std::make_unique<Crc32cHasher>(selectCrc32c(allowHardware));
+        }
+        throw std::runtime_error("Unknown hash algorithm");
+    }
+
+    std::string Hashing::hashFile(const std::string &filePath, HashAlgorithm algorithm) {
+        try {
+            std::ifstream file(filePath, std::ios::binary);
+            if (!file) {
+                throw std::runtime_error("Failed to open file: " + filePath);
+            }
+
+            auto hasher = create(algorithm);
+
+            // Read and hash the file in chunks
+            constexpr std::size_t BUFFER_SIZE = 1024 * 1024;
+            std::vector<uint8_t> buffer(BUFFER_SIZE);
+
+            while (file) {
+                file.read(reinterpret_cast<char *>(buffer.data()), BUFFER_SIZE);
+                std::streamsize bytesRead = file.gcount();
+
+                if (bytesRead > 0) {
+                    hasher->update(buffer.data(), static_cast<std::size_t>(bytesRead));
+                }
+            }
+
+            if (file.bad()) {
+                throw std::runtime_error("Error reading file: " + filePath);
+            }
+
+            return toHex(hasher->finish());
+
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("Hash calculation error: {}", e.what());
+            return "";
+        }
+    }
+
+    std::string Hashing::hashBuffer(const uint8_t *data, std::size_t length, HashAlgorithm algorithm) {
+        auto hasher = create(algorithm);
+        hasher->update(data, length);
+        return toHex(hasher->finish());
+    }
+
+    std::array<uint8_t, 32> Hashing::sha256(const uint8_t *data, std::size_t length) {
+        static const Sha256BlockFunction blocks = selectSha256(true);
+
+        Sha256Hasher hasher(blocks);
+        hasher.update(data, length);
+        auto digest = hasher.finish();
+
+        std::array<uint8_t, 32> result{};
+        std::copy(digest.begin(), digest.end(), result.begin());
+        return result;
+    }
+
+    uint32_t Hashing::crc32c(const uint8_t *data, std::size_t length, uint32_t crc) {
+        static const Crc32cFunction function = selectCrc32c(true);
+        return function(data, length, crc);
+    }
+
+    std::string Hashing::toString(HashAlgorithm algorithm) {
+        switch (algorithm) {
+            case HashAlgorithm::Sha256:
+                return "sha256";
+            case HashAlgorithm::Xxh3:
+                return "xxh3";
+            case HashAlgorithm::Crc32c:
+                return "crc32c";
+        }
+        return "";
+    }
+
+    std::optional<HashAlgorithm> Hashing::fromString(const std::string &name) {
+        if (name == "sha256") return HashAlgorithm::Sha256;
+        if (name == "xxh3") return HashAlgorithm::Xxh3;
+        if (name == "crc32c") return HashAlgorithm::Crc32c;
+        return std::nullopt;
+    }
+
+    std::vector<std::string> Hashing::supportedFileHashes() {
+        // CRC32C is too weak for whole files and is only used per frame
+        return {toString(HashAlgorithm::Sha256), toString(HashAlgorithm::Xxh3)};
+    }
+
+    HashAlgorithm Hashing::negotiate(const std::vector<std::string> &offered) {
+        auto supported = supportedFileHashes();
+
+        for (const auto &name: offered) {
+            if (std::find(supported.begin(), supported.end(), name) != supported.end()) {
+                return *fromString(name);
+            }
+        }
+
+        return HashAlgorithm::Sha256;
+    }
+
+    std::string Hashing::implementationName(HashAlgorithm algorithm) {
+        switch (algorithm) {
+            case HashAlgorithm::Sha256:
+                return selectSha256(true) == sha256BlocksGeneric ? "generic" : "sha-ni";
+            case HashAlgorithm::Xxh3:
+                return "xxhash";
+            case HashAlgorithm::Crc32c:
+                return selectCrc32c(true) == crc32cGeneric ? "generic" : "sse4.2";
+        }
+        return "";
+    }
+
+    std::string Hashing::toHex(const std::vector<uint8_t> &digest) {
+        std::stringstream ss;
+        ss << std::hex << std::setfill('0');
+
+        for (uint8_t byte: digest) {
+            ss << std::setw(2) << static_cast<int>(byte);
+        }
+
+        return ss.str();
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <optional>
+#include <cstdint>
+
+namespace utils {
+
+    /**
+     * Hash algorithms available for integrity checking
+     */
+    enum class HashAlgorithm {
+        Sha256,  // Cryptographic, used for end-to-end file verification
+        Xxh3,    // Fast non-cryptographic, detects corruption only
+        Crc32c   // Per-frame checksum
+    };
+
+    /**
+     * Incremental hasher for a single algorithm
+     */
+    class Hasher {
+    public:
+        virtual ~Hasher() = default;
+
+        /**
+         * Feed data into the hash
+         * @param data Pointer to the data
+         * @param length Number of bytes
+         */
+        virtual void update(const uint8_t *data, std::size_t length) = 0;
+
+        /**
+         * Finish the hash and return the digest
+         * @return Digest bytes (big-endian for integer digests)
+         */
+        virtual std::vector<uint8_t> finish() = 0;
+    };
+
+    /**
+     * Pluggable hashing layer with runtime CPU dispatch
+     */
+    class Hashing {
+    public:
+        /**
+         * Create an incremental hasher
+         * @param algorithm The algorithm to use
+         * @param allowHardware Use CPU acceleration when available (default: true)
+         * @return The hasher
+         */
+        static std::unique_ptr<Hasher> create(HashAlgorithm algorithm, bool allowHardware = true);
+
+        /**
+         * Hash a file
+         * @param filePath Path to the file
+         * @param algorithm The algorithm to use
+         * @return Hexadecimal digest or empty string on error
+         */
+        static std::string hashFile(const std::string &filePath, HashAlgorithm algorithm);
+
+        /**
+         * Hash a buffer
+         * @param data Pointer to the data
+         * @param length Number of bytes
+         * @param algorithm The algorithm to use
+         * @return Hexadecimal digest
+         */
+        static std::string hashBuffer(const uint8_t *data, std::size_t length, HashAlgorithm algorithm);
+
+        /**
+         * Calculate SHA-256 of a buffer
+         * @param data Pointer to the data
+         * @param length Number of bytes
+         * @return 32-byte digest
+         */
+        static std::array<uint8_t, 32> sha256(const uint8_t *data, std::size_t length);
+
+        /**
+         * Calculate CRC32C (Castagnoli) of a buffer
+         * @param data Pointer to the data
+         * @param length Number of bytes
+         * @param crc Previous CRC value when checksumming in pieces
+         * @return CRC32C value
+         */
+        static uint32_t crc32c(const uint8_t *data, std::size_t length, uint32_t crc = 0);
+
+        /**
+         * Get the wire name of an algorithm
+         * @param algorithm The algorithm
+         * @return Name such as "sha256"
+         */
+        static std::string toString(HashAlgorithm algorithm);
+
+        /**
+         * Parse a wire name
+         * @param name Algorithm name
+         * @return The algorithm or std::nullopt if unknown
+         */
+        static std::optional<HashAlgorithm> fromString(const std::string &name);
+
+        /**
+         * Get the names of the file hash algorithms this build supports, most preferred first
+         * @return Algorithm names
+         */
+        static std::vector<std::string> supportedFileHashes();
+
+        /**
+         * Pick the first algorithm offered by a peer that we also support
+         * @param offered Algorithm names offered by the peer, most preferred first
+         * @return Chosen algorithm, SHA-256 if nothing matches
+         */
+        static HashAlgorithm negotiate(const std::vector<std::string> &offered);
+
+        /**
+         * Describe which implementation is used for an algorithm on this CPU
+         * @param algorithm The algorithm
+         * @return Implementation name, e.g. "sha-ni" or "generic"
+         */
+        static std::string implementationName(HashAlgorithm algorithm);
+
+        /**
+         * Convert a digest to a hexadecimal string
+         * @param digest Digest bytes
+         * @return Lowercase hex string
+         */
+        static std::string toHex(const std::vector<uint8_t> &digest);
+    };
+}
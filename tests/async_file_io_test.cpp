@@ -0,0 +1,49 @@
+#include "core/async_file_io.hpp"
+#include "test_utils.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace core;
+
+TEST(WriteBehindWriterTest, ShallowQueueWritesEveryChunk) {
+    test::TempDir dir;
+    auto path = dir.file("out.bin");
+    constexpr std::size_t chunkSize = 64 * 1024;
+    auto data = test::randomBytes(10 * chunkSize + 123, 1);
+
+    {
+        WriteBehindWriter writer(std::make_shared<FileWriter>(path, data.size()), chunkSize, 1);
+        EXPECT_EQ(writer.queueDepth(), writer.usingIoUring() ? 1u : 0u);
+
+        // Out of order, as chunks of a striped transfer arrive
+        for (std::size_t offset = chunkSize; offset < data.size(); offset += 2 * chunkSize) {
+            writer.writeAt(offset, std::span<const uint8_t>(data).subspan(offset, std::min(chunkSize,
+                                                                                         data.size() - offset)));
+        }
+        for (std::size_t offset = 0; offset < data.size(); offset += 2 * chunkSize) {
+            writer.writeAt(offset, std::span<const uint8_t>(data).subspan(offset, std::min(chunkSize,
+                                                                                         data.size() - offset)));
+        }
+        writer.finalize();
+    }
+
+    EXPECT_EQ(test::readFile(path), data);
+}
+
+TEST(ReadAheadReaderTest, ReadsTheFileInOrder) {
+    test::TempDir dir;
+    auto path = dir.file("in.bin");
+    constexpr std::size_t chunkSize = 64 * 1024;
+    auto data = test::randomBytes(5 * chunkSize + 7, 2);
+    test::writeFile(path, data);
+
+    ReadAheadReader reader(path, chunkSize, 2);
+    ASSERT_EQ(reader.size(), data.size());
+
+    std::vector<uint8_t> all;
+    std::vector<uint8_t> chunk;
+    while (all.size() < data.size() && reader.readNext(chunk)) {
+        all.insert(all.end(), chunk.begin(), chunk.end());
+    }
+    EXPECT_EQ(all, data);
+}
@@ -0,0 +1,65 @@
+#include "utils/compression.hpp"
+#include "test_utils.hpp"
+
+#include <gtest/gtest.h>
+
+using utils::Compression;
+using utils::CompressionAlgorithm;
+
+namespace {
+
+    std::vector<uint8_t> textLikeData(std::size_t size) {
+        const std::string line = "2026-10-16 12:00:00 INFO transfer chunk written to disk\n";
+        std::vector<uint8_t> data;
+        while (data.size() < size) {
+            data.insert(data.end(), line.begin(), line.end());
+        }
+        data.resize(size);
+        return data;
+    }
+}
+
+TEST(CompressionTest, RoundTripsEachAlgorithm) {
+    auto input = textLikeData(Compression::MAX_CHUNK_SIZE);
+
+    for (auto algorithm: {CompressionAlgorithm::Lz4, CompressionAlgorithm::Zstd}) {
+        std::vector<uint8_t> compressed;
+        ASSERT_TRUE(Compression::compress(algorithm, input, compressed));
+        EXPECT_LT(compressed.size(), input.size() / 4);
+
+        std::vector<uint8_t> output;
+        ASSERT_TRUE(Compression::decompress(algorithm, compressed, input.size(), output));
+        EXPECT_EQ(output, input);
+    }
+}
+
+TEST(CompressionTest, RejectsOriginalSizeAboveAChunk) {
+    auto input = textLikeData(4096);
+
+    for (auto algorithm: {CompressionAlgorithm::Lz4, CompressionAlgorithm::Zstd}) {
+        std::vector<uint8_t> compressed;
+        ASSERT_TRUE(Compression::compress(algorithm, input, compressed));
+
+        // A peer claiming a huge size must not get us to allocate it
+        std::vector<uint8_t> output;
+        EXPECT_FALSE(Compression::decompress(algorithm, compressed, 0xffffffffu, output));
+        EXPECT_LT(output.capacity(), Compression::MAX_CHUNK_SIZE);
+    }
+}
+
+TEST(CompressionTest, RejectsWrongOriginalSize) {
+    auto input = textLikeData(8192);
+    std::vector<uint8_t> compressed;
+    ASSERT_TRUE(Compression::compress(CompressionAlgorithm::Lz4, input, compressed));
+
+    std::vector<uint8_t> output;
+    EXPECT_FALSE(Compression::decompress(CompressionAlgorithm::Lz4, compressed, input.size() - 1, output));
+}
+
+TEST(CompressionTest, RandomDataLooksIncompressible) {
+    auto random = test::randomBytes(256 * 1024, 9);
+    auto text = textLikeData(256 * 1024);
+
+    EXPECT_FALSE(Compression::looksCompressible(random.data(), random.size()));
+    EXPECT_TRUE(Compression::looksCompressible(text.data(), text.size()));
+}
@@ -0,0 +1,141 @@
+#include "core/delta_sync.hpp"
+#include "utils/hashing.hpp"
+#include "test_utils.hpp"
+
+#include <gtest/gtest.h>
+
+using core::DeltaApplier;
+using core::DeltaInstruction;
+using core::DeltaSync;
+using core::FileSignature;
+
+namespace {
+
+    /**
+     * Run the full exchange: signature of the basis, delta of the new file packed
+     * batch by batch as on the wire, and reconstruction from the basis
+     * @return Number of batches the delta was sent in
+     */
+    std::size_t roundTrip(const std::string &basisPath, const std::string &newPath, const std::string &outputPath,
+                          std::size_t batchBytes) {
+        FileSignature signature = DeltaSync::computeSignature(basisPath);
+        FileSignature received = FileSignature::unpack(signature.blockSize, signature.fileSize, signature.pack());
+
+        std::vector<std::vector<uint8_t>> wire;
+        bool completed = DeltaSync::computeDelta(received, newPath, [&](std::vector<DeltaInstruction> &&batch) {
+            wire.push_back(DeltaSync::packInstructions(batch));
+            return true;
+        }, nullptr, batchBytes);
+        EXPECT_TRUE(completed);
+
+        DeltaApplier applier(basisPath, received.blockSize, outputPath);
+        for (const auto &packed: wire) {
+            applier.apply(DeltaSync::unpackInstructions(packed));
+        }
+        EXPECT_TRUE(applier.finish());
+        EXPECT_TRUE(applier.install());
+
+        return wire.size();
+    }
+}
+
+TEST(DeltaSyncTest, ScatteredEditsRoundTripOverManyBatches) {
+    test::TempDir dir;
+    auto basis = test::randomBytes(4 * 1024 * 1024, 1);
+    auto updated = basis;
+    for (std::size_t i = 0; i < updated.size(); i += 20000) {
+        updated[i] ^= 0xff;
+    }
+    test::writeFile(dir.file("basis.bin"), basis);
+    test::writeFile(dir.file("new.bin"), updated);
+
+    std::size_t batches = roundTrip(dir.file("basis.bin"), dir.file("new.bin"), dir.file("out.bin"), 64 * 1024);
+
+    EXPECT_GT(batches, 2u);
+    EXPECT_EQ(test::readFile(dir.file("out.bin")), updated);
+}
+
+TEST(DeltaSyncTest, InsertionsAndUnchangedRunsRoundTrip) {
+    test::TempDir dir;
+    auto basis = test::randomBytes(1024 * 1024 + 777, 2);
+
+    // Shift most of the file by inserting bytes, and append a new tail
+    std::vector<uint8_t> updated(basis.begin(), basis.begin() + 300000);
+    auto inserted = test::randomBytes(5000, 3);
+    updated.insert(updated.end(), inserted.begin(), inserted.end());
+    updated.insert(updated.end(), basis.begin() + 300000, basis.end());
+    auto tail = test::randomBytes(100000, 4);
+    updated.insert(updated.end(), tail.begin(), tail.end());
+
+    test::writeFile(dir.file("basis.bin"), basis);
+    test::writeFile(dir.file("new.bin"), updated);
+
+    std::size_t batches = roundTrip(dir.file("basis.bin"), dir.file("new.bin"), dir.file("out.bin"), 16 * 1024);
+
+    EXPECT_GT(batches, 1u);
+    EXPECT_EQ(test::readFile(dir.file("out.bin")), updated);
+}
+
+TEST(DeltaSyncTest, IdenticalFileSendsOnlyBlockReferences) {
+    test::TempDir dir;
+    auto basis = test::randomBytes(512 * 1024 + 100, 5);
+    test::writeFile(dir.file("basis.bin"), basis);
+
+    FileSignature signature = DeltaSync::computeSignature(dir.file("basis.bin"));
+    std::size_t literalBytes = 0;
+    DeltaSync::computeDelta(signature, dir.file("basis.bin"), [&](std::vector<DeltaInstruction> &&batch) {
+        for (const auto &instruction: batch) {
+            literalBytes += instruction.data.size();
+        }
+        return true;
+    });
+
+    EXPECT_EQ(literalBytes, 0u);
+}
+
+TEST(DeltaSyncTest, OldCopyStaysUntilTheRebuiltFileIsInstalled) {
+    test::TempDir dir;
+    auto basis = test::randomBytes(256 * 1024, 6);
+    auto updated = basis;
+    updated[1000] ^= 0xff;
+    test::writeFile(dir.file("basis.bin"), basis);
+    test::writeFile(dir.file("new.bin"), updated);
+
+    FileSignature signature = DeltaSync::computeSignature(dir.file("basis.bin"));
+    std::vector<std::vector<DeltaInstruction>> batches;
+    auto senderHasher = utils::Hashing::create(utils::HashAlgorithm::Sha256);
+    ASSERT_TRUE(DeltaSync::computeDelta(signature, dir.file("new.bin"), [&](std::vector<DeltaInstruction> &&batch) {
+        batches.push_back(std::move(batch));
+        return true;
+    }, nullptr, 1024 * 1024, senderHasher.get()));
+    std::string senderHash = utils::Hashing::toHex(senderHasher->finish());
+    EXPECT_EQ(senderHash, utils::Hashing::hashFile(dir.file("new.bin"), utils::HashAlgorithm::Sha256));
+
+    {
+        // Dropped after finish(), as on a hash mismatch: the basis is untouched and the output is gone
+        DeltaApplier applier(dir.file("basis.bin"), signature.blockSize, dir.file("basis.bin"));
+        for (const auto &batch: batches) {
+            applier.apply(batch);
+        }
+        ASSERT_TRUE(applier.finish());
+        EXPECT_EQ(applier.fileHash(), senderHash);
+        EXPECT_EQ(test::readFile(dir.file("basis.bin")), basis);
+    }
+    EXPECT_FALSE(std::filesystem::exists(dir.file("basis.bin.delta")));
+
+    DeltaApplier applier(dir.file("basis.bin"), signature.blockSize, dir.file("basis.bin"));
+    for (const auto &batch: batches) {
+        applier.apply(batch);
+    }
+    ASSERT_TRUE(applier.finish());
+    EXPECT_TRUE(applier.install());
+    EXPECT_EQ(test::readFile(dir.file("basis.bin")), updated);
+}
+
+TEST(DeltaSyncTest, MalformedSignatureIsRejected) {
+    std::vector<uint8_t> packed(20);
+
+    // One block cannot describe a basis that needs several
+    EXPECT_THROW(FileSignature::unpack(4096, 3 * 4096, packed), std::runtime_error);
+    EXPECT_THROW(FileSignature::unpack(0, 0, {}), std::runtime_error);
+}
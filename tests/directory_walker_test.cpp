@@ -0,0 +1,60 @@
+#include "core/directory_walker.hpp"
+#include "test_utils.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+using core::DirectoryWalker;
+namespace fs = std::filesystem;
+
+TEST(DirectoryWalkerTest, WalkListsDirectoriesBeforeTheirContents) {
+    test::TempDir dir;
+    fs::create_directories(dir.path() / "a" / "b");
+    test::writeFile(dir.file("a/b/file.bin"), test::randomBytes(1000, 1));
+    test::writeFile(dir.file("top.txt"), test::randomBytes(10, 2));
+
+    auto entries = DirectoryWalker::walk(dir.path().string(), 2);
+
+    auto position = [&](const std::string &path) {
+        auto it = std::find_if(entries.begin(), entries.end(), [&](const auto &entry) { return entry.path == path; });
+        EXPECT_NE(it, entries.end()) << path;
+        return it - entries.begin();
+    };
+    ASSERT_EQ(entries.size(), 4u);
+    EXPECT_LT(position("a"), position("a/b"));
+    EXPECT_LT(position("a/b"), position("a/b/file.bin"));
+    EXPECT_EQ(entries[position("a/b/file.bin")].size, 1000u);
+}
+
+TEST(DirectoryWalkerTest, UnsafePathsAreRejected) {
+    EXPECT_TRUE(DirectoryWalker::isSafePath("a/b.txt"));
+    EXPECT_FALSE(DirectoryWalker::isSafePath("../escape"));
+    EXPECT_FALSE(DirectoryWalker::isSafePath("a/../../escape"));
+    EXPECT_FALSE(DirectoryWalker::isSafePath("/etc/passwd"));
+    EXPECT_FALSE(DirectoryWalker::isSafePath(""));
+}
+
+TEST(DirectoryWalkerTest, SpecialPermissionBitsAreNeverApplied) {
+    test::TempDir dir;
+    test::writeFile(dir.file("tool"), test::randomBytes(10, 3));
+
+    network::ManifestEntry entry;
+    entry.path = "tool";
+    entry.mode = 04755 | 02000 | 01000; // setuid, setgid and sticky from a peer
+    entry.mtime = 0;
+    DirectoryWalker::applyMetadata(dir.file("tool"), entry);
+
+    auto perms = fs::status(dir.file("tool")).permissions();
+    EXPECT_EQ(perms & (fs::perms::set_uid | fs::perms::set_gid | fs::perms::sticky_bit), fs::perms::none);
+    EXPECT_EQ(perms & fs::perms::all, static_cast<fs::perms>(0755));
+}
+
+TEST(DirectoryWalkerTest, DescribeRecordsOnlyPermissionBits) {
+    test::TempDir dir;
+    test::writeFile(dir.file("tool"), test::randomBytes(10, 4));
+    fs::permissions(dir.file("tool"), static_cast<fs::perms>(04750));
+
+    auto entry = DirectoryWalker::describe(dir.file("tool"), "tool");
+    EXPECT_EQ(entry.mode, 0750u);
+}
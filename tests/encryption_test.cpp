@@ -0,0 +1,91 @@
+#include "utils/encryption.hpp"
+#include "test_utils.hpp"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <thread>
+
+using utils::Encryption;
+using utils::EncryptionKey;
+
+namespace {
+    constexpr std::size_t IV_OFFSET = EncryptionKey::SALT_SIZE;
+    constexpr std::size_t IV_SIZE = 12;
+}
+
+TEST(EncryptionTest, KeyRoundTripsManyMessages) {
+    EncryptionKey sender("secret");
+    EncryptionKey receiver("secret", sender.salt());
+
+    for (uint32_t i = 0; i < 16; ++i) {
+        auto plaintext = test::randomBytes(1000 + i, i);
+        std::vector<uint8_t> ciphertext;
+        ASSERT_TRUE(sender.encrypt(plaintext, ciphertext));
+        EXPECT_EQ(EncryptionKey::saltOf(ciphertext), sender.salt());
+
+        std::vector<uint8_t> decrypted;
+        ASSERT_TRUE(receiver.decrypt(ciphertext, decrypted));
+        EXPECT_EQ(decrypted, plaintext);
+    }
+}
+
+TEST(EncryptionTest, EveryMessageGetsItsOwnIv) {
+    EncryptionKey key("secret");
+    auto plaintext = test::randomBytes(64, 1);
+
+    // Workers of one transfer share its key
+    std::mutex mutex;
+    std::set<std::vector<uint8_t>> ivs;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t) {
+        workers.emplace_back([&]() {
+            for (int i = 0; i < 250; ++i) {
+                std::vector<uint8_t> ciphertext;
+                ASSERT_TRUE(key.encrypt(plaintext, ciphertext));
+                std::lock_guard<std::mutex> lock(mutex);
+                ivs.emplace(ciphertext.begin() + IV_OFFSET, ciphertext.begin() + IV_OFFSET + IV_SIZE);
+            }
+        });
+    }
+    for (auto &worker: workers) {
+        worker.join();
+    }
+
+    EXPECT_EQ(ivs.size(), 1000u);
+}
+
+TEST(EncryptionTest, KeyMessagesAndPasswordMessagesInteroperate) {
+    auto plaintext = test::randomBytes(5000, 2);
+
+    EncryptionKey key("secret");
+    std::vector<uint8_t> ciphertext;
+    ASSERT_TRUE(key.encrypt(plaintext, ciphertext));
+    std::vector<uint8_t> decrypted;
+    ASSERT_TRUE(Encryption::decrypt(ciphertext, "secret", decrypted));
+    EXPECT_EQ(decrypted, plaintext);
+
+    ASSERT_TRUE(Encryption::encrypt(plaintext, "secret", ciphertext));
+    EncryptionKey receiver("secret", EncryptionKey::saltOf(ciphertext));
+    ASSERT_TRUE(receiver.decrypt(ciphertext, decrypted));
+    EXPECT_EQ(decrypted, plaintext);
+}
+
+TEST(EncryptionTest, TamperedOrForeignMessagesAreRejected) {
+    EncryptionKey key("secret");
+    auto plaintext = test::randomBytes(100, 3);
+    std::vector<uint8_t> ciphertext;
+    ASSERT_TRUE(key.encrypt(plaintext, ciphertext));
+
+    std::vector<uint8_t> decrypted;
+    auto tampered = ciphertext;
+    tampered[IV_OFFSET + IV_SIZE + 10] ^= 1;
+    EXPECT_FALSE(key.decrypt(tampered, decrypted));
+
+    EXPECT_FALSE(Encryption::decrypt(ciphertext, "wrong", decrypted));
+
+    EncryptionKey other("secret");
+    EXPECT_FALSE(other.decrypt(ciphertext, decrypted));
+
+    EXPECT_TRUE(EncryptionKey::saltOf({1, 2, 3}).empty());
+}
@@ -0,0 +1,118 @@
+#include "core/file_handler.hpp"
+#include "test_utils.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <set>
+#include <thread>
+
+using namespace core;
+
+TEST(MappedFileTest, CoversOnlyWhatTheFileStillHolds) {
+    test::TempDir dir;
+    auto path = dir.file("mapped.bin");
+    auto data = test::randomBytes(3 * 4096 + 100, 1);
+    test::writeFile(path, data);
+
+    MappedFile mapped(path);
+    ASSERT_EQ(mapped.size(), data.size());
+    EXPECT_TRUE(mapped.covers(0, data.size()));
+
+    // Truncated behind the mapping's back, as another program might
+    std::filesystem::resize_file(path, 4096);
+    EXPECT_TRUE(mapped.covers(0, 4096));
+    EXPECT_FALSE(mapped.covers(4096, 1));
+    EXPECT_FALSE(mapped.covers(0, data.size()));
+    EXPECT_TRUE(mapped.covers(8192, 0));
+
+    auto head = mapped.chunk(0, 4096);
+    EXPECT_TRUE(std::equal(head.begin(), head.end(), data.begin()));
+}
+
+TEST(FileHandlerTest, UniqueNamesFreedByDeletedFilesAreReused) {
+    test::TempDir dir;
+    FileHandler handler(platform::PlatformFactory::create());
+
+    std::vector<std::string> paths;
+    for (int i = 0; i < 3; ++i) {
+        auto writer = handler.createUniqueWriter(dir.path().string(), "report.csv");
+        ASSERT_NE(writer, nullptr);
+        writer->finalize();
+        paths.push_back(writer->path());
+    }
+    EXPECT_EQ(std::filesystem::path(paths[0]).filename(), "report.csv");
+    EXPECT_EQ(std::filesystem::path(paths[2]).filename(), "report_2.csv");
+
+    // Once the earlier downloads are gone, their names are handed out again
+    for (const auto &path: paths) {
+        std::filesystem::remove(path);
+    }
+    auto writer = handler.createUniqueWriter(dir.path().string(), "report.csv");
+    ASSERT_NE(writer, nullptr);
+    EXPECT_EQ(writer->path(), paths[0]);
+}
+
+TEST(FileHandlerTest, ConcurrentWritersGetDistinctNames) {
+    test::TempDir dir;
+    FileHandler handler(platform::PlatformFactory::create());
+
+    constexpr int writers = 8;
+    std::vector<std::unique_ptr<FileWriter>> created(writers);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < writers; ++i) {
+        threads.emplace_back([&, i]() {
+            created[i] = handler.createUniqueWriter(dir.path().string(), "data.bin");
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+
+    std::set<std::string> names;
+    for (const auto &writer: created) {
+        ASSERT_NE(writer, nullptr);
+        names.insert(writer->path());
+    }
+    EXPECT_EQ(names.size(), static_cast<std::size_t>(writers));
+}
+
+TEST(FileWriterTest, CheckpointedFileResumesWhereItStopped) {
+    test::TempDir dir;
+    auto path = dir.file("resumed.bin");
+    auto data = test::randomBytes(4 * 65536, 1);
+    std::span<const uint8_t> bytes(data);
+    FileHandler handler(platform::PlatformFactory::create());
+
+    // An interrupted attempt got the first half to disk before the connection dropped
+    {
+        FileWriter writer(path, data.size());
+        writer.writeAt(0, bytes.first(data.size() / 2));
+        writer.checkpoint("first half");
+    }
+    EXPECT_FALSE(std::filesystem::exists(path));
+    EXPECT_EQ(FileWriter::loadCheckpoint(path), "first half");
+
+    auto writer = handler.resumeWriter(path, data.size());
+    ASSERT_NE(writer, nullptr);
+    writer->writeAt(data.size() / 2, bytes.subspan(data.size() / 2));
+    writer->finalize();
+
+    EXPECT_EQ(test::readFile(path), data);
+    EXPECT_TRUE(FileWriter::loadCheckpoint(path).empty());
+}
+
+TEST(FileWriterTest, DiscardedCheckpointIsRemoved) {
+    test::TempDir dir;
+    auto path = dir.file("abandoned.bin");
+    auto data = test::randomBytes(65536, 2);
+
+    {
+        FileWriter writer(path, data.size());
+        writer.writeAt(0, data);
+        writer.checkpoint("all of it");
+        writer.discard();
+    }
+    EXPECT_TRUE(FileWriter::loadCheckpoint(path).empty());
+    EXPECT_EQ(FileHandler(platform::PlatformFactory::create()).resumeWriter(path, data.size()), nullptr);
+}
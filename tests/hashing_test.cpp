@@ -0,0 +1,104 @@
+#include "utils/hashing.hpp"
+#include "test_utils.hpp"
+
+#include <gtest/gtest.h>
+
+using utils::HashAlgorithm;
+using utils::Hashing;
+
+namespace {
+
+    std::string hashString(const std::string &text, bool allowHardware) {
+        auto hasher = Hashing::create(HashAlgorithm::Sha256, allowHardware);
+        hasher->update(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+        return Hashing::toHex(hasher->finish());
+    }
+
+    /**
+     * Digest of the data fed in pieces that end at the given offsets
+     */
+    std::vector<uint8_t> hashInPieces(HashAlgorithm algorithm, bool allowHardware, const std::vector<uint8_t> &data,
+                                      const std::vector<std::size_t> &splits) {
+        auto hasher = Hashing::create(algorithm, allowHardware);
+        std::size_t pos = 0;
+        for (std::size_t split: splits) {
+            hasher->update(data.data() + pos, split - pos);
+            pos = split;
+        }
+        hasher->update(data.data() + pos, data.size() - pos);
+        return hasher->finish();
+    }
+}
+
+TEST(HashingTest, Sha256MatchesNistVectors) {
+    const std::pair<std::string, std::string> vectors[] = {
+            {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+            {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+            {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+             "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+            {std::string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+    };
+
+    for (bool allowHardware: {true, false}) {
+        for (const auto &[input, expected]: vectors) {
+            EXPECT_EQ(hashString(input, allowHardware), expected)
+                    << "input of " << input.size() << " bytes, hardware " << allowHardware;
+        }
+    }
+}
+
+TEST(HashingTest, Crc32cMatchesCheckValue) {
+    const std::string input = "123456789";
+    const auto *data = reinterpret_cast<const uint8_t *>(input.data());
+
+    EXPECT_EQ(Hashing::crc32c(data, input.size()), 0xE3069283u);
+    EXPECT_EQ(Hashing::crc32c(data + 4, input.size() - 4, Hashing::crc32c(data, 4)), 0xE3069283u);
+
+    for (bool allowHardware: {true, false}) {
+        auto hasher = Hashing::create(HashAlgorithm::Crc32c, allowHardware);
+        hasher->update(data, input.size());
+        EXPECT_EQ(Hashing::toHex(hasher->finish()), "e3069283") << "hardware " << allowHardware;
+    }
+}
+
+TEST(HashingTest, HardwareAndGenericAgreeOverOddLengthsAndSplits) {
+    auto data = test::randomBytes(4099, 7);
+
+    // Lengths around the 64-byte SHA-256 block and the 8-byte CRC32C word, fed whole and in uneven pieces
+    for (std::size_t length = 0; length <= 300; length += (length < 140 ? 1 : 37)) {
+        std::vector<uint8_t> input(data.begin(), data.begin() + static_cast<std::ptrdiff_t>(length));
+        std::vector<std::size_t> splits;
+        for (std::size_t split = 1; split < length; split += 1 + split % 13) {
+            splits.push_back(split);
+        }
+
+        for (auto algorithm: {HashAlgorithm::Sha256, HashAlgorithm::Crc32c}) {
+            auto generic = hashInPieces(algorithm, false, input, {});
+            EXPECT_EQ(hashInPieces(algorithm, true, input, {}), generic)
+                    << Hashing::toString(algorithm) << " over " << length << " bytes";
+            EXPECT_EQ(hashInPieces(algorithm, true, input, splits), generic)
+                    << Hashing::toString(algorithm) << " over " << length << " bytes in pieces";
+            EXPECT_EQ(hashInPieces(algorithm, false, input, splits), generic)
+                    << Hashing::toString(algorithm) << " over " << length << " bytes in pieces, generic";
+        }
+    }
+
+    for (auto algorithm: {HashAlgorithm::Sha256, HashAlgorithm::Crc32c}) {
+        EXPECT_EQ(hashInPieces(algorithm, true, data, {1, 65, 66, 2000, 4095}),
+                  hashInPieces(algorithm, false, data, {}))
+                << Hashing::toString(algorithm) << " (" << Hashing::implementationName(algorithm) << ")";
+    }
+}
+
+TEST(HashingTest, NegotiateFallsBackToSha256) {
+    EXPECT_EQ(Hashing::negotiate({}), HashAlgorithm::Sha256);
+    EXPECT_EQ(Hashing::negotiate({"md5", "blake3"}), HashAlgorithm::Sha256);
+    EXPECT_EQ(Hashing::negotiate({""}), HashAlgorithm::Sha256);
+
+    // CRC32C is only a frame checksum, never a file hash
+    EXPECT_EQ(Hashing::negotiate({"crc32c"}), HashAlgorithm::Sha256);
+
+    // The peer's preference wins among the algorithms both sides support
+    EXPECT_EQ(Hashing::negotiate({"md5", "xxh3", "sha256"}), HashAlgorithm::Xxh3);
+    EXPECT_EQ(Hashing::negotiate({"sha256", "xxh3"}), HashAlgorithm::Sha256);
+}
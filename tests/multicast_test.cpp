@@ -0,0 +1,109 @@
+#include "network/multicast.hpp"
+#include "test_utils.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <future>
+#include <random>
+
+using namespace network;
+
+namespace {
+
+    // One sender and several receivers in this process, all on loopback
+    class MulticastLoopbackTest : public ::testing::Test {
+    protected:
+        struct Receiver {
+            std::vector<uint8_t> data;
+            std::promise<bool> finished;
+            std::unique_ptr<MulticastReceiver> receiver;
+        };
+
+        MulticastSession makeSession(uint64_t size, uint32_t fecGroup) {
+            std::mt19937 random(std::random_device{}());
+            MulticastSession session;
+            session.group = "239.255.34.68";
+            session.port = static_cast<uint16_t>(std::uniform_int_distribution<int>(42000, 62000)(random));
+            session.sessionId = random();
+            session.size = size;
+            session.fecGroup = fecGroup;
+            return session;
+        }
+
+        // Streams the data to the receivers, returns how many finished with every byte
+        std::size_t transfer(const MulticastSession &session, const std::vector<uint8_t> &data,
+                             std::size_t receivers, double loss) {
+            for (std::size_t i = 0; i < receivers; ++i) {
+                auto &r = *m_receivers.emplace_back(std::make_unique<Receiver>());
+                r.data.assign(data.size(), 0);
+                r.receiver = std::make_unique<MulticastReceiver>(
+                        session,
+                        [&r](uint64_t offset, std::span<const uint8_t> bytes) {
+                            std::memcpy(r.data.data() + offset, bytes.data(), bytes.size());
+                        },
+                        [&r](bool success, const std::string &) { r.finished.set_value(success); },
+                        "127.0.0.1", std::chrono::seconds(5));
+                r.receiver->setSimulatedLoss(loss);
+                if (!r.receiver->start()) {
+                    return 0;
+                }
+            }
+
+            m_sender = std::make_unique<MulticastSender>(
+                    session,
+                    [&data](uint64_t offset, std::span<uint8_t> buffer) {
+                        std::size_t length = std::min<std::size_t>(buffer.size(), data.size() - offset);
+                        std::memcpy(buffer.data(), data.data() + offset, length);
+                        return length;
+                    },
+                    receivers, 0, "127.0.0.1");
+            EXPECT_TRUE(m_sender->run());
+
+            std::size_t complete = 0;
+            for (auto &r: m_receivers) {
+                auto finished = r->finished.get_future();
+                if (finished.wait_for(std::chrono::seconds(10)) == std::future_status::ready && finished.get() &&
+                    r->data == data) {
+                    complete++;
+                }
+            }
+            return complete;
+        }
+
+        std::vector<std::unique_ptr<Receiver>> m_receivers;
+        std::unique_ptr<MulticastSender> m_sender;
+    };
+}
+
+TEST_F(MulticastLoopbackTest, EveryReceiverGetsTheStream) {
+    auto data = test::randomBytes(2 * 1024 * 1024 + 123, 1);
+    auto session = makeSession(data.size(), DEFAULT_MULTICAST_FEC_GROUP);
+
+    EXPECT_EQ(transfer(session, data, 3, 0.0), 3u);
+}
+
+TEST_F(MulticastLoopbackTest, LostPacketsAreRepairedOnRequest) {
+    auto data = test::randomBytes(1024 * 1024 + 7, 2);
+    auto session = makeSession(data.size(), 0);
+
+    ASSERT_EQ(transfer(session, data, 3, 0.05), 3u);
+
+    EXPECT_GT(m_sender->repairsSent(), 0u);
+    for (auto &r: m_receivers) {
+        EXPECT_GT(r->receiver->nacksSent(), 0u);
+        EXPECT_EQ(r->receiver->packetsRecovered(), 0u);
+    }
+}
+
+TEST_F(MulticastLoopbackTest, SingleLossesAreRebuiltFromParity) {
+    auto data = test::randomBytes(2 * 1024 * 1024, 3);
+    auto session = makeSession(data.size(), DEFAULT_MULTICAST_FEC_GROUP);
+
+    // At 1% loss most FEC groups lose at most one packet, and the rest are repaired
+    ASSERT_EQ(transfer(session, data, 3, 0.01), 3u);
+
+    for (auto &r: m_receivers) {
+        EXPECT_GT(r->receiver->packetsRecovered(), 0u);
+    }
+}
@@ -0,0 +1,57 @@
+#include "network/protocol.hpp"
+#include "test_utils.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace network;
+
+namespace {
+
+    FileDataMessage roundTrip(const FileDataMessage &message) {
+        auto parsed = Protocol::deserialize(Protocol::serialize(message));
+        auto *fileData = dynamic_cast<FileDataMessage *>(parsed.get());
+        EXPECT_NE(fileData, nullptr);
+        return fileData ? *fileData : FileDataMessage();
+    }
+}
+
+TEST(ProtocolTest, FileDataRoundTrips) {
+    FileDataMessage message;
+    message.transferId = "transfer";
+    message.chunkIndex = 3;
+    message.totalChunks = 10;
+    message.offset = 3 * DEFAULT_CHUNK_SIZE;
+    message.data = test::randomBytes(1000, 1);
+    message.checksum = 0x12345678;
+    message.relayTo = {"a", "b"};
+
+    auto parsed = roundTrip(message);
+    EXPECT_EQ(parsed.transferId, "transfer");
+    EXPECT_EQ(parsed.chunkIndex, 3u);
+    EXPECT_EQ(parsed.offset, message.offset);
+    EXPECT_EQ(parsed.data, message.data);
+    EXPECT_EQ(parsed.checksum, message.checksum);
+    EXPECT_EQ(parsed.relayTo, message.relayTo);
+}
+
+TEST(ProtocolTest, ZeroChecksumIsStillPresent) {
+    FileDataMessage message;
+    message.chunkIndex = 0;
+    message.totalChunks = 1;
+    message.checksum = 0;
+
+    auto parsed = roundTrip(message);
+    ASSERT_TRUE(parsed.checksum.has_value());
+    EXPECT_EQ(*parsed.checksum, 0u);
+}
+
+TEST(ProtocolTest, MissingChecksumStaysAbsent) {
+    FileDataMessage message;
+    message.chunkIndex = 0;
+    message.totalChunks = 1;
+    message.hole = true;
+
+    auto parsed = roundTrip(message);
+    EXPECT_FALSE(parsed.checksum.has_value());
+    EXPECT_TRUE(parsed.hole);
+}
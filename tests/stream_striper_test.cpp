@@ -0,0 +1,208 @@
+#include "core/stream_striper.hpp"
+#include "network/socket_handler.hpp"
+#include "test_utils.hpp"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using core::StreamStriper;
+using network::ConnectionStatus;
+using network::SocketHandler;
+
+namespace {
+
+    constexpr int STRIPES = 3;
+
+    /**
+     * A receiving socket handler on loopback and a sending one with several connections to it
+     */
+    class StreamStriperTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            // Try a few ports in case one is taken
+            for (int attempt = 0; attempt < 20 && m_port == 0; ++attempt) {
+                auto port = static_cast<uint16_t>(42000 + (std::random_device{}() % 20000));
+                if (m_receiver.initTcpServer(port,
+                                             [this](const std::vector<uint8_t> &data, const std::string &from) {
+                                                 onMessage(data, from);
+                                             },
+                                             [](ConnectionStatus, const std::string &, const std::string &) {})) {
+                    m_port = port;
+                }
+            }
+            ASSERT_NE(m_port, 0);
+
+            for (int i = 0; i < STRIPES; ++i) {
+                std::string label = i == 0 ? "" : "stripe/" + std::to_string(i);
+                auto connected = std::make_shared<std::promise<bool>>();
+                auto answered = std::make_shared<std::atomic<bool>>(false);
+                auto future = connected->get_future();
+                ASSERT_TRUE(m_sender.connectTcp(
+                        "127.0.0.1", m_port,
+                        [](const std::vector<uint8_t> &, const std::string &) {},
+                        [connected, answered](ConnectionStatus status, const std::string &, const std::string &) {
+                            if (!answered->exchange(true)) {
+                                connected->set_value(status == ConnectionStatus::Connected);
+                            }
+                        },
+                        label));
+                ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+                ASSERT_TRUE(future.get());
+
+                std::string endpoint = "127.0.0.1:" + std::to_string(m_port) + (label.empty() ? "" : "#" + label);
+                m_paths.push_back({endpoint, ""});
+            }
+        }
+
+        // Messages are a 4-byte chunk index, optionally followed by the offset and length of a raw frame
+        void onMessage(const std::vector<uint8_t> &data, const std::string &from) {
+            uint32_t index = 0;
+            std::memcpy(&index, data.data(), sizeof(index));
+
+            if (data.size() > sizeof(index) && m_outputFd >= 0) {
+                uint64_t offset = 0;
+                uint64_t length = 0;
+                std::memcpy(&offset, data.data() + 4, sizeof(offset));
+                std::memcpy(&length, data.data() + 12, sizeof(length));
+
+                network::RawDataSink sink;
+                sink.fd = m_outputFd;
+                sink.offset = offset;
+                sink.length = length;
+                sink.onComplete = [this, index, from](bool success, const std::string &) {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (success) {
+                        m_received[index].insert(from);
+                    }
+                };
+                m_receiver.expectRawData(from, std::move(sink));
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_received[index].insert(from);
+        }
+
+        bool waitForChunks(std::size_t count) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (std::chrono::steady_clock::now() < deadline) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (m_received.size() >= count) {
+                        return true;
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            return false;
+        }
+
+        std::set<std::string> endpointsUsed() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::set<std::string> endpoints;
+            for (const auto &[index, from]: m_received) {
+                endpoints.insert(from.begin(), from.end());
+            }
+            return endpoints;
+        }
+
+        static std::vector<uint8_t> chunkMessage(uint32_t index) {
+            std::vector<uint8_t> message(sizeof(index));
+            std::memcpy(message.data(), &index, sizeof(index));
+            return message;
+        }
+
+        SocketHandler m_receiver;
+        SocketHandler m_sender;
+        uint16_t m_port = 0;
+        std::vector<StreamStriper::Path> m_paths;
+        int m_outputFd = -1;
+
+        std::mutex m_mutex;
+        std::map<uint32_t, std::set<std::string>> m_received; // Chunk index to the connections it arrived on
+    };
+}
+
+TEST_F(StreamStriperTest, DeliversEveryChunkOnceAcrossConnections) {
+    constexpr uint32_t CHUNKS = 300;
+    {
+        StreamStriper striper(m_sender, m_paths, false);
+        EXPECT_EQ(striper.activeStreams(), static_cast<std::size_t>(STRIPES));
+        for (uint32_t i = 0; i < CHUNKS; ++i) {
+            ASSERT_TRUE(striper.send(i, chunkMessage(i)));
+        }
+        EXPECT_TRUE(striper.flush());
+    }
+
+    ASSERT_TRUE(waitForChunks(CHUNKS));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    EXPECT_EQ(m_received.size(), CHUNKS);
+    for (const auto &[index, from]: m_received) {
+        EXPECT_EQ(from.size(), 1u) << "chunk " << index;
+    }
+}
+
+TEST_F(StreamStriperTest, RawFramesFollowTheirMessage) {
+    if (!SocketHandler::isZeroCopySupported()) {
+        GTEST_SKIP() << "Raw frames are not supported on this platform";
+    }
+
+    test::TempDir dir;
+    constexpr std::size_t CHUNK_SIZE = 256 * 1024;
+    constexpr uint32_t CHUNKS = 24;
+    auto data = test::randomBytes(CHUNK_SIZE * CHUNKS, 7);
+    test::writeFile(dir.file("in.bin"), data);
+
+    int inputFd = ::open(dir.file("in.bin").c_str(), O_RDONLY);
+    m_outputFd = ::open(dir.file("out.bin").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(inputFd, 0);
+    ASSERT_GE(m_outputFd, 0);
+
+    {
+        StreamStriper striper(m_sender, m_paths, false);
+        for (uint32_t i = 0; i < CHUNKS; ++i) {
+            uint64_t offset = static_cast<uint64_t>(i) * CHUNK_SIZE;
+            uint64_t length = CHUNK_SIZE;
+            auto message = chunkMessage(i);
+            message.resize(20);
+            std::memcpy(message.data() + 4, &offset, sizeof(offset));
+            std::memcpy(message.data() + 12, &length, sizeof(length));
+            ASSERT_TRUE(striper.sendRaw(i, std::move(message), inputFd, offset, CHUNK_SIZE));
+        }
+        EXPECT_TRUE(striper.flush());
+    }
+
+    ASSERT_TRUE(waitForChunks(CHUNKS));
+    ::close(inputFd);
+    ::close(m_outputFd);
+    m_outputFd = -1;
+
+    EXPECT_EQ(test::readFile(dir.file("out.bin")), data);
+    EXPECT_GT(endpointsUsed().size(), 1u);
+}
+
+TEST_F(StreamStriperTest, ChunksOfAFailedConnectionGoToTheOthers) {
+    // An extra connection that is not there fails its first write
+    m_paths.push_back({"127.0.0.1:" + std::to_string(m_port) + "#missing", ""});
+
+    constexpr uint32_t CHUNKS = 100;
+    {
+        StreamStriper striper(m_sender, m_paths, false);
+        for (uint32_t i = 0; i < CHUNKS; ++i) {
+            ASSERT_TRUE(striper.send(i, chunkMessage(i)));
+        }
+        EXPECT_TRUE(striper.flush());
+    }
+
+    ASSERT_TRUE(waitForChunks(CHUNKS));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    EXPECT_EQ(m_received.size(), CHUNKS);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <cstdint>
+
+namespace test {
+
+    /**
+     * Scratch directory that is removed with everything in it when the test ends
+     */
+    class TempDir {
+    public:
+        TempDir() {
+            const auto *info = ::testing::UnitTest::GetInstance()->current_test_info();
+            std::string name = info ? std::string(info->test_suite_name()) + "_" + info->name() : "test";
+            m_path = std::filesystem::temp_directory_path() /
+                     ("file_transfer_" + name + "_" + std::to_string(std::random_device{}()));
+            std::filesystem::create_directories(m_path);
+        }
+
+        ~TempDir() {
+            std::error_code ec;
+            std::filesystem::remove_all(m_path, ec);
+        }
+
+        TempDir(const TempDir &) = delete;
+        TempDir &operator=(const TempDir &) = delete;
+
+        const std::filesystem::path &path() const { return m_path; }
+
+        std::string file(const std::string &name) const { return (m_path / name).string(); }
+
+    private:
+        std::filesystem::path m_path;
+    };
+
+    /**
+     * Make reproducible pseudo-random bytes
+     */
+    inline std::vector<uint8_t> randomBytes(std::size_t size, uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::vector<uint8_t> bytes(size);
+        for (auto &byte: bytes) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        return bytes;
+    }
+
+    inline void writeFile(const std::string &path, const std::vector<uint8_t> &data) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+
+    inline std::vector<uint8_t> readFile(const std::string &path) {
+        std::ifstream file(path, std::ios::binary);
+        return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    }
+}